@@ -0,0 +1,110 @@
+#ifndef SOL_BENCH_HARNESS_HPP
+#define SOL_BENCH_HARNESS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+struct result {
+    std::string group;
+    std::string name;
+    double ns_per_op;
+    std::size_t iterations;
+};
+
+// Anything that is measured once rather than timed, e.g. memory per object
+struct measurement {
+    std::string group;
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+// Runs each case in a calibrated loop and keeps the best of a few samples:
+// the least disturbed run is the closest to what the code itself costs
+class harness {
+private:
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<result> results;
+    std::vector<measurement> measurements;
+    std::string filter;
+    clock::duration mintime;
+    int samples;
+
+    bool wanted(const std::string& group, const std::string& name) const {
+        return filter.empty() || (group + "/" + name).find(filter) != std::string::npos;
+    }
+
+    template <typename Fx>
+    static clock::duration time(Fx& fx, std::size_t iterations) {
+        clock::time_point start = clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) {
+            fx();
+        }
+        return clock::now() - start;
+    }
+
+public:
+    harness(std::string filter = std::string(), std::chrono::milliseconds mintime = std::chrono::milliseconds(50), int samples = 5)
+    : filter(std::move(filter)), mintime(mintime), samples(samples) {}
+
+    // fx does opsperrun operations each time it is called, e.g. a Lua loop of that many calls
+    template <typename Fx>
+    void run(const std::string& group, const std::string& name, Fx&& fx, std::size_t opsperrun = 1) {
+        if (!wanted(group, name)) {
+            return;
+        }
+        std::size_t iterations = 1;
+        while (time(fx, iterations) < mintime / 10 && iterations < (static_cast<std::size_t>(1) << 30)) {
+            iterations *= 2;
+        }
+        iterations *= 10;
+        clock::duration best = clock::duration::max();
+        for (int s = 0; s < samples; ++s) {
+            best = (std::min)(best, time(fx, iterations));
+        }
+        double ns = std::chrono::duration<double, std::nano>(best).count() / static_cast<double>(iterations * opsperrun);
+        results.push_back({ group, name, ns, iterations * opsperrun });
+        std::cout << std::left << std::setw(20) << group << std::setw(28) << name << std::right << std::setw(12) << std::fixed << std::setprecision(2) << ns << " ns/op" << std::endl;
+    }
+
+    template <typename Fx>
+    void measure(const std::string& group, const std::string& name, const std::string& unit, Fx&& fx) {
+        if (!wanted(group, name)) {
+            return;
+        }
+        double value = fx();
+        measurements.push_back({ group, name, value, unit });
+        std::cout << std::left << std::setw(20) << group << std::setw(28) << name << std::right << std::setw(12) << std::fixed << std::setprecision(2) << value << " " << unit << std::endl;
+    }
+
+    void write_json(std::ostream& out) const {
+        out << "{\n    \"benchmarks\": [";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "        { \"group\": \"" << r.group << "\", \"name\": \"" << r.name
+                << "\", \"ns_per_op\": " << std::fixed << std::setprecision(3) << r.ns_per_op
+                << ", \"iterations\": " << r.iterations << " }";
+        }
+        out << "\n    ],\n    \"measurements\": [";
+        for (std::size_t i = 0; i < measurements.size(); ++i) {
+            const measurement& m = measurements[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "        { \"group\": \"" << m.group << "\", \"name\": \"" << m.name
+                << "\", \"value\": " << std::fixed << std::setprecision(3) << m.value
+                << ", \"unit\": \"" << m.unit << "\" }";
+        }
+        out << "\n    ]\n}\n";
+    }
+};
+} // bench
+
+#endif // SOL_BENCH_HARNESS_HPP
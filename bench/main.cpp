@@ -0,0 +1,503 @@
+// Microbenchmarks for sol's binding hot paths.
+// Every sol case is paired with a "c api" case doing the same work by hand,
+// so the overhead sol adds can be read straight off the results.
+// Usage: bench [--filter <text>] [--json <file>] [--min-time <ms>]
+
+#define SOL_CHECK_ARGUMENTS
+
+#include <sol.hpp>
+#include "harness.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct small_vec3 {
+    float x = 0, y = 0, z = 0;
+};
+
+struct finalized_vec3 {
+    float x = 0, y = 0, z = 0;
+};
+
+struct cached_vec3 {
+    float x = 0, y = 0, z = 0;
+};
+
+struct value_vec3 {
+    float x = 0, y = 0, z = 0;
+};
+
+struct config {
+    int width = 640;
+    int height = 480;
+    double scale = 1.0;
+    bool vsync = true;
+};
+
+namespace sol {
+template <>
+struct is_value_only_usertype<value_vec3> : std::true_type {};
+
+template <>
+struct is_identity_cached<cached_vec3> : std::true_type {};
+
+template <>
+struct schema_for<config> {
+    static auto fields() {
+        return sol::fields("width", &config::width, "height", &config::height, "scale", &config::scale, "vsync", &config::vsync);
+    }
+};
+}
+
+namespace {
+const int objectcount = 100000;
+const int loopcount = 1000;
+const int containersize = 16;
+const int tablesize = 1000;
+
+volatile lua_Integer sink = 0;
+
+struct vec {
+    int x = 0;
+
+    int get() const {
+        return x;
+    }
+};
+
+int add_one(int i) {
+    return i + 1;
+}
+
+int c_add_one(lua_State* L) {
+    lua_pushinteger(L, luaL_checkinteger(L, 1) + 1);
+    return 1;
+}
+
+int c_vec_get(lua_State* L) {
+    vec* v = static_cast<vec*>(luaL_checkudata(L, 1, "c_vec"));
+    lua_pushinteger(L, v->x);
+    return 1;
+}
+
+int c_vec_index(lua_State* L) {
+    vec* v = static_cast<vec*>(luaL_checkudata(L, 1, "c_vec"));
+    const char* key = luaL_checkstring(L, 2);
+    if (std::strcmp(key, "x") == 0) {
+        lua_pushinteger(L, v->x);
+        return 1;
+    }
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, key);
+    return 1;
+}
+
+int c_vec_newindex(lua_State* L) {
+    vec* v = static_cast<vec*>(luaL_checkudata(L, 1, "c_vec"));
+    const char* key = luaL_checkstring(L, 2);
+    if (std::strcmp(key, "x") != 0) {
+        return luaL_error(L, "no member named '%s'", key);
+    }
+    v->x = static_cast<int>(luaL_checkinteger(L, 3));
+    return 0;
+}
+
+int c_vec_new(lua_State* L) {
+    new (lua_newuserdata(L, sizeof(vec))) vec();
+    luaL_setmetatable(L, "c_vec");
+    return 1;
+}
+
+void c_register_vec(lua_State* L) {
+    luaL_newmetatable(L, "c_vec");
+    lua_pushcfunction(L, &c_vec_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, &c_vec_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, &c_vec_get);
+    lua_setfield(L, -2, "get");
+    lua_pop(L, 1);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &c_vec_new);
+    lua_setfield(L, -2, "new");
+    lua_setglobal(L, "c_vec");
+}
+
+void check(lua_State* L, int status) {
+    if (status != LUA_OK) {
+        std::string err = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw sol::error(err);
+    }
+}
+
+// Runs Lua code that refers to the bound name through `target`, on a sol-bound and a C-bound version of it
+void lua_loop_cases(bench::harness& h, const std::string& group, const std::string& body) {
+    std::string code = "local target = ... for i = 1, " + std::to_string(loopcount) + " do " + body + " end";
+
+    sol::state lua;
+    lua.set_function("add_one", &add_one);
+    lua.new_usertype<vec>("vec", "get", &vec::get, "x", &vec::x);
+    lua.script("sol_obj = vec.new()");
+    c_register_vec(lua.lua_state());
+    lua.script("c_obj = c_vec.new()");
+    lua_pushcfunction(lua.lua_state(), &c_add_one);
+    lua_setglobal(lua.lua_state(), "c_add_one");
+
+    lua_State* L = lua.lua_state();
+    check(L, luaL_loadstring(L, code.c_str()));
+    int chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    auto run = [L, chunk](const char* target) {
+        return [L, chunk, target]() {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, chunk);
+            lua_getglobal(L, target);
+            check(L, lua_pcall(L, 1, 0, 0));
+        };
+    };
+    bool function = group == "free function";
+    bool constructor = group == "constructor";
+    h.run(group, "sol", run(function ? "add_one" : constructor ? "vec" : "sol_obj"), loopcount);
+    h.run(group, "c api", run(function ? "c_add_one" : constructor ? "c_vec" : "c_obj"), loopcount);
+    luaL_unref(L, LUA_REGISTRYINDEX, chunk);
+}
+
+void lua_call_cases(bench::harness& h) {
+    lua_loop_cases(h, "free function", "target(i)");
+    lua_loop_cases(h, "member function", "target:get()");
+    lua_loop_cases(h, "member variable", "target.x = target.x + 1");
+    // T.new throughput: every object made here is garbage by the next iteration
+    lua_loop_cases(h, "constructor", "target.new()");
+}
+
+void table_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    sol::table t = lua.create_table();
+    t["x"] = 0;
+    t[1] = 0;
+    t.push();
+    int raw = lua_gettop(L);
+
+    h.run("table string key", "sol", [&t]() {
+        t["x"] = 24;
+        sink = sink + t.get<int>("x");
+    });
+    h.run("table string key", "c api", [L, raw]() {
+        lua_pushinteger(L, 24);
+        lua_setfield(L, raw, "x");
+        lua_getfield(L, raw, "x");
+        sink = sink + lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    });
+    h.run("table integer key", "sol", [&t]() {
+        t[1] = 24;
+        sink = sink + t.get<int>(1);
+    });
+    h.run("table integer key", "sol raw", [&t]() {
+        t.raw_set(1, 24);
+        sink = sink + t.raw_get<int>(1);
+    });
+    h.run("table integer key", "c api", [L, raw]() {
+        lua_pushinteger(L, 24);
+        lua_rawseti(L, raw, 1);
+        lua_rawgeti(L, raw, 1);
+        sink = sink + lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    });
+
+    sol::table big = lua.create_table(tablesize, 0);
+    for (int i = 1; i <= tablesize; ++i) {
+        big[i] = i;
+    }
+    big.push();
+    int rawbig = lua_gettop(L);
+    h.run("table iteration", "sol", [&big]() {
+        for (auto&& kv : big) {
+            sink = sink + kv.second.as<int>();
+        }
+    }, tablesize);
+    h.run("table iteration", "c api", [L, rawbig]() {
+        lua_pushnil(L);
+        while (lua_next(L, rawbig) != 0) {
+            sink = sink + lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+    }, tablesize);
+    lua_settop(L, 0);
+}
+
+void number_cases(bench::harness& h) {
+    const int count = 1 << 20;
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    std::vector<double> values(count, 0.25);
+    sol::table t = lua.create_table(count, 0);
+    t.write_numbers(sol::as_container(values));
+    t.push();
+    int raw = lua_gettop(L);
+
+    h.run("numbers read", "sol", [&t, &values]() {
+        sink = sink + static_cast<lua_Integer>(t.read_numbers(sol::as_container(values)));
+    }, count);
+    h.run("numbers read", "per element", [L, raw, &values]() {
+        for (int i = 0; i < count; ++i) {
+            lua_rawgeti(L, raw, i + 1);
+            values[i] = sol::stack::get<double>(L, -1);
+            lua_pop(L, 1);
+        }
+        sink = sink + static_cast<lua_Integer>(values.size());
+    }, count);
+    h.run("numbers write", "sol", [&t, &values]() {
+        t.write_numbers(sol::as_container(values));
+    }, count);
+    h.run("numbers write", "per element", [L, raw, &values]() {
+        for (int i = 0; i < count; ++i) {
+            sol::stack::push(L, values[i]);
+            lua_rawseti(L, raw, i + 1);
+        }
+    }, count);
+    lua_settop(L, 0);
+}
+
+void schema_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    config c;
+    h.run("struct round trip", "schema", [L, &c]() {
+        sol::stack::push(L, c);
+        config back = sol::stack::pop<config>(L);
+        sink = sink + back.width;
+    });
+    h.run("struct round trip", "table get/set", [&lua, &c]() {
+        sol::table t = lua.create_table();
+        t.set("width", c.width, "height", c.height, "scale", c.scale, "vsync", c.vsync);
+        config back;
+        std::tie(back.width, back.height, back.scale, back.vsync) = t.get<int, int, double, bool>("width", "height", "scale", "vsync");
+        sink = sink + back.width;
+    });
+}
+
+void container_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    std::vector<int> values(containersize, 24);
+
+    h.run("container push/get", "sol", [L, &values]() {
+        sol::stack::push(L, values);
+        std::vector<int> out = sol::stack::pop<std::vector<int>>(L);
+        sink = sink + out.back();
+    });
+    h.run("container push/get", "c api", [L, &values]() {
+        lua_createtable(L, static_cast<int>(values.size()), 0);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            lua_pushinteger(L, values[i]);
+            lua_rawseti(L, -2, static_cast<int>(i + 1));
+        }
+        std::vector<int> out;
+        std::size_t n = lua_rawlen(L, -1);
+        out.reserve(n);
+        for (std::size_t i = 1; i <= n; ++i) {
+            lua_rawgeti(L, -1, static_cast<int>(i));
+            out.push_back(static_cast<int>(lua_tointeger(L, -1)));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+        sink = sink + out.back();
+    });
+}
+
+void protected_function_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    lua.script("function f(i) return i + 1 end");
+    sol::protected_function f = lua["f"];
+
+    h.run("protected function", "sol", [&f]() {
+        int r = f(24);
+        sink = sink + r;
+    });
+    h.run("protected function", "c api", [L]() {
+        lua_getglobal(L, "f");
+        lua_pushinteger(L, 24);
+        check(L, lua_pcall(L, 1, 1, 0));
+        sink = sink + lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    });
+}
+
+void dispatch_cases(bench::harness& h) {
+    const int listenercount = 16;
+    sol::state lua;
+    lua.new_usertype<vec>("vec", "x", &vec::x);
+    lua.script("function listener(v, n) return v.x + n end");
+    sol::function listener = lua["listener"];
+    std::vector<sol::function> listeners(listenercount, listener);
+    sol::dispatcher bus(lua.lua_state());
+    for (const auto& f : listeners) {
+        bus.add(f);
+    }
+    vec v;
+    // every call pushes its own userdata for &v, the dispatcher pushes one for all of them
+    h.run("event fan-out", "sol::function", [&listeners, &v]() {
+        for (const auto& f : listeners) {
+            f(&v, 1);
+        }
+    }, listenercount);
+    h.run("event fan-out", "dispatcher", [&bus, &v]() {
+        sink = sink + static_cast<lua_Integer>(bus.call(&v, 1));
+    }, listenercount);
+}
+
+void coroutine_cases(bench::harness& h) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine);
+    lua.script("function gen() local i = 0 while true do i = i + 1 coroutine.yield(i) end end");
+
+    sol::thread runner = sol::thread::create(lua.lua_state());
+    sol::state_view runnerstate = runner.state();
+    sol::coroutine co = runnerstate["gen"];
+    h.run("coroutine resume", "sol", [&co]() {
+        int r = co();
+        sink = sink + r;
+    });
+
+    lua_State* L = lua.lua_state();
+    lua_State* T = lua_newthread(L);
+    int anchor = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_getglobal(T, "gen");
+    h.run("coroutine resume", "c api", [L, T]() {
+#if SOL_LUA_VERSION < 502
+        int status = lua_resume(T, 0);
+#elif SOL_LUA_VERSION < 504
+        int status = lua_resume(T, L, 0);
+#else
+        int nresults = 0;
+        int status = lua_resume(T, L, 0, &nresults);
+#endif
+        if (status != LUA_YIELD) {
+            check(T, status);
+        }
+        sink = sink + lua_tointeger(T, -1);
+        lua_settop(T, 0);
+    });
+    luaL_unref(L, LUA_REGISTRYINDEX, anchor);
+}
+
+// Bytes the collector sees per object, for objectcount userdata kept in a table sized up front
+template <typename Fx>
+double bytes_per_object(lua_State* L, Fx&& pushone) {
+    lua_createtable(L, objectcount, 0);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    std::size_t before = static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNTB, 0));
+    for (int i = 1; i <= objectcount; ++i) {
+        pushone();
+        lua_rawseti(L, -2, i);
+    }
+    std::size_t after = static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNTB, 0));
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    return static_cast<double>(after - before) / objectcount;
+}
+
+void memory_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    lua.new_usertype<small_vec3>("small_vec3", "x", &small_vec3::x);
+    lua.new_usertype<value_vec3>("value_vec3", "x", &value_vec3::x);
+    h.measure("vec3 memory", "sol", "bytes/object", [L]() {
+        return bytes_per_object(L, [L]() { sol::stack::push(L, small_vec3()); });
+    });
+    h.measure("vec3 memory", "sol value-only", "bytes/object", [L]() {
+        return bytes_per_object(L, [L]() { sol::stack::push(L, value_vec3()); });
+    });
+    h.measure("vec3 memory", "c api", "bytes/object", [L]() {
+        return bytes_per_object(L, [L]() { new (lua_newuserdata(L, sizeof(small_vec3))) small_vec3(); });
+    });
+}
+
+// Making and collecting objects whose usertype has no __gc, against the same type given the default one
+void gc_cases(bench::harness& h) {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    lua.new_usertype<small_vec3>("small_vec3", "x", &small_vec3::x);
+    lua.new_usertype<finalized_vec3>("finalized_vec3", "__gc", sol::default_destructor, "x", &finalized_vec3::x);
+    auto churn = [L](auto value) {
+        return [L, value]() {
+            for (int i = 0; i < loopcount; ++i) {
+                sol::stack::push(L, value);
+                lua_pop(L, 1);
+            }
+            lua_gc(L, LUA_GCCOLLECT, 0);
+        };
+    };
+    h.run("gc churn", "no __gc", churn(small_vec3()), loopcount);
+    h.run("gc churn", "default __gc", churn(finalized_vec3()), loopcount);
+
+    // the same pointer pushed over and over, as a getter returning Entity* would
+    lua.new_usertype<cached_vec3>("cached_vec3", "x", &cached_vec3::x);
+    small_vec3 plain;
+    cached_vec3 cached;
+    h.run("gc churn", "same pointer", churn(&plain), loopcount);
+    h.run("gc churn", "same pointer, identity cache", churn(&cached), loopcount);
+}
+
+void startup_cases(bench::harness& h) {
+    h.run("state + usertype", "sol", []() {
+        sol::state lua;
+        lua.new_usertype<vec>("vec", "get", &vec::get, "x", &vec::x);
+    });
+    h.run("state + usertype", "c api", []() {
+        lua_State* L = luaL_newstate();
+        c_register_vec(L);
+        lua_close(L);
+    });
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string jsonpath;
+    long mintime = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--filter") {
+            filter = argv[i + 1];
+        }
+        else if (arg == "--json") {
+            jsonpath = argv[i + 1];
+        }
+        else if (arg == "--min-time") {
+            mintime = std::strtol(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    bench::harness h(filter, std::chrono::milliseconds(mintime));
+    try {
+        lua_call_cases(h);
+        table_cases(h);
+        number_cases(h);
+        schema_cases(h);
+        container_cases(h);
+        protected_function_cases(h);
+        dispatch_cases(h);
+        coroutine_cases(h);
+        gc_cases(h);
+        startup_cases(h);
+        memory_cases(h);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "bench: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!jsonpath.empty()) {
+        std::ofstream out(jsonpath);
+        h.write_json(out);
+    }
+    return 0;
+}
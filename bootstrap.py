@@ -123,14 +123,18 @@ if args.testing:
     cxxflags.append('-Wmissing-declarations')
 
 if 'linux' in sys.platform:
+    cxxflags.append('-pthread')
     ldflags.extend(libraries(['dl']))
 
 builddir = 'bin'
 objdir = 'obj'
 if 'win32' in sys.platform:
      tests = os.path.join(builddir, 'tests.exe')
+     benchmarks = os.path.join(builddir, 'bench.exe')
 else:
      tests = os.path.join(builddir, 'tests')
+     benchmarks = os.path.join(builddir, 'bench')
+bench_results = os.path.join(builddir, 'bench.json')
 
 # ninja file
 ninja = ninja_syntax.Writer(open('build.ninja', 'w'))
@@ -150,6 +154,8 @@ ninja.rule('compile', command = '$cxx -MMD -MF $out.d -c $cxxflags -Werror $in -
                       description = 'Compiling $in to $out')
 ninja.rule('link', command = '$cxx $cxxflags $in -o $out $ldflags', description = 'Creating $out')
 ninja.rule('runner', command = tests)
+ninja.rule('bench_runner', command = '{} --json {}'.format(benchmarks, bench_results),
+                           description = 'Running benchmarks, results in {}'.format(bench_results))
 ninja.rule('example', command = '$cxx $cxxflags $in -o $out $ldflags')
 ninja.rule('installer', command = copy_command)
 ninja.rule('uninstaller', command = remove_command)
@@ -164,6 +170,12 @@ for f in glob.glob('test*.cpp'):
     tests_object_files.append(obj)
     ninja.build(obj, 'compile', inputs = f)
 
+bench_object_files = []
+for f in glob.glob('bench/*.cpp'):
+    obj = object_file(f)
+    bench_object_files.append(obj)
+    ninja.build(obj, 'compile', inputs = f)
+
 examples = []
 for f in glob.glob('examples/*.cpp'):
     example = os.path.join(builddir, replace_extension(f, ''))
@@ -172,6 +184,8 @@ for f in glob.glob('examples/*.cpp'):
 
 ninja.build(tests, 'link', inputs = tests_object_files)
 ninja.build('tests', 'phony', inputs = tests)
+ninja.build(benchmarks, 'link', inputs = bench_object_files)
+ninja.build('bench', 'bench_runner', implicit = benchmarks)
 ninja.build('install', 'installer', inputs = args.install_dir)
 ninja.build('uninstall', 'uninstaller')
 ninja.build('examples', 'phony', inputs = examples)
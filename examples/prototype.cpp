@@ -0,0 +1,51 @@
+#include <sol.hpp>
+#include <chrono>
+#include <iostream>
+
+struct vec {
+    double x = 0, y = 0;
+
+    double length() const {
+        return x * x + y * y;
+    }
+};
+
+const char* base_script = R"(
+function make_points(n)
+    local points = {}
+    for i = 1, n do
+        points[i] = { x = i, y = i * 2 }
+    end
+    return points
+end
+)";
+
+int main() {
+    const int count = 200;
+    typedef std::chrono::steady_clock clock;
+    sol::usertype<vec> vectype("x", &vec::x, "y", &vec::y, "length", &vec::length);
+
+    // every state set up by hand: libraries, usertype, then the script parsed and compiled each time
+    clock::time_point start = clock::now();
+    for (int i = 0; i < count; ++i) {
+        sol::state lua;
+        lua.open_libraries();
+        lua.set_usertype("vec", vectype);
+        lua.script(base_script);
+    }
+    std::chrono::duration<double, std::micro> byhand = clock::now() - start;
+
+    // the same states made from a prototype: the script is only compiled once
+    sol::state_prototype prototype;
+    prototype.open_libraries()
+        .setup([&vectype](sol::state_view& lua) { lua.set_usertype("vec", vectype); })
+        .script(base_script);
+    start = clock::now();
+    for (int i = 0; i < count; ++i) {
+        sol::state lua = prototype.make();
+    }
+    std::chrono::duration<double, std::micro> prototyped = clock::now() - start;
+
+    std::cout << "by hand:        " << byhand.count() / count << " us per state" << std::endl;
+    std::cout << "from prototype: " << prototyped.count() / count << " us per state" << std::endl;
+}
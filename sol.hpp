@@ -25,6 +25,20 @@
 #include "sol/state.hpp"
 #include "sol/object.hpp"
 #include "sol/function.hpp"
+#include "sol/dispatcher.hpp"
 #include "sol/coroutine.hpp"
+#include "sol/generator.hpp"
+#include "sol/thread_pool.hpp"
+#include "sol/async.hpp"
+#include "sol/mailbox.hpp"
+#include "sol/scheduler.hpp"
+#include "sol/state_pool.hpp"
+#include "sol/state_prototype.hpp"
+#include "sol/profiler.hpp"
+#include "sol/transfer.hpp"
+#include "sol/array_view.hpp"
+#include "sol/soa_view.hpp"
+#include "sol/schema.hpp"
+#include "sol/ffi.hpp"
 
 #endif // SOL_HPP
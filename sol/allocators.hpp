@@ -0,0 +1,406 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_ALLOCATORS_HPP
+#define SOL_ALLOCATORS_HPP
+
+#include "compatibility.hpp"
+#include "traits.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+
+namespace sol {
+namespace detail {
+template <typename T>
+inline T& unwrap_allocator(T& item) {
+    return item;
+}
+
+template <typename T>
+inline T& unwrap_allocator(std::reference_wrapper<T> item) {
+    return item.get();
+}
+
+// Allocators are callables with lua_Alloc's semantics, minus the user data pointer:
+// void* operator()(void* ptr, std::size_t osize, std::size_t nsize)
+template <typename Allocator>
+inline void* lua_allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize) {
+    Allocator& alloc = *static_cast<Allocator*>(ud);
+    return unwrap_allocator(alloc)(ptr, osize, nsize);
+}
+
+inline std::size_t block_size(void* ptr, std::size_t osize) {
+    // Lua 5.2+ passes the type of the object being created in osize
+    // when ptr is null: that is not a size
+    return ptr == nullptr ? 0 : osize;
+}
+} // detail
+
+// Forwards everything to the C runtime: the same thing luaL_newstate does
+struct default_allocator {
+    void* operator()(void* ptr, std::size_t, std::size_t nsize) const {
+        if (nsize == 0) {
+            std::free(ptr);
+            return nullptr;
+        }
+        return std::realloc(ptr, nsize);
+    }
+};
+
+// Size-class pool: blocks up to max_pooled bytes are carved out of large chunks
+// and recycled through per-class free lists; bigger ones go to the C runtime.
+// The classes are 16 bytes apart, which covers the sizes Lua creates for sol:
+// small strings, closures with a few upvalues, small tables and the
+// sizeof(T*) + sizeof(T) userdata blocks of most usertypes.
+// Not thread-safe: share one between states only if they live on one thread.
+class pool_allocator {
+public:
+    static const std::size_t granularity = 16;
+    static const std::size_t max_pooled = 512;
+    static const std::size_t class_count = max_pooled / granularity;
+
+private:
+    struct free_block {
+        free_block* next;
+    };
+
+    std::size_t chunksize;
+    std::array<free_block*, class_count> freelists;
+    std::vector<void*> chunks;
+    // C runtime blocks that were kept when shrinking them into the pool failed
+    std::vector<void*> adopted;
+    char* chunkcurrent;
+    char* chunkend;
+
+    static std::size_t size_class(std::size_t size) {
+        return (size + granularity - 1) / granularity - 1;
+    }
+
+    static std::size_t class_size(std::size_t c) {
+        return (c + 1) * granularity;
+    }
+
+    bool is_pooled(std::size_t size) const {
+        return size != 0 && size <= max_pooled;
+    }
+
+    void* allocate_pooled(std::size_t c) {
+        free_block*& head = freelists[c];
+        if (head != nullptr) {
+            free_block* block = head;
+            head = block->next;
+            return block;
+        }
+        std::size_t size = class_size(c);
+        if (static_cast<std::size_t>(chunkend - chunkcurrent) < size) {
+            void* chunk = ::operator new(chunksize, std::nothrow);
+            if (chunk == nullptr) {
+                return nullptr;
+            }
+#ifndef SOL_NO_EXCEPTIONS
+            try {
+                chunks.push_back(chunk);
+            }
+            catch (...) {
+                ::operator delete(chunk);
+                return nullptr;
+            }
+#else
+            chunks.push_back(chunk);
+#endif // No Exceptions
+            chunkcurrent = static_cast<char*>(chunk);
+            chunkend = chunkcurrent + chunksize;
+        }
+        void* block = chunkcurrent;
+        chunkcurrent += size;
+        return block;
+    }
+
+    // A shrink that could not move the block: it stays where it is, and is freed later as a block
+    // of the smaller size, which it is at least as big as. A C runtime block ends up in a free list
+    // that way, so it is remembered to be given back to the C runtime when the pool goes
+    void* keep(void* ptr, bool pooled) {
+        if (pooled) {
+            return ptr;
+        }
+#ifndef SOL_NO_EXCEPTIONS
+        try {
+            adopted.push_back(ptr);
+        }
+        catch (...) {
+            // out of memory for the list as well: the block is only lost when the pool goes
+        }
+#else
+        adopted.push_back(ptr);
+#endif // No Exceptions
+        return ptr;
+    }
+
+    void deallocate_pooled(void* ptr, std::size_t c) {
+        free_block* block = static_cast<free_block*>(ptr);
+        block->next = freelists[c];
+        freelists[c] = block;
+    }
+
+public:
+    pool_allocator(std::size_t chunksize = 64 * 1024) : chunksize((std::max)(chunksize, max_pooled)), chunkcurrent(nullptr), chunkend(nullptr) {
+        freelists.fill(nullptr);
+    }
+
+    pool_allocator(const pool_allocator&) = delete;
+    pool_allocator& operator=(const pool_allocator&) = delete;
+
+    pool_allocator(pool_allocator&& o) : chunksize(o.chunksize), freelists(o.freelists), chunks(std::move(o.chunks)), adopted(std::move(o.adopted)), chunkcurrent(o.chunkcurrent), chunkend(o.chunkend) {
+        o.freelists.fill(nullptr);
+        o.chunks.clear();
+        o.adopted.clear();
+        o.chunkcurrent = nullptr;
+        o.chunkend = nullptr;
+    }
+
+    ~pool_allocator() {
+        for (void* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+        for (void* block : adopted) {
+            std::free(block);
+        }
+    }
+
+    std::size_t chunk_count() const {
+        return chunks.size();
+    }
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        osize = detail::block_size(ptr, osize);
+        if (nsize == 0) {
+            if (ptr == nullptr) {
+                return nullptr;
+            }
+            if (is_pooled(osize)) {
+                deallocate_pooled(ptr, size_class(osize));
+            }
+            else {
+                std::free(ptr);
+            }
+            return nullptr;
+        }
+        bool oldpooled = is_pooled(osize);
+        bool newpooled = is_pooled(nsize);
+        if (ptr != nullptr) {
+            if (oldpooled && newpooled && size_class(osize) == size_class(nsize)) {
+                return ptr;
+            }
+            if (!oldpooled && !newpooled) {
+                void* block = std::realloc(ptr, nsize);
+                // Lua counts on shrinking never failing
+                return block == nullptr && nsize <= osize ? ptr : block;
+            }
+        }
+        void* block = newpooled ? allocate_pooled(size_class(nsize)) : std::malloc(nsize);
+        if (block == nullptr && ptr != nullptr && nsize <= osize) {
+            return keep(ptr, oldpooled);
+        }
+        if (block == nullptr || ptr == nullptr) {
+            return block;
+        }
+        std::memcpy(block, ptr, (std::min)(osize, nsize));
+        (*this)(ptr, osize, 0);
+        return block;
+    }
+};
+
+// Bump allocator: freeing is a no-op, and everything is released at once
+// when the arena is destroyed. Meant for short-lived (e.g. request-scoped) states:
+// memory freed by the collector is never reused while the arena lives.
+class arena_allocator {
+private:
+    std::size_t chunksize;
+    std::vector<void*> chunks;
+    char* chunkcurrent;
+    char* chunkend;
+    std::size_t used;
+
+    static std::size_t aligned(std::size_t size) {
+        const std::size_t alignment = alignof(std::max_align_t);
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* allocate(std::size_t size) {
+        size = aligned(size);
+        if (static_cast<std::size_t>(chunkend - chunkcurrent) < size) {
+            std::size_t newchunksize = (std::max)(chunksize, size);
+            void* chunk = ::operator new(newchunksize, std::nothrow);
+            if (chunk == nullptr) {
+                return nullptr;
+            }
+#ifndef SOL_NO_EXCEPTIONS
+            try {
+                chunks.push_back(chunk);
+            }
+            catch (...) {
+                ::operator delete(chunk);
+                return nullptr;
+            }
+#else
+            chunks.push_back(chunk);
+#endif // No Exceptions
+            chunkcurrent = static_cast<char*>(chunk);
+            chunkend = chunkcurrent + newchunksize;
+        }
+        void* block = chunkcurrent;
+        chunkcurrent += size;
+        used += size;
+        return block;
+    }
+
+public:
+    arena_allocator(std::size_t chunksize = 256 * 1024) : chunksize(chunksize), chunkcurrent(nullptr), chunkend(nullptr), used(0) {}
+
+    arena_allocator(const arena_allocator&) = delete;
+    arena_allocator& operator=(const arena_allocator&) = delete;
+
+    arena_allocator(arena_allocator&& o) : chunksize(o.chunksize), chunks(std::move(o.chunks)), chunkcurrent(o.chunkcurrent), chunkend(o.chunkend), used(o.used) {
+        o.chunks.clear();
+        o.chunkcurrent = nullptr;
+        o.chunkend = nullptr;
+        o.used = 0;
+    }
+
+    ~arena_allocator() {
+        for (void* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    std::size_t bytes_used() const {
+        return used;
+    }
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        osize = detail::block_size(ptr, osize);
+        if (nsize == 0) {
+            return nullptr;
+        }
+        if (ptr != nullptr && aligned(nsize) <= aligned(osize)) {
+            return ptr;
+        }
+        void* block = allocate(nsize);
+        if (block != nullptr && ptr != nullptr) {
+            std::memcpy(block, ptr, (std::min)(osize, nsize));
+        }
+        return block;
+    }
+};
+
+struct allocation_stats {
+    static const std::size_t size_classes = 14;
+
+    std::size_t current = 0;
+    std::size_t peak = 0;
+    // new blocks, blocks resized, blocks freed, and requests refused or failed
+    std::size_t allocations = 0;
+    std::size_t reallocations = 0;
+    std::size_t frees = 0;
+    std::size_t failures = 0;
+    // histogram[i] counts new blocks of up to 16 << i bytes; the last class also takes everything bigger
+    std::array<std::size_t, size_classes> histogram{};
+
+    static std::size_t size_class(std::size_t size) {
+        std::size_t c = 0;
+        for (std::size_t limit = 16; c < size_classes - 1 && size > limit; limit <<= 1) {
+            ++c;
+        }
+        return c;
+    }
+};
+
+// Wraps another allocator, counting what goes through it. With a limit, growing past it
+// is refused, so Lua raises its usual memory error instead of the process running out.
+// Pass std::ref(tracker) to a state to be able to read the stats while it runs
+template <typename Allocator = default_allocator>
+class tracking_allocator {
+private:
+    Allocator inner;
+    std::size_t maximum;
+    allocation_stats counts;
+
+public:
+    tracking_allocator(std::size_t limit = 0, Allocator inner = Allocator()) : inner(std::move(inner)), maximum(limit) {}
+
+    const allocation_stats& stats() const {
+        return counts;
+    }
+
+    // 0 means no limit
+    std::size_t limit() const {
+        return maximum;
+    }
+
+    void set_limit(std::size_t limit) {
+        maximum = limit;
+    }
+
+    Allocator& allocator() {
+        return inner;
+    }
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        std::size_t oldsize = detail::block_size(ptr, osize);
+        if (nsize == 0) {
+            if (ptr != nullptr) {
+                counts.current -= oldsize;
+                ++counts.frees;
+            }
+            return detail::unwrap_allocator(inner)(ptr, osize, nsize);
+        }
+        // shrinking is never refused: Lua counts on it working
+        if (maximum != 0 && nsize > oldsize && counts.current + (nsize - oldsize) > maximum) {
+            ++counts.failures;
+            return nullptr;
+        }
+        void* block = detail::unwrap_allocator(inner)(ptr, osize, nsize);
+        if (block == nullptr) {
+            ++counts.failures;
+            return nullptr;
+        }
+        counts.current = counts.current - oldsize + nsize;
+        counts.peak = (std::max)(counts.peak, counts.current);
+        if (ptr == nullptr) {
+            ++counts.allocations;
+            ++counts.histogram[allocation_stats::size_class(nsize)];
+        }
+        else {
+            ++counts.reallocations;
+        }
+        return block;
+    }
+};
+} // sol
+
+#endif // SOL_ALLOCATORS_HPP
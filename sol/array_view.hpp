@@ -0,0 +1,315 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_ARRAY_VIEW_HPP
+#define SOL_ARRAY_VIEW_HPP
+
+#include "stack.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace sol {
+// A pointer and a size, pushed to Lua as one small userdata:
+// Lua reads and writes the C++ memory directly, nothing is copied into a table.
+// The memory has to outlive every use of the view from Lua
+template <typename T>
+class array_view {
+private:
+    T* p;
+    std::size_t n;
+
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+
+    array_view() noexcept : p(nullptr), n(0) {}
+    array_view(T* data, std::size_t size) noexcept : p(data), n(size) {}
+
+    T* data() const noexcept { return p; }
+    std::size_t size() const noexcept { return n; }
+    bool empty() const noexcept { return n == 0; }
+    T& operator[](std::size_t i) const { return p[i]; }
+};
+
+template <typename C>
+inline auto as_container(C& cont) -> array_view<std::remove_reference_t<decltype(*cont.data())>> {
+    return { cont.data(), cont.size() };
+}
+
+template <typename T, std::size_t N>
+inline array_view<T> as_container(T (&arr)[N]) {
+    return { arr, N };
+}
+
+template <typename T>
+struct is_lua_primitive<array_view<T>> : std::true_type {};
+
+namespace stack {
+namespace stack_detail {
+template <typename T>
+struct array_view_metatable {
+    typedef array_view<T> view_t;
+    typedef std::remove_cv_t<T> U;
+
+    static view_t& self(lua_State* L) {
+        return *static_cast<view_t*>(lua_touserdata(L, 1));
+    }
+
+    static int push_element(std::true_type, lua_State* L, T& element) {
+        return stack::push(L, element);
+    }
+
+    static int push_element(std::false_type, lua_State* L, T& element) {
+        // usertypes are handed out by reference, so changes land in the array
+        return stack::push(L, &element);
+    }
+
+    static int push_element(lua_State* L, T& element) {
+        return push_element(is_lua_primitive<U>(), L, element);
+    }
+
+    static int get_index(lua_State* L) {
+        view_t& v = self(L);
+        // Past the end is nil even without bounds checks: ipairs stops on it
+        lua_Integer i = lua_tointeger(L, 2);
+        if (i < 1 || static_cast<std::size_t>(i) > v.size()) {
+            lua_pushnil(L);
+            return 1;
+        }
+        return push_element(L, v[static_cast<std::size_t>(i - 1)]);
+    }
+
+    static int set_element(std::true_type, lua_State* L) {
+        return luaL_error(L, "sol: cannot write to an array_view of const elements");
+    }
+
+    static int set_element(std::false_type, lua_State* L) {
+        view_t& v = self(L);
+        lua_Integer i = lua_tointeger(L, 2);
+#ifndef SOL_NO_BOUNDS_CHECKS
+        if (i < 1 || static_cast<std::size_t>(i) > v.size()) {
+            return luaL_error(L, "sol: index %d is out of bounds for an array_view of size %d", static_cast<int>(i), static_cast<int>(v.size()));
+        }
+#endif // Bounds checks
+        v[static_cast<std::size_t>(i - 1)] = stack::get<U>(L, 3);
+        return 0;
+    }
+
+    static int set_index(lua_State* L) {
+        return set_element(std::is_const<T>(), L);
+    }
+
+    static int length(lua_State* L) {
+        lua_pushinteger(L, static_cast<lua_Integer>(self(L).size()));
+        return 1;
+    }
+
+    static int next(lua_State* L) {
+        view_t& v = self(L);
+        lua_Integer i = lua_tointeger(L, 2) + 1;
+        if (static_cast<std::size_t>(i) > v.size()) {
+            return 0;
+        }
+        lua_pushinteger(L, i);
+        return 1 + push_element(L, v[static_cast<std::size_t>(i - 1)]);
+    }
+
+    static int pairs(lua_State* L) {
+        lua_pushcfunction(L, &next);
+        lua_pushvalue(L, 1);
+        lua_pushinteger(L, 0);
+        return 3;
+    }
+
+    static void push(lua_State* L) {
+        if (get_metatable<view_t>(L) != type::nil) {
+            return;
+        }
+        lua_pop(L, 1);
+        static const luaL_Reg metafunctions[] = {
+            { "__index", &get_index },
+            { "__newindex", &set_index },
+            { "__len", &length },
+            // ipairs in 5.3 goes through __index; 5.2 asks for __ipairs
+            { "__ipairs", &pairs },
+            { "__pairs", &pairs },
+            { nullptr, nullptr }
+        };
+        luaL_newmetatable(L, &usertype_traits<view_t>::metatable()[0]);
+        luaL_setfuncs(L, metafunctions, 0);
+        register_metatable<view_t>(L);
+    }
+};
+
+// A view is only read back from userdata that carries the metatable registered for it
+template <typename V, typename Handler>
+inline bool check_view(lua_State* L, int index, Handler&& handler) {
+    type indextype = type_of(L, index);
+    if (indextype != type::userdata) {
+        handler(L, index, type::userdata, indextype);
+        return false;
+    }
+    if (lua_getmetatable(L, index) == 0) {
+        handler(L, index, type::userdata, indextype);
+        return false;
+    }
+    if (check_metatable<V>(L))
+        return true;
+    lua_pop(L, 1);
+    handler(L, index, type::userdata, indextype);
+    return false;
+}
+} // stack_detail
+
+template <typename T, typename C>
+struct checker<array_view<T>, type::userdata, C> {
+    template <typename Handler>
+    static bool check(lua_State* L, int index, Handler&& handler) {
+        return stack_detail::check_view<array_view<T>>(L, index, std::forward<Handler>(handler));
+    }
+};
+
+template <typename T>
+struct pusher<array_view<T>> {
+    static int push(lua_State* L, const array_view<T>& v) {
+        void* memory = lua_newuserdata(L, sizeof(array_view<T>));
+        new (memory) array_view<T>(v);
+        stack_detail::array_view_metatable<T>::push(L);
+        lua_setmetatable(L, -2);
+        return 1;
+    }
+};
+
+template <typename T>
+struct getter<array_view<T>> {
+    static array_view<T> get(lua_State* L, int index = -1) {
+        checker<array_view<T>>::check(L, index, type_panic);
+        return *static_cast<array_view<T>*>(lua_touserdata(L, index));
+    }
+};
+
+namespace stack_detail {
+// Numbers move between the array part of a table and C++ memory a batch at a time:
+// the batch sits on the stack, is converted into a staging buffer in one pass (checking
+// all of it with a single flag), and then narrowed or widened into place in a plain loop
+const int number_batch = 256;
+
+template <typename T>
+using staged_number_t = std::conditional_t<std::is_integral<T>::value && SOL_LUA_VERSION >= 503, lua_Integer, lua_Number>;
+
+inline lua_Number to_staged(lua_State* L, int index, lua_Number*, int* isnum) {
+    return lua_tonumberx(L, index, isnum);
+}
+
+inline lua_Integer to_staged(lua_State* L, int index, lua_Integer*, int* isnum) {
+    return lua_tointegerx(L, index, isnum);
+}
+
+inline void push_staged(lua_State* L, lua_Number value) {
+    lua_pushnumber(L, value);
+}
+
+inline void push_staged(lua_State* L, lua_Integer value) {
+    lua_pushinteger(L, value);
+}
+
+template <typename T>
+struct is_number_element : meta::And<std::is_arithmetic<T>, meta::Not<std::is_same<std::remove_cv_t<T>, bool>>> {};
+} // stack_detail
+
+// Reads t[1], t[2], ... of the table at index into out with raw gets.
+// Stops at the end of out, at the end of the array part, or at the first element that is not a number,
+// and returns how many elements were read
+template <typename T>
+inline std::size_t read_numbers(lua_State* L, int index, array_view<T> out) {
+    static_assert(stack_detail::is_number_element<T>::value && !std::is_const<T>::value, "read_numbers needs a view of writable arithmetic elements");
+    typedef stack_detail::staged_number_t<T> staged;
+    index = lua_absindex(L, index);
+    std::size_t n = (std::min)(out.size(), static_cast<std::size_t>(lua_rawlen(L, index)));
+    luaL_checkstack(L, stack_detail::number_batch, "sol: not enough stack space to read numbers");
+    staged staging[stack_detail::number_batch];
+    int isnum[stack_detail::number_batch];
+    std::size_t done = 0;
+    while (done < n) {
+        int count = static_cast<int>((std::min)(n - done, static_cast<std::size_t>(stack_detail::number_batch)));
+        int base = lua_gettop(L) + 1;
+        for (int i = 0; i < count; ++i) {
+            lua_rawgeti(L, index, static_cast<int>(done) + i + 1);
+        }
+        int valid = 1;
+        for (int i = 0; i < count; ++i) {
+            staging[i] = stack_detail::to_staged(L, base + i, staging, &isnum[i]);
+            valid &= isnum[i];
+        }
+        lua_settop(L, base - 1);
+        int good = count;
+        if (valid == 0) {
+            good = static_cast<int>(std::find(isnum, isnum + count, 0) - isnum);
+        }
+        T* target = out.data() + done;
+        for (int i = 0; i < good; ++i) {
+            target[i] = static_cast<T>(staging[i]);
+        }
+        done += static_cast<std::size_t>(good);
+        if (good < count) {
+            break;
+        }
+    }
+    return done;
+}
+
+// Writes in to t[1], t[2], ... of the table at index with raw sets
+template <typename T>
+inline void write_numbers(lua_State* L, int index, array_view<T> in) {
+    typedef std::remove_const_t<T> U;
+    static_assert(stack_detail::is_number_element<U>::value, "write_numbers needs a view of arithmetic elements");
+    typedef stack_detail::staged_number_t<U> staged;
+    index = lua_absindex(L, index);
+    staged staging[stack_detail::number_batch];
+    std::size_t done = 0;
+    while (done < in.size()) {
+        int count = static_cast<int>((std::min)(in.size() - done, static_cast<std::size_t>(stack_detail::number_batch)));
+        const U* source = in.data() + done;
+        for (int i = 0; i < count; ++i) {
+            staging[i] = static_cast<staged>(source[i]);
+        }
+        for (int i = 0; i < count; ++i) {
+            stack_detail::push_staged(L, staging[i]);
+            lua_rawseti(L, index, static_cast<int>(done) + i + 1);
+        }
+        done += static_cast<std::size_t>(count);
+    }
+}
+
+// Pushes a new table holding the numbers, sized up front for all of them
+template <typename T>
+inline int push_numbers(lua_State* L, array_view<T> in) {
+    lua_createtable(L, static_cast<int>(in.size()), 0);
+    write_numbers(L, -1, in);
+    return 1;
+}
+} // stack
+} // sol
+
+#endif // SOL_ARRAY_VIEW_HPP
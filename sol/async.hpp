@@ -0,0 +1,178 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_ASYNC_HPP
+#define SOL_ASYNC_HPP
+
+#include "stack.hpp"
+#include "function.hpp"
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <utility>
+
+namespace sol {
+// A result that is not there yet: what a yielding function returning a std::future hands to whoever resumes it
+class pending_result {
+public:
+    virtual ~pending_result() {}
+    virtual bool ready() = 0;
+    // Pushes the results onto the thread about to be resumed and returns how many there are.
+    // A failure comes back as nil plus the error message
+    virtual int push(lua_State* L) = 0;
+};
+
+namespace async_detail {
+template <typename T>
+class future_result : public pending_result {
+private:
+    std::future<T> value;
+
+    int push_value(std::true_type, lua_State*) {
+        value.get();
+        return 0;
+    }
+
+    int push_value(std::false_type, lua_State* L) {
+        return stack::push(L, value.get());
+    }
+
+public:
+    future_result(std::future<T> value) : value(std::move(value)) {}
+
+    virtual bool ready() override {
+        return value.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    virtual int push(lua_State* L) override {
+#ifndef SOL_NO_EXCEPTIONS
+        try {
+#endif // No Exceptions
+            return push_value(std::is_void<T>(), L);
+#ifndef SOL_NO_EXCEPTIONS
+        }
+        catch (const std::exception& e) {
+            lua_pushnil(L);
+            lua_pushstring(L, e.what());
+            return 2;
+        }
+        catch (...) {
+            lua_pushnil(L);
+            lua_pushstring(L, "sol: the operation failed with an unknown exception");
+            return 2;
+        }
+#endif // No Exceptions
+    }
+};
+
+inline const char* pending_metatable() {
+    return "sol.pending_result";
+}
+
+inline int pending_gc(lua_State* L) {
+    pending_result** p = static_cast<pending_result**>(lua_touserdata(L, 1));
+    delete *p;
+    *p = nullptr;
+    return 0;
+}
+
+inline int push_pending(lua_State* L, std::unique_ptr<pending_result> p) {
+    pending_result** memory = static_cast<pending_result**>(lua_newuserdata(L, sizeof(pending_result*)));
+    *memory = nullptr;
+    if (luaL_newmetatable(L, pending_metatable()) == 1) {
+        lua_pushcfunction(L, &pending_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    *memory = p.release();
+    return 1;
+}
+
+// Calls the wrapped function (upvalue 1) with every argument, then yields everything it returned
+inline int yielding_call(lua_State* L) {
+    int nargs = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, nargs, LUA_MULTRET);
+    return lua_yield(L, lua_gettop(L));
+}
+} // async_detail
+
+template <typename F>
+struct yielding_t {
+    F fx;
+};
+
+// Binds fx so that calling it yields its results from the calling coroutine, instead of returning them.
+// Paired with a std::future return, the coroutine is suspended until the future is ready
+template <typename F>
+inline yielding_t<std::decay_t<F>> yielding(F&& fx) {
+    return { std::forward<F>(fx) };
+}
+
+template <typename F>
+struct lua_type_of<yielding_t<F>> : std::integral_constant<type, type::function> {};
+
+namespace stack {
+// The pending result yielded at index, still owned by its userdata; nullptr for any other value
+inline pending_result* get_pending(lua_State* L, int index) {
+    void* memory = luaL_testudata(L, index, async_detail::pending_metatable());
+    return memory == nullptr ? nullptr : *static_cast<pending_result**>(memory);
+}
+
+// Takes the pending result at index away from its userdata, so it can outlive it
+inline std::unique_ptr<pending_result> take_pending(lua_State* L, int index) {
+    void* memory = luaL_testudata(L, index, async_detail::pending_metatable());
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    pending_result** p = static_cast<pending_result**>(memory);
+    std::unique_ptr<pending_result> taken(*p);
+    *p = nullptr;
+    return taken;
+}
+
+template <typename T>
+struct pusher<std::future<T>> {
+    static int push(lua_State* L, std::future<T>&& value) {
+        return async_detail::push_pending(L, std::make_unique<async_detail::future_result<T>>(std::move(value)));
+    }
+
+    static int push(lua_State* L, std::future<T>& value) {
+        return push(L, std::move(value));
+    }
+};
+
+template <typename F>
+struct pusher<yielding_t<F>> {
+    template <typename Y>
+    static int push(lua_State* L, Y&& y) {
+        pusher<function_sig<>>{}.push(L, std::forward<Y>(y).fx);
+        lua_pushcclosure(L, &async_detail::yielding_call, 1);
+        return 1;
+    }
+};
+} // stack
+} // sol
+
+#endif // SOL_ASYNC_HPP
@@ -0,0 +1,220 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_BINDING_STATS_HPP
+#define SOL_BINDING_STATS_HPP
+
+#include "compatibility.hpp"
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#ifdef SOL_BINDING_STATS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif // SOL_BINDING_STATS
+
+namespace sol {
+struct binding_stat {
+    // "usertype.member" for usertype bindings, "<unnamed>" otherwise
+    std::string name;
+    std::size_t calls;
+    // calls that raised an error, or that have not returned yet
+    std::size_t errors;
+    std::chrono::nanoseconds total;
+    // percentiles are the upper bound of their histogram bucket, within 25%
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p90;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds max;
+};
+
+#ifdef SOL_BINDING_STATS
+namespace binding_stats_detail {
+// 4 buckets per power of two, up to 2^64 nanoseconds
+const std::size_t bucket_count = 252;
+
+inline std::size_t bucket_of(std::uint64_t ns) {
+    if (ns < 4) {
+        return static_cast<std::size_t>(ns);
+    }
+    std::size_t log = 0;
+    for (std::uint64_t v = ns; v > 1; v >>= 1) {
+        ++log;
+    }
+    std::size_t sub = static_cast<std::size_t>(ns >> (log - 2)) & 3;
+    return (log - 1) * 4 + sub;
+}
+
+inline std::uint64_t bucket_bound(std::size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    std::size_t log = bucket / 4 + 1;
+    std::uint64_t sub = bucket % 4;
+    return ((5 + sub) << (log - 2)) - 1;
+}
+
+struct record {
+    std::size_t calls = 0;
+    std::size_t returns = 0;
+    std::uint64_t total = 0;
+    std::uint64_t max = 0;
+    std::array<std::size_t, bucket_count> histogram{};
+};
+
+struct registry {
+    bool enabled = false;
+    std::unordered_map<const void*, record> records;
+    std::unordered_map<const void*, std::string> names;
+};
+
+// States with stats turned on, so that calls in every other state skip the registry lookup
+inline std::atomic<int>& enabled_states() {
+    static std::atomic<int> count(0);
+    return count;
+}
+
+inline const void* registry_key() {
+    static char key = 0;
+    return &key;
+}
+
+inline int registry_gc(lua_State* L) {
+    registry* reg = static_cast<registry*>(lua_touserdata(L, 1));
+    if (reg->enabled) {
+        --enabled_states();
+    }
+    reg->~registry();
+    return 0;
+}
+
+inline registry* find_registry(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, registry_key());
+    void* existing = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return static_cast<registry*>(existing);
+}
+
+inline registry& get_registry(lua_State* L) {
+    registry* existing = find_registry(L);
+    if (existing != nullptr) {
+        return *existing;
+    }
+    registry* reg = new (lua_newuserdata(L, sizeof(registry))) registry();
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &registry_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, registry_key());
+    return *reg;
+}
+
+inline void name_binding(lua_State* L, const void* binding, std::string name) {
+    get_registry(L).names[binding] = std::move(name);
+}
+
+// A call that throws or raises a Lua error never gets back here: it shows up as calls - returns
+template <typename Fx, typename... Args>
+inline int timed_call(lua_State* L, const void* binding, Fx&& fx, Args&&... args) {
+    if (enabled_states().load(std::memory_order_relaxed) == 0) {
+        return fx(L, std::forward<Args>(args)...);
+    }
+    registry* reg = find_registry(L);
+    if (reg == nullptr || !reg->enabled) {
+        return fx(L, std::forward<Args>(args)...);
+    }
+    // references into an unordered_map survive rehashing, and resets zero records rather than erase them
+    record& r = reg->records[binding];
+    ++r.calls;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int results = fx(L, std::forward<Args>(args)...);
+    std::uint64_t ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    ++r.returns;
+    r.total += ns;
+    r.max = (std::max)(r.max, ns);
+    ++r.histogram[bucket_of(ns)];
+    return results;
+}
+
+inline std::chrono::nanoseconds percentile(const record& r, double q) {
+    std::size_t wanted = static_cast<std::size_t>(q * static_cast<double>(r.returns));
+    std::size_t seen = 0;
+    for (std::size_t b = 0; b < bucket_count; ++b) {
+        seen += r.histogram[b];
+        if (seen > wanted) {
+            return std::chrono::nanoseconds((std::min)(bucket_bound(b), r.max));
+        }
+    }
+    return std::chrono::nanoseconds(r.max);
+}
+
+inline void enable(lua_State* L, bool on) {
+    registry& reg = get_registry(L);
+    if (reg.enabled != on) {
+        reg.enabled = on;
+        on ? ++enabled_states() : --enabled_states();
+    }
+}
+
+inline std::vector<binding_stat> collect(lua_State* L) {
+    std::vector<binding_stat> stats;
+    registry* reg = find_registry(L);
+    if (reg == nullptr) {
+        return stats;
+    }
+    for (const auto& kv : reg->records) {
+        const record& r = kv.second;
+        if (r.calls == 0) {
+            continue;
+        }
+        auto name = reg->names.find(kv.first);
+        // a reset during a call can leave one more return than call
+        std::size_t errors = r.calls > r.returns ? r.calls - r.returns : 0;
+        stats.push_back({ name != reg->names.end() ? name->second : std::string("<unnamed>"), r.calls, errors,
+            std::chrono::nanoseconds(r.total), percentile(r, 0.5), percentile(r, 0.9), percentile(r, 0.99), std::chrono::nanoseconds(r.max) });
+    }
+    // hottest first
+    std::sort(stats.begin(), stats.end(), [](const binding_stat& l, const binding_stat& r) { return l.total > r.total; });
+    return stats;
+}
+
+inline void reset(lua_State* L) {
+    registry* reg = find_registry(L);
+    if (reg == nullptr) {
+        return;
+    }
+    for (auto& kv : reg->records) {
+        kv.second = record();
+    }
+}
+} // binding_stats_detail
+#endif // SOL_BINDING_STATS
+} // sol
+
+#endif // SOL_BINDING_STATS_HPP
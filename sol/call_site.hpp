@@ -0,0 +1,158 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_CALL_SITE_HPP
+#define SOL_CALL_SITE_HPP
+
+#include "stack.hpp"
+
+namespace sol {
+namespace detail {
+// How many values a call converted to R leaves on the stack
+template <typename R>
+struct return_count : std::integral_constant<int, 1> {};
+
+template <>
+struct return_count<void> : std::integral_constant<int, 0> {};
+
+template <typename... Rn>
+struct return_count<std::tuple<Rn...>> : std::integral_constant<int, static_cast<int>(sizeof...(Rn))> {};
+} // detail
+
+template <typename Sig>
+class call_site;
+
+// A Lua function pinned to a fixed stack slot with a fixed signature. Every call is a
+// lua_pushvalue of that slot, the argument pushes and lua_callk: no registry lookup and no
+// function_result bookkeeping. The slot is released when the call_site is destroyed,
+// so call sites must be destroyed in the reverse order they were made (like any stack value)
+template <typename R, typename... Args>
+class call_site<R(Args...)> {
+private:
+    lua_State* L = nullptr;
+    int index = 0;
+    bool owning = false;
+
+public:
+    typedef meta::If<std::is_void<R>, std::tuple<>, R> result_type;
+
+private:
+    typedef meta::Bool<meta::is_specialization_of<result_type, std::tuple>::value> is_multi;
+    static const int return_count = detail::return_count<result_type>::value;
+
+    int luacall(Args... args) const {
+        lua_pushvalue(L, index);
+        int pushcount = stack::multi_push(L, args...);
+        lua_callk(L, pushcount, return_count, 0, nullptr);
+        return lua_gettop(L) - return_count + 1;
+    }
+
+    template <std::size_t... I>
+    void assign(std::true_type, std::index_sequence<I...>, result_type& out, int firstreturn) const {
+        void(detail::swallow{ 0, (std::get<I>(out) = stack::get<std::tuple_element_t<I, result_type>>(L, firstreturn + static_cast<int>(I)), 0)... });
+    }
+
+    template <std::size_t... I>
+    void assign(std::false_type, std::index_sequence<I...>, result_type& out, int firstreturn) const {
+        out = stack::get<result_type>(L, firstreturn);
+    }
+
+    void results(types<void>) const {}
+
+    template <typename T>
+    T results(types<T>) const {
+        return stack::pop<T>(L);
+    }
+
+    void release() {
+        if (owning && L != nullptr) {
+            lua_remove(L, index);
+        }
+        L = nullptr;
+        owning = false;
+    }
+
+public:
+    call_site() noexcept = default;
+
+    // Pins a copy of the function to the top of the stack
+    template <typename Fx, meta::EnableIf<meta::Not<std::is_same<meta::Unqualified<Fx>, call_site>>> = 0>
+    explicit call_site(const Fx& fx) : L(fx.lua_state()), owning(true) {
+        fx.push();
+        index = lua_gettop(L);
+    }
+
+    // Uses a function already on the stack, which the call_site does not remove
+    call_site(lua_State* L, int index) noexcept : L(L), index(lua_absindex(L, index)), owning(false) {}
+
+    call_site(const call_site&) = delete;
+    call_site& operator=(const call_site&) = delete;
+
+    call_site(call_site&& o) noexcept : L(o.L), index(o.index), owning(o.owning) {
+        o.L = nullptr;
+        o.owning = false;
+    }
+
+    call_site& operator=(call_site&& o) noexcept {
+        if (this != &o) {
+            release();
+            L = o.L;
+            index = o.index;
+            owning = o.owning;
+            o.L = nullptr;
+            o.owning = false;
+        }
+        return *this;
+    }
+
+    ~call_site() {
+        release();
+    }
+
+    R operator()(Args... args) const {
+        luacall(args...);
+        return results(types<R>());
+    }
+
+    // Writes the results into an existing object instead of building a new one each call:
+    // elements of a std::tuple are assigned one by one
+    void call_into(result_type& out, Args... args) const {
+        int firstreturn = luacall(args...);
+        assign(is_multi(), std::make_index_sequence<return_count>(), out, firstreturn);
+        lua_pop(L, return_count);
+    }
+
+    int stack_index() const noexcept {
+        return index;
+    }
+
+    lua_State* lua_state() const noexcept {
+        return L;
+    }
+
+    bool valid() const noexcept {
+        return L != nullptr && lua_type(L, index) == LUA_TFUNCTION;
+    }
+};
+
+} // sol
+
+#endif // SOL_CALL_SITE_HPP
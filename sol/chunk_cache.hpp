@@ -0,0 +1,188 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_CHUNK_CACHE_HPP
+#define SOL_CHUNK_CACHE_HPP
+
+#include "compatibility.hpp"
+#include "mapped_file.hpp"
+#include "compile.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace sol {
+// Compiled chunks kept as lua_dump bytecode, so sources shared by many states are only compiled once.
+// The cache can be shared between states on different threads; with a directory,
+// bytecode is also kept on disk, named after a hash of the source.
+// Bytecode that does not load (another Lua version, or another number layout) is compiled again from source
+class chunk_cache {
+private:
+    typedef std::shared_ptr<const std::string> bytecode_t;
+
+    std::string directory;
+    bool strip;
+    std::mutex lock;
+    std::unordered_map<std::string, bytecode_t> chunks;
+    std::size_t hitcount = 0;
+    std::size_t misscount = 0;
+
+    std::string path_for(const std::string& key) const {
+        return directory + "/" + key + ".luac";
+    }
+
+    bytecode_t find(const std::string& key) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = chunks.find(key);
+            if (it != chunks.end()) {
+                ++hitcount;
+                return it->second;
+            }
+        }
+        if (directory.empty()) {
+            return nullptr;
+        }
+        std::ifstream file(path_for(key), std::ios::binary);
+        if (!file) {
+            return nullptr;
+        }
+        auto bytecode = std::make_shared<std::string>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        std::lock_guard<std::mutex> guard(lock);
+        ++hitcount;
+        return chunks.emplace(key, std::move(bytecode)).first->second;
+    }
+
+    void store(const std::string& key, std::string bytecode) {
+        if (!directory.empty()) {
+            std::ofstream file(path_for(key), std::ios::binary | std::ios::trunc);
+            file.write(bytecode.data(), static_cast<std::streamsize>(bytecode.size()));
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        chunks[key] = std::make_shared<const std::string>(std::move(bytecode));
+    }
+
+    void forget(const std::string& key) {
+        std::lock_guard<std::mutex> guard(lock);
+        chunks.erase(key);
+    }
+
+public:
+    // The name a source is cached under, which changes whenever the source does
+    static std::string key_for(const char* code, std::size_t size) {
+        // 64-bit FNV-1a, plus the length to make collisions that much less likely
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= static_cast<unsigned char>(code[i]);
+            hash *= 1099511628211ULL;
+        }
+        static const char digits[] = "0123456789abcdef";
+        std::string key;
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            key.push_back(digits[(hash >> shift) & 0xF]);
+        }
+        key.push_back('-');
+        key += std::to_string(size);
+        return key;
+    }
+
+    chunk_cache(std::string directory = std::string(), bool strip = false) : directory(std::move(directory)), strip(strip) {}
+
+    chunk_cache(const chunk_cache&) = delete;
+    chunk_cache& operator=(const chunk_cache&) = delete;
+
+    // Like luaL_loadbuffer: pushes the compiled chunk and returns LUA_OK,
+    // or pushes the error message and returns the error code
+    int load(lua_State* L, const char* code, std::size_t size, const char* name) {
+        std::string key = key_for(code, size);
+        bytecode_t cached = find(key);
+        if (cached != nullptr) {
+            if (stack::load_bytecode(L, cached->data(), cached->size(), name) == LUA_OK) {
+                return LUA_OK;
+            }
+            // made by some other build of Lua: start over from the source
+            lua_pop(L, 1);
+            forget(key);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ++misscount;
+        }
+        int status = stack::load_buffer(L, code, size, name);
+        if (status != LUA_OK) {
+            return status;
+        }
+        std::string bytecode;
+        stack::dump(L, bytecode, strip);
+        store(key, std::move(bytecode));
+        return LUA_OK;
+    }
+
+    int load(lua_State* L, const std::string& code, const std::string& chunkname = std::string()) {
+        return load(L, code.data(), code.size(), chunkname.empty() ? code.c_str() : chunkname.c_str());
+    }
+
+    // The source is mapped rather than read through stdio
+    int load_file(lua_State* L, const std::string& filename) {
+#ifndef SOL_NO_EXCEPTIONS
+        try {
+#endif // No Exceptions
+            mapped_file file(filename);
+            std::string chunkname = "@" + filename;
+            return load(L, file.data(), file.size(), chunkname.c_str());
+#ifndef SOL_NO_EXCEPTIONS
+        }
+        catch (const error& e) {
+            lua_pushstring(L, e.what());
+            return LUA_ERRFILE;
+        }
+#endif // No Exceptions
+    }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> guard(lock);
+        return chunks.size();
+    }
+
+    std::size_t hits() {
+        std::lock_guard<std::mutex> guard(lock);
+        return hitcount;
+    }
+
+    std::size_t misses() {
+        std::lock_guard<std::mutex> guard(lock);
+        return misscount;
+    }
+
+    // Drops the in-memory copies; files on disk are left alone
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        chunks.clear();
+    }
+};
+} // sol
+
+#endif // SOL_CHUNK_CACHE_HPP
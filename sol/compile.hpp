@@ -0,0 +1,128 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_COMPILE_HPP
+#define SOL_COMPILE_HPP
+
+#include "compatibility.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sol {
+namespace stack {
+namespace stack_detail {
+inline int write_dump(lua_State*, const void* p, std::size_t size, void* ud) {
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+} // stack_detail
+
+// Appends the bytecode of the function on top of the stack to out, leaving the function where it is
+inline void dump(lua_State* L, std::string& out, bool strip = false) {
+#if SOL_LUA_VERSION >= 503
+    lua_dump(L, &stack_detail::write_dump, &out, strip ? 1 : 0);
+#else
+    (void)strip;
+    lua_dump(L, &stack_detail::write_dump, &out);
+#endif // Lua 5.3+ can strip debug information
+}
+
+// Loads bytecode only: a source chunk is refused rather than compiled
+inline int load_bytecode(lua_State* L, const char* data, std::size_t size, const char* chunkname) {
+#if SOL_LUA_VERSION > 501
+    return luaL_loadbufferx(L, data, size, chunkname, "b");
+#else
+    return luaL_loadbuffer(L, data, size, chunkname);
+#endif // Lua 5.2+ load modes
+}
+} // stack
+
+struct compiled_chunk {
+    std::string name;
+    std::string bytecode;
+    // empty when the chunk compiled
+    std::string error;
+
+    bool valid() const {
+        return error.empty();
+    }
+};
+
+// Compiles every (name, code) source on up to threads worker threads, each in its own scratch lua_State.
+// The results come back in the same order as the sources; compile errors are kept per chunk, not thrown
+inline std::vector<compiled_chunk> compile_parallel(const std::vector<std::pair<std::string, std::string>>& sources, std::size_t threads = std::thread::hardware_concurrency(), bool strip = false) {
+    std::vector<compiled_chunk> chunks(sources.size());
+    std::atomic<std::size_t> next(0);
+    auto work = [&]() {
+        lua_State* L = luaL_newstate();
+        for (std::size_t i = next++; i < sources.size(); i = next++) {
+            const std::string& name = sources[i].first;
+            const std::string& code = sources[i].second;
+            compiled_chunk& chunk = chunks[i];
+            chunk.name = name;
+            if (L == nullptr) {
+                chunk.error = "sol: unable to allocate a lua_State to compile with";
+                continue;
+            }
+            if (stack::load_buffer(L, code.data(), code.size(), name.c_str()) != LUA_OK) {
+                const char* message = lua_tostring(L, -1);
+                chunk.error = message != nullptr ? message : "sol: unknown compile error";
+            }
+            else {
+                stack::dump(L, chunk.bytecode, strip);
+            }
+            lua_settop(L, 0);
+        }
+        if (L != nullptr) {
+            lua_close(L);
+        }
+    };
+    std::size_t count = (std::min)((std::max)(threads, static_cast<std::size_t>(1)), sources.size());
+    std::vector<std::thread> workers;
+    // this thread does its share too
+    for (std::size_t i = 1; i < count; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& w : workers) {
+        w.join();
+    }
+    return chunks;
+}
+
+namespace stack {
+inline int load_compiled(lua_State* L, const compiled_chunk& chunk) {
+    if (!chunk.valid()) {
+        lua_pushlstring(L, chunk.error.data(), chunk.error.size());
+        return LUA_ERRSYNTAX;
+    }
+    return load_bytecode(L, chunk.bytecode.data(), chunk.bytecode.size(), chunk.name.c_str());
+}
+} // stack
+} // sol
+
+#endif // SOL_COMPILE_HPP
@@ -0,0 +1,462 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_CONTAINER_USERTYPE_HPP
+#define SOL_CONTAINER_USERTYPE_HPP
+
+#include "stack_core.hpp"
+#include "inheritance.hpp"
+#include <iterator>
+#include <new>
+#include <utility>
+
+namespace sol {
+namespace container_detail {
+struct has_size_impl {
+    template<typename T, typename U = meta::Unqualified<T>,
+        typename S = decltype(std::declval<U&>().size())>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct has_size : decltype(has_size_impl::test<T>(0)) {};
+
+struct has_insert_impl {
+    template<typename T, typename U = meta::Unqualified<T>,
+        typename I = decltype(std::declval<U&>().insert(std::declval<U&>().end(), std::declval<typename U::value_type>()))>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct has_insert : decltype(has_insert_impl::test<T>(0)) {};
+
+struct has_erase_impl {
+    template<typename T, typename U = meta::Unqualified<T>,
+        typename E = decltype(std::declval<U&>().erase(std::declval<U&>().begin()))>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct has_erase : decltype(has_erase_impl::test<T>(0)) {};
+
+struct has_clear_impl {
+    template<typename T, typename U = meta::Unqualified<T>,
+        typename C = decltype(std::declval<U&>().clear())>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct has_clear : decltype(has_clear_impl::test<T>(0)) {};
+} // container_detail
+
+// Containers pushed by pointer or std::ref are handed to Lua as a live view of the C++ object,
+// unless they were registered as usertypes themselves. Specialize to false_type to opt a type out
+template <typename T>
+struct is_container : std::integral_constant<bool,
+    meta::has_begin_end<T>::value
+    && container_detail::has_size<T>::value
+    && lua_type_of<meta::Unqualified<T>>::value != type::string
+    && !is_lua_reference<T>::value> {};
+
+namespace stack {
+namespace stack_detail {
+// The metatable of a container view: every metamethod works on the C++ container in place,
+// through the pointer stored in the userdata; nothing is copied into a table
+template <typename C>
+struct container_metatable {
+    typedef std::remove_const_t<C> Cu;
+    typedef typename Cu::value_type value_type;
+    typedef decltype(std::declval<C&>().begin()) iterator;
+    typedef meta::has_key_value_pair<Cu> is_associative;
+    typedef meta::Not<std::is_const<C>> is_mutable;
+
+    struct iteration {
+        iterator it;
+        lua_Integer i;
+    };
+
+    static C& self(lua_State* L) {
+        return **static_cast<C**>(lua_touserdata(L, 1));
+    }
+
+    template <typename V>
+    static int push_value(std::true_type, lua_State* L, V& value) {
+        return stack::push(L, value);
+    }
+
+    template <typename V>
+    static int push_value(std::false_type, lua_State* L, V& value) {
+        // usertypes (and nested containers) go out by reference, so changes land in the container
+        return stack::push(L, &value);
+    }
+
+    template <typename V>
+    static int push_value(lua_State* L, V& value) {
+        typedef std::remove_cv_t<V> Vu;
+        return push_value(meta::And<is_lua_primitive<Vu>, meta::Not<is_container<Vu>>>(), L, value);
+    }
+
+    static iterator at(C& c, lua_Integer i) {
+        iterator it = c.begin();
+        std::advance(it, static_cast<std::ptrdiff_t>(i - 1));
+        return it;
+    }
+
+    static bool in_range(C& c, lua_Integer i) {
+        return i >= 1 && static_cast<std::size_t>(i) <= c.size();
+    }
+
+    // Keys that are not elements are looked up in the metatable, which holds insert/erase/clear
+    static int method(lua_State* L) {
+        lua_getmetatable(L, 1);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return 1;
+    }
+
+    static int not_mutable(lua_State* L) {
+        return luaL_error(L, "sol: cannot modify a container through a const view");
+    }
+
+    static int out_of_bounds(lua_State* L, lua_Integer i, std::size_t n) {
+        return luaL_error(L, "sol: index %d is out of bounds for a container of size %d", static_cast<int>(i), static_cast<int>(n));
+    }
+
+    // sequences: vector, deque, list, array, set...
+    static int get_index(std::false_type, lua_State* L) {
+        if (lua_type(L, 2) != LUA_TNUMBER) {
+            return method(L);
+        }
+        C& c = self(L);
+        // Past the end is nil: ipairs stops on it
+        lua_Integer i = lua_tointeger(L, 2);
+        if (!in_range(c, i)) {
+            lua_pushnil(L);
+            return 1;
+        }
+        return push_value(L, *at(c, i));
+    }
+
+    // maps: keys that are not in the container fall back to the methods
+    static int get_index(std::true_type, lua_State* L) {
+        typedef typename Cu::key_type K;
+        if (!stack::check<K>(L, 2)) {
+            return method(L);
+        }
+        C& c = self(L);
+        auto it = c.find(stack::get<K>(L, 2));
+        if (it == c.end()) {
+            return method(L);
+        }
+        return push_value(L, it->second);
+    }
+
+    static int get_index(lua_State* L) {
+        return get_index(is_associative(), L);
+    }
+
+    static int assign(std::true_type, lua_State* L, iterator it, int valueindex) {
+        *it = stack::get<value_type>(L, valueindex);
+        return 0;
+    }
+
+    static int assign(std::false_type, lua_State* L, iterator, int) {
+        return luaL_error(L, "sol: the elements of this container cannot be assigned to");
+    }
+
+    static int insert_at(std::true_type, lua_State* L, C& c, iterator where, int valueindex) {
+        c.insert(where, stack::get<value_type>(L, valueindex));
+        return 0;
+    }
+
+    static int insert_at(std::false_type, lua_State* L, C&, iterator, int) {
+        return luaL_error(L, "sol: cannot insert into this container");
+    }
+
+    static int insert_at(lua_State* L, C& c, iterator where, int valueindex) {
+        return insert_at(meta::And<is_mutable, container_detail::has_insert<Cu>>(), L, c, where, valueindex);
+    }
+
+    static int set_index(std::false_type, std::true_type, lua_State* L) {
+        C& c = self(L);
+        lua_Integer i = lua_tointeger(L, 2);
+        std::size_t n = c.size();
+        // one past the end appends, like t[#t + 1] = v does for tables
+        if (static_cast<std::size_t>(i) == n + 1) {
+            return insert_at(L, c, c.end(), 3);
+        }
+#ifndef SOL_NO_BOUNDS_CHECKS
+        if (!in_range(c, i)) {
+            return out_of_bounds(L, i, n);
+        }
+#endif // Bounds checks
+        return assign(std::is_assignable<decltype(*std::declval<iterator>()), value_type>(), L, at(c, i), 3);
+    }
+
+    static int set_index(std::true_type, std::true_type, lua_State* L) {
+        typedef typename Cu::key_type K;
+        typedef typename Cu::mapped_type V;
+        C& c = self(L);
+        K key = stack::get<K>(L, 2);
+        // assigning nil removes the key, like it does for tables
+        if (lua_isnil(L, 3)) {
+            c.erase(key);
+            return 0;
+        }
+        auto it = c.find(key);
+        if (it == c.end()) {
+            c.emplace(std::move(key), stack::get<V>(L, 3));
+        }
+        else {
+            it->second = stack::get<V>(L, 3);
+        }
+        return 0;
+    }
+
+    template <typename B>
+    static int set_index(B, std::false_type, lua_State* L) {
+        return not_mutable(L);
+    }
+
+    static int set_index(lua_State* L) {
+        return set_index(is_associative(), is_mutable(), L);
+    }
+
+    static int length(lua_State* L) {
+        lua_pushinteger(L, static_cast<lua_Integer>(self(L).size()));
+        return 1;
+    }
+
+    // c:insert(v) appends, c:insert(i, v) inserts before the i-th element
+    static int insert(std::false_type, std::true_type, lua_State* L) {
+        C& c = self(L);
+        if (lua_gettop(L) < 3) {
+            return insert_at(L, c, c.end(), 2);
+        }
+        lua_Integer i = lua_tointeger(L, 2);
+        std::size_t n = c.size();
+        if (i < 1 || static_cast<std::size_t>(i) > n + 1) {
+            return out_of_bounds(L, i, n);
+        }
+        return insert_at(L, c, at(c, i), 3);
+    }
+
+    // m:insert(k, v) adds the pair unless k is already there, and returns whether it did
+    static int insert(std::true_type, std::true_type, lua_State* L) {
+        typedef typename Cu::key_type K;
+        typedef typename Cu::mapped_type V;
+        C& c = self(L);
+        bool inserted = c.emplace(stack::get<K>(L, 2), stack::get<V>(L, 3)).second;
+        lua_pushboolean(L, inserted);
+        return 1;
+    }
+
+    template <typename B>
+    static int insert(B, std::false_type, lua_State* L) {
+        return not_mutable(L);
+    }
+
+    static int insert(lua_State* L) {
+        return insert(is_associative(), is_mutable(), L);
+    }
+
+    static int erase_at(std::true_type, lua_State* L) {
+        C& c = self(L);
+        lua_Integer i = lua_tointeger(L, 2);
+        if (!in_range(c, i)) {
+            return out_of_bounds(L, i, c.size());
+        }
+        c.erase(at(c, i));
+        return 0;
+    }
+
+    static int erase_at(std::false_type, lua_State* L) {
+        return luaL_error(L, "sol: cannot erase from this container");
+    }
+
+    // c:erase(i) removes the i-th element, m:erase(k) removes the key
+    static int erase(std::false_type, std::true_type, lua_State* L) {
+        return erase_at(container_detail::has_erase<Cu>(), L);
+    }
+
+    static int erase(std::true_type, std::true_type, lua_State* L) {
+        typedef typename Cu::key_type K;
+        self(L).erase(stack::get<K>(L, 2));
+        return 0;
+    }
+
+    template <typename B>
+    static int erase(B, std::false_type, lua_State* L) {
+        return not_mutable(L);
+    }
+
+    static int erase(lua_State* L) {
+        return erase(is_associative(), is_mutable(), L);
+    }
+
+    static int clear(std::true_type, lua_State* L) {
+        self(L).clear();
+        return 0;
+    }
+
+    static int clear(std::false_type, lua_State* L) {
+        return luaL_error(L, "sol: cannot clear this container");
+    }
+
+    static int clear(lua_State* L) {
+        return clear(meta::And<is_mutable, container_detail::has_clear<Cu>>(), L);
+    }
+
+    static int push_key(std::false_type, lua_State* L, iteration& state) {
+        lua_pushinteger(L, state.i);
+        return 1;
+    }
+
+    static int push_key(std::true_type, lua_State* L, iteration& state) {
+        return stack::push(L, state.it->first);
+    }
+
+    static int push_mapped(std::false_type, lua_State* L, iteration& state) {
+        return push_value(L, *state.it);
+    }
+
+    static int push_mapped(std::true_type, lua_State* L, iteration& state) {
+        return push_value(L, state.it->second);
+    }
+
+    // The iterator lives in an upvalue: walking a list or a map is one step per element,
+    // not a search from the beginning. Changing the container while iterating is undefined
+    static int next(lua_State* L) {
+        iteration& state = *static_cast<iteration*>(lua_touserdata(L, lua_upvalueindex(1)));
+        if (state.it == self(L).end()) {
+            return 0;
+        }
+        ++state.i;
+        int pushed = push_key(is_associative(), L, state);
+        pushed += push_mapped(is_associative(), L, state);
+        ++state.it;
+        return pushed;
+    }
+
+    static int destroy_iteration(lua_State* L) {
+        static_cast<iteration*>(lua_touserdata(L, 1))->~iteration();
+        return 0;
+    }
+
+    static int pairs(lua_State* L) {
+        void* memory = lua_newuserdata(L, sizeof(iteration));
+        new (memory) iteration{ self(L).begin(), 0 };
+        if (!std::is_trivially_destructible<iteration>::value) {
+            if (luaL_newmetatable(L, &usertype_traits<iteration>::metatable()[0]) == 1) {
+                lua_pushcfunction(L, &destroy_iteration);
+                lua_setfield(L, -2, "__gc");
+            }
+            lua_setmetatable(L, -2);
+        }
+        lua_pushcclosure(L, &next, 1);
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+
+    static void push(lua_State* L) {
+        if (get_metatable<container_metatable<C>>(L) != type::nil) {
+            return;
+        }
+        lua_pop(L, 1);
+        static const luaL_Reg metafunctions[] = {
+            { "__index", &get_index },
+            { "__newindex", &set_index },
+            { "__len", &length },
+            { "__pairs", &pairs },
+            { "insert", &insert },
+            { "erase", &erase },
+            { "clear", &clear },
+            { nullptr, nullptr }
+        };
+        luaL_newmetatable(L, &usertype_traits<container_metatable<C>>::metatable()[0]);
+        luaL_setfuncs(L, metafunctions, 0);
+        if (!is_associative::value) {
+            // ipairs in 5.3 goes through __index; 5.2 asks for __ipairs
+            lua_pushcfunction(L, &pairs);
+            lua_setfield(L, -2, "__ipairs");
+        }
+        // the same identity as C*, so functions taking a C& or C* accept the view;
+        // that of C's usertype when one is registered, for its sol::base_classes
+        const detail::usertype_identity* identity = &detail::identity_for<Cu>::pointers;
+        if (get_metatable<Cu>(L) != type::nil) {
+            const detail::usertype_identity* registered = detail::get_identity(L);
+            if (registered != nullptr) {
+                identity = registered->by_pointer;
+            }
+        }
+        lua_pop(L, 1);
+        lua_pushlightuserdata(L, const_cast<detail::usertype_identity*>(identity));
+        lua_rawsetp(L, -2, detail::usertype_identity_key());
+        register_metatable<container_metatable<C>>(L);
+    }
+};
+} // stack_detail
+
+// vector, array, map and unordered_map are tables when pushed by value: their views are userdata
+template <typename T, typename C>
+struct checker<T, type::table, C> {
+    template <typename Handler>
+    static bool check_view(std::true_type, lua_State* L, type indextype, int index, Handler&& handler) {
+        return checker<T, type::userdata, C>{}.check(types<T>(), L, indextype, index, std::forward<Handler>(handler));
+    }
+
+    template <typename Handler>
+    static bool check_view(std::false_type, lua_State* L, type indextype, int index, Handler&& handler) {
+        handler(L, index, type::table, indextype);
+        return false;
+    }
+
+    template <typename Handler>
+    static bool check(lua_State* L, int index, Handler&& handler) {
+        const type indextype = type_of(L, index);
+        if (indextype == type::userdata) {
+            return check_view(is_container<T>(), L, indextype, index, std::forward<Handler>(handler));
+        }
+        bool success = indextype == type::table;
+        if (!success) {
+            // expected type, actual type
+            handler(L, index, type::table, indextype);
+        }
+        return success;
+    }
+};
+} // stack
+} // sol
+
+#endif // SOL_CONTAINER_USERTYPE_HPP
@@ -59,7 +59,7 @@ private:
 
     protected_function_result invoke(types<>, std::index_sequence<>, std::ptrdiff_t n) {
         int stacksize = lua_gettop( lua_state() );
-        int firstreturn = std::max( 1, stacksize - static_cast<int>( n ) );
+        int firstreturn = (std::max)( 1, stacksize - static_cast<int>( n ) );
         luacall(n, LUA_MULTRET);
         int poststacksize = lua_gettop(lua_state());
         int returncount = poststacksize - (firstreturn - 1);
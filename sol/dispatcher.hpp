@@ -0,0 +1,250 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_DISPATCHER_HPP
+#define SOL_DISPATCHER_HPP
+
+#include "reference.hpp"
+#include "stack.hpp"
+#include "optional.hpp"
+#include "protected_function.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sol {
+namespace detail {
+// Pushes the arguments once, then calls every listener in [first, last) with copies of them
+// (lua_pushvalue), so a usertype argument is one userdata shared by all the listeners.
+// onresult sees the listener's results on top of the stack and returns true to stop
+template <int resultcount, typename It, typename Fx, typename... Args>
+inline void fan_out(lua_State* L, It first, It last, int handlerindex, protected_function::batch_errors* failures, Fx&& onresult, Args&&... args) {
+    int firstarg = lua_gettop(L) + 1;
+    int n = stack::multi_push(L, std::forward<Args>(args)...);
+    for (std::size_t position = 0; first != last; ++first, ++position) {
+        // removed while a dispatch was running
+        if (!first->valid()) {
+            continue;
+        }
+        int top = lua_gettop(L);
+        first->push();
+        for (int i = 0; i < n; ++i) {
+            lua_pushvalue(L, firstarg + i);
+        }
+        if (failures == nullptr) {
+            lua_callk(L, n, resultcount, 0, nullptr);
+        }
+        else if (static_cast<call_status>(lua_pcallk(L, n, resultcount, handlerindex, 0, nullptr)) != call_status::ok) {
+            const char* message = lua_tostring(L, -1);
+            failures->emplace_back(position, message != nullptr ? message : "error object is not a string");
+            lua_settop(L, top);
+            continue;
+        }
+        bool stop = onresult(L);
+        lua_settop(L, top);
+        if (stop) {
+            break;
+        }
+    }
+}
+} // detail
+
+// Calls many Lua functions with the same arguments, converting the arguments only once.
+// Unprotected: the first error propagates like it does from sol::function
+template <typename Range, typename... Args>
+inline void multi_call(const Range& listeners, Args&&... args) {
+    using std::begin;
+    using std::end;
+    auto first = begin(listeners);
+    auto last = end(listeners);
+    if (first == last) {
+        return;
+    }
+    lua_State* L = first->lua_state();
+    stack::stack_detail::stack_reset reset(L);
+    detail::fan_out<0>(L, first, last, 0, nullptr, [](lua_State*) { return false; }, std::forward<Args>(args)...);
+}
+
+// A list of listeners that are all called with the same arguments, pushed once per dispatch.
+// Protected dispatchers run every listener even if some fail, and report the failures.
+// Listeners may add, remove or clear while a dispatch runs: removals leave an empty slot
+// and additions wait in a side list, both settled once the outermost dispatch returns
+class dispatcher {
+public:
+    typedef protected_function::batch_errors batch_errors;
+
+private:
+    lua_State* L;
+    std::vector<reference> listeners;
+    std::vector<reference> pending;
+    batch_errors failures;
+    int running;
+    bool protect;
+
+    struct dispatching {
+        dispatcher& d;
+        dispatching(dispatcher& d) : d(d) { ++d.running; }
+        dispatching(const dispatching&) = delete;
+        dispatching& operator=(const dispatching&) = delete;
+        ~dispatching() {
+            if (--d.running == 0) {
+                d.settle();
+            }
+        }
+    };
+
+    void settle() {
+        listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [](const reference& r) { return !r.valid(); }), listeners.end());
+        for (auto& listener : pending) {
+            listeners.push_back(std::move(listener));
+        }
+        pending.clear();
+    }
+
+    static bool remove_from(lua_State* L, std::vector<reference>& list, bool keep_slot) {
+        for (auto it = list.begin(); it != list.end(); ++it) {
+            if (!it->valid()) {
+                continue;
+            }
+            it->push();
+            bool same = lua_rawequal(L, -1, -2) == 1;
+            lua_pop(L, 1);
+            if (same) {
+                if (keep_slot) {
+                    *it = reference();
+                }
+                else {
+                    list.erase(it);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <int resultcount, typename Fx, typename... Args>
+    void dispatch(Fx&& onresult, Args&&... args) {
+        failures.clear();
+        if (listeners.empty()) {
+            return;
+        }
+        dispatching guard(*this);
+        stack::stack_detail::stack_reset reset(L);
+        int handlerindex = 0;
+        if (protect && error_handler.valid()) {
+            error_handler.push();
+            handlerindex = lua_gettop(L);
+        }
+        detail::fan_out<resultcount>(L, listeners.begin(), listeners.end(), handlerindex, protect ? &failures : nullptr, std::forward<Fx>(onresult), std::forward<Args>(args)...);
+    }
+
+public:
+    reference error_handler;
+
+    dispatcher(lua_State* L, bool protect = false) : L(L), running(0), protect(protect), error_handler(protected_function::get_default_handler()) {}
+
+    // added during a dispatch, a listener is first called by the next one
+    void add(reference listener) {
+        if (running > 0) {
+            pending.push_back(std::move(listener));
+            return;
+        }
+        listeners.push_back(std::move(listener));
+    }
+
+    // removes the first listener that is the same Lua value as the given one
+    bool remove(const reference& listener) {
+        auto pp = stack::push_pop(listener);
+        return remove_from(L, listeners, running > 0) || remove_from(L, pending, false);
+    }
+
+    void clear() {
+        pending.clear();
+        if (running > 0) {
+            for (auto& listener : listeners) {
+                listener = reference();
+            }
+            return;
+        }
+        listeners.clear();
+    }
+
+    std::size_t size() const {
+        if (running == 0) {
+            return listeners.size();
+        }
+        return pending.size() + static_cast<std::size_t>(std::count_if(listeners.begin(), listeners.end(), [](const reference& r) { return r.valid(); }));
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool is_protected() const {
+        return protect;
+    }
+
+    void set_protected(bool on) {
+        protect = on;
+    }
+
+    // (position in the list, error message) of every listener that failed in the last dispatch
+    const batch_errors& errors() const {
+        return failures;
+    }
+
+    lua_State* lua_state() const {
+        return L;
+    }
+
+    // calls every listener, and returns how many of them ran without error
+    template <typename... Args>
+    std::size_t call(Args&&... args) {
+        std::size_t ran = 0;
+        dispatch<0>([&ran](lua_State*) { ++ran; return false; }, std::forward<Args>(args)...);
+        return ran;
+    }
+
+    template <typename... Args>
+    std::size_t operator()(Args&&... args) {
+        return call(std::forward<Args>(args)...);
+    }
+
+    // calls listeners in order until one returns something other than nil or false, which is returned
+    template <typename Ret, typename... Args>
+    optional<Ret> call_until(Args&&... args) {
+        optional<Ret> result;
+        dispatch<1>([&result](lua_State* L) {
+            if (!lua_toboolean(L, -1)) {
+                return false;
+            }
+            result = stack::get<Ret>(L, -1);
+            return true;
+        }, std::forward<Args>(args)...);
+        return result;
+    }
+};
+} // sol
+
+#endif // SOL_DISPATCHER_HPP
@@ -0,0 +1,238 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_FFI_HPP
+#define SOL_FFI_HPP
+
+#include "stack.hpp"
+#include "schema.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace sol {
+namespace ffi_detail {
+template <typename T, typename = void>
+struct c_type {
+    static_assert(is_ffi_usertype<T>::value, "the FFI bridge only lays out arithmetic fields, enums and pointers to FFI usertypes");
+
+    // a C identifier derived from T's name
+    static std::string name() {
+        std::string n = "sol_" + usertype_traits<T>::name();
+        std::replace_if(n.begin(), n.end(), [](char c) { return !(std::isalnum(static_cast<unsigned char>(c)) || c == '_'); }, '_');
+        return n;
+    }
+};
+
+template <>
+struct c_type<void> {
+    static std::string name() {
+        return "void";
+    }
+};
+
+template <>
+struct c_type<bool> {
+    static std::string name() {
+        return "bool";
+    }
+};
+
+template <typename T>
+struct c_type<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>> {
+    static std::string name() {
+        return (std::is_signed<T>::value ? "int" : "uint") + std::to_string(sizeof(T) * 8) + "_t";
+    }
+};
+
+template <typename T>
+struct c_type<T, std::enable_if_t<std::is_enum<T>::value>> : c_type<std::underlying_type_t<T>> {};
+
+template <>
+struct c_type<float> {
+    static std::string name() {
+        return "float";
+    }
+};
+
+template <>
+struct c_type<double> {
+    static std::string name() {
+        return "double";
+    }
+};
+
+template <typename T>
+struct c_type<const T> {
+    static std::string name() {
+        return "const " + c_type<T>::name();
+    }
+};
+
+template <typename T>
+struct c_type<T*> {
+    static std::string name() {
+        return c_type<T>::name() + "*";
+    }
+};
+
+template <typename T, typename M>
+inline std::size_t offset_of(M T::* member) {
+    // no T is made: the address is only taken, never read
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    const T* object = reinterpret_cast<const T*>(&storage);
+    return static_cast<std::size_t>(reinterpret_cast<const char*>(&(object->*member)) - reinterpret_cast<const char*>(object));
+}
+
+struct field_layout {
+    std::size_t offset;
+    std::size_t size;
+    std::string declaration;
+};
+
+template <typename T, typename M>
+inline field_layout layout_of(const char* name, M T::* member) {
+    static_assert(!std::is_reference<M>::value && !std::is_array<M>::value, "the FFI bridge does not lay out reference or array fields");
+    return { offset_of(member), sizeof(M), c_type<M>::name() + " " + name + ";" };
+}
+
+template <typename T, std::size_t... I, typename Fields>
+inline std::array<field_layout, sizeof...(I)> layouts(std::index_sequence<I...>, const Fields& f) {
+    return { { layout_of(f.names[I], std::get<I>(f.members))... } };
+}
+
+template <typename R, typename... Args>
+inline std::string signature(R(*)(Args...)) {
+    std::string s = c_type<R>::name() + "(*)(";
+    std::array<std::string, sizeof...(Args)> args = { { c_type<Args>::name()... } };
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        if (i != 0) {
+            s += ", ";
+        }
+        s += args[i];
+    }
+    return s + ")";
+}
+} // ffi_detail
+
+// The ffi.cdef declaration of T: its fields in offset order, with explicit padding between them
+// and up to sizeof(T), so that LuaJIT lays the struct out exactly as the compiler did
+template <typename T>
+inline std::string ffi_declaration() {
+    static_assert(std::is_standard_layout<T>::value, "the FFI bridge needs a standard-layout type");
+    typedef decltype(ffi_layout<T>::fields()) fields_type;
+    typedef std::tuple_size<std::decay_t<decltype(std::declval<fields_type&>().members)>> count;
+    auto fields = ffi_detail::layouts<T>(std::make_index_sequence<count::value>(), ffi_layout<T>::fields());
+    std::sort(fields.begin(), fields.end(), [](const ffi_detail::field_layout& l, const ffi_detail::field_layout& r) { return l.offset < r.offset; });
+    std::string decl = "typedef struct { ";
+    std::size_t at = 0;
+    std::size_t pads = 0;
+    auto pad = [&](std::size_t to) {
+        if (to > at) {
+            decl += "uint8_t sol_pad" + std::to_string(pads++) + "[" + std::to_string(to - at) + "]; ";
+        }
+    };
+    for (const ffi_detail::field_layout& f : fields) {
+        if (f.offset < at) {
+            throw error("sol: the FFI layout of " + usertype_traits<T>::name() + " has overlapping fields");
+        }
+        pad(f.offset);
+        decl += f.declaration + " ";
+        at = f.offset + f.size;
+    }
+    pad(sizeof(T));
+    return decl + "} " + ffi_detail::c_type<T>::name() + ";";
+}
+
+#ifdef SOL_LUAJIT
+namespace ffi_detail {
+const char declare_chunk[] =
+    "local ffi = require('ffi')\n"
+    "local decl, name, methods = ...\n"
+    "ffi.cdef(decl)\n"
+    "local index = {}\n"
+    "for i = 1, #methods, 3 do index[methods[i]] = ffi.cast(methods[i + 1], methods[i + 2]) end\n"
+    "local ptr = ffi.metatype(name, { __index = index })\n"
+    "ptr = ffi.typeof('$*', ptr)\n"
+    "local cast = ffi.cast\n"
+    "return function(p) return cast(ptr, p) end, ffi.sizeof(name)";
+
+template <typename Fx>
+inline void add_method(lua_State* L, int& n, const char* name, Fx fx) {
+    static_assert(std::is_pointer<Fx>::value && std::is_function<std::remove_pointer_t<Fx>>::value, "FFI methods are plain function pointers");
+    lua_pushstring(L, name);
+    lua_rawseti(L, -2, ++n);
+    stack::push(L, signature(fx));
+    lua_rawseti(L, -2, ++n);
+    lua_pushlightuserdata(L, reinterpret_cast<void*>(fx));
+    lua_rawseti(L, -2, ++n);
+}
+
+template <std::size_t... I, typename Methods>
+inline void add_methods(std::index_sequence<I...>, lua_State* L, const Methods& m) {
+    int n = 0;
+    (void)n;
+    (void)detail::swallow{ 0, (add_method(L, n, m.names[I], std::get<I>(m.members)), 0)... };
+}
+} // ffi_detail
+
+// Declares T to this state's FFI, with methods("name", &c_function, ...) reachable as obj:name(...)
+// through FFI calls, and from then on pushes T* as cdata. Methods take T* by their first argument
+// and only arithmetic values, enums and FFI usertype pointers. Declaring the same T again does nothing
+template <typename T, typename... Methods>
+inline void ffi_declare(lua_State* L, Methods&&... methods) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, stack::stack_detail::ffi_caster<T>::key());
+    bool declared = lua_type(L, -1) == LUA_TFUNCTION;
+    lua_pop(L, 1);
+    if (declared) {
+        return;
+    }
+    if (luaL_loadbuffer(L, ffi_detail::declare_chunk, sizeof(ffi_detail::declare_chunk) - 1, "=sol.ffi") != 0) {
+        std::string message = stack::pop<std::string>(L);
+        throw error(message);
+    }
+    stack::push(L, ffi_declaration<T>());
+    stack::push(L, ffi_detail::c_type<T>::name());
+    lua_createtable(L, static_cast<int>(sizeof...(Methods) / 2 * 3), 0);
+    ffi_detail::add_methods(std::make_index_sequence<sizeof...(Methods) / 2>(), L, fields(std::forward<Methods>(methods)...));
+    if (lua_pcall(L, 3, 2, 0) != 0) {
+        std::string message = stack::pop<std::string>(L);
+        throw error(message);
+    }
+    std::size_t size = static_cast<std::size_t>(lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    if (size != sizeof(T)) {
+        lua_pop(L, 1);
+        throw error("sol: LuaJIT lays out " + usertype_traits<T>::name() + " in " + std::to_string(size) + " bytes instead of " + std::to_string(sizeof(T)));
+    }
+    lua_rawsetp(L, LUA_REGISTRYINDEX, stack::stack_detail::ffi_caster<T>::key());
+}
+#endif // SOL_LUAJIT
+} // sol
+
+#endif // SOL_FFI_HPP
@@ -0,0 +1,172 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_FINALIZER_QUEUE_HPP
+#define SOL_FINALIZER_QUEUE_HPP
+
+#include "compatibility.hpp"
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sol {
+// C++ objects whose __gc ran for a type with is_destruction_deferred, moved out of their userdata
+// and waiting to be destroyed. Deferring and draining take a lock, so draining can be done from another
+// thread as long as the destructors themselves can; the destructors run outside the lock
+class finalizer_queue {
+private:
+    struct entry {
+        void* object;
+        void(*destroy)(void*);
+    };
+
+    template <typename T>
+    static void destroy_object(void* object) {
+        delete static_cast<T*>(object);
+    }
+
+    mutable std::mutex lock;
+    std::deque<entry> entries;
+
+    bool pop(entry& e) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (entries.empty()) {
+            return false;
+        }
+        e = entries.front();
+        entries.pop_front();
+        return true;
+    }
+
+public:
+    finalizer_queue() = default;
+    finalizer_queue(const finalizer_queue&) = delete;
+    finalizer_queue& operator=(const finalizer_queue&) = delete;
+
+    ~finalizer_queue() {
+        drain();
+    }
+
+    // Moves obj into the queue; obj itself is left to be destroyed by the caller
+    template <typename T>
+    void defer(T&& obj) {
+        typedef std::remove_cv_t<std::remove_reference_t<T>> Tu;
+        std::unique_ptr<Tu> moved(new Tu(std::move(obj)));
+        std::lock_guard<std::mutex> guard(lock);
+        entries.push_back({ moved.get(), &destroy_object<Tu> });
+        moved.release();
+    }
+
+    // Destroys everything queued, including what the destructors themselves queue. Returns how many
+    std::size_t drain() {
+        std::size_t count = 0;
+        for (;;) {
+            std::deque<entry> batch;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                batch.swap(entries);
+            }
+            if (batch.empty()) {
+                return count;
+            }
+            for (const entry& e : batch) {
+                e.destroy(e.object);
+            }
+            count += batch.size();
+        }
+    }
+
+    // Destroys queued objects, oldest first, until budget has passed or none are left.
+    // At least one is destroyed if any are queued. Returns how many
+    std::size_t drain(std::chrono::nanoseconds budget) {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point deadline = clock::now() + budget;
+        std::size_t count = 0;
+        entry e;
+        while (pop(e)) {
+            e.destroy(e.object);
+            ++count;
+            if (clock::now() >= deadline) {
+                break;
+            }
+        }
+        return count;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return entries.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+};
+
+namespace finalizer_detail {
+inline const void* queue_key() {
+    static char key = 0;
+    return &key;
+}
+
+// The queue is collected like anything else: what is still in it is destroyed then,
+// and from that point on finalizers find no queue and destroy right away
+inline int queue_gc(lua_State* L) {
+    finalizer_queue* q = static_cast<finalizer_queue*>(lua_touserdata(L, 1));
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, queue_key());
+    q->~finalizer_queue();
+    return 0;
+}
+
+// Never creates the queue: this is called from __gc, when making a new finalized userdata is not safe
+inline finalizer_queue* find(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, queue_key());
+    void* existing = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return static_cast<finalizer_queue*>(existing);
+}
+
+// Made before any object that may be deferred into it, so that on lua_close it is finalized after all of them
+inline finalizer_queue& ensure(lua_State* L) {
+    finalizer_queue* existing = find(L);
+    if (existing != nullptr) {
+        return *existing;
+    }
+    void* memory = lua_newuserdata(L, sizeof(finalizer_queue));
+    finalizer_queue* q = new (memory) finalizer_queue();
+    lua_createtable(L, 0, 1);
+    lua_pushcclosure(L, &queue_gc, 0);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, queue_key());
+    return *q;
+}
+} // finalizer_detail
+} // sol
+
+#endif // SOL_FINALIZER_QUEUE_HPP
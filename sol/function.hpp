@@ -27,8 +27,11 @@
 #include "resolve.hpp"
 #include "function_result.hpp"
 #include "function_types.hpp"
+#include "call_site.hpp"
+#include "function_ref.hpp"
 #include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
 
 namespace sol {
@@ -44,7 +47,11 @@ function_packer<Sig, Args...> function_pack( Args&&... args ) {
     return function_packer<Sig, Args...>(std::forward<Args>(args)...);
 }
 
-class function : public reference {
+template <typename base_t>
+class basic_function : public base_t {
+public:
+    using base_t::lua_state;
+
 private:
     void luacall( std::ptrdiff_t argcount, std::ptrdiff_t resultcount ) const {
         lua_callk( lua_state( ), static_cast<int>( argcount ), static_cast<int>( resultcount ), 0, nullptr );
@@ -69,7 +76,7 @@ private:
 
     function_result invoke(types<>, std::index_sequence<>, std::ptrdiff_t n ) const {
         int stacksize = lua_gettop( lua_state( ) );
-        int firstreturn = std::max( 1, stacksize - static_cast<int>( n ) );
+        int firstreturn = (std::max)( 1, stacksize - static_cast<int>( n ) );
         luacall(n, LUA_MULTRET);
         int poststacksize = lua_gettop( lua_state( ) );
         int returncount = poststacksize - (firstreturn - 1);
@@ -77,8 +84,8 @@ private:
     }
 
 public:
-    using reference::reference;
-    
+    using base_t::base_t;
+
     template<typename... Args>
     function_result operator()( Args&&... args ) const {
         return call<>( std::forward<Args>( args )... );
@@ -91,10 +98,42 @@ public:
 
     template<typename... Ret, typename... Args>
     decltype(auto) call( Args&&... args ) const {
-        push( );
+        this->push( );
         int pushcount = stack::multi_push( lua_state( ), std::forward<Args>( args )... );
         return invoke( types<Ret...>( ), std::index_sequence_for<Ret...>(), pushcount );
     }
+
+    // Pins the function to the top of the stack for repeated calls with a fixed signature
+    template<typename Sig>
+    call_site<Sig> bind( ) const {
+        return call_site<Sig>( *this );
+    }
+
+    // Calls the function once per element of [first, last), writing each result to out.
+    // The function stays on the stack for the whole batch
+    template<typename Ret, typename It, typename OutIt>
+    OutIt map( It first, It last, OutIt out ) const {
+        call_site<Ret(decltype(*first))> site( *this );
+        for ( ; first != last; ++first, ++out ) {
+            *out = site( *first );
+        }
+        return out;
+    }
+
+    template<typename It>
+    void for_each_call( It first, It last ) const {
+        call_site<void(decltype(*first))> site( *this );
+        for ( ; first != last; ++first ) {
+            site( *first );
+        }
+    }
+
+    template<typename Range>
+    void for_each_call( Range&& range ) const {
+        using std::begin;
+        using std::end;
+        for_each_call( begin( range ), end( range ) );
+    }
 };
 
 namespace stack {
@@ -115,6 +154,12 @@ struct pusher<function_sig<Sigs...>> {
         set(L, &fx_t::operator(), std::forward<Fx>(fx));
     }
 
+    // already a lua_CFunction (e.g. sol::c_call): pushed as is, with no upvalues
+    template<typename... Sig>
+    static void set(lua_State* L, lua_CFunction fxptr){
+        stack::push(L, fxptr);
+    }
+
     template<typename... Args, typename R>
     static void set(lua_State* L, R fxptr(Args...)){
         set_fx(std::false_type(), L, fxptr);
@@ -170,8 +215,7 @@ struct pusher<function_sig<Sigs...>> {
     template<typename Fx, typename R, typename... Args>
     static void set_isconvertible_fx(std::false_type, types<R(Args...)>, lua_State* L, Fx&& fx) {
         typedef meta::Unwrapped<std::decay_t<Fx>> fx_t;
-        std::unique_ptr<function_detail::base_function> sptr = std::make_unique<function_detail::functor_function<fx_t>>(std::forward<Fx>(fx));
-        set_fx(L, std::move(sptr));
+        set_inline_fx<function_detail::functor_function<fx_t>>(L, std::forward<Fx>(fx));
     }
 
     template<typename Fx, typename T>
@@ -182,8 +226,7 @@ struct pusher<function_sig<Sigs...>> {
     template<typename Fx, typename T>
     static void set_reference_fx(std::false_type, lua_State* L, Fx&& fx, T&& obj) {
         typedef std::remove_pointer_t<std::decay_t<Fx>> clean_fx;
-        std::unique_ptr<function_detail::base_function> sptr = std::make_unique<function_detail::member_function<clean_fx, meta::Unqualified<T>>>(std::forward<T>(obj), std::forward<Fx>(fx));
-        return set_fx(L, std::move(sptr));
+        set_inline_fx<function_detail::member_function<clean_fx, meta::Unqualified<T>>>(L, std::forward<T>(obj), std::forward<Fx>(fx));
     }
 
     template<typename Fx, typename T>
@@ -215,6 +258,11 @@ struct pusher<function_sig<Sigs...>> {
         stack::push(L, freefunc, upvalues);
     }
 
+    template<typename Fx, typename... Args>
+    static void set_inline_fx(lua_State* L, Args&&... args) {
+        function_detail::inline_function_storage<Fx>::push(L, std::forward<Args>(args)...);
+    }
+
     static void set_fx(lua_State* L, std::unique_ptr<function_detail::base_function> luafunc) {
         function_detail::base_function* target = luafunc.release();
         void* targetdata = static_cast<void*>(target);
@@ -257,12 +305,12 @@ struct pusher<std::function<Signature>> {
 template<typename... Functions>
 struct pusher<overload_set<Functions...>> {
     static int push(lua_State* L, overload_set<Functions...>&& set) {
-        pusher<function_sig<>>{}.set_fx(L, std::make_unique<function_detail::overloaded_function<Functions...>>(std::move(set.set)));
+        pusher<function_sig<>>{}.set_inline_fx<function_detail::overloaded_function<Functions...>>(L, std::move(set.set));
         return 1;
     }
 
     static int push(lua_State* L, const overload_set<Functions...>& set) {
-        pusher<function_sig<>>{}.set_fx(L, std::make_unique<function_detail::overloaded_function<Functions...>>(set.set));
+        pusher<function_sig<>>{}.set_inline_fx<function_detail::overloaded_function<Functions...>>(L, set.set);
         return 1;
     }
 };
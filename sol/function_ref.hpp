@@ -0,0 +1,127 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_FUNCTION_REF_HPP
+#define SOL_FUNCTION_REF_HPP
+
+#include "call_site.hpp"
+
+namespace sol {
+template <typename Sig>
+class function_ref;
+
+// A move-only handle to a Lua function with a fixed signature: just the state and a registry reference.
+// Unlike std::function<Sig> it never allocates and calls with the arity and return conversion known
+// at compile time. It can be taken as a parameter by C++ functions bound to Lua
+template <typename R, typename... Args>
+class function_ref<R(Args...)> {
+private:
+    lua_State* L = nullptr; // non-owning
+    int ref = LUA_NOREF;
+
+    void results(types<void>) const {}
+
+    template <typename T>
+    T results(types<T>) const {
+        return stack::pop<T>(L);
+    }
+
+public:
+    function_ref() noexcept = default;
+
+    function_ref(lua_State* L, int index = -1) : L(L) {
+        type_assert(L, index, type::function);
+        lua_pushvalue(L, index);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    template <typename Fx, meta::EnableIf<is_lua_reference<meta::Unqualified<Fx>>> = 0>
+    explicit function_ref(const Fx& fx) : L(fx.lua_state()) {
+        fx.push();
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    function_ref(const function_ref&) = delete;
+    function_ref& operator=(const function_ref&) = delete;
+
+    function_ref(function_ref&& o) noexcept : L(o.L), ref(o.ref) {
+        o.L = nullptr;
+        o.ref = LUA_NOREF;
+    }
+
+    function_ref& operator=(function_ref&& o) noexcept {
+        if (this != &o) {
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+            L = o.L;
+            ref = o.ref;
+            o.L = nullptr;
+            o.ref = LUA_NOREF;
+        }
+        return *this;
+    }
+
+    ~function_ref() {
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    }
+
+    R operator()(Args... args) const {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        int pushcount = stack::multi_push(L, args...);
+        lua_callk(L, pushcount, detail::return_count<R>::value, 0, nullptr);
+        return results(types<R>());
+    }
+
+    int push() const noexcept {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        return 1;
+    }
+
+    bool valid() const noexcept {
+        return ref != LUA_NOREF && ref != LUA_REFNIL;
+    }
+
+    explicit operator bool() const noexcept {
+        return valid();
+    }
+
+    lua_State* lua_state() const noexcept {
+        return L;
+    }
+};
+
+namespace stack {
+template <typename Sig>
+struct getter<function_ref<Sig>> {
+    static function_ref<Sig> get(lua_State* L, int index = -1) {
+        return function_ref<Sig>(L, index);
+    }
+};
+
+template <typename Sig>
+struct pusher<function_ref<Sig>> {
+    static int push(lua_State*, const function_ref<Sig>& fx) {
+        return fx.push();
+    }
+};
+} // stack
+} // sol
+
+#endif // SOL_FUNCTION_REF_HPP
@@ -57,35 +57,55 @@ inline int construct(Match&& matchfx, lua_State* L, int fxarity, int start) {
     return overload_match_arity<decltype(detail::void_call<T, TypeLists>::call)...>(std::forward<Match>(matchfx), L, fxarity, start);
 }
 
-template <typename T, typename... TypeLists>
-inline int construct(lua_State* L) {
-    static const auto& meta = usertype_traits<T>::metatable;
-    call_syntax syntax = stack::get_call_syntax(L, meta);
-    int argcount = lua_gettop(L) - static_cast<int>(syntax);
-
-    T** pointerpointer = reinterpret_cast<T**>(lua_newuserdata(L, sizeof(T*) + sizeof(T)));
-    T*& referencepointer = *pointerpointer;
-    T* obj = reinterpret_cast<T*>(pointerpointer + 1);
-    referencepointer = obj;
-    reference userdataref(L, -1);
-    userdataref.pop();
-        
-    construct<T, TypeLists...>(detail::constructor_match<T>(obj), L, argcount, 1 + static_cast<int>(syntax));
-
-    userdataref.push();
-    luaL_getmetatable(L, &meta[0]);
-    if (stack::get<type>(L) == type::nil) {
-        lua_pop(L, 1);
-        return luaL_error(L, "sol: unable to get usertype metatable");
+// Makes the userdata for a new T and moves it, with T's metatable, below the arguments: the new object
+// is kept alive by its stack slot instead of a registry reference, and the arguments are read where they are.
+// The one metatable lookup also tells T.new(...) from T:new(...), whose first argument is that same table
+template <typename T>
+inline T* construct_begin(lua_State* L, int& argcount, int& start) {
+    int top = lua_gettop(L);
+    if (stack::stack_detail::get_metatable<T>(L) == type::nil) {
+        luaL_error(L, "sol: unable to get usertype metatable for %s", usertype_traits<T>::name().c_str());
+        return nullptr;
     }
+    int syntax = top > 0 && lua_rawequal(L, 1, -1) == 1 ? 1 : 0;
+    T* obj = detail::usertype_storage<T>::allocate(L);
+    lua_insert(L, 1);
+    lua_insert(L, 2);
+    argcount = top - syntax;
+    start = 3 + syntax;
+    return obj;
+}
 
-    lua_setmetatable(L, -2);
+inline int construct_end(lua_State* L) {
+    lua_settop(L, 2);
+    lua_setmetatable(L, 1);
     return 1;
 }
 
+template <typename T, typename... TypeLists>
+inline int construct(lua_State* L) {
+    int argcount = 0;
+    int start = 0;
+    T* obj = construct_begin<T>(L, argcount, start);
+    construct<T, TypeLists...>(detail::constructor_match<T>(obj), L, argcount, start);
+    return construct_end(L);
+}
+
+template <typename T>
+inline void defer_destruct(std::false_type, lua_State*, T&) {}
+
+template <typename T>
+inline void defer_destruct(std::true_type, lua_State* L, T& obj) {
+    finalizer_queue* q = finalizer_detail::find(L);
+    if (q != nullptr) {
+        q->defer(std::move(obj));
+    }
+}
+
 template <typename T>
 inline int destruct(lua_State* L) {
     T* obj = stack::get<non_null<T*>>(L, 1);
+    defer_destruct(is_destruction_deferred<T>(), L, *obj);
     std::allocator<T> alloc{};
     alloc.destroy(obj);
     return 0;
@@ -105,37 +125,18 @@ struct usertype_constructor_function : base_function {
     usertype_constructor_function(Functions... fxs) : overloads(fxs...) {}
 
     template <typename Fx, std::size_t I, typename... R, typename... Args>
-    int call(types<Fx>, Index<I>, types<R...> r, types<Args...> a, lua_State* L, int, int start) {
-        static const auto& meta = usertype_traits<T>::metatable;
-        T** pointerpointer = reinterpret_cast<T**>(lua_newuserdata(L, sizeof(T*) + sizeof(T)));
-        T*& referencepointer = *pointerpointer;
-        T* obj = reinterpret_cast<T*>(pointerpointer + 1);
-        referencepointer = obj;
-        reference userdataref(L, -1);
-        userdataref.pop();
-
+    int call(T* obj, types<Fx>, Index<I>, types<R...> r, types<Args...> a, lua_State* L, int, int start) {
         auto& func = std::get<I>(overloads);
-        stack::call_into_lua<false>(r, a, func, L, start, function_detail::implicit_wrapper<T>(obj));
-
-        userdataref.push();
-        luaL_getmetatable(L, &meta[0]);
-        if (stack::get<type>(L) == type::nil) {
-            lua_pop(L, 1);
-            std::string err = "sol: unable to get usertype metatable for ";
-            err += usertype_traits<T>::name;
-            return luaL_error(L, err.c_str());
-        }
-        lua_setmetatable(L, -2);
-            
-        return 1;
+        return stack::call_into_lua<false>(r, a, func, L, start, function_detail::implicit_wrapper<T>(obj));
     }
 
     virtual int operator()(lua_State* L) override {
-        static const auto& meta = usertype_traits<T>::metatable;
-        call_syntax syntax = stack::get_call_syntax(L, meta);
-        int argcount = lua_gettop(L) - static_cast<int>(syntax);
-        auto mfx = [&](auto&&... args) { return this->call(std::forward<decltype(args)>(args)...); };
-        return construct<T, meta::pop_front_type_t<meta::function_args_t<Functions>>...>(mfx, L, argcount, 1 + static_cast<int>(syntax));
+        int argcount = 0;
+        int start = 0;
+        T* obj = construct_begin<T>(L, argcount, start);
+        auto mfx = [&](auto&&... args) { return this->call(obj, std::forward<decltype(args)>(args)...); };
+        construct<T, meta::pop_front_type_t<meta::function_args_t<Functions>>...>(mfx, L, argcount, start);
+        return construct_end(L);
     }
 };
 } // function_detail
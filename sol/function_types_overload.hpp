@@ -25,6 +25,12 @@
 #include "overload.hpp"
 #include "function_types_core.hpp"
 #include "function_types_usertype.hpp"
+#ifdef SOL_OVERLOAD_CACHE
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iterator>
+#endif // SOL_OVERLOAD_CACHE
 
 namespace sol {
 namespace function_detail {
@@ -39,40 +45,226 @@ struct overload_traits<functor<T, Func, X>> {
     static const std::size_t arity = functor<T, Func, X>::arity;
 };
 
-template <std::size_t... M, typename Match, typename... Args>
-inline int overload_match_arity(types<>, std::index_sequence<>, std::index_sequence<M...>, Match&&, lua_State* L, int, int, Args&&...) {
+// How many overloads take exactly `arity` arguments: buckets with a single
+// candidate need no type checks to be told apart from the rest
+template <std::size_t arity, typename... Fxs>
+struct arity_bucket_size : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t arity, typename Fx, typename... Fxs>
+struct arity_bucket_size<arity, Fx, Fxs...> : std::integral_constant<std::size_t, (overload_traits<meta::Unqualified<Fx>>::arity == arity ? 1 : 0) + arity_bucket_size<arity, Fxs...>::value> {};
+
+template <typename... Fxs>
+struct overload_bucket_traits {
+    template <std::size_t arity>
+    using unique = meta::Bool<arity_bucket_size<arity, Fxs...>::value == 1>;
+};
+
+template <typename... Fxs>
+struct overload_max_arity : std::integral_constant<std::size_t, 0> {};
+
+template <typename Fx, typename... Fxs>
+struct overload_max_arity<Fx, Fxs...> : std::integral_constant<std::size_t, (overload_traits<meta::Unqualified<Fx>>::arity > overload_max_arity<Fxs...>::value ? overload_traits<meta::Unqualified<Fx>>::arity : overload_max_arity<Fxs...>::value)> {};
+
+inline int overload_no_match(lua_State* L) {
     return luaL_error(L, "sol: no matching function call takes this number of arguments and the specified types");
 }
 
-template <typename Fx, typename... Fxs, std::size_t I, std::size_t... In, std::size_t... M, typename Match, typename... Args>
-inline int overload_match_arity(types<Fx, Fxs...>, std::index_sequence<I, In...>, std::index_sequence<M...>, Match&& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
+// Tries the overloads of one arity in order; the others are skipped at compile time
+template <int arity, typename Buckets, typename Match, typename... Args>
+inline int overload_match_bucket(Buckets, types<>, std::index_sequence<>, Match&, lua_State* L, int, Args&&...) {
+    return overload_no_match(L);
+}
+
+template <int arity, typename Buckets, typename Fx, typename... Fxs, std::size_t I, std::size_t... In, typename Match, typename... Args>
+inline int overload_match_candidate(std::false_type, Buckets buckets, types<Fx, Fxs...>, std::index_sequence<I, In...>, Match& matchfx, lua_State* L, int start, Args&&... args) {
+    return overload_match_bucket<arity>(buckets, types<Fxs...>(), std::index_sequence<In...>(), matchfx, L, start, std::forward<Args>(args)...);
+}
+
+template <int arity, typename Buckets, typename Fx, typename... Fxs, std::size_t I, std::size_t... In, typename Match, typename... Args>
+inline int overload_match_candidate(std::true_type, Buckets buckets, types<Fx, Fxs...>, std::index_sequence<I, In...>, Match& matchfx, lua_State* L, int start, Args&&... args) {
     typedef overload_traits<meta::Unqualified<Fx>> traits;
     typedef meta::tuple_types<typename traits::return_type> return_types;
     typedef typename traits::args_type args_type;
     typedef typename args_type::indices args_indices;
-    // compile-time eliminate any functions that we know ahead of time are of improper arity
-    if (meta::find_in_pack_v<Index<traits::arity>, Index<M>...>::value) {
-        return overload_match_arity(types<Fxs...>(), std::index_sequence<In...>(), std::index_sequence<M...>(), std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+    typedef typename Buckets::template unique<traits::arity> unique_in_bucket;
+    // the only overload of this arity: nothing else could be picked, so the checks are
+    // only worth it if the user asked for argument checking everywhere
+    if (!unique_in_bucket::value || stack::stack_detail::default_check_arguments) {
+        if (!stack::stack_detail::check_types<true>().check(args_type(), args_indices(), L, start, no_panic)) {
+            return overload_match_bucket<arity>(buckets, types<Fxs...>(), std::index_sequence<In...>(), matchfx, L, start, std::forward<Args>(args)...);
+        }
+    }
+    return matchfx(types<Fx>(), Index<I>(), return_types(), args_type(), L, arity, start, std::forward<Args>(args)...);
+}
+
+template <int arity, typename Buckets, typename Fx, typename... Fxs, std::size_t I, std::size_t... In, typename Match, typename... Args>
+inline int overload_match_bucket(Buckets buckets, types<Fx, Fxs...> t, std::index_sequence<I, In...> i, Match& matchfx, lua_State* L, int start, Args&&... args) {
+    typedef meta::Bool<overload_traits<meta::Unqualified<Fx>>::arity == static_cast<std::size_t>(arity)> in_bucket;
+    return overload_match_candidate<arity>(in_bucket(), buckets, t, i, matchfx, L, start, std::forward<Args>(args)...);
+}
+
+template <int arity, typename Buckets, typename List, typename Indices, typename Match, typename... Args>
+int overload_bucket_entry(Match& matchfx, lua_State* L, int start, Args&&... args) {
+    return overload_match_bucket<arity>(Buckets(), List(), Indices(), matchfx, L, start, std::forward<Args>(args)...);
+}
+
+// One entry point per arity, from 0 to the largest one in the set: the number of arguments
+// picks the bucket with a single indexed call, and only that bucket's overloads are checked
+template <typename... Functions, std::size_t... Arities, typename Match, typename... Args>
+inline int overload_dispatch_arity(std::index_sequence<Arities...>, Match& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
+    typedef int(*entry)(Match&, lua_State*, int, Args&&...);
+    static const entry entries[] = { &overload_bucket_entry<static_cast<int>(Arities), overload_bucket_traits<Functions...>, types<Functions...>, std::index_sequence_for<Functions...>, Match, Args...>... };
+    if (fxarity < 0 || static_cast<std::size_t>(fxarity) >= sizeof...(Arities)) {
+        return overload_no_match(L);
     }
-    if (traits::arity != fxarity) {
-        return overload_match_arity(types<Fxs...>(), std::index_sequence<In...>(), std::index_sequence<traits::arity, M...>(), std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+    return entries[fxarity](matchfx, L, start, std::forward<Args>(args)...);
+}
+
+template <typename... Functions, typename Match, typename... Args>
+inline int overload_match_arity(Match& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
+    return overload_dispatch_arity<Functions...>(std::make_index_sequence<overload_max_arity<Functions...>::value + 1>(), matchfx, L, fxarity, start, std::forward<Args>(args)...);
+}
+
+#ifdef SOL_OVERLOAD_CACHE
+// What a call's arguments look like to the checkers: the Lua type of each one and, for userdata,
+// its usertype identity. Two calls with the same signature resolve to the same overload
+struct overload_signature {
+    static const int max_arguments = 8;
+    int arity = -1;
+    std::size_t index = 0;
+    std::array<int, max_arguments> tags;
+    std::array<const void*, max_arguments> identities;
+
+    // false when the arguments cannot be summed up this way: too many of them, or foreign userdata
+    bool read(lua_State* L, int start, int count) {
+        if (count > max_arguments) {
+            return false;
+        }
+        for (int i = 0; i < count; ++i) {
+            tags[i] = lua_type(L, start + i);
+            identities[i] = nullptr;
+            if (tags[i] != LUA_TUSERDATA) {
+                continue;
+            }
+            if (lua_getmetatable(L, start + i) == 0) {
+                return false;
+            }
+            identities[i] = detail::get_identity(L);
+            lua_pop(L, 1);
+            if (identities[i] == nullptr) {
+                return false;
+            }
+        }
+        arity = count;
+        return true;
     }
-    if (!stack::stack_detail::check_types<true>().check(args_type(), args_indices(), L, start, no_panic)) {
-        return overload_match_arity(types<Fxs...>(), std::index_sequence<In...>(), std::index_sequence<M...>(), std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+
+    bool same(const overload_signature& o) const {
+        if (arity != o.arity) {
+            return false;
+        }
+        for (int i = 0; i < arity; ++i) {
+            if (tags[i] != o.tags[i] || identities[i] != o.identities[i]) {
+                return false;
+            }
+        }
+        return true;
     }
-    return matchfx(types<Fx>(), Index<I>(), return_types(), args_type(), L, fxarity, start, std::forward<Args>(args)...);
+};
+
+// Whether a string passes for an enum depends on the string, not its type: a signature cannot
+// stand for such a call, so overload sets taking an enum are never cached
+template <typename Args>
+struct takes_enum;
+
+template <typename... Args>
+struct takes_enum<types<Args...>> : meta::Or<std::is_enum<meta::Unqualified<Args>>...> {};
+
+template <typename Match, typename... Args>
+inline int overload_call_index(types<>, std::index_sequence<>, std::size_t, Match&&, lua_State* L, int, int, Args&&...) {
+    return overload_no_match(L);
+}
+
+template <typename Fx, typename... Fxs, std::size_t I, std::size_t... In, typename Match, typename... Args>
+inline int overload_call_index(types<Fx, Fxs...>, std::index_sequence<I, In...>, std::size_t index, Match&& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
+    if (index != I) {
+        return overload_call_index(types<Fxs...>(), std::index_sequence<In...>(), index, std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+    }
+    typedef overload_traits<meta::Unqualified<Fx>> traits;
+    return matchfx(types<Fx>(), Index<I>(), meta::tuple_types<typename traits::return_type>(), typename traits::args_type(), L, fxarity, start, std::forward<Args>(args)...);
 }
+
+// The signature of the last call that matched, kept by each overloaded function. Usertype functions
+// are shared by every state they are pushed into: a call that finds the cache in use by another
+// thread goes through the full search rather than wait for it
+struct overload_cache {
+    overload_signature last;
+    std::atomic<bool> busy;
+
+    overload_cache() : busy(false) {}
+    // a copied function starts out with nothing remembered
+    overload_cache(const overload_cache&) : overload_cache() {}
+    overload_cache& operator=(const overload_cache&) {
+        return *this;
+    }
+
+    bool acquire() {
+        return !busy.exchange(true, std::memory_order_acquire);
+    }
+
+    void release() {
+        busy.store(false, std::memory_order_release);
+    }
+};
+
+template <typename... Functions, typename Match, typename... Args>
+inline int overload_match_cached(overload_cache& cache, Match&& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
+    static const int arities[] = { static_cast<int>(overload_traits<meta::Unqualified<Functions>>::arity)... };
+    typedef meta::Or<takes_enum<typename overload_traits<meta::Unqualified<Functions>>::args_type>...> uncacheable;
+    // a lone overload of this arity is taken without any checks: nothing to save there
+    if (uncacheable::value || (!stack::stack_detail::default_check_arguments && std::count(std::begin(arities), std::end(arities), fxarity) < 2)) {
+        return overload_match_arity<Functions...>(matchfx, L, fxarity, start, std::forward<Args>(args)...);
+    }
+    overload_signature now;
+    if (!now.read(L, start, fxarity) || !cache.acquire()) {
+        return overload_match_arity<Functions...>(matchfx, L, fxarity, start, std::forward<Args>(args)...);
+    }
+    // let go of the cache before calling anything: the call may come back into this function
+    bool hit = now.same(cache.last);
+    std::size_t remembered = cache.last.index;
+    cache.release();
+    if (hit) {
+        return overload_call_index(types<Functions...>(), std::index_sequence_for<Functions...>(), remembered, std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+    }
+    auto remember = [&](auto tfx, auto index, auto r, auto a, lua_State* state, int count, int first, auto&&... rest) {
+        now.index = decltype(index)::value;
+        if (cache.acquire()) {
+            cache.last = now;
+            cache.release();
+        }
+        return matchfx(tfx, index, r, a, state, count, first, std::forward<decltype(rest)>(rest)...);
+    };
+    return overload_match_arity<Functions...>(remember, L, fxarity, start, std::forward<Args>(args)...);
+}
+#else
+struct overload_cache {};
+#endif // SOL_OVERLOAD_CACHE
 } // internals
 
 template <typename... Functions, typename Match, typename... Args>
 inline int overload_match_arity(Match&& matchfx, lua_State* L, int fxarity, int start, Args&&... args) {
-    return internals::overload_match_arity(types<Functions...>(), std::index_sequence_for<Functions...>(), std::index_sequence<>(), std::forward<Match>(matchfx), L, fxarity,  start, std::forward<Args>(args)...);
+    return internals::overload_match_arity<Functions...>(matchfx, L, fxarity, start, std::forward<Args>(args)...);
 }
 
 template <typename... Functions, typename Match, typename... Args>
-inline int overload_match(Match&& matchfx, lua_State* L, int start, Args&&... args) {
+inline int overload_match(internals::overload_cache& cache, Match&& matchfx, lua_State* L, int start, Args&&... args) {
      int fxarity = lua_gettop(L) - (start - 1);
+#ifdef SOL_OVERLOAD_CACHE
+     return internals::overload_match_cached<Functions...>(cache, std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+#else
+     (void)cache;
      return overload_match_arity<Functions...>(std::forward<Match>(matchfx), L, fxarity, start, std::forward<Args>(args)...);
+#endif // SOL_OVERLOAD_CACHE
 }
 
 template <typename... Functions>
@@ -80,6 +272,7 @@ struct overloaded_function : base_function {
     typedef std::tuple<Functions...> overload_list;
     typedef std::index_sequence_for<Functions...> indices;
     overload_list overloads;
+    internals::overload_cache cache;
 
     overloaded_function(overload_list set)
     : overloads(std::move(set)) {}
@@ -97,7 +290,7 @@ struct overloaded_function : base_function {
 
     virtual int operator()(lua_State* L) override {
         auto mfx = [&](auto&&... args){ return this->call(std::forward<decltype(args)>(args)...); };
-        return overload_match<Functions...>(mfx, L, 1);
+        return overload_match<Functions...>(cache, mfx, L, 1);
     }
 };
 
@@ -106,19 +299,19 @@ struct usertype_overloaded_function : base_function {
     typedef std::tuple<functor<T, std::remove_pointer_t<std::decay_t<Functions>>>...> overload_list;
     typedef std::index_sequence_for<Functions...> indices;
     overload_list overloads;
+    internals::overload_cache cache;
     
     usertype_overloaded_function(std::tuple<Functions...> set) : overloads(std::move(set)) {}
 
     template <typename Fx, std::size_t I, typename... R, typename... Args>
     int call(types<Fx>, Index<I>, types<R...> r, types<Args...> a, lua_State* L, int, int start) {
         auto& func = std::get<I>(overloads);
-        func.item = detail::ptr(stack::get<T>(L, 1));
-        return stack::call_into_lua<false>(r, a, func, L, start);
+        return stack::call_into_lua<false>(r, a, func, L, start, *detail::ptr(stack::get<T>(L, 1)));
     }
 
     virtual int operator()(lua_State* L) override {
         auto mfx = [&](auto&&... args){ return this->call(std::forward<decltype(args)>(args)...); };
-        return overload_match<functor<T, std::remove_pointer_t<std::decay_t<Functions>>>...>(mfx, L, 2);
+        return overload_match<functor<T, std::remove_pointer_t<std::decay_t<Functions>>>...>(cache, mfx, L, 2);
     }
 };
 } // function_detail
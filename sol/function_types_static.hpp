@@ -95,7 +95,54 @@ struct upvalue_this_member_function {
         return call(L);
     }
 };
+
+template<typename F>
+struct member_class;
+
+template<typename R, typename T>
+struct member_class<R T::*> {
+    typedef T type;
+};
+
+// The target is a template argument: no upvalues to read, and the call can be inlined
+template<typename F, F fx, bool is_member = std::is_member_function_pointer<F>::value>
+struct compile_time_function {
+    typedef meta::function_traits<F> traits_type;
+
+    static int real_call(lua_State* L) {
+        return stack::call_into_lua(meta::tuple_types<typename traits_type::return_type>(), typename traits_type::args_type(), fx, L, 1);
+    }
+
+    static int call (lua_State* L) {
+        return detail::static_trampoline<(&real_call)>(L);
+    }
+};
+
+template<typename F, F fx>
+struct compile_time_function<F, fx, true> {
+    typedef meta::function_traits<F> traits_type;
+    typedef typename member_class<F>::type T;
+
+    static int real_call(lua_State* L) {
+        auto f = [](lua_State* L, auto&&... args) -> typename traits_type::return_type {
+            T& item = stack::get<T>(L, 1);
+            return (item.*fx)(std::forward<decltype(args)>(args)...);
+        };
+        return stack::call_into_lua(meta::tuple_types<typename traits_type::return_type>(), typename traits_type::args_type(), f, L, 2, L);
+    }
+
+    static int call (lua_State* L) {
+        return detail::static_trampoline<(&real_call)>(L);
+    }
+};
 } // function_detail
+
+// A lua_CFunction calling fx, e.g. sol::c_call<decltype(&f), &f>.
+// Member functions take the object as their first argument (as with obj:f())
+template<typename F, F fx>
+inline int c_call(lua_State* L) {
+    return function_detail::compile_time_function<F, fx>::call(L);
+}
 } // sol
 
 #endif // SOL_FUNCTION_TYPES_STATIC_HPP
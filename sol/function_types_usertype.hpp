@@ -24,7 +24,8 @@
 
 #include "overload.hpp"
 #include "function_types_core.hpp"
-#include <map>
+#include <vector>
+#include <algorithm>
 
 namespace sol {
 namespace function_detail {
@@ -43,8 +44,8 @@ struct usertype_function_core : public base_function {
     usertype_function_core(Args&&... args): fx(std::forward<Args>(args)...) {}
 
     template<typename Return, typename Raw = meta::Unqualified<Return>>
-    std::enable_if_t<std::is_same<T, Raw>::value, int> push(lua_State* L, Return&& r) {
-        if(detail::ptr(detail::unwrap(r)) == fx.item) {
+    std::enable_if_t<std::is_same<T, Raw>::value, int> push(lua_State* L, T* self, Return&& r) {
+        if(detail::ptr(detail::unwrap(r)) == self) {
             // push nothing
             // note that pushing nothing with the ':'
             // syntax means we leave the instance of what
@@ -59,24 +60,24 @@ struct usertype_function_core : public base_function {
     }
 
     template<typename Return, typename Raw = meta::Unqualified<Return>>
-    std::enable_if_t<!std::is_same<T, Raw>::value, int> push(lua_State* L, Return&& r) {
+    std::enable_if_t<!std::is_same<T, Raw>::value, int> push(lua_State* L, T*, Return&& r) {
         return stack::push(L, std::forward<Return>(r));
     }
 
     template<typename... Args, std::size_t Start>
-    int operator()(types<void> tr, types<Args...> ta, Index<Start>, lua_State* L) {
-        stack::call(tr, ta, L, static_cast<int>(Start), fx);
+    int operator()(types<void> tr, types<Args...> ta, Index<Start>, lua_State* L, T* self) {
+        stack::call(tr, ta, L, static_cast<int>(Start), fx, *self);
         int nargs = static_cast<int>(sizeof...(Args));
         lua_pop(L, nargs);
         return 0;
     }
 
     template<typename... Ret, typename... Args, std::size_t Start>
-    int operator()(types<Ret...> tr, types<Args...> ta, Index<Start>, lua_State* L) {
-        decltype(auto) r = stack::call(tr, ta, L, static_cast<int>(Start), fx);
+    int operator()(types<Ret...> tr, types<Args...> ta, Index<Start>, lua_State* L, T* self) {
+        decltype(auto) r = stack::call(tr, ta, L, static_cast<int>(Start), fx, *self);
         int nargs = static_cast<int>(sizeof...(Args));
         lua_pop(L, nargs);
-        int pushcount = push(L, std::forward<decltype(r)>(r));
+        int pushcount = push(L, self, std::forward<decltype(r)>(r));
         return pushcount;
     }
 };
@@ -93,11 +94,11 @@ struct usertype_function : public usertype_function_core<Function, Tp> {
     usertype_function(Args&&... args): base_t(std::forward<Args>(args)...) {}
 
     int prelude(lua_State* L) {
-        this->fx.item = detail::ptr(stack::get<T>(L, 1));
-        if(this->fx.item == nullptr) {
+        T* self = detail::ptr(stack::get<T>(L, 1));
+        if(self == nullptr) {
             return luaL_error(L, "sol: userdata for function call is null: are you using the wrong syntax? (use item:function/variable(...) syntax)");
         }
-        return static_cast<base_t&>(*this)(meta::tuple_types<return_type>(), args_type(), Index<2>(), L);
+        return static_cast<base_t&>(*this)(meta::tuple_types<return_type>(), args_type(), Index<2>(), L, self);
     }
 
     virtual int operator()(lua_State* L) override {
@@ -118,15 +119,15 @@ struct usertype_variable_function : public usertype_function_core<Function, Tp>
 
     int prelude(lua_State* L) {
         int argcount = lua_gettop(L);
-        this->fx.item = stack::get<T*>(L, 1);
-        if(this->fx.item == nullptr) {
+        T* self = stack::get<T*>(L, 1);
+        if(self == nullptr) {
             return luaL_error(L, "sol: userdata for member variable is null");
         }
         switch(argcount) {
         case 2:
-            return static_cast<base_t&>(*this)(meta::tuple_types<return_type>(), types<>(), Index<2>(), L);
+            return static_cast<base_t&>(*this)(meta::tuple_types<return_type>(), types<>(), Index<2>(), L, self);
         case 3:
-            return static_cast<base_t&>(*this)(meta::tuple_types<void>(), args_type(), Index<3>(), L);
+            return static_cast<base_t&>(*this)(meta::tuple_types<void>(), args_type(), Index<3>(), L, self);
         default:
             return luaL_error(L, "sol: cannot get/set userdata member variable with inappropriate number of arguments");
         }
@@ -137,33 +138,241 @@ struct usertype_variable_function : public usertype_function_core<Function, Tp>
     }
 };
 
+// A plain lua_CFunction registered on a usertype: the metatable gets the function itself,
+// this is only used when it has to be reached through __index
+struct usertype_cfunction : base_function {
+    lua_CFunction fx;
+
+    usertype_cfunction(lua_CFunction fx) : fx(fx) {}
+
+    virtual int operator()(lua_State* L) override {
+        return fx(L);
+    }
+};
+
 struct usertype_indexing_function : base_function {
+    typedef std::pair<bool, base_function*> member_t;
+    typedef std::vector<std::pair<std::string, member_t>> member_list_t;
     std::string name;
     base_function* original;
-    std::map<std::string, std::pair<bool, base_function*>> functions;
+    member_list_t functions;
+    // a plain table of name -> method closure, or name -> slot in functions for variables,
+    // kept in each state's registry under this object's address until the state lets go of it:
+    // finding a member is then a single raw get, however many variables there are
 
     template<typename... Args>
-    usertype_indexing_function(std::string name, base_function* original, Args&&... args): name(std::move(name)), original(original), functions(std::forward<Args>(args)...) {}
+    usertype_indexing_function(std::string name, base_function* original, Args&&... args): name(std::move(name)), original(original), functions(std::forward<Args>(args)...) {
+        // keep the first registration of a name, just like a map insert would
+        std::stable_sort(functions.begin(), functions.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+        functions.erase(std::unique(functions.begin(), functions.end(), [](const auto& l, const auto& r) { return l.first == r.first; }), functions.end());
+    }
 
-    int prelude(lua_State* L) {
-        const char* accessor = stack::get<const char*>(L, 1 - lua_gettop(L));
-        auto functionpair = functions.find(accessor);
-        if (functionpair != functions.end()) {
-            std::pair<bool, base_function*>& target = functionpair->second;
-            if (target.first) {
-                stack::push<light_userdata_value>(L, target.second);
+    // Pushes the lookup table for this state, making it the first time through
+    void push_lookup(lua_State* L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, this);
+        if (lua_type(L, -1) == LUA_TTABLE) {
+            return;
+        }
+        lua_pop(L, 1);
+        lua_createtable(L, 0, static_cast<int>(functions.size()));
+        for (std::size_t i = 0; i < functions.size(); ++i) {
+            auto& f = functions[i];
+            lua_pushlstring(L, f.first.data(), f.first.size());
+            if (f.second.first) {
+                stack::push<light_userdata_value>(L, f.second.second);
                 stack::push(L, c_closure(usertype_call<0>, 1));
-                return 1;
             }
-            return (*target.second)(L);
-       }
-       base_function& core = *original;
-       return core(L);
+            else {
+                lua_pushinteger(L, static_cast<lua_Integer>(i));
+            }
+            lua_rawset(L, -3);
+        }
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+    }
+
+    // Pushes the closure to use as __index/__newindex:
+    // the lookup table rides along as an upvalue so it's never fetched from the registry.
+    // fallbacks is the index of an array of the bases' __index/__newindex, searched on a miss
+    void push(lua_State* L, int fallbacks = 0) {
+        push_lookup(L);
+        stack::push<light_userdata_value>(L, this);
+        if (fallbacks != 0) {
+            lua_pushvalue(L, fallbacks);
+        }
+        else {
+            lua_pushnil(L);
+        }
+        lua_pushcclosure(L, &call, 3);
+    }
+
+    // Leaves the result with only the arguments below it
+    static int keep_top(lua_State* L, int nargs) {
+        lua_replace(L, nargs + 1);
+        lua_settop(L, nargs + 1);
+        return 1;
+    }
+
+    // Looks the key (argument 2) up in every base behind the array at fallbacks, depth first in the
+    // order they were declared. Bases registered by sol are searched through their lookup tables directly:
+    // a method found there is left on the stack with method set, a variable is called in place.
+    // A base's own __index/__newindex answers before that base's bases are searched.
+    // Returns -1 if no base knows the key
+    static int search_bases(lua_State* L, int nargs, int fallbacks, bool& method) {
+        int count = static_cast<int>(lua_rawlen(L, fallbacks));
+        for (int i = 1; i <= count; ++i) {
+            lua_rawgeti(L, fallbacks, i);
+            int f = lua_gettop(L);
+            if (lua_tocfunction(L, f) == &call) {
+                lua_getupvalue(L, f, 1);
+                lua_pushvalue(L, 2);
+                lua_rawget(L, -2);
+                switch (lua_type(L, -1)) {
+                case LUA_TFUNCTION:
+                    method = true;
+                    return keep_top(L, nargs);
+                case LUA_TNUMBER: {
+                    std::size_t slot = static_cast<std::size_t>(lua_tointeger(L, -1));
+                    lua_getupvalue(L, f, 2);
+                    usertype_indexing_function& base = *static_cast<usertype_indexing_function*>(lua_touserdata(L, -1));
+                    lua_settop(L, nargs);
+                    return (*base.functions[slot].second.second)(L);
+                }
+                default:
+                    break;
+                }
+                lua_settop(L, f);
+                lua_getupvalue(L, f, 2);
+                usertype_indexing_function& base = *static_cast<usertype_indexing_function*>(lua_touserdata(L, -1));
+                if (base.original != nullptr) {
+                    lua_settop(L, nargs);
+                    return (*base.original)(L);
+                }
+                lua_getupvalue(L, f, 3);
+                if (lua_type(L, -1) == LUA_TTABLE) {
+                    int r = search_bases(L, nargs, lua_gettop(L), method);
+                    if (r >= 0) {
+                        return r;
+                    }
+                }
+            }
+            else if (lua_type(L, f) == LUA_TTABLE && nargs == 2) {
+                lua_pushvalue(L, 2);
+                lua_gettable(L, f);
+                if (lua_type(L, -1) != LUA_TNIL) {
+                    return keep_top(L, nargs);
+                }
+            }
+            else if (lua_type(L, f) == LUA_TFUNCTION) {
+                // anything else gets the same arguments, and has the last word
+                for (int arg = 1; arg <= nargs; ++arg) {
+                    lua_pushvalue(L, arg);
+                }
+                lua_call(L, nargs, nargs == 2 ? 1 : 0);
+                if (nargs != 2) {
+                    lua_settop(L, nargs);
+                    return 0;
+                }
+                return keep_top(L, nargs);
+            }
+            lua_settop(L, f - 1);
+        }
+        return -1;
+    }
+
+    static int chain_search(lua_State* L) {
+        int nargs = lua_gettop(L);
+        bool method = false;
+        int r = search_bases(L, nargs, lua_upvalueindex(1), method);
+        if (r >= 0) {
+            return r;
+        }
+        if (nargs > 2) {
+            return luaL_error(L, "sol: cannot set a member that does not exist on this usertype");
+        }
+        lua_settop(L, nargs);
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // __index/__newindex for usertypes with bases but no members of their own
+    static int chain(lua_State* L) {
+        return detail::static_trampoline<&chain_search>(L);
+    }
+
+    static int dispatch(lua_State* L, usertype_indexing_function& self) {
+        // the result of looking up the key sits on top
+        switch (lua_type(L, -1)) {
+        case LUA_TFUNCTION:
+            return 1;
+        case LUA_TNUMBER: {
+            std::size_t slot = static_cast<std::size_t>(lua_tointeger(L, -1));
+            lua_pop(L, 1);
+            base_function& variable = *self.functions[slot].second.second;
+#ifdef SOL_BINDING_STATS
+            return binding_stats_detail::timed_call(L, &variable, [&variable](lua_State* L) { return variable(L); });
+#else
+            return variable(L);
+#endif // SOL_BINDING_STATS
+        }
+        default:
+            lua_pop(L, 1);
+            break;
+        }
+        // the type's own __index/__newindex comes before anything inherited
+        if (self.original != nullptr) {
+            base_function& core = *self.original;
+#ifdef SOL_BINDING_STATS
+            return binding_stats_detail::timed_call(L, &core, [&core](lua_State* L) { return core(L); });
+#else
+            return core(L);
+#endif // SOL_BINDING_STATS
+        }
+        if (lua_type(L, lua_upvalueindex(3)) == LUA_TTABLE) {
+            int nargs = lua_gettop(L);
+            bool method = false;
+            int r = search_bases(L, nargs, lua_upvalueindex(3), method);
+            if (r >= 0) {
+                if (method) {
+                    // methods do not change: the next lookup of this key on this type is a single raw get
+                    lua_pushvalue(L, 2);
+                    lua_pushvalue(L, -2);
+                    lua_rawset(L, lua_upvalueindex(1));
+                }
+                return r;
+            }
+        }
+        if (lua_gettop(L) > 2) {
+            return luaL_error(L, "sol: cannot set a member that does not exist on this usertype");
+        }
+        lua_pushnil(L);
+        return 1;
+    }
+
+    static int call(lua_State* L) {
+        usertype_indexing_function& self = *static_cast<usertype_indexing_function*>(lua_touserdata(L, lua_upvalueindex(2)));
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return detail::trampoline(L, &dispatch, self);
+    }
+
+    int prelude(lua_State* L) {
+        push_lookup(L);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        lua_remove(L, -2);
+        return dispatch(L, *this);
     }
 
     virtual int operator()(lua_State* L) override {
         return prelude(L);
     }
+
+    // The lookup table is keyed on this object's address, which a later function could be given
+    virtual void release(lua_State* L) override {
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+    }
 };
 } // function_detail
 } // sol
@@ -0,0 +1,101 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_GC_HPP
+#define SOL_GC_HPP
+
+#include "compatibility.hpp"
+#include <cstddef>
+
+namespace sol {
+enum class gc_mode : char {
+    incremental,
+    generational
+};
+
+struct gc_stats {
+    // everything the collector is currently keeping around
+    std::size_t bytes;
+    // how much that grew since the last finished cycle; frees count against it
+    std::ptrdiff_t bytes_since_cycle;
+    // cycles finished since the stats were first asked for
+    std::size_t cycles;
+};
+
+namespace gc_detail {
+struct tracker {
+    std::size_t cycles;
+    std::size_t marked;
+};
+
+inline const void* tracker_key() {
+    static char key = 0;
+    return &key;
+}
+
+inline std::size_t bytes_in_use(lua_State* L) {
+    return static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNTB, 0));
+}
+
+inline void plant_sentinel(lua_State* L, int metatableindex) {
+    lua_newuserdata(L, 1);
+    lua_pushvalue(L, metatableindex);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+}
+
+// Finalizer of an unreachable sentinel: its collection means a cycle went by, so count it and plant the next one
+inline int sentinel_gc(lua_State* L) {
+    tracker& t = *static_cast<tracker*>(lua_touserdata(L, lua_upvalueindex(1)));
+    ++t.cycles;
+    t.marked = bytes_in_use(L);
+    lua_getmetatable(L, 1);
+    plant_sentinel(L, lua_gettop(L));
+    lua_pop(L, 1);
+    return 0;
+}
+
+inline tracker& get_tracker(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, tracker_key());
+    void* existing = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (existing != nullptr) {
+        return *static_cast<tracker*>(existing);
+    }
+    tracker* t = static_cast<tracker*>(lua_newuserdata(L, sizeof(tracker)));
+    t->cycles = 0;
+    t->marked = bytes_in_use(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, tracker_key());
+    // the tracker rides along with the sentinels' finalizer, and the registry keeps it alive
+    lua_createtable(L, 0, 1);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, &sentinel_gc, 1);
+    lua_setfield(L, -2, "__gc");
+    plant_sentinel(L, lua_gettop(L));
+    lua_pop(L, 2);
+    return *t;
+}
+} // gc_detail
+} // sol
+
+#endif // SOL_GC_HPP
@@ -0,0 +1,185 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_GENERATOR_HPP
+#define SOL_GENERATOR_HPP
+
+#include "coroutine.hpp"
+#include "thread.hpp"
+#include "error.hpp"
+#include "optional.hpp"
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+namespace sol {
+// An input range over what a Lua function yields, one resume per step. Each yielded value is read
+// straight off the coroutine's stack with stack::get<T> (a std::tuple takes several values), and stays
+// there until the next step, so T may also be a view into it. A return ends the range, and its values
+// are not part of it. An error ends it too, and is thrown as a sol::error (without exceptions,
+// it is kept in error_message()). Stopping early leaves the coroutine suspended, to be collected
+template <typename T>
+class generator {
+private:
+    thread owner;
+    lua_State* co;
+    int pending;
+    bool started;
+    call_status stats;
+    optional<T> current;
+    std::string message;
+
+    template <typename... Args>
+    void start(Args&&... args) {
+        pending = stack::multi_push(co, std::forward<Args>(args)...);
+    }
+
+    call_status resume(int nargs) {
+#if SOL_LUA_VERSION < 502
+        return static_cast<call_status>(lua_resume(co, nargs));
+#else
+        return static_cast<call_status>(lua_resume(co, nullptr, nargs));
+#endif // Lua 5.1 compat
+    }
+
+    void fail() {
+        const char* what = lua_tostring(co, -1);
+        message = what != nullptr ? what : "sol: the generator failed with a non-string error";
+        lua_settop(co, 0);
+#ifndef SOL_NO_EXCEPTIONS
+        throw sol::error(message);
+#endif // No Exceptions
+    }
+
+public:
+    class iterator {
+    private:
+        generator* g;
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        iterator(generator* g = nullptr) : g(g) {}
+
+        reference operator*() const {
+            return *g->current;
+        }
+
+        pointer operator->() const {
+            return &*g->current;
+        }
+
+        iterator& operator++() {
+            if (!g->next()) {
+                g = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(const iterator& right) const {
+            return g == right.g;
+        }
+
+        bool operator!=(const iterator& right) const {
+            return g != right.g;
+        }
+    };
+
+    // Runs fx(args...) on a thread of its own, made in L
+    template <typename... Args>
+    generator(lua_State* L, reference fx, Args&&... args) : owner(thread::create(L)), co(owner.thread_state()), pending(0), started(false), stats(call_status::yielded) {
+        fx.push();
+        lua_xmove(L, co, 1);
+        start(std::forward<Args>(args)...);
+    }
+
+    // Runs the coroutine's function on the coroutine's thread, which has to stay alive meanwhile
+    template <typename C, typename... Args, std::enable_if_t<std::is_same<meta::Unqualified<C>, coroutine>::value>* = nullptr>
+    explicit generator(C&& c, Args&&... args) : co(c.lua_state()), pending(0), started(false), stats(c.status()) {
+        c.push();
+        start(std::forward<Args>(args)...);
+    }
+
+    generator(const generator&) = delete;
+    generator& operator=(const generator&) = delete;
+
+    // Resumes unless the range is over; returns whether there is a new value
+    bool next() {
+        current = nullopt;
+        if (stats != call_status::yielded) {
+            return false;
+        }
+        // the first step hands over the function and its arguments; later ones drop the last values
+        int nargs = pending;
+        if (started) {
+            lua_settop(co, 0);
+            nargs = 0;
+        }
+        started = true;
+        stats = resume(nargs);
+        if (stats == call_status::yielded) {
+            current = stack::get<T>(co, 1);
+            return true;
+        }
+        if (stats == call_status::ok) {
+            lua_settop(co, 0);
+            return false;
+        }
+        fail();
+        return false;
+    }
+
+    iterator begin() {
+        if (!started) {
+            next();
+        }
+        return current ? iterator(this) : end();
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+    call_status status() const noexcept {
+        return stats;
+    }
+
+    bool error() const noexcept {
+        return stats != call_status::ok && stats != call_status::yielded;
+    }
+
+    const std::string& error_message() const noexcept {
+        return message;
+    }
+};
+} // sol
+
+#endif // SOL_GENERATOR_HPP
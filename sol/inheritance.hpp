@@ -23,9 +23,11 @@
 #define SOL_INHERITANCE_HPP
 
 #include "types.hpp"
-#if defined(SOL_NO_RTTI) && defined(SOL_NO_EXCEPTIONS)
+#include "usertype_storage.hpp"
+#include <array>
 #include <atomic>
-#endif // No Runtime Type Information and No Exceptions
+#include <algorithm>
+#include <functional>
 
 namespace sol {
 template <typename... Args>
@@ -36,138 +38,183 @@ using bases = base_list<Args...>;
 typedef bases<> base_classes_tag;
 const auto base_classes = base_classes_tag();
 
-namespace detail {
-#if defined(SOL_NO_RTTI) && defined(SOL_NO_EXCEPTIONS)
-inline std::size_t unique_id () {
-    static std::atomic<std::size_t> x(0);
-    return ++x;
-}
+// Specialize this to tell sol the bases of a type, so that usertypes deriving
+// from it pick up its bases transitively without listing every ancestor
+template <typename T>
+struct base {
+    typedef bases<> type;
+};
 
+namespace detail {
+// The address of a per-type tag: unique per type across translation units and
+// constant-initialized, so there is no static initialization order to worry about
 template <typename T>
 struct id_for {
-    static const std::size_t value;
+    static char tag;
+    static const void* const value;
 };
 
 template <typename T>
-const std::size_t id_for<T>::value = unique_id();
-#endif // No Runtime Type Information / No Exceptions
+char id_for<T>::tag = 0;
 
-inline decltype(auto) base_class_check_key() {
-    static const auto& key = u8"♡o｡.(✿ฺ｡ ✿ฺ)";
-    return key;
-}
+template <typename T>
+const void* const id_for<T>::value = &id_for<T>::tag;
 
-inline decltype(auto) base_class_cast_key() {
-    static const auto& key = u8"(◕‿◕✿)";
-    return key;
+// The identity field of usertype metatables is keyed by this address (lightuserdata),
+// so reading it is a raw pointer-keyed get
+inline const void* usertype_identity_key() {
+    static char key = 0;
+    return &key;
 }
 
-#ifndef SOL_NO_EXCEPTIONS
+template <typename... Lists>
+struct concat_bases {
+    typedef bases<> type;
+};
 
-template <typename T>
-void throw_as(void* p) {
-    throw static_cast<T*>(p);
-}
+template <typename... Args>
+struct concat_bases<bases<Args...>> {
+    typedef bases<Args...> type;
+};
 
-using throw_cast = decltype(&throw_as<void>);
+template <typename... Args, typename... Others, typename... Lists>
+struct concat_bases<bases<Args...>, bases<Others...>, Lists...> : concat_bases<bases<Args..., Others...>, Lists...> {};
 
-template <typename T>
-inline T* catch_cast(void* p, throw_cast f) {
-    try {
-        f(static_cast<void*>(p));
-    }
-    catch (T* ptr) {
-        return ptr;
-    }
-    catch (...) {
-        return static_cast<T*>(p);
-    }
-    return static_cast<T*>(p);
-}
+template <typename List>
+struct flatten_bases;
 
-template <typename T>
-inline bool catch_check(throw_cast f) {
-    try {
-        f( nullptr );
-    }
-    catch (T*) {
-        return true;
-    }
-    catch (...) {
-        return false;
-    }
-    return false;
-}
+// Every base, followed by everything `base<Base>` says about it, recursively
+template <typename... Bases>
+struct flatten_bases<bases<Bases...>> : concat_bases<bases<Bases...>, typename flatten_bases<typename base<Bases>::type>::type...> {};
+
+template <typename T, typename List = typename flatten_bases<bases<T>>::type>
+struct inheritance_table;
 
-#elif !defined(SOL_NO_RTTI)
 template <typename T, typename... Bases>
-struct inheritance {
-    static bool type_check(types<>, const std::type_info&) {
-        return false;
-    }
+struct inheritance_table<T, bases<Bases...>> {
+    typedef void*(*cast_function)(void*);
 
-    template <typename Base, typename... Args>
-    static bool type_check(types<Base, Args...>, const std::type_info& ti) {
-        return ti != typeid(Base) || type_check(types<Bases...>(), ti);
-    }
+    struct cast_entry {
+        const void* id;
+        cast_function cast;
+    };
+
+    typedef std::array<cast_entry, sizeof...(Bases)> cast_table;
 
-    static bool check(const std::type_info& ti) {
-        return ti != typeid(T) || type_check(types<Bases...>(), ti);
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    template <typename Base>
+    static void* cast_to(void* data) {
+        // Make sure to convert to T first, so the pointer is adjusted properly for Base
+        return static_cast<void*>(static_cast<Base*>(static_cast<T*>(data)));
     }
 
-    static void* type_cast(types<>, T*, const std::type_info& ti) {
-        return nullptr;
+    static cast_table make_casts() {
+        cast_table table = { { { id_for<Bases>::value, &cast_to<Bases> }... } };
+        // addresses are not known until link time, so the sort happens once, on first use
+        std::sort(table.begin(), table.end(), [](const cast_entry& l, const cast_entry& r) { return std::less<const void*>()(l.id, r.id); });
+        return table;
     }
 
-    template <typename Base, typename... Args>
-    static void* type_cast(types<Base, Args...>, T* data, const std::type_info& ti) {
-        // Make sure to convert to T first, and then dynamic cast to the proper type
-        return ti != typeid(Base) ? type_cast(types<Bases...>(), data, ti) : static_cast<void*>(dynamic_cast<Base*>(static_cast<T*>(data)));
+    static const cast_table& casts() {
+        static const cast_table table = make_casts();
+        return table;
     }
 
-    static void* cast(void* voiddata, const std::type_info& ti) {
-        T* data = static_cast<T*>(voiddata);
-        return static_cast<void*>(ti != typeid(T) ? type_cast(types<Bases...>(), data, ti) : data);
+    static std::size_t lookup(const void* ti) {
+        // Arguments of one C++ function tend to ask for the same type over and over:
+        // remember where the last one was found
+        static std::atomic<std::size_t> lasthit(0);
+        const cast_table& table = casts();
+        std::size_t last = lasthit.load(std::memory_order_relaxed);
+        if (table[last].id == ti) {
+            return last;
+        }
+        auto found = std::lower_bound(table.begin(), table.end(), ti, [](const cast_entry& l, const void* r) { return std::less<const void*>()(l.id, r); });
+        if (found == table.end() || found->id != ti) {
+            return npos;
+        }
+        std::size_t i = static_cast<std::size_t>(found - table.begin());
+        lasthit.store(i, std::memory_order_relaxed);
+        return i;
     }
 };
 
-using inheritance_check_function = decltype(&inheritance<void>::check);
-using inheritance_cast_function = decltype(&inheritance<void>::cast);
-#else
 template <typename T, typename... Bases>
 struct inheritance {
-    static bool type_check(types<>, std::size_t) {
-        return false;
-    }
-
-    template <typename Base, typename... Args>
-    static bool type_check(types<Base, Args...>, std::size_t ti) {
-        return ti != id_for<Base>::value || type_check(types<Bases...>(), ti);
-    }
+    // T itself, the listed bases and all of their declared bases, flattened
+    typedef inheritance_table<T, typename flatten_bases<bases<T, Bases...>>::type> table_type;
+    typedef typename table_type::cast_table cast_table;
 
-    static bool check(std::size_t ti) {
-        return ti != id_for<T>::value || type_check(types<Bases...>(), ti);
+    static const cast_table& casts() {
+        return table_type::casts();
     }
 
-    static void* type_cast(types<>, T*, std::size_t) {
-        return nullptr;
+    static bool check(const void* ti) {
+        return table_type::lookup(ti) != table_type::npos;
     }
 
-    template <typename Base, typename... Args>
-    static void* type_cast(types<Base, Args...>, T* data, std::size_t ti) {
-        // Make sure to convert to T first, and then dynamic cast to the proper type
-        return ti != id_for<Base>::value ? type_cast(types<Bases...>(), data, ti) : static_cast<void*>(static_cast<Base*>(data));
-    }
-
-    static void* cast(void* voiddata, std::size_t ti) {
-        T* data = static_cast<T*>(voiddata);
-        return static_cast<void*>(ti != id_for<T>::value ? type_cast(types<Bases...>(), data, ti) : data);
+    static void* cast(void* voiddata, const void* ti) {
+        std::size_t i = table_type::lookup(ti);
+        if (i == table_type::npos) {
+            return nullptr;
+        }
+        return table_type::casts()[i].cast(voiddata);
     }
 };
 
 using inheritance_check_function = decltype(&inheritance<void>::check);
 using inheritance_cast_function = decltype(&inheritance<void>::cast);
-#endif // No Exceptions and/or No Runtime Type Information
+
+// One per usertype, shared by its T, T* and unique metatables as a lightuserdata field:
+// a single raw get answers both "is this a T?" and "how does it convert to its bases?"
+struct usertype_identity {
+    const void* id;
+    inheritance_check_function check;
+    inheritance_cast_function cast;
+    // finds the object in a userdata block; null when the block starts with a pointer to it
+    void* (*locate)(void*);
+    // the identity of the T* and unique metatables copied from this one
+    const usertype_identity* by_pointer;
+};
+
+// One identity per T and base list (sol::base_classes), filled in entirely by static
+// initialization and never written afterwards, so states on several threads can share it.
+// With no base list, the bases declared through sol::base<T> are used
+template <typename T, typename... Bases>
+struct identity_for {
+    typedef inheritance<T, Bases...> casts_type;
+    // the cast table always holds T itself
+    static const bool has_bases = std::tuple_size<typename casts_type::cast_table>::value > 1;
+    static const usertype_identity value;
+    // for the T* and unique metatables of value-only types, whose blocks do start with a pointer
+    static const usertype_identity pointers;
+};
+
+template <typename T, typename... Bases>
+const usertype_identity identity_for<T, Bases...>::value = {
+    id_for<T>::value,
+    identity_for<T, Bases...>::has_bases ? &identity_for<T, Bases...>::casts_type::check : nullptr,
+    identity_for<T, Bases...>::has_bases ? &identity_for<T, Bases...>::casts_type::cast : nullptr,
+    usertype_storage<T>::value_only ? &usertype_storage<T>::locate : nullptr,
+    usertype_storage<T>::value_only ? &identity_for<T, Bases...>::pointers : &identity_for<T, Bases...>::value
+};
+
+template <typename T, typename... Bases>
+const usertype_identity identity_for<T, Bases...>::pointers = {
+    id_for<T>::value,
+    identity_for<T, Bases...>::has_bases ? &identity_for<T, Bases...>::casts_type::check : nullptr,
+    identity_for<T, Bases...>::has_bases ? &identity_for<T, Bases...>::casts_type::cast : nullptr,
+    nullptr,
+    &identity_for<T, Bases...>::pointers
+};
+
+inline const usertype_identity* get_identity(lua_State* L, int metatableindex = -1) {
+    lua_rawgetp(L, metatableindex, usertype_identity_key());
+    const usertype_identity* identity = static_cast<const usertype_identity*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return identity;
+}
 
 } // detail
 } // sol
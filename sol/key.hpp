@@ -0,0 +1,58 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_KEY_HPP
+#define SOL_KEY_HPP
+
+#include "reference.hpp"
+#include "string_view.hpp"
+#include <array>
+
+namespace sol {
+// A Lua string made once and kept in the registry, for use as a table key:
+// pushing it is a registry read, so lookups never hash or intern the name again
+class key : public reference {
+private:
+    static reference make(lua_State* L, string_view name) {
+        lua_pushlstring(L, name.data(), name.size());
+        reference r(L, -1);
+        lua_pop(L, 1);
+        return r;
+    }
+
+public:
+    key() noexcept = default;
+    key(lua_State* L, int index = -1) : reference(L, index) {}
+    key(lua_State* L, string_view name) : reference(make(L, name)) {}
+    key(lua_State* L, const char* name) : key(L, string_view(name)) {}
+    key(lua_State* L, const std::string& name) : key(L, string_view(name)) {}
+};
+
+// Declares a set of keys once per state:
+// auto keys = sol::make_keys(L, "position", "velocity"); tbl[keys[0]] ...
+template <typename... Names>
+inline std::array<key, sizeof...(Names)> make_keys(lua_State* L, Names&&... names) {
+    return {{ key(L, string_view(std::forward<Names>(names)))... }};
+}
+} // sol
+
+#endif // SOL_KEY_HPP
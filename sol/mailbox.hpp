@@ -0,0 +1,172 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_MAILBOX_HPP
+#define SOL_MAILBOX_HPP
+
+#include "stack.hpp"
+#include "error.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace sol {
+// A bounded queue of C++ payloads posted from any number of threads into a state owned by one thread.
+// Posting never blocks or locks: each slot carries a sequence number telling producers and the consumer
+// whose turn it is (Vyukov's bounded queue). Payloads stay C++ values until drain pushes them,
+// on the consumer's thread; a std::tuple payload is passed to the handler as several arguments
+template <typename T>
+class mailbox {
+private:
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    // keep the producers' and the consumer's counters off each other's cache line
+    static const std::size_t cache_line = 64;
+
+    lua_State* L;
+    std::unique_ptr<cell[]> cells;
+    std::size_t mask;
+    char padfront[cache_line];
+    std::atomic<std::size_t> enqueuepos;
+    char padback[cache_line];
+    std::size_t dequeuepos;
+    std::string message;
+
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    cell* front() {
+        cell* c = &cells[dequeuepos & mask];
+        std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+        return static_cast<std::ptrdiff_t>(sequence - (dequeuepos + 1)) < 0 ? nullptr : c;
+    }
+
+    void pop(cell* c) {
+        reinterpret_cast<T*>(&c->storage)->~T();
+        c->sequence.store(dequeuepos + mask + 1, std::memory_order_release);
+        ++dequeuepos;
+    }
+
+public:
+    // capacity is rounded up to a power of two
+    mailbox(lua_State* L, std::size_t capacity = 1024) : L(L), cells(new cell[round_up(capacity)]), mask(round_up(capacity) - 1), enqueuepos(0), dequeuepos(0) {
+        (void)padfront;
+        (void)padback;
+        for (std::size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mailbox(const mailbox&) = delete;
+    mailbox& operator=(const mailbox&) = delete;
+
+    ~mailbox() {
+        for (cell* c = front(); c != nullptr; c = front()) {
+            pop(c);
+        }
+    }
+
+    // From any thread; false when the mailbox is full
+    template <typename... Args>
+    bool post(Args&&... args) {
+        std::size_t pos = enqueuepos.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &cells[pos & mask];
+            std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - pos);
+            if (difference == 0) {
+                if (enqueuepos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuepos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&c->storage) T(std::forward<Args>(args)...);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // On the state's thread: calls handler with up to max payloads, in the order they were posted.
+    // The handler is pushed once for the whole batch. An error stops the drain and is thrown
+    // (with SOL_NO_EXCEPTIONS, kept in error_message()); the payload that caused it is dropped,
+    // the rest stay for the next drain
+    template <typename Fx>
+    std::size_t drain(const Fx& handler, std::size_t max = static_cast<std::size_t>(-1)) {
+        message.clear();
+        int top = lua_gettop(L);
+        handler.push();
+        int handlerindex = lua_gettop(L);
+        std::size_t count = 0;
+        for (cell* c = front(); count < max && c != nullptr; c = front()) {
+            lua_pushvalue(L, handlerindex);
+            int nargs = stack::push(L, std::move(*reinterpret_cast<T*>(&c->storage)));
+            pop(c);
+            ++count;
+            if (lua_pcall(L, nargs, 0, 0) != LUA_OK) {
+                message = stack::get<std::string>(L, -1);
+                lua_settop(L, top);
+#ifndef SOL_NO_EXCEPTIONS
+                throw error(message);
+#else
+                return count;
+#endif // No Exceptions
+            }
+        }
+        lua_settop(L, top);
+        return count;
+    }
+
+    std::size_t capacity() const {
+        return mask + 1;
+    }
+
+    // The error that stopped the last drain, or empty if it ran through
+    const std::string& error_message() const noexcept {
+        return message;
+    }
+
+    lua_State* lua_state() const {
+        return L;
+    }
+};
+} // sol
+
+#endif // SOL_MAILBOX_HPP
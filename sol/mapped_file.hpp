@@ -0,0 +1,224 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_MAPPED_FILE_HPP
+#define SOL_MAPPED_FILE_HPP
+
+#include "compatibility.hpp"
+#include "error.hpp"
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // Too much of windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // min and max macros break std::min and std::max
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // Windows or POSIX mapping
+
+namespace sol {
+// A read-only mapping of a whole file, so it can be handed to lua_load without copying it
+class mapped_file {
+private:
+    const char* first = nullptr;
+    std::size_t len = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif // Windows handles
+
+    void unmap() {
+#ifdef _WIN32
+        if (first != nullptr) {
+            UnmapViewOfFile(first);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        if (first != nullptr) {
+            munmap(const_cast<char*>(first), len);
+        }
+#endif // Windows or POSIX mapping
+        first = nullptr;
+        len = 0;
+    }
+
+public:
+    explicit mapped_file(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            unmap();
+            throw error("sol: cannot open " + filename);
+        }
+        len = static_cast<std::size_t>(size.QuadPart);
+        if (len == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        first = mapping == nullptr ? nullptr : static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (first == nullptr) {
+            unmap();
+            throw error("sol: cannot map " + filename);
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd == -1 || fstat(fd, &info) != 0) {
+            if (fd != -1) {
+                close(fd);
+            }
+            throw error("sol: cannot open " + filename);
+        }
+        len = static_cast<std::size_t>(info.st_size);
+        if (len == 0) {
+            close(fd);
+            return;
+        }
+        void* memory = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file alive on its own
+        close(fd);
+        if (memory == MAP_FAILED) {
+            len = 0;
+            throw error("sol: cannot map " + filename);
+        }
+        first = static_cast<const char*>(memory);
+#endif // Windows or POSIX mapping
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& o) noexcept : first(o.first), len(o.len) {
+#ifdef _WIN32
+        file = o.file;
+        mapping = o.mapping;
+        o.file = INVALID_HANDLE_VALUE;
+        o.mapping = nullptr;
+#endif // Windows handles
+        o.first = nullptr;
+        o.len = 0;
+    }
+
+    mapped_file& operator=(mapped_file&& o) noexcept {
+        if (this != &o) {
+            unmap();
+            std::swap(first, o.first);
+            std::swap(len, o.len);
+#ifdef _WIN32
+            std::swap(file, o.file);
+            std::swap(mapping, o.mapping);
+#endif // Windows handles
+        }
+        return *this;
+    }
+
+    ~mapped_file() {
+        unmap();
+    }
+
+    const char* data() const noexcept {
+        return len == 0 ? "" : first;
+    }
+
+    std::size_t size() const noexcept {
+        return len;
+    }
+};
+
+namespace stack {
+namespace stack_detail {
+struct whole_buffer {
+    const char* data;
+    std::size_t size;
+};
+
+// Hands over everything in one go, then says it's done
+inline const char* read_whole_buffer(lua_State*, void* ud, std::size_t* size) {
+    whole_buffer& buffer = *static_cast<whole_buffer*>(ud);
+    *size = buffer.size;
+    buffer.size = 0;
+    return *size == 0 ? nullptr : buffer.data;
+}
+} // stack_detail
+
+// Like luaL_loadbufferx, through a single-shot lua_Reader.
+// As luaL_loadfile does, a leading byte order mark and a first line starting with # are skipped
+inline int load_buffer(lua_State* L, const char* data, std::size_t size, const char* chunkname, const char* mode = nullptr) {
+    if (size >= 3 && data[0] == '\xEF' && data[1] == '\xBB' && data[2] == '\xBF') {
+        data += 3;
+        size -= 3;
+    }
+    if (size > 0 && data[0] == '#') {
+        // keep the newline, so line numbers still match
+        std::size_t skip = 0;
+        while (skip < size && data[skip] != '\n') {
+            ++skip;
+        }
+        data += skip;
+        size -= skip;
+    }
+    stack_detail::whole_buffer buffer{ data, size };
+#if SOL_LUA_VERSION > 501
+    return lua_load(L, &stack_detail::read_whole_buffer, &buffer, chunkname, mode);
+#else
+    (void)mode;
+    return lua_load(L, &stack_detail::read_whole_buffer, &buffer, chunkname);
+#endif // Lua 5.2+ load modes
+}
+
+// Like luaL_loadfile, but the file is mapped instead of read through stdio
+inline int load_mapped_file(lua_State* L, const std::string& filename, const char* mode = nullptr) {
+#ifndef SOL_NO_EXCEPTIONS
+    try {
+#endif // No Exceptions
+        mapped_file file(filename);
+        std::string chunkname = "@" + filename;
+        return load_buffer(L, file.data(), file.size(), chunkname.c_str(), mode);
+#ifndef SOL_NO_EXCEPTIONS
+    }
+    catch (const error& e) {
+        lua_pushstring(L, e.what());
+        return LUA_ERRFILE;
+    }
+#endif // No Exceptions
+}
+} // stack
+} // sol
+
+#endif // SOL_MAPPED_FILE_HPP
@@ -0,0 +1,517 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_MODULE_MANAGER_HPP
+#define SOL_MODULE_MANAGER_HPP
+
+#include "compatibility.hpp"
+#include "error.hpp"
+#include "mapped_file.hpp"
+#include "chunk_cache.hpp"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace sol {
+struct module_reload {
+    // in the order they were run again
+    std::vector<std::string> reloaded;
+    // "name: message" for the modules that did not compile or run; they keep their old values
+    std::vector<std::string> errors;
+
+    bool ok() const {
+        return errors.empty();
+    }
+};
+
+// Tracks the Lua modules that require loads from files: their path, a hash of their source,
+// and the modules they require. Changed modules are run again in the running state,
+// and the tables they return are patched in place, so whatever holds on to them sees the new functions
+class module_manager {
+private:
+    struct module {
+        std::string path;
+        std::string hash;
+        std::set<std::string> dependencies;
+    };
+
+    lua_State* L;
+    chunk_cache* cache;
+    std::map<std::string, module> modules;
+    // the modules whose chunks are running, innermost last
+    std::vector<std::string> loading;
+
+    static module_manager& self(lua_State* L) {
+        return *static_cast<module_manager*>(lua_touserdata(L, lua_upvalueindex(1)));
+    }
+
+    static std::string module_file(const char* pattern, std::size_t size, const std::string& name) {
+        std::string dotted = name;
+        for (char& c : dotted) {
+            if (c == '.') {
+#ifdef LUA_DIRSEP
+                c = LUA_DIRSEP[0];
+#else
+                c = '/';
+#endif // LUA_DIRSEP
+            }
+        }
+        std::string path;
+        for (std::size_t i = 0; i < size; ++i) {
+            if (pattern[i] == '?') {
+                path += dotted;
+            }
+            else {
+                path.push_back(pattern[i]);
+            }
+        }
+        return path;
+    }
+
+    // The first file package.path has for name, as the standard searcher would pick it
+    static bool find_file(const char* searchpath, const std::string& name, std::string& found) {
+        const char* next = searchpath;
+        while (*next != '\0') {
+            const char* end = std::strchr(next, ';');
+            std::size_t size = end == nullptr ? std::strlen(next) : static_cast<std::size_t>(end - next);
+            if (size > 0) {
+                std::string path = module_file(next, size, name);
+                std::ifstream file(path);
+                if (file) {
+                    found = std::move(path);
+                    return true;
+                }
+            }
+            next += size;
+            if (*next == ';') {
+                ++next;
+            }
+        }
+        return false;
+    }
+
+    // Pushes the compiled chunk, or the error message, and hashes the source
+    int load_file(lua_State* Ls, const std::string& path, std::string& hash) {
+#ifndef SOL_NO_EXCEPTIONS
+        try {
+#endif // No Exceptions
+            mapped_file file(path);
+            hash = chunk_cache::key_for(file.data(), file.size());
+            std::string chunkname = "@" + path;
+            if (cache != nullptr) {
+                return cache->load(Ls, file.data(), file.size(), chunkname.c_str());
+            }
+            return stack::load_buffer(Ls, file.data(), file.size(), chunkname.c_str());
+#ifndef SOL_NO_EXCEPTIONS
+        }
+        catch (const error& e) {
+            lua_pushstring(Ls, e.what());
+            return LUA_ERRFILE;
+        }
+#endif // No Exceptions
+    }
+
+    // Runs the module's chunk, which is on top of the stack, with the arguments require gives a loader
+    int run(lua_State* Ls, const std::string& name, const std::string& path) {
+        lua_pushstring(Ls, name.c_str());
+        lua_pushstring(Ls, path.c_str());
+        loading.push_back(name);
+        int status = lua_pcall(Ls, 2, 1, 0);
+        loading.pop_back();
+        return status;
+    }
+
+    // Loader handed to require: upvalues are the manager, the chunk and its path
+    static int loader(lua_State* L) {
+        module_manager& m = self(L);
+        const char* name = luaL_checkstring(L, 1);
+        lua_settop(L, 1);
+        lua_pushvalue(L, lua_upvalueindex(2));
+        int status = m.run(L, name, lua_tostring(L, lua_upvalueindex(3)));
+        if (status != LUA_OK) {
+            return lua_error(L);
+        }
+        return 1;
+    }
+
+    // Pushes what the searcher returns, or the error message and returns -1
+    int search(lua_State* Ls, const char* name) {
+        lua_getfield(Ls, lua_upvalueindex(2), "path");
+        const char* searchpath = lua_tostring(Ls, -1);
+        std::string path;
+        if (searchpath == nullptr || !find_file(searchpath, name, path)) {
+            lua_pushnil(Ls);
+            return 1;
+        }
+        std::string hash;
+        if (load_file(Ls, path, hash) != LUA_OK) {
+            lua_pushfstring(Ls, "error loading module '%s' from file '%s':\n\t%s", name, path.c_str(), lua_tostring(Ls, -1));
+            return -1;
+        }
+        module& mod = modules[name];
+        mod.path = path;
+        mod.hash = std::move(hash);
+        mod.dependencies.clear();
+        lua_pushlightuserdata(Ls, this);
+        lua_insert(Ls, -2);
+        lua_pushstring(Ls, path.c_str());
+        lua_pushcclosure(Ls, &loader, 3);
+        lua_pushstring(Ls, path.c_str());
+        return 2;
+    }
+
+    // Goes in front of the standard file searchers: upvalues are the manager and the package table.
+    // The error is raised out here, once search has cleaned up after itself
+    static int searcher(lua_State* L) {
+        const char* name = luaL_checkstring(L, 1);
+        int results = self(L).search(L, name);
+        if (results < 0) {
+            return lua_error(L);
+        }
+        return results;
+    }
+
+    // Stands in for require: records that the running module needs name, then requires it as usual
+    static int require(lua_State* L) {
+        module_manager& m = self(L);
+        const char* name = luaL_checkstring(L, 1);
+        if (!m.loading.empty()) {
+            auto it = m.modules.find(m.loading.back());
+            if (it != m.modules.end()) {
+                it->second.dependencies.insert(name);
+            }
+        }
+        int top = lua_gettop(L);
+        lua_pushvalue(L, lua_upvalueindex(2));
+        lua_insert(L, 1);
+        lua_call(L, top, LUA_MULTRET);
+        return lua_gettop(L);
+    }
+
+    // Gives target what source has: all of its functions, and its other values only where target
+    // has nothing yet, so the data a running program has built up is kept. Tables found in both are patched
+    // the same way, and functions that source no longer has are removed
+    static void patch(lua_State* L, int target, int source, int visited) {
+        lua_pushvalue(L, target);
+        lua_rawget(L, visited);
+        bool seen = lua_toboolean(L, -1) != 0;
+        lua_pop(L, 1);
+        if (seen) {
+            return;
+        }
+        lua_pushvalue(L, target);
+        lua_pushboolean(L, 1);
+        lua_rawset(L, visited);
+        luaL_checkstack(L, 8, "sol: module tables are nested too deeply to patch");
+        lua_pushnil(L);
+        while (lua_next(L, source) != 0) {
+            int value = lua_gettop(L);
+            lua_pushvalue(L, value - 1);
+            lua_rawget(L, target);
+            int current = lua_gettop(L);
+            if (lua_type(L, value) == LUA_TTABLE && lua_type(L, current) == LUA_TTABLE) {
+                if (!lua_rawequal(L, value, current)) {
+                    patch(L, current, value, visited);
+                }
+            }
+            else if (lua_type(L, value) == LUA_TFUNCTION || lua_type(L, current) == LUA_TNIL) {
+                lua_pushvalue(L, value - 1);
+                lua_pushvalue(L, value);
+                lua_rawset(L, target);
+            }
+            lua_settop(L, value - 1);
+        }
+        lua_pushnil(L);
+        while (lua_next(L, target) != 0) {
+            if (lua_type(L, -1) == LUA_TFUNCTION) {
+                lua_pushvalue(L, -2);
+                lua_rawget(L, source);
+                bool gone = lua_type(L, -1) == LUA_TNIL;
+                lua_pop(L, 1);
+                if (gone) {
+                    // clearing a field that is being traversed is allowed
+                    lua_pushvalue(L, -2);
+                    lua_pushnil(L);
+                    lua_rawset(L, target);
+                }
+            }
+            lua_pop(L, 1);
+        }
+        if (!lua_getmetatable(L, target)) {
+            if (lua_getmetatable(L, source)) {
+                lua_setmetatable(L, target);
+            }
+        }
+        else {
+            lua_pop(L, 1);
+        }
+    }
+
+    // Runs name again. Returns whether package.loaded now holds another value than before,
+    // which the modules requiring it may have kept
+    bool reload_one(const std::string& name, module_reload& report, bool& replaced) {
+        module& mod = modules[name];
+        int top = lua_gettop(L);
+        std::string hash;
+        std::set<std::string> previous;
+        previous.swap(mod.dependencies);
+        int status = load_file(L, mod.path, hash);
+        if (status == LUA_OK) {
+            status = run(L, name, mod.path);
+        }
+        if (status != LUA_OK) {
+            const char* message = lua_tostring(L, -1);
+            report.errors.push_back(name + ": " + (message == nullptr ? "(error object is not a string)" : message));
+            mod.dependencies.insert(previous.begin(), previous.end());
+            lua_settop(L, top);
+            return false;
+        }
+        int fresh = lua_gettop(L);
+        lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+        int loaded = lua_gettop(L);
+        lua_getfield(L, loaded, name.c_str());
+        int old = lua_gettop(L);
+        if (lua_type(L, fresh) == LUA_TTABLE && lua_type(L, old) == LUA_TTABLE) {
+            if (!lua_rawequal(L, fresh, old)) {
+                lua_newtable(L);
+                patch(L, old, fresh, lua_gettop(L));
+            }
+        }
+        else if (lua_type(L, fresh) != LUA_TNIL && !lua_rawequal(L, fresh, old)) {
+            lua_pushvalue(L, fresh);
+            lua_setfield(L, loaded, name.c_str());
+            replaced = true;
+        }
+        lua_settop(L, top);
+        mod.hash = std::move(hash);
+        report.reloaded.push_back(name);
+        return true;
+    }
+
+    void order(const std::string& name, const std::set<std::string>& pending, std::set<std::string>& visited, std::vector<std::string>& sorted) const {
+        if (!visited.insert(name).second) {
+            return;
+        }
+        auto it = modules.find(name);
+        if (it == modules.end()) {
+            return;
+        }
+        for (const std::string& dependency : it->second.dependencies) {
+            if (pending.count(dependency) != 0) {
+                order(dependency, pending, visited, sorted);
+            }
+        }
+        sorted.push_back(name);
+    }
+
+    static lua_State* main_thread(lua_State* L) {
+#if SOL_LUA_VERSION > 501
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+        lua_State* main = lua_tothread(L, -1);
+        lua_pop(L, 1);
+        return main;
+#else
+        return L;
+#endif // Lua 5.2+ keeps the main thread in the registry
+    }
+
+    void install() {
+        lua_getglobal(L, "package");
+        if (lua_type(L, -1) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            luaL_requiref(L, "package", luaopen_package, 1);
+        }
+        int package = lua_gettop(L);
+#if SOL_LUA_VERSION > 501
+        lua_getfield(L, package, "searchers");
+#else
+        lua_getfield(L, package, "loaders");
+#endif // Lua 5.2 renamed package.loaders
+        int searchers = lua_gettop(L);
+        // right after the preload searcher, before the standard file searchers
+        int last = static_cast<int>(lua_rawlen(L, searchers));
+        for (int i = last; i >= 2; --i) {
+            lua_rawgeti(L, searchers, i);
+            lua_rawseti(L, searchers, i + 1);
+        }
+        lua_pushlightuserdata(L, this);
+        lua_pushvalue(L, package);
+        lua_pushcclosure(L, &searcher, 2);
+        lua_rawseti(L, searchers, last < 1 ? 1 : 2);
+        lua_pushlightuserdata(L, this);
+        lua_getglobal(L, "require");
+        lua_pushcclosure(L, &require, 2);
+        lua_setglobal(L, "require");
+        lua_settop(L, package - 1);
+    }
+
+public:
+    module_manager(lua_State* Ls) : L(main_thread(Ls)), cache(nullptr) {
+        install();
+    }
+
+    module_manager(const module_manager&) = delete;
+    module_manager& operator=(const module_manager&) = delete;
+
+    // Compiles through cache from now on; it must outlive the state, or be unset first
+    void set_cache(chunk_cache* c) {
+        cache = c;
+    }
+
+    bool tracks(const std::string& name) const {
+        return modules.count(name) != 0;
+    }
+
+    std::vector<std::string> loaded() const {
+        std::vector<std::string> names;
+        for (const auto& m : modules) {
+            names.push_back(m.first);
+        }
+        return names;
+    }
+
+    std::string path(const std::string& name) const {
+        auto it = modules.find(name);
+        return it == modules.end() ? std::string() : it->second.path;
+    }
+
+    // What name required the last time it ran
+    std::vector<std::string> dependencies(const std::string& name) const {
+        auto it = modules.find(name);
+        if (it == modules.end()) {
+            return std::vector<std::string>();
+        }
+        return std::vector<std::string>(it->second.dependencies.begin(), it->second.dependencies.end());
+    }
+
+    std::vector<std::string> dependents(const std::string& name) const {
+        std::vector<std::string> names;
+        for (const auto& m : modules) {
+            if (m.second.dependencies.count(name) != 0) {
+                names.push_back(m.first);
+            }
+        }
+        return names;
+    }
+
+    // The modules whose files no longer hash to what was last run. Files that cannot be read are left out
+    std::vector<std::string> changed() const {
+        std::vector<std::string> names;
+        for (const auto& m : modules) {
+#ifndef SOL_NO_EXCEPTIONS
+            try {
+#endif // No Exceptions
+                mapped_file file(m.second.path);
+                if (chunk_cache::key_for(file.data(), file.size()) != m.second.hash) {
+                    names.push_back(m.first);
+                }
+#ifndef SOL_NO_EXCEPTIONS
+            }
+            catch (const error&) {
+            }
+#endif // No Exceptions
+        }
+        return names;
+    }
+
+    // Runs the given modules again, the ones they depend on first. A module returning a table has that
+    // table patched into the one already loaded. Any other value replaces it in package.loaded, and then
+    // the modules that required it are run again too, since they may have kept the old one
+    module_reload reload(const std::vector<std::string>& names) {
+        module_reload report;
+        std::set<std::string> pending;
+        for (const std::string& name : names) {
+            if (tracks(name)) {
+                pending.insert(name);
+            }
+        }
+        std::set<std::string> done;
+        while (!pending.empty()) {
+            std::vector<std::string> sorted;
+            std::set<std::string> visited;
+            for (const std::string& name : pending) {
+                order(name, pending, visited, sorted);
+            }
+            pending.clear();
+            for (const std::string& name : sorted) {
+                if (!done.insert(name).second) {
+                    continue;
+                }
+                bool replaced = false;
+                if (reload_one(name, report, replaced) && replaced) {
+                    for (const std::string& dependent : dependents(name)) {
+                        if (done.count(dependent) == 0) {
+                            pending.insert(dependent);
+                        }
+                    }
+                }
+            }
+        }
+        return report;
+    }
+
+    module_reload reload(const std::string& name) {
+        return reload(std::vector<std::string>{ name });
+    }
+
+    // Runs again every module whose file changed
+    module_reload reload() {
+        return reload(changed());
+    }
+};
+
+namespace module_detail {
+inline const void* manager_key() {
+    static char key = 0;
+    return &key;
+}
+
+inline int manager_gc(lua_State* L) {
+    module_manager* m = static_cast<module_manager*>(lua_touserdata(L, 1));
+    m->~module_manager();
+    return 0;
+}
+
+inline module_manager& ensure(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, manager_key());
+    void* existing = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (existing != nullptr) {
+        return *static_cast<module_manager*>(existing);
+    }
+    void* memory = lua_newuserdata(L, sizeof(module_manager));
+    module_manager* m = new (memory) module_manager(L);
+    lua_createtable(L, 0, 1);
+    lua_pushcclosure(L, &manager_gc, 0);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, manager_key());
+    return *m;
+}
+} // module_detail
+} // sol
+
+#endif // SOL_MODULE_MANAGER_HPP
@@ -27,13 +27,16 @@
 #include "stack.hpp"
 
 namespace sol {
-class object : public reference {
+template <typename base_t>
+class basic_object : public base_t {
 public:
-    using reference::reference;
+    using base_t::base_t;
+    using base_t::lua_state;
+    using base_t::valid;
 
     template<typename T>
     decltype(auto) as() const {
-        push();
+        this->push();
         return stack::pop<T>(lua_state());
     }
 
@@ -46,19 +49,23 @@ public:
     }
 };
 
-inline bool operator==(const object& lhs, const nil_t&) {
+template <typename base_t>
+inline bool operator==(const basic_object<base_t>& lhs, const nil_t&) {
     return !lhs.valid();
 }
 
-inline bool operator==(const nil_t&, const object& rhs) {
+template <typename base_t>
+inline bool operator==(const nil_t&, const basic_object<base_t>& rhs) {
     return !rhs.valid();
 }
 
-inline bool operator!=(const object& lhs, const nil_t&) {
+template <typename base_t>
+inline bool operator!=(const basic_object<base_t>& lhs, const nil_t&) {
     return lhs.valid();
 }
 
-inline bool operator!=(const nil_t&, const object& rhs) {
+template <typename base_t>
+inline bool operator!=(const nil_t&, const basic_object<base_t>& rhs) {
     return rhs.valid();
 }
 } // sol
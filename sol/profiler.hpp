@@ -0,0 +1,225 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_PROFILER_HPP
+#define SOL_PROFILER_HPP
+
+#include "state_view.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace sol {
+// A sampling profiler for the Lua code running on one lua_State.
+// A timer thread arms a one-shot hook every interval, the same way the standalone lua
+// interpreter arms its interrupt hook from a signal handler. The hook fires on the next
+// call, return or instruction, takes the stack and removes itself, so between samples
+// the VM runs without any hook at all. Arming on a call or a return is what lets time
+// spent inside a C or C++ function be charged to it: it is sampled on its way out.
+// Samples are kept as folded stacks ("outer;inner;leaf count"), the input format of flamegraph.pl
+class profiler {
+private:
+    typedef std::chrono::steady_clock clock;
+
+    lua_State* L;
+    std::chrono::microseconds interval;
+    std::thread timer;
+    std::mutex timerlock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::atomic<bool> armed;
+    std::atomic<clock::rep> armedat;
+    mutable std::mutex samplelock;
+    std::unordered_map<std::string, std::size_t> stacks;
+    std::size_t total = 0;
+    std::size_t dropped = 0;
+
+    static const void* key() {
+        static char k = 0;
+        return &k;
+    }
+
+    static const int maxdepth = 64;
+
+    static void append_frame(std::string& frame, lua_State* T, lua_Debug& ar) {
+        lua_getinfo(T, "Sn", &ar);
+        if (ar.what != nullptr && ar.what[0] == 'C') {
+            frame += ar.name != nullptr ? ar.name : "?";
+            frame += " [C]";
+        }
+        else if (ar.what != nullptr && ar.what[0] == 'm') {
+            frame += "main chunk (";
+            frame += ar.short_src;
+            frame += ")";
+        }
+        else {
+            frame += ar.name != nullptr ? ar.name : "?";
+            frame += " (";
+            frame += ar.short_src;
+            frame += ":";
+            frame += std::to_string(ar.linedefined);
+            frame += ")";
+        }
+    }
+
+    static void hook(lua_State* T, lua_Debug* event) {
+        lua_sethook(T, nullptr, 0, 0);
+        lua_rawgetp(T, LUA_REGISTRYINDEX, key());
+        profiler* self = static_cast<profiler*>(lua_touserdata(T, -1));
+        lua_pop(T, 1);
+        if (self == nullptr) {
+            return;
+        }
+        self->sample(T, event->event);
+    }
+
+    void sample(lua_State* T, int event) {
+        armed = false;
+        // armed while nothing was running: the first thing to run afterwards did not earn it
+        clock::duration since = clock::now().time_since_epoch() - clock::duration(armedat.load());
+        if (since > interval * 2) {
+            std::lock_guard<std::mutex> lock(samplelock);
+            ++dropped;
+            return;
+        }
+        // on a call, the function being entered has not run yet: the sample belongs to its caller
+        int level = event == LUA_HOOKCALL ? 1 : 0;
+#ifdef LUA_HOOKTAILCALL
+        if (event == LUA_HOOKTAILCALL) {
+            level = 1;
+        }
+#endif // Lua 5.2+
+        lua_Debug frames[maxdepth];
+        int depth = 0;
+        while (depth < maxdepth && lua_getstack(T, level + depth, &frames[depth])) {
+            ++depth;
+        }
+        std::string folded;
+        for (int i = depth; i-- > 0;) {
+            append_frame(folded, T, frames[i]);
+            if (i > 0) {
+                folded += ';';
+            }
+        }
+        if (folded.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(samplelock);
+        ++stacks[folded];
+        ++total;
+    }
+
+    void tick() {
+        std::unique_lock<std::mutex> lock(timerlock);
+        while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+            if (armed.exchange(true)) {
+                continue;
+            }
+            armedat = clock::now().time_since_epoch().count();
+            lua_sethook(L, &hook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+        }
+    }
+
+public:
+    profiler(lua_State* L, std::chrono::microseconds interval = std::chrono::milliseconds(1)) : L(L), interval(interval), armed(false), armedat(0) {}
+    profiler(const state_view& lua, std::chrono::microseconds interval = std::chrono::milliseconds(1)) : profiler(lua.lua_state(), interval) {}
+
+    profiler(const profiler&) = delete;
+    profiler& operator=(const profiler&) = delete;
+
+    ~profiler() {
+        stop();
+    }
+
+    // Replaces any hook already set on the lua_State until stop
+    void start() {
+        if (timer.joinable()) {
+            return;
+        }
+        lua_pushlightuserdata(L, this);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+        stopping = false;
+        armed = false;
+        timer = std::thread([this]() { tick(); });
+    }
+
+    // Must be called from the thread running the lua_State, like everything else that touches it
+    void stop() {
+        if (!timer.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(timerlock);
+            stopping = true;
+        }
+        wake.notify_all();
+        timer.join();
+        lua_sethook(L, nullptr, 0, 0);
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+    }
+
+    bool running() const {
+        return timer.joinable();
+    }
+
+    std::size_t samples() const {
+        std::lock_guard<std::mutex> lock(samplelock);
+        return total;
+    }
+
+    // Samples thrown away because the hook was armed while no Lua code was running
+    std::size_t idle_samples() const {
+        std::lock_guard<std::mutex> lock(samplelock);
+        return dropped;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(samplelock);
+        stacks.clear();
+        total = 0;
+        dropped = 0;
+    }
+
+    void write_folded(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(samplelock);
+        for (const auto& kv : stacks) {
+            out << kv.first << ' ' << kv.second << '\n';
+        }
+    }
+
+    std::string folded() const {
+        std::ostringstream out;
+        write_folded(out);
+        return out.str();
+    }
+};
+} // sol
+
+#endif // SOL_PROFILER_HPP
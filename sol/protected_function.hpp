@@ -25,7 +25,12 @@
 #include "reference.hpp"
 #include "stack.hpp"
 #include "protected_function_result.hpp"
+#include "call_site.hpp"
 #include <cstdint>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace sol {
 class protected_function : public reference {
@@ -48,19 +53,23 @@ private:
     struct handler {
         const reference& target;
         int stackindex;
-        handler(const reference& target) : target(target), stackindex(0) {
-            if (target.valid()) {
+        bool pushed;
+        handler(const reference& target, int pinnedindex = 0) : target(target), stackindex(pinnedindex), pushed(false) {
+            if (stackindex == 0 && target.valid()) {
                 stackindex = lua_gettop(target.lua_state()) + 1;
+                pushed = true;
                 target.push();
             }
         }
         ~handler() {
-            if (stackindex > 0) {
+            if (pushed && stackindex > 0) {
                 lua_remove(target.lua_state(), stackindex);
             }
         }
     };
 
+    int pinnedhandler = 0;
+
     int luacall(std::ptrdiff_t argcount, std::ptrdiff_t resultcount, handler& h) const {
         return lua_pcallk(lua_state(), static_cast<int>(argcount), static_cast<int>(resultcount), h.stackindex, 0, nullptr);
     }
@@ -83,12 +92,12 @@ private:
     }
 
     protected_function_result invoke(types<>, std::index_sequence<>, std::ptrdiff_t n, handler& h) const {
-        bool handlerpushed = error_handler.valid();
+        bool handlerpushed = h.pushed;
         int stacksize = lua_gettop(lua_state());
-        int firstreturn = std::max(1, stacksize - static_cast<int>(n) - 1);
+        int firstreturn = (std::max)(1, stacksize - static_cast<int>(n) - 1);
         int returncount = 0;
         call_status code = call_status::ok;
-#ifndef SOL_NO_EXCEPTIONS
+#if !defined(SOL_NO_EXCEPTIONS) && !defined(SOL_PROTECTED_FUNCTION_NO_CATCH)
         auto onexcept = [&](const char* error) {
             h.stackindex = 0;
             if (h.target.valid()) {
@@ -101,11 +110,11 @@ private:
             }
         };
         try {
-#endif // No Exceptions
+#endif // No Exceptions or no catching in protected calls
             code = static_cast<call_status>(luacall(n, LUA_MULTRET, h));
             int poststacksize = lua_gettop(lua_state());
             returncount = poststacksize - firstreturn;
-#ifndef SOL_NO_EXCEPTIONS
+#if !defined(SOL_NO_EXCEPTIONS) && !defined(SOL_PROTECTED_FUNCTION_NO_CATCH)
         }
         // Handle C++ errors thrown from C++ functions bound inside of lua
         catch (const char* error) {
@@ -123,21 +132,88 @@ private:
             firstreturn = lua_gettop(lua_state());
             return protected_function_result(lua_state(), firstreturn, 0, 1, call_status::runtime);
         }
-#endif // No Exceptions
+#endif // No Exceptions or no catching in protected calls
         return protected_function_result(lua_state(), firstreturn + ( handlerpushed ? 0 : 1 ), returncount, returncount, code);
     }
 
+    template<int resultcount, typename It, typename Fx>
+    std::vector<std::pair<std::size_t, std::string>> batch_call(It first, It last, Fx&& onsuccess) const {
+        lua_State* L = lua_state();
+        std::vector<std::pair<std::size_t, std::string>> failures;
+        handler h(error_handler, pinnedhandler);
+        auto pp = stack::push_pop(*this);
+        int fxindex = lua_gettop(L);
+        for (std::size_t position = 0; first != last; ++first, ++position) {
+            lua_pushvalue(L, fxindex);
+            int pushcount = stack::push(L, *first);
+            if (static_cast<call_status>(lua_pcallk(L, pushcount, resultcount, h.stackindex, 0, nullptr)) == call_status::ok) {
+                onsuccess(L);
+                continue;
+            }
+            const char* message = lua_tostring(L, -1);
+            failures.emplace_back(position, message != nullptr ? message : "error object is not a string");
+            lua_pop(L, 1);
+        }
+        return failures;
+    }
+
 public:
+    // (position in the batch, error message) of every call in a batch that failed
+    typedef std::vector<std::pair<std::size_t, std::string>> batch_errors;
+
     reference error_handler;
 
     protected_function() = default;
     protected_function(lua_State* L, int index = -1): reference(L, index), error_handler(get_default_handler()) {
         type_assert(L, index, type::function);
     }
-    protected_function(const protected_function&) = default;
-    protected_function& operator=(const protected_function&) = default;
-    protected_function( protected_function&& ) = default;
-    protected_function& operator=( protected_function&& ) = default;
+    // a pinned handler slot is never shared: copies start unpinned, moves take it along
+    protected_function(const protected_function& o) : reference(o), error_handler(o.error_handler) {}
+    protected_function& operator=(const protected_function& o) {
+        if (this != &o) {
+            unpin_handler();
+            reference::operator=(o);
+            error_handler = o.error_handler;
+        }
+        return *this;
+    }
+    protected_function( protected_function&& o ) : reference(std::move(o)), pinnedhandler(o.pinnedhandler), error_handler(std::move(o.error_handler)) {
+        o.pinnedhandler = 0;
+    }
+    protected_function& operator=( protected_function&& o ) {
+        if (this != &o) {
+            unpin_handler();
+            reference::operator=(std::move(o));
+            error_handler = std::move(o.error_handler);
+            pinnedhandler = o.pinnedhandler;
+            o.pinnedhandler = 0;
+        }
+        return *this;
+    }
+    ~protected_function() {
+        unpin_handler();
+    }
+
+    // Pushes the error handler once and has every call use that stack slot, instead of
+    // pushing it before and lua_remove-ing it after each call. The slot belongs to this object
+    // until unpin_handler (or destruction): like any pushed value, unpin in reverse order
+    void pin_handler() {
+        if (pinnedhandler != 0 || !error_handler.valid())
+            return;
+        error_handler.push();
+        pinnedhandler = lua_gettop(lua_state());
+    }
+
+    void unpin_handler() {
+        if (pinnedhandler == 0)
+            return;
+        lua_remove(lua_state(), pinnedhandler);
+        pinnedhandler = 0;
+    }
+
+    bool handler_pinned() const {
+        return pinnedhandler != 0;
+    }
 
     template<typename... Args>
     protected_function_result operator()(Args&&... args) const {
@@ -151,11 +227,34 @@ public:
 
     template<typename... Ret, typename... Args>
     decltype(auto) call(Args&&... args) const {
-        handler h(error_handler);
+        handler h(error_handler, pinnedhandler);
         push();
         int pushcount = stack::multi_push(lua_state(), std::forward<Args>(args)...);
         return invoke(types<Ret...>(), std::index_sequence_for<Ret...>(), pushcount, h);
     }
+
+    // Calls the function once per element of [first, last), with the function and the error handler
+    // pushed once for the whole batch. A failing call does not stop the batch: its result is skipped
+    // (nothing is written to out) and its position and message are returned
+    template<typename Ret, typename It, typename OutIt>
+    batch_errors map(It first, It last, OutIt out) const {
+        return batch_call<detail::return_count<Ret>::value>(first, last, [&out](lua_State* L) {
+            *out = stack::pop<Ret>(L);
+            ++out;
+        });
+    }
+
+    template<typename It>
+    batch_errors for_each_call(It first, It last) const {
+        return batch_call<0>(first, last, [](lua_State*) {});
+    }
+
+    template<typename Range>
+    batch_errors for_each_call(Range&& range) const {
+        using std::begin;
+        using std::end;
+        return for_each_call(begin(range), end(range));
+    }
 };
 } // sol
 
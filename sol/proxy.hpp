@@ -29,10 +29,106 @@
 #include "proxy_base.hpp"
 
 namespace sol {
+// A proxy with its key chain already walked: it holds the innermost table and the last key
+// in the registry, so each read or write is one lookup instead of one per level.
+// It keeps referring to the table it resolved, even if a parent later replaces that table
+struct cached_proxy : public proxy_base<cached_proxy> {
+private:
+    reference tbl;
+    reference key;
+
+public:
+    cached_proxy() = default;
+    cached_proxy(reference table, reference key) : tbl(std::move(table)), key(std::move(key)) {}
+
+    // pushes the current value of the field
+    int push() const {
+        lua_State* L = tbl.lua_state();
+        tbl.push();
+        key.push();
+        lua_gettable(L, -2);
+        lua_remove(L, -2);
+        return 1;
+    }
+
+    template<typename T>
+    cached_proxy& set(T&& item) {
+        lua_State* L = tbl.lua_state();
+        tbl.push();
+        key.push();
+        stack::push(L, std::forward<T>(item));
+        lua_settable(L, -3);
+        lua_pop(L, 1);
+        return *this;
+    }
+
+    template<typename T>
+    cached_proxy& raw_set(T&& item) {
+        lua_State* L = tbl.lua_state();
+        tbl.push();
+        key.push();
+        stack::push(L, std::forward<T>(item));
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+        return *this;
+    }
+
+    template<typename T>
+    decltype(auto) raw_get() const {
+        lua_State* L = tbl.lua_state();
+        tbl.push();
+        key.push();
+        lua_rawget(L, -2);
+        lua_remove(L, -2);
+        return stack::pop<T>(L);
+    }
+
+    // defined in table_core.hpp, once table is complete
+    template<typename... Args>
+    cached_proxy& set_function(Args&&... args);
+
+    template<typename U, meta::EnableIf<meta::Function<meta::Unqualified<U>>> = 0>
+    cached_proxy& operator=(U&& other) {
+        return set_function(std::forward<U>(other));
+    }
+
+    template<typename U, meta::DisableIf<meta::Function<meta::Unqualified<U>>> = 0>
+    cached_proxy& operator=(U&& other) {
+        return set(std::forward<U>(other));
+    }
+
+    template<typename T>
+    decltype(auto) get() const {
+        push();
+        return stack::pop<T>(tbl.lua_state());
+    }
+
+    template<typename... Ret, typename... Args>
+    decltype(auto) call(Args&&... args) {
+        return get<function>().template call<Ret...>(std::forward<Args>(args)...);
+    }
+
+    template<typename... Args>
+    decltype(auto) operator()(Args&&... args) {
+        return call<>(std::forward<Args>(args)...);
+    }
+
+    bool valid () const {
+        if (!tbl.valid())
+            return false;
+        push();
+        bool isvalid = lua_isnoneornil(tbl.lua_state(), -1) == 0;
+        lua_pop(tbl.lua_state(), 1);
+        return isvalid;
+    }
+};
+
 template<typename Table, typename Key>
 struct proxy : public proxy_base<proxy<Table, Key>> {
 private:
-    typedef meta::If<meta::is_specialization_of<Key, std::tuple>, Key, std::tuple<meta::If<std::is_array<meta::Unqualified<Key>>, Key&, meta::Unqualified<Key>>>> key_type;
+    // arrays and named sol::keys are held by reference: copying a key would cost a fresh registry reference
+    typedef meta::Or<std::is_array<meta::Unqualified<Key>>, meta::And<std::is_lvalue_reference<Key>, std::is_same<meta::Unqualified<Key>, ::sol::key>>> by_reference;
+    typedef meta::If<meta::is_specialization_of<Key, std::tuple>, Key, std::tuple<meta::If<by_reference, Key&, meta::Unqualified<Key>>>> key_type;
 
     template<typename T, std::size_t... I>
     decltype(auto) tuple_get(std::index_sequence<I...>) const {
@@ -44,6 +140,39 @@ private:
         tbl.traverse_set( std::get<I>(key)..., std::forward<T>(value) );
     }
 
+    template<typename T, std::size_t... I>
+    decltype(auto) tuple_raw_get(std::index_sequence<I...>) const {
+        return tbl.template raw_traverse_get<T>( std::get<I>(key)... );
+    }
+
+    template<std::size_t... I, typename T>
+    void tuple_raw_set(std::index_sequence<I...>, T&& value) const {
+        tbl.raw_traverse_set( std::get<I>(key)..., std::forward<T>(value) );
+    }
+
+    template<std::size_t... I>
+    cached_proxy tuple_cache(std::index_sequence<I...>) const {
+        lua_State* L = tbl.lua_state();
+        auto pp = stack::push_pop(tbl);
+        // walk everything but the last key, each lookup leaving the next table on top
+        void(detail::swallow{ 0, (stack::get_field<false>(L, std::get<I>(key)), 0)... });
+        reference innermost(L, -1);
+        stack::push(L, std::get<sizeof...(I)>(key));
+        reference last(L, -1);
+        lua_pop(L, static_cast<int>(sizeof...(I)) + 1);
+        return cached_proxy(std::move(innermost), std::move(last));
+    }
+
+    template<typename T, std::size_t... I>
+    decltype(auto) tuple_try_get(std::index_sequence<I...>) const {
+        return tbl.template try_get<T>( std::get<I>(key)... );
+    }
+
+    template<typename T, std::size_t... I, typename U>
+    T tuple_get_or(std::index_sequence<I...>, U&& otherwise) const {
+        return tbl.template get_or<T>( std::get<I>(key)..., std::forward<U>(otherwise) );
+    }
+
 public:
     Table tbl;
     key_type key;
@@ -78,6 +207,34 @@ public:
         return tuple_get<T>( std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value>() );
     }
 
+    // every level is looked up and the last one written with raw accesses
+    template<typename T>
+    decltype(auto) raw_get() const {
+        return tuple_raw_get<T>( std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value>() );
+    }
+
+    template<typename T>
+    proxy& raw_set(T&& item) {
+        tuple_raw_set( std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value>(), std::forward<T>(item) );
+        return *this;
+    }
+
+    // single pass: nullopt when any level is missing or the value is not a T
+    template<typename T>
+    decltype(auto) try_get() const {
+        return tuple_try_get<T>( std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value>() );
+    }
+
+    template<typename T>
+    std::decay_t<T> get_or(T&& otherwise) const {
+        return tuple_get_or<std::decay_t<T>>( std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value>(), std::forward<T>(otherwise) );
+    }
+
+    // Resolves the key chain once, for repeated reads and writes of the same field
+    cached_proxy cache() const {
+        return tuple_cache(std::make_index_sequence<std::tuple_size<meta::Unqualified<key_type>>::value - 1>());
+    }
+
     template <typename K>
     decltype(auto) operator[](K&& k) const {
         auto keys = meta::tuplefy(key, std::forward<K>(k));
@@ -141,7 +298,30 @@ inline bool operator!=(const proxy<Table, Key>& right, nil_t) {
     return right.valid();
 }
 
+inline bool operator==(nil_t, const cached_proxy& right) {
+    return !right.valid();
+}
+
+inline bool operator==(const cached_proxy& right, nil_t) {
+    return !right.valid();
+}
+
+inline bool operator!=(nil_t, const cached_proxy& right) {
+    return right.valid();
+}
+
+inline bool operator!=(const cached_proxy& right, nil_t) {
+    return right.valid();
+}
+
 namespace stack {
+template <>
+struct pusher<cached_proxy> {
+    static int push (lua_State*, const cached_proxy& p) {
+        return p.push();
+    }
+};
+
 template <typename Table, typename Key>
 struct pusher<proxy<Table, Key>> {
     static int push (lua_State*, const proxy<Table, Key>& p) {
@@ -23,6 +23,7 @@
 #define SOL_REFERENCE_HPP
 
 #include "types.hpp"
+#include "reference_stats.hpp"
 
 namespace sol {
 namespace stack {
@@ -47,22 +48,90 @@ namespace detail {
 struct global_tag { } const global_{};
 } // detail
 
+// Refers to a value by its (absolute) position on the Lua stack instead of through the registry:
+// making, copying and destroying one never touches the registry.
+// Only good for as long as the value stays at that position, e.g. function arguments during a call
+class stack_reference {
+private:
+    lua_State* L = nullptr; // non-owning
+    int index = 0;
+
+public:
+    stack_reference() noexcept = default;
+
+    stack_reference(lua_State* L, int i = -1) noexcept : L(L), index(lua_absindex(L, i)) {}
+
+    int push() const noexcept {
+        lua_pushvalue(L, index);
+        return 1;
+    }
+
+    void pop(int n = 1) const noexcept {
+        lua_pop(lua_state( ), n);
+    }
+
+    int stack_index() const noexcept {
+        return index;
+    }
+
+    bool valid () const noexcept {
+        if (L == nullptr)
+            return false;
+        int t = lua_type(L, index);
+        return t != LUA_TNONE && t != LUA_TNIL;
+    }
+
+    explicit operator bool () const noexcept {
+        return valid();
+    }
+
+    type get_type() const noexcept {
+        return static_cast<type>(lua_type(L, index));
+    }
+
+    lua_State* lua_state() const noexcept {
+        return L;
+    }
+};
+
 class reference {
 private:
+    friend class value_reference;
+
     lua_State* L = nullptr; // non-owning
     int ref = LUA_NOREF;
 
-    int copy() const noexcept {
+    // Every registry slot a reference takes or gives back goes through these two;
+    // site is the SOL_REFERENCE_SITE of the public constructor that asked for the slot
+    static int make_ref(lua_State* L, const void* site) noexcept {
+#ifdef SOL_REFERENCE_STATS
+        int r = luaL_ref(L, LUA_REGISTRYINDEX);
+        reference_stats_detail::created(L, r, site);
+        return r;
+#else
+        (void)site;
+        return luaL_ref(L, LUA_REGISTRYINDEX);
+#endif // SOL_REFERENCE_STATS
+    }
+
+    static void drop_ref(lua_State* L, int r) noexcept {
+#ifdef SOL_REFERENCE_STATS
+        reference_stats_detail::destroyed(L, r);
+#endif // SOL_REFERENCE_STATS
+        luaL_unref(L, LUA_REGISTRYINDEX, r);
+    }
+
+    int copy(const void* site) const noexcept {
         if (ref == LUA_NOREF)
             return LUA_NOREF;
         push();
-        return luaL_ref(L, LUA_REGISTRYINDEX);
+        return make_ref(L, site);
     }
 
 protected:
     reference(lua_State* L, detail::global_tag) noexcept : L(L) {
         lua_pushglobaltable(L);
-        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        ref = make_ref(L, SOL_REFERENCE_SITE);
     }
 
 public:
@@ -70,11 +139,19 @@ public:
 
     reference(lua_State* L, int index = -1) noexcept : L(L) {
         lua_pushvalue(L, index);
-        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        ref = make_ref(L, SOL_REFERENCE_SITE);
+    }
+
+    // Keeps a value seen through a stack_reference alive past its time on the stack
+    reference(const stack_reference& r) noexcept : L(r.lua_state()) {
+        if (L == nullptr)
+            return;
+        r.push();
+        ref = make_ref(L, SOL_REFERENCE_SITE);
     }
 
     virtual ~reference() noexcept {
-        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        drop_ref(L, ref);
     }
 
     reference(reference&& o) noexcept {
@@ -86,6 +163,9 @@ public:
     }
 
     reference& operator=(reference&& o) noexcept {
+        if (this == &o)
+            return *this;
+        drop_ref(L, ref);
         L = o.L;
         ref = o.ref;
 
@@ -97,12 +177,15 @@ public:
 
     reference(const reference& o) noexcept {
         L = o.L;
-        ref = o.copy();
+        ref = o.copy(SOL_REFERENCE_SITE);
     }
 
     reference& operator=(const reference& o) noexcept {
+        if (this == &o)
+            return *this;
+        drop_ref(L, ref);
         L = o.L;
-        ref = o.copy();
+        ref = o.copy(SOL_REFERENCE_SITE);
         return *this;
     }
 
@@ -138,6 +221,195 @@ public:
         return L;
     }
 };
+
+// Holds nil, booleans, numbers and lightuserdata by value, and anything else through the registry
+// like reference does: scalars never touch the registry. Not polymorphic, unlike reference
+class value_reference {
+private:
+    lua_State* L = nullptr; // non-owning
+    type t = type::nil;
+#if SOL_LUA_VERSION >= 503
+    bool integer = false;
+#endif // Lua 5.3+ integers
+    union {
+        bool boolean;
+        lua_Integer i;
+        lua_Number n;
+        void* p;
+        int ref;
+    } data;
+
+    bool by_reference() const noexcept {
+        return t != type::nil && t != type::boolean && t != type::number && t != type::lightuserdata;
+    }
+
+    void read(int index, const void* site) noexcept {
+        data.n = 0;
+        t = static_cast<type>(lua_type(L, index));
+        switch (t) {
+        case type::none:
+            t = type::nil;
+            break;
+        case type::nil:
+            break;
+        case type::boolean:
+            data.boolean = lua_toboolean(L, index) != 0;
+            break;
+        case type::lightuserdata:
+            data.p = lua_touserdata(L, index);
+            break;
+        case type::number:
+#if SOL_LUA_VERSION >= 503
+            integer = lua_isinteger(L, index) != 0;
+            if (integer) {
+                data.i = lua_tointeger(L, index);
+                break;
+            }
+#endif // Lua 5.3+ integers
+            data.n = lua_tonumber(L, index);
+            break;
+        default:
+            lua_pushvalue(L, index);
+            data.ref = reference::make_ref(L, site);
+            break;
+        }
+    }
+
+    void copy_from(const value_reference& o, const void* site) noexcept {
+        L = o.L;
+        t = o.t;
+#if SOL_LUA_VERSION >= 503
+        integer = o.integer;
+#endif // Lua 5.3+ integers
+        if (o.by_reference()) {
+            o.push();
+            data.ref = reference::make_ref(L, site);
+        }
+        else {
+            data = o.data;
+        }
+    }
+
+    void steal(value_reference& o) noexcept {
+        L = o.L;
+        t = o.t;
+#if SOL_LUA_VERSION >= 503
+        integer = o.integer;
+#endif // Lua 5.3+ integers
+        data = o.data;
+        o.t = type::nil;
+    }
+
+    void release() noexcept {
+        if (by_reference()) {
+            reference::drop_ref(L, data.ref);
+        }
+        t = type::nil;
+    }
+
+public:
+    value_reference() noexcept {
+        data.n = 0;
+    }
+
+    value_reference(lua_State* L, int index = -1) noexcept : L(L) {
+        read(index, SOL_REFERENCE_SITE);
+    }
+
+    value_reference(const stack_reference& r) noexcept : L(r.lua_state()) {
+        if (L != nullptr) {
+            read(r.stack_index(), SOL_REFERENCE_SITE);
+        }
+    }
+
+    value_reference(const reference& r) noexcept : L(r.lua_state()) {
+        if (L != nullptr) {
+            r.push();
+            read(-1, SOL_REFERENCE_SITE);
+            lua_pop(L, 1);
+        }
+    }
+
+    ~value_reference() noexcept {
+        release();
+    }
+
+    value_reference(value_reference&& o) noexcept {
+        steal(o);
+    }
+
+    value_reference& operator=(value_reference&& o) noexcept {
+        if (this == &o)
+            return *this;
+        release();
+        steal(o);
+        return *this;
+    }
+
+    value_reference(const value_reference& o) noexcept {
+        copy_from(o, SOL_REFERENCE_SITE);
+    }
+
+    value_reference& operator=(const value_reference& o) noexcept {
+        if (this == &o)
+            return *this;
+        release();
+        copy_from(o, SOL_REFERENCE_SITE);
+        return *this;
+    }
+
+    int push() const noexcept {
+        switch (t) {
+        case type::boolean:
+            lua_pushboolean(L, data.boolean);
+            break;
+        case type::lightuserdata:
+            lua_pushlightuserdata(L, data.p);
+            break;
+        case type::number:
+#if SOL_LUA_VERSION >= 503
+            if (integer) {
+                lua_pushinteger(L, data.i);
+                break;
+            }
+#endif // Lua 5.3+ integers
+            lua_pushnumber(L, data.n);
+            break;
+        case type::nil:
+            lua_pushnil(L);
+            break;
+        default:
+            lua_rawgeti(L, LUA_REGISTRYINDEX, data.ref);
+            break;
+        }
+        return 1;
+    }
+
+    void pop(int n = 1) const noexcept {
+        lua_pop(lua_state( ), n);
+    }
+
+    // LUA_NOREF for the values held inline
+    int registry_index() const noexcept {
+        return by_reference() ? data.ref : LUA_NOREF;
+    }
+
+    bool valid () const noexcept {
+        return t != type::nil;
+    }
+
+    explicit operator bool () const noexcept {
+        return valid();
+    }
+
+    type get_type() const noexcept {
+        return t;
+    }
+
+    lua_State* lua_state() const noexcept {
+        return L;
+    }
+};
 } // sol
 
 #endif // SOL_REFERENCE_HPP
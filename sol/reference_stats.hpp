@@ -0,0 +1,201 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_REFERENCE_STATS_HPP
+#define SOL_REFERENCE_STATS_HPP
+
+#include "compatibility.hpp"
+#include <cstddef>
+#include <string>
+
+#ifdef SOL_REFERENCE_STATS
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // MSVC
+#endif // SOL_REFERENCE_STATS
+
+// Where the function it is written in returns to. The public constructors of references use it,
+// and hand it down to where the slot is taken: a helper of its own would only ever see itself
+#if defined(SOL_REFERENCE_STATS) && defined(__GNUC__)
+#define SOL_REFERENCE_SITE __builtin_return_address(0)
+#elif defined(SOL_REFERENCE_STATS) && defined(_MSC_VER)
+#define SOL_REFERENCE_SITE _ReturnAddress()
+#else
+#define SOL_REFERENCE_SITE nullptr
+#endif // Return addresses
+
+namespace sol {
+struct reference_stats {
+    // registry slots held by sol::reference and everything derived from it
+    std::size_t live;
+    std::size_t created;
+    std::size_t destroyed;
+    // since the previous call to reference_statistics, or since the first reference was counted
+    double created_per_second;
+    double destroyed_per_second;
+};
+
+struct reference_site {
+    // return address into the C++ code that made the references; feed it to addr2line or a debugger
+    const void* address;
+    // where the Lua code calling into that C++ code was, as given by luaL_where; empty if there was none
+    std::string where;
+    std::size_t created;
+    std::size_t destroyed;
+    std::size_t live;
+};
+
+#ifdef SOL_REFERENCE_STATS
+namespace reference_stats_detail {
+typedef std::chrono::steady_clock clock;
+
+struct site_record {
+    std::size_t created = 0;
+    std::size_t destroyed = 0;
+};
+
+typedef std::map<std::pair<const void*, std::string>, site_record> site_map;
+
+struct registry {
+    std::size_t created = 0;
+    std::size_t destroyed = 0;
+    clock::time_point sampled = clock::now();
+    std::size_t createdatsample = 0;
+    std::size_t destroyedatsample = 0;
+#ifndef NDEBUG
+    site_map sites;
+    std::unordered_map<int, site_map::iterator> owners;
+#endif // Debug
+};
+
+inline const void* registry_key() {
+    static char key = 0;
+    return &key;
+}
+
+inline int registry_gc(lua_State* L) {
+    static_cast<registry*>(lua_touserdata(L, 1))->~registry();
+    return 0;
+}
+
+inline registry* find_registry(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, registry_key());
+    void* existing = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return static_cast<registry*>(existing);
+}
+
+inline registry& get_registry(lua_State* L) {
+    registry* existing = find_registry(L);
+    if (existing != nullptr) {
+        return *existing;
+    }
+    registry* reg = new (lua_newuserdata(L, sizeof(registry))) registry();
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &registry_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, registry_key());
+    return *reg;
+}
+
+inline void created(lua_State* L, int ref, const void* address) {
+    if (ref < 0) {
+        // nil takes no slot
+        return;
+    }
+    registry& reg = get_registry(L);
+    ++reg.created;
+#ifndef NDEBUG
+    luaL_where(L, 1);
+    std::string where = lua_tostring(L, -1);
+    lua_pop(L, 1);
+    auto site = reg.sites.emplace(std::make_pair(address, std::move(where)), site_record()).first;
+    ++site->second.created;
+    reg.owners[ref] = site;
+#else
+    (void)address;
+#endif // Debug
+}
+
+inline void destroyed(lua_State* L, int ref) {
+    if (L == nullptr || ref < 0) {
+        return;
+    }
+    registry& reg = get_registry(L);
+    ++reg.destroyed;
+#ifndef NDEBUG
+    auto owner = reg.owners.find(ref);
+    if (owner != reg.owners.end()) {
+        ++owner->second->second.destroyed;
+        reg.owners.erase(owner);
+    }
+#endif // Debug
+}
+
+inline reference_stats statistics(lua_State* L) {
+    registry& reg = get_registry(L);
+    clock::time_point now = clock::now();
+    double seconds = std::chrono::duration<double>(now - reg.sampled).count();
+    reference_stats stats{ reg.created - reg.destroyed, reg.created, reg.destroyed, 0.0, 0.0 };
+    if (seconds > 0) {
+        stats.created_per_second = static_cast<double>(reg.created - reg.createdatsample) / seconds;
+        stats.destroyed_per_second = static_cast<double>(reg.destroyed - reg.destroyedatsample) / seconds;
+    }
+    reg.sampled = now;
+    reg.createdatsample = reg.created;
+    reg.destroyedatsample = reg.destroyed;
+    return stats;
+}
+
+inline std::vector<reference_site> sites(lua_State* L) {
+    std::vector<reference_site> result;
+#ifndef NDEBUG
+    registry* reg = find_registry(L);
+    if (reg == nullptr) {
+        return result;
+    }
+    for (const auto& kv : reg->sites) {
+        const site_record& r = kv.second;
+        result.push_back({ kv.first.first, kv.first.second, r.created, r.destroyed, r.created - r.destroyed });
+    }
+    // the biggest holders first: those are the leaks
+    std::sort(result.begin(), result.end(), [](const reference_site& l, const reference_site& r) {
+        return l.live != r.live ? l.live > r.live : l.created > r.created;
+    });
+#else
+    (void)L;
+#endif // Debug
+    return result;
+}
+} // reference_stats_detail
+#endif // SOL_REFERENCE_STATS
+} // sol
+
+#endif // SOL_REFERENCE_STATS_HPP
@@ -0,0 +1,314 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_SCHEDULER_HPP
+#define SOL_SCHEDULER_HPP
+
+#include "reference.hpp"
+#include "stack.hpp"
+#include "thread.hpp"
+#include "thread_pool.hpp"
+#include "async.hpp"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sol {
+// Runs many Lua coroutines cooperatively from one state.
+// A task tells the scheduler what it is waiting for through the values it yields:
+//     coroutine.yield()                    -- run again on the next step
+//     coroutine.yield("sleep", seconds)    -- run again once that much time has passed
+//     coroutine.yield("wait", "event")     -- run again after notify("event")
+// Calling a sol::yielding function that returns a std::future parks the task until the future is ready,
+// and resumes it with the future's value.
+// Tasks are resumed straight through lua_resume on their own thread: no function_result is built,
+// and yielded values are dropped with a single lua_settop. Given a thread_pool, threads of tasks that
+// returned are handed back to it instead of being left to the collector
+class scheduler {
+public:
+    typedef std::chrono::steady_clock clock;
+    typedef std::size_t task_id;
+
+    struct task_info {
+        // yielded while the task is still scheduled, ok once it returned, an error status if it failed
+        call_status status = call_status::yielded;
+        std::size_t resumes = 0;
+        clock::duration cpu_time = clock::duration::zero();
+        std::string error;
+    };
+
+private:
+    struct task {
+        lua_State* thread = nullptr;
+        int ref = LUA_NOREF;
+        int pending = 0; // values waiting on the thread's stack for the next resume
+        bool inuse = false;
+        std::unique_ptr<pending_result> awaiting;
+        task_info info;
+    };
+
+    typedef std::pair<clock::time_point, task_id> sleeper;
+
+    lua_State* L;
+    thread_pool* pool;
+    std::vector<task> tasks;
+    std::vector<task_id> freeslots;
+    std::deque<task_id> ready;
+    std::priority_queue<sleeper, std::vector<sleeper>, std::greater<sleeper>> sleeping;
+    std::unordered_map<std::string, std::vector<task_id>> waiting;
+    std::vector<task_id> inflight;
+    std::size_t live = 0;
+
+    int resume(task& t) {
+        // on the first resume the function sits below its arguments
+        int nargs = t.pending;
+        t.pending = 0;
+#if SOL_LUA_VERSION < 502
+        return lua_resume(t.thread, nargs);
+#else
+        return lua_resume(t.thread, L, nargs);
+#endif // Lua 5.1 compat
+    }
+
+    void finish(task& t, call_status status) {
+        t.info.status = status;
+        if (status != call_status::ok) {
+            const char* message = lua_tostring(t.thread, -1);
+            t.info.error = message != nullptr ? message : "error object is not a string";
+        }
+        lua_settop(t.thread, 0);
+        drop(t);
+        --live;
+    }
+
+    void reschedule(task_id id, task& t, clock::time_point now) {
+        int yielded = lua_gettop(t.thread);
+        if (yielded >= 1) {
+            t.awaiting = stack::take_pending(t.thread, 1);
+            if (t.awaiting != nullptr) {
+                lua_settop(t.thread, 0);
+                inflight.push_back(id);
+                return;
+            }
+        }
+        if (yielded >= 2 && lua_type(t.thread, 1) == LUA_TSTRING) {
+            std::size_t len = 0;
+            const char* request = lua_tolstring(t.thread, 1, &len);
+            std::string what(request, len);
+            if (what == "sleep" && lua_type(t.thread, 2) == LUA_TNUMBER) {
+                double seconds = lua_tonumber(t.thread, 2);
+                lua_settop(t.thread, 0);
+                sleeping.emplace(now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds)), id);
+                return;
+            }
+            if (what == "wait" && lua_type(t.thread, 2) == LUA_TSTRING) {
+                std::string event = lua_tostring(t.thread, 2);
+                lua_settop(t.thread, 0);
+                waiting[event].push_back(id);
+                return;
+            }
+        }
+        lua_settop(t.thread, 0);
+        ready.push_back(id);
+    }
+
+    void drop(task& t) {
+        if (pool != nullptr) {
+            pool->release(t.thread);
+        }
+        else {
+            luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+        }
+        t.ref = LUA_NOREF;
+        t.thread = nullptr;
+    }
+
+    void wake_sleepers(clock::time_point now) {
+        while (!sleeping.empty() && sleeping.top().first <= now) {
+            ready.push_back(sleeping.top().second);
+            sleeping.pop();
+        }
+    }
+
+    void wake_completed() {
+        auto completed = std::stable_partition(inflight.begin(), inflight.end(), [this](task_id id) {
+            return !tasks[id].awaiting->ready();
+        });
+        for (auto it = completed; it != inflight.end(); ++it) {
+            task& t = tasks[*it];
+            t.pending = t.awaiting->push(t.thread);
+            t.awaiting.reset();
+            ready.push_back(*it);
+        }
+        inflight.erase(completed, inflight.end());
+    }
+
+public:
+    scheduler(lua_State* L, thread_pool* pool = nullptr) : L(L), pool(pool) {}
+
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    ~scheduler() {
+        for (task& t : tasks) {
+            if (t.thread != nullptr) {
+                drop(t);
+            }
+        }
+    }
+
+    // Starts fx(args...) as a new task, first resumed on the next step
+    template <typename Fx, typename... Args>
+    task_id spawn(const Fx& fx, Args&&... args) {
+        task_id id;
+        if (freeslots.empty()) {
+            id = tasks.size();
+            tasks.emplace_back();
+        }
+        else {
+            id = freeslots.back();
+            freeslots.pop_back();
+            tasks[id] = task();
+        }
+        task& t = tasks[id];
+        t.inuse = true;
+        if (pool != nullptr) {
+            t.thread = pool->acquire();
+        }
+        else {
+            t.thread = lua_newthread(L);
+            t.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        fx.push();
+        lua_xmove(L, t.thread, 1);
+        t.pending = stack::multi_push(t.thread, std::forward<Args>(args)...);
+        ready.push_back(id);
+        ++live;
+        return id;
+    }
+
+    // Moves every task waiting on event to the ready queue
+    std::size_t notify(const std::string& event) {
+        auto found = waiting.find(event);
+        if (found == waiting.end()) {
+            return 0;
+        }
+        std::vector<task_id> woken = std::move(found->second);
+        waiting.erase(found);
+        ready.insert(ready.end(), woken.begin(), woken.end());
+        return woken.size();
+    }
+
+    // Resumes, in order, up to budget of the tasks that are ready at now.
+    // Tasks that become ready during the step run on the next one. Returns how many were resumed
+    std::size_t step(clock::time_point now = clock::now(), std::size_t budget = static_cast<std::size_t>(-1)) {
+        wake_sleepers(now);
+        wake_completed();
+        std::size_t count = (std::min)(budget, ready.size());
+        for (std::size_t i = 0; i < count; ++i) {
+            task_id id = ready.front();
+            ready.pop_front();
+            clock::time_point start = clock::now();
+            call_status status = static_cast<call_status>(resume(tasks[id]));
+            // a task spawned during the resume can grow tasks: only look this one up after it
+            task& t = tasks[id];
+            t.info.cpu_time += clock::now() - start;
+            ++t.info.resumes;
+            if (status == call_status::yielded) {
+                reschedule(id, t, now);
+            }
+            else {
+                finish(t, status);
+            }
+        }
+        return count;
+    }
+
+    // Steps until no task is ready, sleeping or awaiting a future (tasks waiting on events are left waiting)
+    void run() {
+        while (!ready.empty() || !sleeping.empty() || !inflight.empty()) {
+            if (ready.empty()) {
+                clock::time_point until = clock::now() + std::chrono::milliseconds(1);
+                if (inflight.empty() || (!sleeping.empty() && sleeping.top().first < until)) {
+                    until = sleeping.top().first;
+                }
+                std::this_thread::sleep_until(until);
+            }
+            step();
+        }
+    }
+
+    const task_info& info(task_id id) const {
+        return tasks[id].info;
+    }
+
+    bool finished(task_id id) const {
+        return tasks[id].thread == nullptr;
+    }
+
+    // Frees the slots of finished tasks so spawn can reuse them: their ids become invalid
+    std::size_t reap() {
+        std::size_t reaped = 0;
+        for (task_id id = 0; id < tasks.size(); ++id) {
+            if (tasks[id].inuse && tasks[id].thread == nullptr) {
+                tasks[id] = task();
+                freeslots.push_back(id);
+                ++reaped;
+            }
+        }
+        return reaped;
+    }
+
+    // tasks spawned and not yet finished
+    std::size_t size() const {
+        return live;
+    }
+
+    std::size_t ready_count() const {
+        return ready.size();
+    }
+
+    std::size_t sleeping_count() const {
+        return sleeping.size();
+    }
+
+    std::size_t inflight_count() const {
+        return inflight.size();
+    }
+
+    std::size_t waiting_count() const {
+        std::size_t count = 0;
+        for (const auto& w : waiting) {
+            count += w.second.size();
+        }
+        return count;
+    }
+};
+} // sol
+
+#endif // SOL_SCHEDULER_HPP
@@ -0,0 +1,159 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_SCHEMA_HPP
+#define SOL_SCHEMA_HPP
+
+#include "stack.hpp"
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+namespace sol {
+// The names and member pointers of a struct's fields, made with sol::fields
+template <typename... Members>
+struct schema_fields {
+    std::array<const char*, sizeof...(Members)> names;
+    std::tuple<Members...> members;
+};
+
+namespace schema_detail {
+template <std::size_t... I, typename Tuple>
+inline auto split(std::index_sequence<I...>, Tuple&& args) {
+    return schema_fields<std::decay_t<std::tuple_element_t<I * 2 + 1, std::decay_t<Tuple>>>...>{
+        { { std::get<I * 2>(args)... } },
+        std::make_tuple(std::get<I * 2 + 1>(args)...)
+    };
+}
+} // schema_detail
+
+// fields("x", &T::x, "y", &T::y, ...), in the same form as a usertype's members
+template <typename... Args>
+inline auto fields(Args&&... args) {
+    static_assert(sizeof...(Args) % 2 == 0, "sol::fields takes a name and a member pointer for every field");
+    return schema_detail::split(std::make_index_sequence<sizeof...(Args) / 2>(), std::forward_as_tuple(std::forward<Args>(args)...));
+}
+
+// Converts T to and from a plain table in one pass. The field names are pushed into a table in the
+// registry the first time a state sees T, and are fetched from it by index after that, so no key
+// is ever hashed again; the tables made for T are sized for all of its fields up front,
+// and every field is read and written with raw accesses
+template <typename T>
+struct schema {
+    typedef decltype(schema_for<T>::fields()) fields_type;
+    static const std::size_t size = std::tuple_size<std::decay_t<decltype(std::declval<fields_type&>().members)>>::value;
+
+    static const fields_type& fields() {
+        static const fields_type f = schema_for<T>::fields();
+        return f;
+    }
+
+    static const void* keys_key() {
+        static char key = 0;
+        return &key;
+    }
+
+    // Leaves this state's table of T's field names on the stack
+    static void push_keys(lua_State* L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, keys_key());
+        if (lua_type(L, -1) == LUA_TTABLE) {
+            return;
+        }
+        lua_pop(L, 1);
+        lua_createtable(L, static_cast<int>(size), 0);
+        const fields_type& f = fields();
+        for (std::size_t i = 0; i < size; ++i) {
+            lua_pushstring(L, f.names[i]);
+            lua_rawseti(L, -2, static_cast<int>(i + 1));
+        }
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, keys_key());
+    }
+
+    template <std::size_t... I>
+    static void set_fields(std::index_sequence<I...>, lua_State* L, int keys, int target, const T& value) {
+        const fields_type& f = fields();
+        (void)f;
+        void(detail::swallow{ 0, (lua_rawgeti(L, keys, static_cast<int>(I + 1)),
+            stack::push(L, value.*std::get<I>(f.members)),
+            lua_rawset(L, target), 0)... });
+    }
+
+    template <typename Member>
+    static void get_field(lua_State* L, Member& member) {
+        if (lua_type(L, -1) != LUA_TNIL) {
+            member = stack::get<Member>(L, -1);
+        }
+        lua_pop(L, 1);
+    }
+
+    template <std::size_t... I>
+    static void get_fields(std::index_sequence<I...>, lua_State* L, int keys, int source, T& value) {
+        const fields_type& f = fields();
+        (void)f;
+        void(detail::swallow{ 0, (lua_rawgeti(L, keys, static_cast<int>(I + 1)),
+            lua_rawget(L, source),
+            get_field(L, value.*std::get<I>(f.members)), 0)... });
+    }
+
+    static int push(lua_State* L, const T& value) {
+        push_keys(L);
+        int keys = lua_gettop(L);
+        lua_createtable(L, 0, static_cast<int>(size));
+        set_fields(std::make_index_sequence<size>(), L, keys, keys + 1, value);
+        lua_remove(L, keys);
+        return 1;
+    }
+
+    // Fields missing from the table (or nil) keep the value they already had
+    static void get(lua_State* L, int index, T& value) {
+        index = lua_absindex(L, index);
+        push_keys(L);
+        get_fields(std::make_index_sequence<size>(), L, lua_gettop(L), index, value);
+        lua_pop(L, 1);
+    }
+
+    static T get(lua_State* L, int index = -1) {
+        T value{};
+        get(L, index, value);
+        return value;
+    }
+};
+
+namespace stack {
+template <typename T>
+struct pusher<T, std::enable_if_t<has_schema<T>::value>> {
+    static int push(lua_State* L, const T& value) {
+        return schema<T>::push(L, value);
+    }
+};
+
+template <typename T>
+struct getter<T, std::enable_if_t<has_schema<T>::value>> {
+    static T get(lua_State* L, int index = -1) {
+        return schema<T>::get(L, index);
+    }
+};
+} // stack
+} // sol
+
+#endif // SOL_SCHEMA_HPP
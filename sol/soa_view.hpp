@@ -0,0 +1,257 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_SOA_VIEW_HPP
+#define SOL_SOA_VIEW_HPP
+
+#include "array_view.hpp"
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sol {
+// Named columns of a struct-of-arrays, pushed to Lua as one userdata. Each column is handed out as an
+// array_view over the C++ memory, and for_each_batch gives a Lua function whole chunks of rows at a time,
+// so one call into Lua covers many entities. The columns have to outlive every use of the view from Lua
+class soa_view {
+private:
+    struct column {
+        std::string name;
+        char* data;
+        std::size_t size;
+        std::size_t stride;
+        void(*push)(lua_State*, char*, std::size_t);
+        void(*rebind)(void*, char*, std::size_t);
+    };
+
+    template <typename T>
+    struct column_ops {
+        static void push(lua_State* L, char* data, std::size_t n) {
+            stack::push(L, array_view<T>(reinterpret_cast<T*>(data), n));
+        }
+
+        // points the array_view userdata made by push somewhere else, without making a new one
+        static void rebind(void* memory, char* data, std::size_t n) {
+            new (memory) array_view<T>(reinterpret_cast<T*>(data), n);
+        }
+    };
+
+    std::vector<column> columns;
+
+public:
+    // A column with an existing name replaces it
+    template <typename T>
+    soa_view& add(std::string name, array_view<T> values) {
+        typedef std::remove_cv_t<T> U;
+        column c{ std::move(name), const_cast<char*>(reinterpret_cast<const char*>(values.data())), values.size(), sizeof(U), &column_ops<T>::push, &column_ops<T>::rebind };
+        for (column& existing : columns) {
+            if (existing.name == c.name) {
+                existing = std::move(c);
+                return *this;
+            }
+        }
+        columns.push_back(std::move(c));
+        return *this;
+    }
+
+    template <typename C>
+    soa_view& add(std::string name, C& container) {
+        return add(std::move(name), as_container(container));
+    }
+
+    // Rows every column has
+    std::size_t size() const {
+        if (columns.empty()) {
+            return 0;
+        }
+        std::size_t n = columns.front().size;
+        for (const column& c : columns) {
+            n = (std::min)(n, c.size);
+        }
+        return n;
+    }
+
+    std::size_t column_count() const {
+        return columns.size();
+    }
+
+    bool has(const std::string& name) const {
+        for (const column& c : columns) {
+            if (c.name == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear() {
+        columns.clear();
+    }
+
+    // Pushes rows [first, first + n) of the column named name, or nil
+    int push_column(lua_State* L, const char* name, std::size_t first, std::size_t n) const {
+        for (const column& c : columns) {
+            if (c.name == name) {
+                c.push(L, c.data + first * c.stride, n);
+                return 1;
+            }
+        }
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Calls fn(slices, count, first) for every chunk of rows: slices holds an array_view per column,
+    // over count rows starting at row first (1-based). The views are reused from one chunk to the next,
+    // so they are only good for the call they were given to
+    int for_each_batch(lua_State* L, int fn, std::size_t chunk) const {
+        fn = lua_absindex(L, fn);
+        std::size_t n = size();
+        luaL_checkstack(L, static_cast<int>(columns.size()) + 5, "sol: too many columns for for_each_batch");
+        lua_createtable(L, 0, static_cast<int>(columns.size()));
+        int slices = lua_gettop(L);
+        for (const column& c : columns) {
+            c.push(L, c.data, (std::min)(chunk, n));
+            lua_pushvalue(L, -1);
+            lua_setfield(L, slices, c.name.c_str());
+        }
+        int calls = 0;
+        for (std::size_t first = 0; first < n; first += chunk) {
+            std::size_t count = (std::min)(chunk, n - first);
+            for (std::size_t i = 0; i < columns.size(); ++i) {
+                const column& c = columns[i];
+                c.rebind(lua_touserdata(L, slices + 1 + static_cast<int>(i)), c.data + first * c.stride, count);
+            }
+            lua_pushvalue(L, fn);
+            lua_pushvalue(L, slices);
+            lua_pushinteger(L, static_cast<lua_Integer>(count));
+            lua_pushinteger(L, static_cast<lua_Integer>(first + 1));
+            lua_call(L, 3, 0);
+            ++calls;
+        }
+        lua_settop(L, slices - 1);
+        return calls;
+    }
+};
+
+template <>
+struct is_lua_primitive<soa_view> : std::true_type {};
+
+namespace stack {
+namespace stack_detail {
+struct soa_view_metatable {
+    static const std::size_t default_chunk = 1024;
+
+    static soa_view& self(lua_State* L) {
+        return *static_cast<soa_view*>(lua_touserdata(L, 1));
+    }
+
+    static int for_each_batch(lua_State* L) {
+        soa_view& v = *static_cast<soa_view*>(luaL_checkudata(L, 1, &usertype_traits<soa_view>::metatable()[0]));
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        lua_Integer chunk = lua_isnoneornil(L, 3) ? static_cast<lua_Integer>(default_chunk) : lua_tointeger(L, 3);
+        if (chunk < 1) {
+            return luaL_error(L, "sol: for_each_batch needs a chunk size of at least 1");
+        }
+        lua_pushinteger(L, v.for_each_batch(L, 2, static_cast<std::size_t>(chunk)));
+        return 1;
+    }
+
+    static int get_index(lua_State* L) {
+        soa_view& v = self(L);
+        if (lua_type(L, 2) != LUA_TSTRING) {
+            lua_pushnil(L);
+            return 1;
+        }
+        const char* name = lua_tostring(L, 2);
+        // methods come first: a column named like one is still there through for_each_batch
+        if (std::strcmp(name, "for_each_batch") == 0) {
+            lua_pushcfunction(L, &for_each_batch);
+            return 1;
+        }
+        return v.push_column(L, name, 0, v.size());
+    }
+
+    static int set_index(lua_State* L) {
+        return luaL_error(L, "sol: the columns of a soa_view cannot be replaced from Lua; write to their elements instead");
+    }
+
+    static int length(lua_State* L) {
+        lua_pushinteger(L, static_cast<lua_Integer>(self(L).size()));
+        return 1;
+    }
+
+    static int destroy(lua_State* L) {
+        self(L).~soa_view();
+        return 0;
+    }
+
+    static void push(lua_State* L) {
+        if (get_metatable<soa_view>(L) != type::nil) {
+            return;
+        }
+        lua_pop(L, 1);
+        static const luaL_Reg metafunctions[] = {
+            { "__index", &get_index },
+            { "__newindex", &set_index },
+            { "__len", &length },
+            { "__gc", &destroy },
+            { nullptr, nullptr }
+        };
+        luaL_newmetatable(L, &usertype_traits<soa_view>::metatable()[0]);
+        luaL_setfuncs(L, metafunctions, 0);
+        register_metatable<soa_view>(L);
+    }
+};
+} // stack_detail
+
+template <typename C>
+struct checker<soa_view, type::userdata, C> {
+    template <typename Handler>
+    static bool check(lua_State* L, int index, Handler&& handler) {
+        return stack_detail::check_view<soa_view>(L, index, std::forward<Handler>(handler));
+    }
+};
+
+template <>
+struct pusher<soa_view> {
+    static int push(lua_State* L, const soa_view& v) {
+        void* memory = lua_newuserdata(L, sizeof(soa_view));
+        new (memory) soa_view(v);
+        stack_detail::soa_view_metatable::push(L);
+        lua_setmetatable(L, -2);
+        return 1;
+    }
+};
+
+template <>
+struct getter<soa_view> {
+    static soa_view& get(lua_State* L, int index = -1) {
+        checker<soa_view>::check(L, index, type_panic);
+        return *static_cast<soa_view*>(lua_touserdata(L, index));
+    }
+};
+} // stack
+} // sol
+
+#endif // SOL_SOA_VIEW_HPP
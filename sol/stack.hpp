@@ -148,9 +148,23 @@ inline int call_into_lua(types<Ret0, Ret...>, types<Args...> ta, Fx&& fx, lua_St
     return push(L, std::forward<decltype(r)>(r));
 }
 
+// T:f(...) passes T's table as the first argument; it is compared raw, so no __eq runs
 inline call_syntax get_call_syntax(lua_State* L, const std::string& meta) {
+    bool hasargs = lua_gettop(L) > 0;
     luaL_getmetatable(L, meta.c_str());
-    if (lua_compare(L, -1, -2, LUA_OPEQ) == 1) {
+    if (hasargs && lua_rawequal(L, -1, 1) == 1) {
+        lua_pop(L, 1);
+        return call_syntax::colon;
+    }
+    lua_pop(L, 1);
+    return call_syntax::dot;
+}
+
+template <typename T>
+inline call_syntax get_call_syntax(lua_State* L) {
+    bool hasargs = lua_gettop(L) > 0;
+    stack_detail::get_metatable<T>(L);
+    if (hasargs && lua_rawequal(L, -1, 1) == 1) {
         lua_pop(L, 1);
         return call_syntax::colon;
     }
@@ -34,8 +34,7 @@ namespace stack {
 namespace stack_detail {
 template <typename T>
 inline bool check_metatable(lua_State* L, int index = -2) {
-    luaL_getmetatable(L, &usertype_traits<T>::metatable[0]);
-    const type expectedmetatabletype = static_cast<type>(lua_type(L, -1));
+    const type expectedmetatabletype = get_metatable<T>(L);
     if (expectedmetatabletype != type::nil) {
         if (lua_rawequal(L, -1, index) == 1) {
             lua_pop(L, 2);
@@ -148,6 +147,22 @@ struct checker<T, type::lightuserdata, C> {
 template <typename T, typename C>
 struct checker<non_null<T>, type::userdata, C> : checker<T, lua_type_of<T>::value, C> {};
 
+// Any whole number, or one of the names given to new_enum
+template <typename T>
+struct checker<T, type::number, std::enable_if_t<std::is_enum<T>::value>> {
+    template <typename Handler>
+    static bool check (lua_State* L, int index, Handler&& handler) {
+        type t = type_of(L, index);
+        lua_Integer value = 0;
+        bool success = stack_detail::enum_names<T>::value_of(L, index, value);
+        if (!success) {
+            // expected type, actual type
+            handler(L, index, type::number, t);
+        }
+        return success;
+    }
+};
+
 template <type X, typename C>
 struct checker<lua_CFunction, X, C> : stack_detail::basic_check<type::function, lua_iscfunction> {};
 template <type X, typename C>
@@ -182,43 +197,25 @@ struct checker<T, type::userdata, C> {
              handler(L, index, type::userdata, indextype);
              return false;
 	   }
-	   if (stack_detail::check_metatable<U>(L))
-            return true;
-	   if (stack_detail::check_metatable<U*>(L))
-            return true;
-	   if (stack_detail::check_metatable<unique_usertype<U>>(L))
-            return true;
-#ifndef SOL_NO_EXCEPTIONS
-        lua_getfield(L, -1, &detail::base_class_check_key()[0]);
-        void* basecastdata = lua_touserdata(L, -1);
-        detail::throw_cast basecast = (detail::throw_cast)basecastdata;
-        bool success = detail::catch_check<T>(basecast);
-#elif !defined(SOL_NO_RTTI)
-        lua_getfield(L, -1, &detail::base_class_check_key()[0]);
-        if (stack::get<type>(L) == type::nil) {
-            lua_pop(L, 2);
-            return false;
-        }
-        void* basecastdata = lua_touserdata(L, -1);
-        detail::inheritance_check_function ic = (detail::inheritance_check_function)basecastdata;
-        bool success = ic(typeid(T));
-#else
-        // Topkek
-        lua_getfield(L, -1, &detail::base_class_check_key()[0]);
-        if (stack::get<type>(L) == type::nil) {
-            lua_pop(L, 2);
-            return false;
-        }
-        void* basecastdata = lua_touserdata(L, -1);
-        detail::inheritance_check_function ic = (detail::inheritance_check_function)basecastdata;
-        bool success = ic(detail::id_for<T>::value);
-#endif // No Runtime Type Information || Exceptions
-        lua_pop(L, 2);
-        if (!success) {
+        // Usertype metatables carry their identity: one raw get settles it, bases included
+        const detail::usertype_identity* identity = detail::get_identity(L);
+        if (identity != nullptr) {
+            lua_pop(L, 1);
+            if (identity->id == detail::id_for<U>::value || (identity->check != nullptr && identity->check(detail::id_for<U>::value)))
+                return true;
             handler(L, index, type::userdata, indextype);
             return false;
         }
-        return true;
+        // Anything else has to be one of the metatables registered for U
+        if (stack_detail::check_metatable<U>(L))
+            return true;
+        if (stack_detail::check_metatable<U*>(L))
+            return true;
+        if (stack_detail::check_metatable<unique_usertype<U>>(L))
+            return true;
+        lua_pop(L, 1);
+        handler(L, index, type::userdata, indextype);
+        return false;
     }
 
     template <typename Handler>
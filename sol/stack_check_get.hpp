@@ -78,6 +78,54 @@ struct check_getter<T, std::enable_if_t<std::is_floating_point<T>::value>> {
     }
 };
 
+namespace stack_detail {
+template <typename C>
+struct container_check_getter {
+    template <typename Handler>
+    static optional<C> get(lua_State* L, int index, Handler&& handler) {
+        const type indextype = type_of(L, index);
+        if (indextype == type::userdata) {
+            // views are checked against the container type, then copied
+            if (!stack::check<C>(L, index, handler)) {
+                return nullopt;
+            }
+            return optional<C>(*getter<C*>::get_no_nil(L, index));
+        }
+        if (indextype != type::table) {
+            handler(L, index, type::table, indextype);
+            return nullopt;
+        }
+        C cont{};
+        if (!read(meta::has_key_value_pair<C>(), L, lua_absindex(L, index), cont, handler)) {
+            return nullopt;
+        }
+        return optional<C>(std::move(cont));
+    }
+
+    template <typename Handler>
+    static bool read(std::false_type, lua_State* L, int index, C& cont, Handler& handler) {
+        return get_sequence(std::true_type(), L, index, cont, handler);
+    }
+
+    template <typename Handler>
+    static bool read(std::true_type, lua_State* L, int index, C& cont, Handler& handler) {
+        return get_associative(std::true_type(), L, index, cont, handler);
+    }
+};
+} // stack_detail
+
+template <typename T, typename Al>
+struct check_getter<std::vector<T, Al>> : stack_detail::container_check_getter<std::vector<T, Al>> {};
+
+template <typename T, std::size_t N>
+struct check_getter<std::array<T, N>> : stack_detail::container_check_getter<std::array<T, N>> {};
+
+template <typename K, typename V, typename C, typename Al>
+struct check_getter<std::map<K, V, C, Al>> : stack_detail::container_check_getter<std::map<K, V, C, Al>> {};
+
+template <typename K, typename V, typename H, typename E, typename Al>
+struct check_getter<std::unordered_map<K, V, H, E, Al>> : stack_detail::container_check_getter<std::unordered_map<K, V, H, E, Al>> {};
+
 template <typename T>
 struct getter<optional<T>> {
     static decltype(auto) get(lua_State* L, int index) {
@@ -27,16 +27,33 @@
 #include "userdata.hpp"
 #include "tuple.hpp"
 #include "traits.hpp"
+#include "usertype_traits.hpp"
+#include "inheritance.hpp"
+#include "usertype_storage.hpp"
+#include "finalizer_queue.hpp"
+#include "table_pool_core.hpp"
 
 namespace sol {
 namespace detail {
-using special_destruct_func = void(*)(void*);
+// Given a queue, the holder is moved into it before the one in the userdata is destroyed
+using special_destruct_func = void(*)(void*, finalizer_queue*);
+
+template <typename Real>
+inline void special_defer(std::false_type, Real&, finalizer_queue*) {}
+
+template <typename Real>
+inline void special_defer(std::true_type, Real& target, finalizer_queue* deferred) {
+    if (deferred != nullptr) {
+        deferred->defer(std::move(target));
+    }
+}
 
 template <typename T, typename Real>
-inline void special_destruct(void* memory) {
+inline void special_destruct(void* memory, finalizer_queue* deferred) {
     T** pointerpointer = static_cast<T**>(memory);
     special_destruct_func* dx = static_cast<special_destruct_func*>(static_cast<void*>(pointerpointer + 1));
     Real* target = static_cast<Real*>(static_cast<void*>(dx + 1));
+    special_defer(is_destruction_deferred<T>(), *target, deferred);
     target->~Real();
 }
 
@@ -45,7 +62,7 @@ inline int unique_destruct(lua_State* L) {
     void* memory = lua_touserdata(L, 1);
     T** pointerpointer = static_cast<T**>(memory);
     special_destruct_func& dx = *static_cast<special_destruct_func*>( static_cast<void*>( pointerpointer + 1 ) );
-    (dx)(memory);
+    (dx)(memory, is_destruction_deferred<T>::value ? finalizer_detail::find(L) : nullptr);
     return 0;
 }
 } // detail
@@ -58,6 +75,10 @@ struct field_setter;
 template <typename T, bool global = false, typename = void>
 struct probe_field_getter;
 template<typename T, typename = void>
+struct raw_field_getter;
+template<typename T, typename = void>
+struct raw_field_setter;
+template<typename T, typename = void>
 struct getter;
 template<typename T, typename = void>
 struct popper;
@@ -78,6 +99,19 @@ struct probe {
 };
 
 namespace stack_detail {
+// Puts a stack back the way it was, unless released
+struct stack_reset {
+    lua_State* L;
+    int top;
+    stack_reset(lua_State* L) : L(L), top(lua_gettop(L)) {}
+    void release() { L = nullptr; }
+    ~stack_reset() {
+        if (L != nullptr) {
+            lua_settop(L, top);
+        }
+    }
+};
+
 template <typename T>
 struct strip {
     typedef T type;
@@ -92,6 +126,46 @@ struct strip<non_null<T>> {
 };
 template <typename T>
 using strip_t = typename strip<T>::type;
+
+// Per state and enum: a registry table from the names given to new_enum to their values.
+// Lua strings are interned, so looking a name up is a single hashed raw get
+template <typename E>
+struct enum_names {
+    static const void* key() {
+        static char k = 0;
+        return &k;
+    }
+
+    static bool lookup(lua_State* L, int index, lua_Integer& value) {
+        index = lua_absindex(L, index);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+        if (lua_type(L, -1) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            return false;
+        }
+        lua_pushvalue(L, index);
+        lua_rawget(L, -2);
+        int isnum = 0;
+        value = lua_tointegerx(L, -1, &isnum);
+        lua_pop(L, 2);
+        return isnum != 0;
+    }
+
+    // Whole numbers, or names given to new_enum: fractions and unknown names are not a value
+    static bool value_of(lua_State* L, int index, lua_Integer& value) {
+        switch (lua_type(L, index)) {
+        case LUA_TNUMBER: {
+            lua_Number n = lua_tonumber(L, index);
+            value = static_cast<lua_Integer>(n);
+            return static_cast<lua_Number>(value) == n;
+        }
+        case LUA_TSTRING:
+            return lookup(L, index, value);
+        default:
+            return false;
+        }
+    }
+};
 const bool default_check_arguments = 
 #ifdef SOL_CHECK_ARGUMENTS
 true;
@@ -102,6 +176,99 @@ template<typename T>
 inline decltype(auto) unchecked_get(lua_State* L, int index = -1) {
     return getter<meta::Unqualified<T>>{}.get(L, index);
 }
+
+// Metatables are cached in the registry under a per-type lightuserdata key,
+// so fetching one is a pointer-keyed raw get instead of hashing the type name
+template <typename T>
+inline type get_metatable(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &usertype_traits<T>::metatable_key);
+    return static_cast<type>(lua_type(L, -1));
+}
+
+// T* and unique_usertype<T> get their metatables copied from T's (see get_derived_metatable)
+template <typename T>
+struct is_derived_metatable : std::is_pointer<T> {};
+
+template <typename T, typename Real>
+struct is_derived_metatable<unique_usertype<T, Real>> : std::true_type {};
+
+// Both the cached key and the name: luaL_newmetatable would hand the old table back otherwise
+template <typename T>
+inline void unregister_metatable(lua_State* L) {
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &usertype_traits<T>::metatable_key);
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, &usertype_traits<T>::metatable()[0]);
+}
+
+template <typename T>
+inline void forget_derived_metatables(std::true_type, lua_State*) {}
+
+template <typename T>
+inline void forget_derived_metatables(std::false_type, lua_State* L) {
+    unregister_metatable<T*>(L);
+    unregister_metatable<unique_usertype<T>>(L);
+}
+
+template <typename T>
+inline void register_metatable(lua_State* L, int index = -1) {
+    lua_pushvalue(L, index);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &usertype_traits<T>::metatable_key);
+    // copies made from an earlier metatable of T are stale now: they are made again when needed
+    forget_derived_metatables<T>(is_derived_metatable<T>(), L);
+}
+
+// The metatables for T* and unique_usertype<T> only differ from T's in their __gc,
+// so they are copied from it the first time they're needed rather than built up front
+// for every usertype. Leaves the metatable (or nil, if T has none) on the stack.
+template <typename Meta, typename T>
+inline type get_derived_metatable(lua_State* L, lua_CFunction gc) {
+    if (get_metatable<Meta>(L) != type::nil) {
+        return type::table;
+    }
+    lua_pop(L, 1);
+    if (get_metatable<T>(L) == type::nil) {
+        return type::nil;
+    }
+    int source = lua_gettop(L);
+    luaL_newmetatable(L, &usertype_traits<Meta>::metatable()[0]);
+    int target = source + 1;
+    lua_pushliteral(L, "__gc");
+    int gcname = target + 1;
+    lua_pushnil(L);
+    while (lua_next(L, source) != 0) {
+        if (lua_rawequal(L, -2, gcname) == 1) {
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, target);
+    }
+#if SOL_LUA_VERSION > 502
+    // the copy brought T's __name along
+    lua_pushstring(L, &usertype_traits<Meta>::metatable()[0]);
+    lua_setfield(L, target, "__name");
+#endif // __name is 5.3
+    if (gc != nullptr) {
+        lua_pushcfunction(L, gc);
+        lua_rawset(L, target);
+    }
+    else {
+        lua_pop(L, 1);
+    }
+    if (detail::usertype_storage<T>::value_only) {
+        // the copy brought T's identity along, whose blocks hold the object rather than a pointer
+        const detail::usertype_identity* identity = detail::get_identity(L, source);
+        if (identity != nullptr) {
+            lua_pushlightuserdata(L, const_cast<detail::usertype_identity*>(identity->by_pointer));
+            lua_rawsetp(L, target, detail::usertype_identity_key());
+        }
+    }
+    register_metatable<Meta>(L, target);
+    lua_remove(L, source);
+    return type::table;
+}
 } // stack_detail
 
 inline bool maybe_indexable(lua_State* L, int index = -1) {
@@ -217,6 +384,27 @@ template <bool global = false, typename Key, typename Value>
 void set_field(lua_State* L, Key&& key, Value&& value, int tableindex) {
     field_setter<meta::Unqualified<Key>, global>{}.set(L, std::forward<Key>(key), std::forward<Value>(value), tableindex);
 }
+
+// Same as get_field/set_field, but with raw accesses: metamethods are never looked up
+template <typename Key>
+void raw_get_field(lua_State* L, Key&& key) {
+    raw_field_getter<meta::Unqualified<Key>>{}.get(L, std::forward<Key>(key));
+}
+
+template <typename Key>
+void raw_get_field(lua_State* L, Key&& key, int tableindex) {
+    raw_field_getter<meta::Unqualified<Key>>{}.get(L, std::forward<Key>(key), tableindex);
+}
+
+template <typename Key, typename Value>
+void raw_set_field(lua_State* L, Key&& key, Value&& value) {
+    raw_field_setter<meta::Unqualified<Key>>{}.set(L, std::forward<Key>(key), std::forward<Value>(value));
+}
+
+template <typename Key, typename Value>
+void raw_set_field(lua_State* L, Key&& key, Value&& value, int tableindex) {
+    raw_field_setter<meta::Unqualified<Key>>{}.set(L, std::forward<Key>(key), std::forward<Value>(value), tableindex);
+}
 } // stack
 } // sol
 
@@ -29,6 +29,23 @@
 
 namespace sol {
 namespace stack {
+namespace stack_detail {
+// Moves a relative index past values pushed on top of it; absolute and pseudo-indices stay put
+inline int below(int index, int pushed) {
+    return index < 0 && index > LUA_REGISTRYINDEX ? index - pushed : index;
+}
+
+// bool is integral too, but true and false are keys of their own
+template <typename T>
+using is_integer_key = meta::And<std::is_integral<T>, meta::Not<std::is_same<T, bool>>>;
+
+#if SOL_LUA_VERSION >= 503
+typedef lua_Integer raw_index_t;
+#else
+typedef int raw_index_t;
+#endif // Lua 5.3.x takes lua_Integer indices
+} // stack_detail
+
 template <typename T, bool, typename>
 struct field_getter {
     template <typename Key>
@@ -84,15 +101,19 @@ struct field_getter<T, false, std::enable_if_t<meta::is_c_str<T>::value>> {
     }
 };
 
-#if SOL_LUA_VERSION >= 503
 template <typename T>
-struct field_getter<T, false, std::enable_if_t<std::is_integral<T>::value>> {
+struct field_getter<T, false, std::enable_if_t<stack_detail::is_integer_key<T>::value>> {
     template <typename Key>
     void get(lua_State* L, Key&& key, int tableindex = -1) {
+#if SOL_LUA_VERSION >= 503
         lua_geti(L, tableindex, static_cast<lua_Integer>(key));
+#else
+        // no lua_geti: the integer goes straight on the stack instead of through push
+        lua_pushinteger(L, static_cast<lua_Integer>(key));
+        lua_gettable(L, stack_detail::below(tableindex, 1));
+#endif // Lua 5.3.x
     }
 };
-#endif // Lua 5.3.x
 
 template <typename T, bool, typename>
 struct field_setter {
@@ -122,16 +143,57 @@ struct field_setter<T, false, std::enable_if_t<meta::is_c_str<T>::value>> {
     }
 };
 
-#if SOL_LUA_VERSION >= 503
 template <typename T>
-struct field_setter<T, false, std::enable_if_t<std::is_integral<T>::value>> {
+struct field_setter<T, false, std::enable_if_t<stack_detail::is_integer_key<T>::value>> {
     template <typename Key, typename Value>
     void set(lua_State* L, Key&& key, Value&& value, int tableindex = -2) {
+#if SOL_LUA_VERSION >= 503
         push(L, std::forward<Value>(value));
         lua_seti(L, tableindex, static_cast<lua_Integer>(key));
+#else
+        // tableindex counts the value only: the key sits one slot further up
+        lua_pushinteger(L, static_cast<lua_Integer>(key));
+        push(L, std::forward<Value>(value));
+        lua_settable(L, stack_detail::below(tableindex, 1));
+#endif // Lua 5.3.x
+    }
+};
+
+template <typename T, typename>
+struct raw_field_getter {
+    template <typename Key>
+    void get(lua_State* L, Key&& key, int tableindex = -2) {
+        push(L, std::forward<Key>(key));
+        lua_rawget(L, tableindex);
+    }
+};
+
+template <typename T>
+struct raw_field_getter<T, std::enable_if_t<stack_detail::is_integer_key<T>::value>> {
+    template <typename Key>
+    void get(lua_State* L, Key&& key, int tableindex = -1) {
+        lua_rawgeti(L, tableindex, static_cast<stack_detail::raw_index_t>(key));
+    }
+};
+
+template <typename T, typename>
+struct raw_field_setter {
+    template <typename Key, typename Value>
+    void set(lua_State* L, Key&& key, Value&& value, int tableindex = -3) {
+        push(L, std::forward<Key>(key));
+        push(L, std::forward<Value>(value));
+        lua_rawset(L, tableindex);
+    }
+};
+
+template <typename T>
+struct raw_field_setter<T, std::enable_if_t<stack_detail::is_integer_key<T>::value>> {
+    template <typename Key, typename Value>
+    void set(lua_State* L, Key&& key, Value&& value, int tableindex = -2) {
+        push(L, std::forward<Value>(value));
+        lua_rawseti(L, tableindex, static_cast<stack_detail::raw_index_t>(key));
     }
 };
-#endif // Lua 5.3.x
 } // stack
 } // sol
 
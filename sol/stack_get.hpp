@@ -30,6 +30,11 @@
 #include <memory>
 #include <functional>
 #include <utility>
+#include <vector>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
 
 namespace sol {
 namespace stack {
@@ -62,8 +67,20 @@ struct getter<T, std::enable_if_t<meta::And<std::is_integral<T>, std::is_unsigne
     }
 };
 
+// Whole numbers are taken as they are; strings are looked up among the names given to new_enum
 template<typename T>
-struct getter<T, std::enable_if_t<std::is_base_of<reference, T>::value>> {
+struct getter<T, std::enable_if_t<std::is_enum<T>::value>> {
+    static T get(lua_State* L, int index = -1) {
+        lua_Integer value = 0;
+        if (!stack_detail::enum_names<T>::value_of(L, index, value)) {
+            luaL_error(L, "sol: %s is not a value of this enum", luaL_tolstring(L, index, nullptr));
+        }
+        return static_cast<T>(value);
+    }
+};
+
+template<typename T>
+struct getter<T, std::enable_if_t<is_lua_reference<T>::value>> {
     static T get(lua_State* L, int index = -1) {
         return T(L, index);
     }
@@ -106,6 +123,16 @@ struct getter<std::string> {
     }
 };
 
+template<>
+struct getter<string_view> {
+    static string_view get(lua_State* L, int index = -1) {
+        // Points into the string Lua owns: good for as long as that string stays on the stack
+        std::size_t len;
+        auto str = lua_tolstring(L, index, &len);
+        return { str, len };
+    }
+};
+
 template<>
 struct getter<const char*> {
     static const char* get(lua_State* L, int index = -1) {
@@ -144,38 +171,38 @@ struct getter<void*> {
 template<typename T>
 struct getter<T*> {
     static T* get_no_nil(lua_State* L, int index = -1) {
-        void** pudata = static_cast<void**>(lua_touserdata(L, index));
-        void* udata = *pudata;
-        return get_no_nil_from(L, udata, index);
+        void* memory = lua_touserdata(L, index);
+        if (lua_getmetatable(L, index) == 0) {
+            return static_cast<T*>(*static_cast<void**>(memory));
+        }
+        const detail::usertype_identity* identity = detail::get_identity(L);
+        lua_pop(L, 1);
+        if (identity == nullptr) {
+            return static_cast<T*>(*static_cast<void**>(memory));
+        }
+        // value-only blocks hold the object itself, every other kind starts with a pointer to it
+        void* udata = identity->locate != nullptr ? identity->locate(memory) : *static_cast<void**>(memory);
+        if (identity->id != detail::id_for<T>::value && identity->cast != nullptr) {
+            void* castdata = identity->cast(udata, detail::id_for<T>::value);
+            if (castdata != nullptr) {
+                udata = castdata;
+            }
+        }
+        return static_cast<T*>(udata);
     }
 
     static T* get_no_nil_from(lua_State* L, void* udata, int index = -1) {
-#ifndef SOL_NO_EXCEPTIONS
-        if (luaL_getmetafield(L, index, &detail::base_class_check_key()[0]) != 0) {
-            void* basecastdata = lua_touserdata(L, -1);
-            detail::throw_cast basecast = (detail::throw_cast)basecastdata;
-            // use the casting function to properly adjust the pointer for the desired T
-            udata = detail::catch_cast<T>(udata, basecast);
-            lua_pop(L, 1);
-        }
-#elif !defined(SOL_NO_RTTI)
-        if (luaL_getmetafield(L, index, &detail::base_class_cast_key()[0]) != 0) {
-            void* basecastdata = lua_touserdata(L, -1);
-            detail::inheritance_cast_function ic = (detail::inheritance_cast_function)basecastdata;
-            // use the casting function to properly adjust the pointer for the desired T
-            udata = ic(udata, typeid(T));
-            lua_pop(L, 1);
-        }
-#else
-        // Lol, you motherfucker
-        if (luaL_getmetafield(L, index, &detail::base_class_cast_key()[0]) != 0) {
-            void* basecastdata = lua_touserdata(L, -1);
-            detail::inheritance_cast_function ic = (detail::inheritance_cast_function)basecastdata;
-            // use the casting function to properly adjust the pointer for the desired T
-            udata = ic(udata, detail::id_for<T>::value);
+        if (lua_getmetatable(L, index) != 0) {
+            const detail::usertype_identity* identity = detail::get_identity(L);
             lua_pop(L, 1);
+            if (identity != nullptr && identity->id != detail::id_for<T>::value && identity->cast != nullptr) {
+                // use the casting function to properly adjust the pointer for the desired T
+                void* castdata = identity->cast(udata, detail::id_for<T>::value);
+                if (castdata != nullptr) {
+                    udata = castdata;
+                }
+            }
         }
-#endif // No Runtime Type Information || Exceptions
         T* obj = static_cast<T*>(udata);
         return obj;
     }
@@ -254,6 +281,136 @@ struct getter<std::pair<A, B>> {
     }
 };
 
+namespace stack_detail {
+// Tables are read straight into containers with raw accesses:
+// no sol::object or registry reference is made for any element.
+// With Checked = std::true_type every element is checked first, and a bad one stops the conversion
+template <typename T, typename Handler>
+inline bool check_element(std::false_type, lua_State*, int, Handler&) {
+    return true;
+}
+
+template <typename T, typename Handler>
+inline bool check_element(std::true_type, lua_State* L, int index, Handler& handler) {
+    return stack::check<T>(L, index, handler);
+}
+
+template <typename C, typename Checked, typename Handler>
+inline bool get_sequence(Checked checked, lua_State* L, int index, C& cont, Handler&& handler) {
+    typedef typename C::value_type T;
+    std::size_t len = static_cast<std::size_t>(lua_rawlen(L, index));
+    cont.reserve(len);
+    for (std::size_t i = 1; i <= len; ++i) {
+        lua_rawgeti(L, index, static_cast<int>(i));
+        if (!check_element<T>(checked, L, -1, handler)) {
+            lua_pop(L, 1);
+            return false;
+        }
+        cont.push_back(stack_detail::unchecked_get<T>(L, -1));
+        lua_pop(L, 1);
+    }
+    return true;
+}
+
+template <typename T, std::size_t N, typename Checked, typename Handler>
+inline bool get_sequence(Checked checked, lua_State* L, int index, std::array<T, N>& cont, Handler&& handler) {
+    std::size_t len = (std::min)(N, static_cast<std::size_t>(lua_rawlen(L, index)));
+    for (std::size_t i = 0; i < len; ++i) {
+        lua_rawgeti(L, index, static_cast<int>(i + 1));
+        if (!check_element<T>(checked, L, -1, handler)) {
+            lua_pop(L, 1);
+            return false;
+        }
+        cont[i] = stack_detail::unchecked_get<T>(L, -1);
+        lua_pop(L, 1);
+    }
+    return true;
+}
+
+template <typename C, typename Checked, typename Handler>
+inline bool get_associative(Checked checked, lua_State* L, int index, C& cont, Handler&& handler) {
+    typedef typename C::key_type K;
+    typedef typename C::mapped_type V;
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        // Keys are read from a copy: lua_tolstring would turn a number key
+        // into a string in place, which lua_next does not survive
+        lua_pushvalue(L, -2);
+        if (!check_element<K>(checked, L, -1, handler) || !check_element<V>(checked, L, -2, handler)) {
+            lua_pop(L, 3);
+            return false;
+        }
+        cont.emplace(stack_detail::unchecked_get<K>(L, -1), stack_detail::unchecked_get<V>(L, -2));
+        lua_pop(L, 2);
+    }
+    return true;
+}
+
+// A container view (pushed by pointer or std::ref) is copied out of the C++ container it refers to
+template <typename C>
+inline void get_view(lua_State* L, int index, C& cont) {
+    if (lua_type(L, index) == LUA_TUSERDATA) {
+        cont = *getter<C*>::get_no_nil(L, index);
+    }
+}
+} // stack_detail
+
+template<typename T, typename Al>
+struct getter<std::vector<T, Al>> {
+    static std::vector<T, Al> get(lua_State* L, int index = -1) {
+        std::vector<T, Al> cont;
+        if (lua_type(L, index) == LUA_TTABLE) {
+            stack_detail::get_sequence(std::false_type(), L, lua_absindex(L, index), cont, no_panic);
+        }
+        else {
+            stack_detail::get_view(L, index, cont);
+        }
+        return cont;
+    }
+};
+
+template<typename T, std::size_t N>
+struct getter<std::array<T, N>> {
+    static std::array<T, N> get(lua_State* L, int index = -1) {
+        std::array<T, N> cont{};
+        if (lua_type(L, index) == LUA_TTABLE) {
+            stack_detail::get_sequence(std::false_type(), L, lua_absindex(L, index), cont, no_panic);
+        }
+        else {
+            stack_detail::get_view(L, index, cont);
+        }
+        return cont;
+    }
+};
+
+template<typename K, typename V, typename C, typename Al>
+struct getter<std::map<K, V, C, Al>> {
+    static std::map<K, V, C, Al> get(lua_State* L, int index = -1) {
+        std::map<K, V, C, Al> cont;
+        if (lua_type(L, index) == LUA_TTABLE) {
+            stack_detail::get_associative(std::false_type(), L, lua_absindex(L, index), cont, no_panic);
+        }
+        else {
+            stack_detail::get_view(L, index, cont);
+        }
+        return cont;
+    }
+};
+
+template<typename K, typename V, typename H, typename E, typename Al>
+struct getter<std::unordered_map<K, V, H, E, Al>> {
+    static std::unordered_map<K, V, H, E, Al> get(lua_State* L, int index = -1) {
+        std::unordered_map<K, V, H, E, Al> cont;
+        if (lua_type(L, index) == LUA_TTABLE) {
+            stack_detail::get_associative(std::false_type(), L, lua_absindex(L, index), cont, no_panic);
+        }
+        else {
+            stack_detail::get_view(L, index, cont);
+        }
+        return cont;
+    }
+};
+
 } // stack
 } // sol
 
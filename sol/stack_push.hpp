@@ -23,6 +23,7 @@
 #define SOL_STACK_PUSH_HPP
 
 #include "stack_core.hpp"
+#include "container_usertype.hpp"
 #include "raii.hpp"
 #include <memory>
 
@@ -35,31 +36,141 @@ struct pusher {
         // Basically, we store all user-data like this:
         // If it's a movable/copyable value (no std::ref(x)), then we store the pointer to the new
         // data in the first sizeof(T*) bytes, and then however many bytes it takes to
-        // do the actual object. Things that are std::ref or plain T* are stored as 
-        // just the sizeof(T*), and nothing else.
-        T** pointerpointer = static_cast<T**>(lua_newuserdata(L, sizeof(T*) + sizeof(T)));
-        T*& referencereference = *pointerpointer;
-        T* allocationtarget = reinterpret_cast<T*>(pointerpointer + 1);
-        referencereference = allocationtarget;
+        // do the actual object (see usertype_storage, which also drops the pointer for value-only types).
+        // Things that are std::ref or plain T* are stored as just the sizeof(T*), and nothing else.
+        T* allocationtarget = detail::usertype_storage<T>::allocate(L);
         std::allocator<T> alloc{};
         alloc.construct(allocationtarget, std::forward<Args>(args)...);
-        luaL_getmetatable(L, &usertype_traits<T>::metatable[0]);
+        stack_detail::get_metatable<T>(L);
         lua_setmetatable(L, -2);
         return 1;
     }
 };
 
+template<typename T, typename... Args>
+struct pusher<emplaced<T, Args...>> {
+    template <std::size_t... I>
+    static int push(std::index_sequence<I...>, lua_State* L, emplaced<T, Args...>& e) {
+        return stack::push<T>(L, std::move(std::get<I>(e.args))...);
+    }
+
+    static int push(lua_State* L, emplaced<T, Args...> e) {
+        return push(std::index_sequence_for<Args...>(), L, e);
+    }
+};
+
+namespace stack_detail {
+// A weak-valued table per state and pointee type: address (lightuserdata) -> the userdata made for it
+template <typename T>
+struct identity_cache {
+    static const void* key() {
+        static char k = 0;
+        return &k;
+    }
+
+    static void push(lua_State* L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+        if (lua_type(L, -1) == LUA_TTABLE) {
+            return;
+        }
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+    }
+};
+
+#ifdef SOL_LUAJIT
+// Per state and type: the function ffi_declare left in the registry, turning a lightuserdata into T* cdata
+template <typename T>
+struct ffi_caster {
+    static const void* key() {
+        static char k = 0;
+        return &k;
+    }
+};
+#endif // SOL_LUAJIT
+} // stack_detail
+
+// Forgets the userdata cached for obj, typically when obj is destroyed: otherwise a new object
+// that reuses the address would be handed the old userdata (and whatever Lua attached to it)
+template <typename T>
+inline void invalidate_identity(lua_State* L, T* obj) {
+    stack_detail::identity_cache<T>::push(L);
+    lua_pushnil(L);
+    lua_rawsetp(L, -2, obj);
+    lua_pop(L, 1);
+}
+
 template<typename T>
 struct pusher<T*> {
-    static int push(lua_State* L, T* obj) {
-        if (obj == nullptr)
-            return stack::push(L, nil);
+    static void push_metatable(std::false_type, lua_State* L) {
+        stack_detail::get_derived_metatable<T*, T>(L, nullptr);
+    }
+
+    static void push_metatable(std::true_type, lua_State* L) {
+        // containers that are not usertypes of their own get a live view
+        if (stack_detail::get_derived_metatable<T*, T>(L, nullptr) == type::nil) {
+            lua_pop(L, 1);
+            stack_detail::container_metatable<T>::push(L);
+        }
+    }
+
+    static int push_new(lua_State* L, T* obj) {
         T** pref = static_cast<T**>(lua_newuserdata(L, sizeof(T*)));
         *pref = obj;
-        luaL_getmetatable(L, &usertype_traits<T*>::metatable[0]);
+        push_metatable(is_container<T>(), L);
         lua_setmetatable(L, -2);
         return 1;
     }
+
+    static int push(std::false_type, lua_State* L, T* obj) {
+        return push_new(L, obj);
+    }
+
+    static int push(std::true_type, lua_State* L, T* obj) {
+        stack_detail::identity_cache<T>::push(L);
+        lua_rawgetp(L, -1, obj);
+        if (lua_type(L, -1) != LUA_TUSERDATA) {
+            lua_pop(L, 1);
+            push_new(L, obj);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, -3, obj);
+        }
+        lua_remove(L, -2);
+        return 1;
+    }
+
+#ifdef SOL_LUAJIT
+    static bool push_cdata(std::false_type, lua_State*, T*) {
+        return false;
+    }
+
+    static bool push_cdata(std::true_type, lua_State* L, T* obj) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, stack_detail::ffi_caster<std::remove_cv_t<T>>::key());
+        if (lua_type(L, -1) != LUA_TFUNCTION) {
+            lua_pop(L, 1);
+            return false;
+        }
+        lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(obj)));
+        lua_call(L, 1, 1);
+        return true;
+    }
+#endif // SOL_LUAJIT
+
+    static int push(lua_State* L, T* obj) {
+        if (obj == nullptr)
+            return stack::push(L, nil);
+#ifdef SOL_LUAJIT
+        if (push_cdata(is_ffi_usertype<std::remove_cv_t<T>>(), L, obj))
+            return 1;
+#endif // SOL_LUAJIT
+        return push(is_identity_cached<std::remove_cv_t<T>>(), L, obj);
+    }
 };
 
 template<typename T, typename Real>
@@ -72,8 +183,15 @@ struct pusher<unique_usertype<T, Real>> {
         *fx = detail::special_destruct<T, Real>;
         detail::default_construct::construct(mem, std::forward<Args>(args)...);
 	   *pref = std::addressof(detail::deref(*mem));
-        if (luaL_newmetatable(L, &usertype_traits<unique_usertype<T>>::metatable[0]) == 1) {
-            set_field(L, "__gc", detail::unique_destruct<T>);
+        if (stack_detail::get_derived_metatable<unique_usertype<T>, T>(L, detail::unique_destruct<T>) == type::nil) {
+            lua_pop(L, 1);
+            if (luaL_newmetatable(L, &usertype_traits<unique_usertype<T>>::metatable()[0]) == 1) {
+                set_field(L, "__gc", detail::unique_destruct<T>);
+                if (is_destruction_deferred<T>::value) {
+                    finalizer_detail::ensure(L);
+                }
+            }
+            stack_detail::register_metatable<unique_usertype<T>>(L);
         }
         lua_setmetatable(L, -2);
         return 1;
@@ -141,32 +259,74 @@ struct pusher<T, std::enable_if_t<meta::And<std::is_integral<T>, std::is_unsigne
 };
 
 template<typename T>
-struct pusher<T, std::enable_if_t<meta::And<meta::has_begin_end<T>, meta::Not<meta::has_key_value_pair<T>>, meta::Not<std::is_base_of<reference, T>>>::value>> {
+struct pusher<T, std::enable_if_t<std::is_enum<T>::value>> {
+    static int push(lua_State* L, const T& value) {
+        lua_pushinteger(L, static_cast<lua_Integer>(value));
+        return 1;
+    }
+};
+
+namespace stack_detail {
+// Ranges go into tables with raw sets: a freshly made table has no metamethods to honour,
+// and lua_settable would look for them on every element
+template <typename It>
+inline void raw_set_sequence(lua_State* L, int tableindex, int index, It first, It last) {
+    for (; first != last; ++first, ++index) {
+        stack::push(L, *first);
+        lua_rawseti(L, tableindex, index);
+    }
+}
+
+template <typename It>
+inline void raw_set_pairs(lua_State* L, int tableindex, It first, It last) {
+    for (; first != last; ++first) {
+        auto&& pair = *first;
+        stack::push(L, pair.first);
+        stack::push(L, pair.second);
+        lua_rawset(L, tableindex);
+    }
+}
+} // stack_detail
+
+template<typename T>
+struct pusher<T, std::enable_if_t<meta::And<meta::has_begin_end<T>, meta::Not<meta::has_key_value_pair<T>>, meta::Not<is_lua_reference<T>>>::value>> {
     static int push(lua_State* L, const T& cont) {
         lua_createtable(L, static_cast<int>(cont.size()), 0);
-        int tableindex = lua_gettop(L);
-        unsigned index = 1;
-        for(auto&& i : cont) {
-            set_field(L, index++, i, tableindex);
-        }
+        stack_detail::raw_set_sequence(L, lua_gettop(L), 1, cont.begin(), cont.end());
         return 1;
     }
 };
 
 template<typename T>
-struct pusher<T, std::enable_if_t<meta::And<meta::has_begin_end<T>, meta::has_key_value_pair<T>, meta::Not<std::is_base_of<reference, T>>>::value>> {
+struct pusher<T, std::enable_if_t<meta::And<meta::has_begin_end<T>, meta::has_key_value_pair<T>, meta::Not<is_lua_reference<T>>>::value>> {
     static int push(lua_State* L, const T& cont) {
-        lua_createtable(L, static_cast<int>(cont.size()), 0);
-        int tableindex = lua_gettop(L);
-        for(auto&& pair : cont) {
-            set_field(L, pair.first, pair.second, tableindex);
-        }
+        // keys land in the hash part, so that's the one to presize
+        lua_createtable(L, 0, static_cast<int>(cont.size()));
+        stack_detail::raw_set_pairs(L, lua_gettop(L), cont.begin(), cont.end());
+        return 1;
+    }
+};
+
+template<typename T>
+struct pusher<pooled_container<T>> {
+    static void fill(std::false_type, lua_State* L, int tableindex, const T& cont) {
+        stack_detail::raw_set_sequence(L, tableindex, 1, cont.begin(), cont.end());
+    }
+
+    static void fill(std::true_type, lua_State* L, int tableindex, const T& cont) {
+        stack_detail::raw_set_pairs(L, tableindex, cont.begin(), cont.end());
+    }
+
+    static int push(lua_State* L, const pooled_container<T>& p) {
+        int size = static_cast<int>(p.container.size());
+        table_pool_detail::acquire(L, meta::has_key_value_pair<T>::value ? 0 : size, meta::has_key_value_pair<T>::value ? size : 0);
+        fill(meta::has_key_value_pair<T>(), L, lua_gettop(L), p.container);
         return 1;
     }
 };
 
 template<typename T>
-struct pusher<T, std::enable_if_t<std::is_base_of<reference, T>::value>> {
+struct pusher<T, std::enable_if_t<is_lua_reference<T>::value>> {
     static int push(lua_State*, T& ref) {
         return ref.push();
     }
@@ -265,6 +425,14 @@ struct pusher<std::string> {
     }
 };
 
+template<>
+struct pusher<string_view> {
+    static int push(lua_State* L, string_view str) {
+        lua_pushlstring(L, str.data(), str.size());
+        return 1;
+    }
+};
+
 template<typename... Args>
 struct pusher<std::tuple<Args...>> {
     template <std::size_t... I, typename T>
@@ -23,11 +23,42 @@
 #define SOL_STATE_HPP
 
 #include "state_view.hpp"
+#include "allocators.hpp"
 
 namespace sol {
-class state : private std::unique_ptr<lua_State, void(*)(lua_State*)>, public state_view {
+namespace detail {
+struct state_allocator_holder {
+    // type-erased: must outlive the lua_State, hence a base class constructed before it
+    std::shared_ptr<void> allocator;
+
+    state_allocator_holder() = default;
+    state_allocator_holder(std::shared_ptr<void> allocator) : allocator(std::move(allocator)) {}
+};
+
+inline lua_State* new_state(lua_Alloc alfunc, void* aldata) {
+    lua_State* L = lua_newstate(alfunc, aldata);
+#ifndef SOL_NO_EXCEPTIONS
+    if (L == nullptr) {
+        throw error("sol: unable to allocate a new lua_State");
+    }
+#endif // No Exceptions
+    return L;
+}
+} // detail
+
+class state : private detail::state_allocator_holder, private std::unique_ptr<lua_State, void(*)(lua_State*)>, public state_view {
 private:
     typedef std::unique_ptr<lua_State, void(*)(lua_State*)> unique_base;
+
+    struct allocator_tag {};
+
+    template <typename Allocator>
+    state(allocator_tag, std::shared_ptr<Allocator> alloc, lua_CFunction panic) : detail::state_allocator_holder(alloc), unique_base(detail::new_state(&detail::lua_allocate<Allocator>, alloc.get()), lua_close),
+    state_view(unique_base::get()) {
+        set_panic(panic);
+        stack::luajit_exception_handler(unique_base::get());
+    }
+
 public:
     state(lua_CFunction panic = detail::atpanic) : unique_base(luaL_newstate(), lua_close),
     state_view(unique_base::get()) {
@@ -35,6 +66,17 @@ public:
         stack::luajit_exception_handler(unique_base::get());
     }
 
+    state(lua_Alloc alfunc, void* aldata, lua_CFunction panic = detail::atpanic) : unique_base(detail::new_state(alfunc, aldata), lua_close),
+    state_view(unique_base::get()) {
+        set_panic(panic);
+        stack::luajit_exception_handler(unique_base::get());
+    }
+
+    // The state keeps the allocator alive until after lua_close;
+    // pass std::ref(alloc) to keep ownership (and share it between states)
+    template <typename Allocator, meta::DisableIf<meta::Or<std::is_convertible<std::decay_t<Allocator>, lua_CFunction>, std::is_convertible<std::decay_t<Allocator>, lua_Alloc>>> = 0>
+    state(Allocator&& alloc, lua_CFunction panic = detail::atpanic) : state(allocator_tag(), std::make_shared<std::decay_t<Allocator>>(std::forward<Allocator>(alloc)), panic) {}
+
     using state_view::get;
 };
 } // sol
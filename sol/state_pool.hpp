@@ -0,0 +1,204 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_STATE_POOL_HPP
+#define SOL_STATE_POOL_HPP
+
+#include "state.hpp"
+#include "function.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace sol {
+// A fixed set of states, each owned by its own worker thread.
+// Every worker runs the setup callback on its own state, so all of them begin with the same
+// registrations; the functions behind a usertype pushed into several of them are shared, not copied.
+// A state is only ever touched by its worker: work is handed over as jobs that return futures
+class state_pool {
+public:
+    typedef std::function<void(state&)> setup_function;
+
+private:
+    struct worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void(state&)>> jobs;
+        bool stopping = false;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+    std::size_t next = 0;
+    std::mutex nextlock;
+
+    static void run(worker& w, const setup_function& setup, std::promise<void>& ready) {
+        std::unique_ptr<state> lua;
+#ifndef SOL_NO_EXCEPTIONS
+        try {
+#endif // No Exceptions
+            lua = std::make_unique<state>();
+            if (setup) {
+                setup(*lua);
+            }
+            ready.set_value();
+#ifndef SOL_NO_EXCEPTIONS
+        }
+        catch (...) {
+            ready.set_exception(std::current_exception());
+            return;
+        }
+#endif // No Exceptions
+        for (;;) {
+            std::function<void(state&)> job;
+            {
+                std::unique_lock<std::mutex> lock(w.mutex);
+                w.wake.wait(lock, [&w]() { return w.stopping || !w.jobs.empty(); });
+                // whatever was queued before stopping still gets to run
+                if (w.jobs.empty()) {
+                    break;
+                }
+                job = std::move(w.jobs.front());
+                w.jobs.pop_front();
+            }
+            job(*lua);
+        }
+        // the state is closed on the thread that used it
+    }
+
+    void stop() {
+        for (auto& w : workers) {
+            {
+                std::lock_guard<std::mutex> lock(w->mutex);
+                w->stopping = true;
+            }
+            w->wake.notify_one();
+        }
+        for (auto& w : workers) {
+            if (w->thread.joinable()) {
+                w->thread.join();
+            }
+        }
+        workers.clear();
+    }
+
+    template <typename R, typename Tuple, std::size_t... I>
+    static R call_global(state& lua, const std::string& name, Tuple& params, std::index_sequence<I...>) {
+        function fx = lua[name];
+        return fx.template call<R>(std::get<I>(params)...);
+    }
+
+public:
+    state_pool(std::size_t count, setup_function setup = setup_function()) {
+        if (count < 1) {
+            count = 1;
+        }
+        std::vector<std::promise<void>> ready(count);
+        workers.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            workers.push_back(std::make_unique<worker>());
+            worker& w = *workers.back();
+            std::promise<void>& r = ready[i];
+            // the states are made in parallel, but setup must outlive them all being ready
+            w.thread = std::thread([&w, &setup, &r]() { run(w, setup, r); });
+        }
+        std::exception_ptr failure = nullptr;
+        for (auto& r : ready) {
+#ifndef SOL_NO_EXCEPTIONS
+            try {
+#endif // No Exceptions
+                r.get_future().get();
+#ifndef SOL_NO_EXCEPTIONS
+            }
+            catch (...) {
+                if (failure == nullptr) {
+                    failure = std::current_exception();
+                }
+            }
+#endif // No Exceptions
+        }
+        if (failure != nullptr) {
+            stop();
+            std::rethrow_exception(failure);
+        }
+    }
+
+    state_pool(const state_pool&) = delete;
+    state_pool& operator=(const state_pool&) = delete;
+
+    ~state_pool() {
+        stop();
+    }
+
+    std::size_t size() const {
+        return workers.size();
+    }
+
+    // Runs fx(state&) on the given worker's state
+    template <typename Fx>
+    auto submit_to(std::size_t index, Fx&& fx) -> std::future<decltype(fx(std::declval<state&>()))> {
+        typedef decltype(fx(std::declval<state&>())) R;
+        auto task = std::make_shared<std::packaged_task<R(state&)>>(std::forward<Fx>(fx));
+        std::future<R> result = task->get_future();
+        worker& w = *workers[index % workers.size()];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.jobs.emplace_back([task](state& lua) { (*task)(lua); });
+        }
+        w.wake.notify_one();
+        return result;
+    }
+
+    // Runs fx(state&) on the next state, round robin
+    template <typename Fx>
+    auto submit(Fx&& fx) -> std::future<decltype(fx(std::declval<state&>()))> {
+        std::size_t index;
+        {
+            std::lock_guard<std::mutex> lock(nextlock);
+            index = next++;
+        }
+        return submit_to(index, std::forward<Fx>(fx));
+    }
+
+    std::future<void> script(std::string code) {
+        return submit([code](state& lua) { lua.script(code); });
+    }
+
+    // Calls the global function name with args on the next state; the args are copied over
+    template <typename R, typename... Args>
+    std::future<R> call(std::string name, Args&&... args) {
+        auto params = std::make_tuple(std::forward<Args>(args)...);
+        return submit([name, params](state& lua) mutable -> R {
+            return call_global<R>(lua, name, params, std::index_sequence_for<Args...>());
+        });
+    }
+};
+} // sol
+
+#endif // SOL_STATE_POOL_HPP
@@ -0,0 +1,114 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_STATE_PROTOTYPE_HPP
+#define SOL_STATE_PROTOTYPE_HPP
+
+#include "state.hpp"
+#include "compile.hpp"
+#include "mapped_file.hpp"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sol {
+// A recipe for initialized states: libraries, registrations and scripts are recorded once,
+// with the scripts compiled to bytecode up front, then replayed into every new state.
+// Usertypes made outside the prototype and set from a setup step share their functions between all the states
+class state_prototype {
+public:
+    typedef std::function<void(state_view&)> step_function;
+
+private:
+    std::vector<step_function> steps;
+
+    static std::string compile(const char* code, std::size_t size, const std::string& chunkname) {
+        state scratch;
+        lua_State* L = scratch.lua_state();
+        if (stack::load_buffer(L, code, size, chunkname.c_str()) != LUA_OK) {
+            std::string err = stack::pop<std::string>(L);
+            throw error(err);
+        }
+        std::string bytecode;
+        stack::dump(L, bytecode);
+        return bytecode;
+    }
+
+    state_prototype& bytecode_step(std::string bytecode, std::string chunkname) {
+        steps.push_back([bytecode, chunkname](state_view& lua) {
+            lua_State* L = lua.lua_state();
+            if (stack::load_bytecode(L, bytecode.data(), bytecode.size(), chunkname.c_str()) || lua_pcall(L, 0, 0, 0)) {
+                lua_error(L);
+            }
+        });
+        return *this;
+    }
+
+public:
+    template <typename... Args>
+    state_prototype& open_libraries(Args... libraries) {
+        static_assert(meta::are_same<lib, Args...>::value, "all types must be libraries");
+        steps.push_back([libraries...](state_view& lua) { lua.open_libraries(static_cast<lib>(libraries)...); });
+        return *this;
+    }
+
+    // Anything else to do to every state, such as set_usertype or set_function
+    state_prototype& setup(step_function step) {
+        steps.push_back(std::move(step));
+        return *this;
+    }
+
+    // Compiled right away, so syntax errors are thrown here rather than from make
+    state_prototype& script(const std::string& code, const std::string& chunkname = std::string()) {
+        std::string name = chunkname.empty() ? code : chunkname;
+        return bytecode_step(compile(code.data(), code.size(), name), name);
+    }
+
+    state_prototype& script_file(const std::string& filename) {
+        mapped_file file(filename);
+        std::string name = "@" + filename;
+        return bytecode_step(compile(file.data(), file.size(), name), name);
+    }
+
+    // Replays every step, in the order they were added, into an existing state
+    void apply(state_view& lua) const {
+        for (auto& step : steps) {
+            step(lua);
+        }
+    }
+
+    // Makes a new state (args go to its constructor, for a panic function or an allocator) and applies the steps to it
+    template <typename... Args>
+    state make(Args&&... args) const {
+        state lua(std::forward<Args>(args)...);
+        apply(lua);
+        return lua;
+    }
+
+    std::size_t size() const {
+        return steps.size();
+    }
+};
+} // sol
+
+#endif // SOL_STATE_PROTOTYPE_HPP
@@ -24,6 +24,14 @@
 
 #include "error.hpp"
 #include "table.hpp"
+#include "table_pool.hpp"
+#include "chunk_cache.hpp"
+#include "mapped_file.hpp"
+#include "compile.hpp"
+#include "module_manager.hpp"
+#include "function.hpp"
+#include "gc.hpp"
+#include <chrono>
 #include <memory>
 
 namespace sol {
@@ -54,6 +62,109 @@ enum class lib : char {
     count
 };
 
+namespace detail {
+// The name and luaopen_ function of a library, or nullptr when there is nothing to open for it
+inline const char* library_opener(lib library, lua_CFunction& opener) {
+    switch(library) {
+#if SOL_LUA_VERSION <= 501 && defined(SOL_LUAJIT)
+    case lib::coroutine:
+#endif // luajit opens coroutine base stuff
+    case lib::base:
+        opener = luaopen_base;
+        return "base";
+    case lib::package:
+        opener = luaopen_package;
+        return "package";
+#if SOL_LUA_VERSION > 501
+    case lib::coroutine:
+        opener = luaopen_coroutine;
+        return "coroutine";
+#endif // Lua 5.2+ only
+    case lib::string:
+        opener = luaopen_string;
+        return "string";
+    case lib::table:
+        opener = luaopen_table;
+        return "table";
+    case lib::math:
+        opener = luaopen_math;
+        return "math";
+    case lib::bit32:
+#if SOL_LUA_VERSION > 510
+        opener = luaopen_bit32;
+        return "bit32";
+#else
+        return nullptr;
+#endif // Lua 5.2+ only
+    case lib::io:
+        opener = luaopen_io;
+        return "io";
+    case lib::os:
+        opener = luaopen_os;
+        return "os";
+    case lib::debug:
+        opener = luaopen_debug;
+        return "debug";
+    default:
+        return nullptr;
+    }
+}
+
+// Upvalues of the lazy loaders: 1 is global name -> library, 2 is library -> luaopen_ function
+// for the libraries not opened yet, 3 is whatever __index the globals had before.
+// Opens the library named at nameindex and pushes it, if it is still pending
+inline bool open_lazy_library(lua_State* L, int nameindex) {
+    lua_pushvalue(L, nameindex);
+    lua_rawget(L, lua_upvalueindex(2));
+    lua_CFunction opener = lua_tocfunction(L, -1);
+    lua_pop(L, 1);
+    if(opener == nullptr) {
+        return false;
+    }
+    lua_pushvalue(L, nameindex);
+    lua_pushnil(L);
+    lua_rawset(L, lua_upvalueindex(2));
+    luaL_requiref(L, lua_tostring(L, nameindex), opener, 1);
+    return true;
+}
+
+inline int lazy_library_index(lua_State* L) {
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    if(lua_type(L, -1) == LUA_TSTRING && open_lazy_library(L, lua_gettop(L))) {
+        // the library made its globals: look the name up again
+        lua_settop(L, 2);
+        lua_rawget(L, 1);
+        return 1;
+    }
+    lua_settop(L, 2);
+    switch(lua_type(L, lua_upvalueindex(3))) {
+    case LUA_TFUNCTION:
+        lua_pushvalue(L, lua_upvalueindex(3));
+        lua_insert(L, 1);
+        lua_call(L, 2, 1);
+        return 1;
+    case LUA_TTABLE:
+        lua_gettable(L, lua_upvalueindex(3));
+        return 1;
+    default:
+        lua_pushnil(L);
+        return 1;
+    }
+}
+
+// The first method called on a string opens the string library, which puts its own metatable on strings
+inline int lazy_string_index(lua_State* L) {
+    lua_pushstring(L, "string");
+    if(!open_lazy_library(L, lua_gettop(L))) {
+        lua_getglobal(L, "string");
+    }
+    lua_pushvalue(L, 2);
+    lua_gettable(L, -2);
+    return 1;
+}
+} // detail
+
 class state_view {
 private:
     lua_State* L;
@@ -82,59 +193,81 @@ public:
         lib libraries[1 + sizeof...(args)] = { lib::count, std::forward<Args>(args)... };
 
         for(auto&& library : libraries) {
-            switch(library) {
-#if SOL_LUA_VERSION <= 501 && defined(SOL_LUAJIT)
-            case lib::coroutine:
-#endif // luajit opens coroutine base stuff
-            case lib::base:
-                luaL_requiref(L, "base", luaopen_base, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::package:
-                luaL_requiref(L, "package", luaopen_package, 1);
-                lua_pop(L, 1);
-                break;
-#if SOL_LUA_VERSION > 501
-            case lib::coroutine:
-                luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+            lua_CFunction opener = nullptr;
+            const char* name = detail::library_opener(library, opener);
+            if(name != nullptr) {
+                luaL_requiref(L, name, opener, 1);
                 lua_pop(L, 1);
-                break;
-#endif // Lua 5.2+ only
-            case lib::string:
-                luaL_requiref(L, "string", luaopen_string, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::table:
-                luaL_requiref(L, "table", luaopen_table, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::math:
-                luaL_requiref(L, "math", luaopen_math, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::bit32:
-#if SOL_LUA_VERSION > 510
-                luaL_requiref(L, "bit32", luaopen_bit32, 1);
-                lua_pop(L, 1);
-#else
-#endif // Lua 5.2+ only
-                break;
-            case lib::io:
-                luaL_requiref(L, "io", luaopen_io, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::os:
-                luaL_requiref(L, "os", luaopen_os, 1);
-                lua_pop(L, 1);
-                break;
-            case lib::debug:
-                luaL_requiref(L, "debug", luaopen_debug, 1);
+            }
+        }
+    }
+
+    // Only base is opened right away: the other libraries are opened by the globals' __index
+    // the first time their name is looked up, after which they are plain globals.
+    // Strings get a stand-in metatable so a method call on a string brings in the string library too
+    template<typename... Args>
+    void open_libraries_lazy(Args&&... args) {
+        static_assert(meta::are_same<lib, Args...>::value, "all types must be libraries");
+        lib listed[1 + sizeof...(args)] = { lib::count, std::forward<Args>(args)... };
+        lib everything[static_cast<std::size_t>(lib::count)];
+        for(std::size_t i = 0; i < static_cast<std::size_t>(lib::count); ++i) {
+            everything[i] = static_cast<lib>(i);
+        }
+        lib* first = sizeof...(args) == 0 ? everything : listed;
+        lib* last = sizeof...(args) == 0 ? everything + static_cast<std::size_t>(lib::count) : listed + 1 + sizeof...(args);
+
+        int top = lua_gettop(L);
+        lua_newtable(L);
+        int pending = lua_gettop(L);
+        lua_newtable(L);
+        int openers = lua_gettop(L);
+        bool lazystrings = false;
+        for(lib* library = first; library != last; ++library) {
+            lua_CFunction opener = nullptr;
+            const char* name = detail::library_opener(*library, opener);
+            if(name == nullptr) {
+                continue;
+            }
+            if(opener == luaopen_base) {
+                // its functions are globals themselves
+                luaL_requiref(L, name, opener, 1);
                 lua_pop(L, 1);
-                break;
-            case lib::count:
-                break;
+                continue;
             }
+            lua_pushcfunction(L, opener);
+            lua_setfield(L, openers, name);
+            lua_pushstring(L, name);
+            lua_setfield(L, pending, name);
+            if(*library == lib::package) {
+                lua_pushstring(L, name);
+                lua_setfield(L, pending, "require");
+            }
+            lazystrings = lazystrings || *library == lib::string;
+        }
+
+        lua_pushglobaltable(L);
+        if(lua_getmetatable(L, -1) == 0) {
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setmetatable(L, -3);
+        }
+        int metatable = lua_gettop(L);
+        lua_pushvalue(L, pending);
+        lua_pushvalue(L, openers);
+        lua_getfield(L, metatable, "__index");
+        lua_pushcclosure(L, &detail::lazy_library_index, 3);
+        lua_setfield(L, metatable, "__index");
+        if(lazystrings) {
+            lua_pushstring(L, "");
+            lua_createtable(L, 0, 1);
+            lua_pushvalue(L, pending);
+            lua_pushvalue(L, openers);
+            lua_pushnil(L);
+            lua_pushcclosure(L, &detail::lazy_string_index, 3);
+            lua_setfield(L, -2, "__index");
+            lua_setmetatable(L, -2);
         }
+        lua_settop(L, top);
     }
 
     void script(const std::string& code) {
@@ -144,7 +277,40 @@ public:
     }
 
     void script_file(const std::string& filename) {
-        if(luaL_dofile(L, filename.c_str())) {
+        if(stack::load_mapped_file(L, filename) || lua_pcall(L, 0, LUA_MULTRET, 0)) {
+            lua_error(L);
+        }
+    }
+
+    // Compiles the file without running it; the file is mapped and handed to lua_load in one piece
+    template<typename Fx = function>
+    Fx load_file(const std::string& filename) {
+        if(stack::load_mapped_file(L, filename)) {
+            std::string err = stack::pop<std::string>(L);
+            throw error(err);
+        }
+        return stack::pop<Fx>(L);
+    }
+
+    // Loads a chunk made by compile_parallel, throwing its compile error if it had one
+    template<typename Fx = function>
+    Fx load(const compiled_chunk& chunk) {
+        if(stack::load_compiled(L, chunk)) {
+            std::string err = stack::pop<std::string>(L);
+            throw error(err);
+        }
+        return stack::pop<Fx>(L);
+    }
+
+    // Same as above, but compiled at most once for all the states sharing cache
+    void script(const std::string& code, chunk_cache& cache) {
+        if(cache.load(L, code) || lua_pcall(L, 0, LUA_MULTRET, 0)) {
+            lua_error(L);
+        }
+    }
+
+    void script_file(const std::string& filename, chunk_cache& cache) {
+        if(cache.load_file(L, filename) || lua_pcall(L, 0, LUA_MULTRET, 0)) {
             lua_error(L);
         }
     }
@@ -177,6 +343,139 @@ public:
         lua_atpanic(L, panic);
     }
 
+    void collect_garbage() {
+        lua_gc(L, LUA_GCCOLLECT, 0);
+    }
+
+    // Does incremental steps of stepsize until budget is spent or a cycle finishes;
+    // returns whether the cycle finished. At least one step is always done
+    bool collect_garbage_step(std::chrono::microseconds budget, int stepsize = 0) {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point deadline = clock::now() + budget;
+        do {
+            if (lua_gc(L, LUA_GCSTEP, stepsize) != 0) {
+                return true;
+            }
+        } while (clock::now() < deadline);
+        return false;
+    }
+
+    void stop_gc() {
+        lua_gc(L, LUA_GCSTOP, 0);
+    }
+
+    void restart_gc() {
+        lua_gc(L, LUA_GCRESTART, 0);
+    }
+
+#if SOL_LUA_VERSION > 501
+    bool is_gc_running() const {
+        return lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+    }
+#endif // Lua 5.2+ only
+
+    // Only Lua 5.4 (and 5.2's experimental mode) have a generational collector: elsewhere this does nothing
+    void set_gc_mode(gc_mode mode) {
+#if SOL_LUA_VERSION >= 504
+        lua_gc(L, mode == gc_mode::generational ? LUA_GCGEN : LUA_GCINC, 0, 0);
+#elif SOL_LUA_VERSION == 502
+        lua_gc(L, mode == gc_mode::generational ? LUA_GCGEN : LUA_GCINC, 0);
+#else
+        (void)mode;
+#endif // generational collectors
+    }
+
+    // Both return the previous value, in percent
+    int set_gc_pause(int pause) {
+        return lua_gc(L, LUA_GCSETPAUSE, pause);
+    }
+
+    int set_gc_step_multiplier(int stepmul) {
+        return lua_gc(L, LUA_GCSETSTEPMUL, stepmul);
+    }
+
+    std::size_t memory_used() const {
+        return gc_detail::bytes_in_use(L);
+    }
+
+    // Cycles are counted from the first call on, including the ones Lua runs on its own
+    gc_stats gc_statistics() const {
+        gc_detail::tracker& t = gc_detail::get_tracker(L);
+        std::size_t bytes = gc_detail::bytes_in_use(L);
+        return { bytes, static_cast<std::ptrdiff_t>(bytes) - static_cast<std::ptrdiff_t>(t.marked), t.cycles };
+    }
+
+    // Destroys what the finalizers of is_destruction_deferred types have queued; both return how many
+    std::size_t drain_finalizers() {
+        finalizer_queue* q = finalizer_detail::find(L);
+        return q == nullptr ? 0 : q->drain();
+    }
+
+    std::size_t drain_finalizers(std::chrono::nanoseconds budget) {
+        finalizer_queue* q = finalizer_detail::find(L);
+        return q == nullptr ? 0 : q->drain(budget);
+    }
+
+    std::size_t pending_finalizers() const {
+        finalizer_queue* q = finalizer_detail::find(L);
+        return q == nullptr ? 0 : q->size();
+    }
+
+    // Lives as long as the state; it can be drained from another thread, but not once the state is closing
+    finalizer_queue& finalizers() {
+        return finalizer_detail::ensure(L);
+    }
+
+    sol::table_pool pooled_tables() const {
+        return sol::table_pool(L);
+    }
+
+    // Made the first time it is asked for: only modules required after that are tracked
+    module_manager& modules() {
+        return module_detail::ensure(L);
+    }
+
+    // Without SOL_BINDING_STATS nothing is measured: these do nothing and the stats are always empty
+    void enable_binding_stats(bool on = true) {
+#ifdef SOL_BINDING_STATS
+        binding_stats_detail::enable(L, on);
+#else
+        (void)on;
+#endif // SOL_BINDING_STATS
+    }
+
+    std::vector<binding_stat> binding_stats() const {
+#ifdef SOL_BINDING_STATS
+        return binding_stats_detail::collect(L);
+#else
+        return std::vector<binding_stat>();
+#endif // SOL_BINDING_STATS
+    }
+
+    void reset_binding_stats() {
+#ifdef SOL_BINDING_STATS
+        binding_stats_detail::reset(L);
+#endif // SOL_BINDING_STATS
+    }
+
+    // Without SOL_REFERENCE_STATS nothing is counted and these are all zero or empty;
+    // sites are only recorded when NDEBUG is not defined
+    reference_stats reference_statistics() const {
+#ifdef SOL_REFERENCE_STATS
+        return reference_stats_detail::statistics(L);
+#else
+        return reference_stats{ 0, 0, 0, 0.0, 0.0 };
+#endif // SOL_REFERENCE_STATS
+    }
+
+    std::vector<reference_site> reference_sites() const {
+#ifdef SOL_REFERENCE_STATS
+        return reference_stats_detail::sites(L);
+#else
+        return std::vector<reference_site>();
+#endif // SOL_REFERENCE_STATS
+    }
+
     template<typename... Args, typename... Keys>
     decltype(auto) get(Keys&&... keys) const {
         return global.get<Args...>(std::forward<Keys>(keys)...);
@@ -193,6 +492,16 @@ public:
         return global.traverse_get<T>(std::forward<Keys>(keys)...);
     }
 
+    template<typename T, typename... Keys>
+    decltype(auto) try_get(Keys&&... keys) const {
+        return global.template try_get<T>(std::forward<Keys>(keys)...);
+    }
+
+    template<typename T, typename... Args>
+    T get_or(Args&&... args) const {
+        return global.template get_or<T>(std::forward<Args>(args)...);
+    }
+
     template<typename... Args>
     state_view& traverse_set(Args&&... args) {
         global.traverse_set(std::forward<Args>(args)...);
@@ -201,7 +510,7 @@ public:
 
     template<typename T>
     state_view& set_usertype(usertype<T>& user) {
-        return set_usertype(usertype_traits<T>::name, user);
+        return set_usertype(usertype_traits<T>::name(), user);
     }
 
     template<typename Key, typename T>
@@ -228,11 +537,22 @@ public:
         return *this;
     }
 
+    template<typename E>
+    state_view& new_enum(const std::string& name, std::initializer_list<std::pair<const char*, E>> items, bool read_only = false) {
+        global.new_enum<E>(name, items, read_only);
+        return *this;
+    }
+
     template <typename Fx>
     void for_each(Fx&& fx) {
         global.for_each(std::forward<Fx>(fx));
     }
 
+    template <typename Key, typename Value, typename Fx>
+    void for_each(Fx&& fx) {
+        global.template for_each<Key, Value>(std::forward<Fx>(fx));
+    }
+
     template<typename T>
     proxy<global_table&, T> operator[](T&& key) {
         return global[std::forward<T>(key)];
@@ -309,6 +629,20 @@ public:
         return create_table_with(lua_state(), std::forward<Args>(args)...);
     }
 
+    table create_table(pooled_t, int narr = 0, int nrec = 0) {
+        return global_table::create(pooled, lua_state(), narr, nrec);
+    }
+
+    template <typename Key, typename Value, typename... Args>
+    table create_table(pooled_t, int narr, int nrec, Key&& key, Value&& value, Args&&... args) {
+        return global_table::create(pooled, lua_state(), narr, nrec, std::forward<Key>(key), std::forward<Value>(value), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    table create_table_with(pooled_t, Args&&... args) {
+        return global_table::create_with(pooled, lua_state(), std::forward<Args>(args)...);
+    }
+
     static inline table create_table(lua_State* L, int narr = 0, int nrec = 0) {
         return global_table::create(L, narr, nrec);
     }
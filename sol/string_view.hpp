@@ -0,0 +1,100 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_STRING_VIEW_HPP
+#define SOL_STRING_VIEW_HPP
+
+#if __cplusplus > 201402L
+#include <string_view>
+#else
+#include <string>
+#include <cstddef>
+#include <algorithm>
+#include <ostream>
+#endif // C++ 14
+
+namespace sol {
+
+#if __cplusplus > 201402L
+using string_view = std::string_view;
+#else
+// A read-only view of characters someone else owns:
+// enough of std::string_view for reading strings off the Lua stack without copying them
+class string_view {
+private:
+    const char* p;
+    std::size_t len;
+
+public:
+    typedef char value_type;
+    typedef const char* const_iterator;
+    typedef const_iterator iterator;
+    typedef std::size_t size_type;
+    static const size_type npos = static_cast<size_type>(-1);
+
+    string_view() noexcept : p(nullptr), len(0) {}
+    string_view(const char* str, size_type count) noexcept : p(str), len(count) {}
+    string_view(const char* str) : p(str), len(std::char_traits<char>::length(str)) {}
+    string_view(const std::string& str) noexcept : p(str.data()), len(str.size()) {}
+
+    const_iterator begin() const noexcept { return p; }
+    const_iterator end() const noexcept { return p + len; }
+    const char* data() const noexcept { return p; }
+    size_type size() const noexcept { return len; }
+    size_type length() const noexcept { return len; }
+    bool empty() const noexcept { return len == 0; }
+    const char& operator[](size_type i) const { return p[i]; }
+    const char& front() const { return p[0]; }
+    const char& back() const { return p[len - 1]; }
+
+    string_view substr(size_type pos, size_type count = npos) const {
+        pos = (std::min)(pos, len);
+        return string_view(p + pos, (std::min)(count, len - pos));
+    }
+
+    int compare(string_view r) const noexcept {
+        int c = std::char_traits<char>::compare(p, r.p, (std::min)(len, r.len));
+        if (c != 0) {
+            return c;
+        }
+        return len < r.len ? -1 : (len > r.len ? 1 : 0);
+    }
+
+    explicit operator std::string() const {
+        return std::string(p, len);
+    }
+
+    friend bool operator==(string_view l, string_view r) noexcept { return l.len == r.len && l.compare(r) == 0; }
+    friend bool operator!=(string_view l, string_view r) noexcept { return !(l == r); }
+    friend bool operator<(string_view l, string_view r) noexcept { return l.compare(r) < 0; }
+    friend bool operator>(string_view l, string_view r) noexcept { return l.compare(r) > 0; }
+    friend bool operator<=(string_view l, string_view r) noexcept { return l.compare(r) <= 0; }
+    friend bool operator>=(string_view l, string_view r) noexcept { return l.compare(r) >= 0; }
+
+    friend std::ostream& operator<<(std::ostream& os, string_view s) {
+        return os.write(s.p, static_cast<std::streamsize>(s.len));
+    }
+};
+#endif // C++ 14
+} // sol
+
+#endif // SOL_STRING_VIEW_HPP
@@ -27,10 +27,36 @@
 #include "function_types.hpp"
 #include "usertype.hpp"
 #include "table_iterator.hpp"
+#include "key.hpp"
+#include "array_view.hpp"
+#include <initializer_list>
 
 namespace sol {
-template <bool top_level>
-class table_core : public reference {
+namespace detail {
+inline int enum_newindex(lua_State* L) {
+    return luaL_error(L, "sol: cannot modify the values of an enum");
+}
+
+inline int enum_next(lua_State* L) {
+    lua_settop(L, 2);
+    if (lua_next(L, 1) == 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return 2;
+}
+
+// pairs over a read-only enum walks the table behind it
+inline int enum_pairs(lua_State* L) {
+    lua_pushcfunction(L, &enum_next);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushnil(L);
+    return 3;
+}
+} // detail
+
+template <bool top_level, typename base_t>
+class basic_table_core : public base_t {
     friend class state;
     friend class state_view;
 
@@ -62,6 +88,20 @@ class table_core : public reference {
         }
     }
 
+    template<typename Key, typename Value, typename Fx>
+    static void call_with_pair( std::false_type, lua_State* L, Fx& fx ) {
+        fx( stack::get<Key>( L, -2 ), stack::get<Value>( L, -1 ) );
+    }
+
+    template<typename Key, typename Value, typename Fx>
+    static void call_with_pair( std::true_type, lua_State* L, Fx& fx ) {
+        // Getting a string out of a number key converts it in place, which would break lua_next:
+        // read the key from a copy instead
+        lua_pushvalue( L, -2 );
+        fx( stack::get<Key>( L, -1 ), stack::get<Value>( L, -2 ) );
+        lua_pop( L, 1 );
+    }
+
     template<typename Ret0, typename Ret1, typename... Ret, std::size_t... I, typename Keys>
     auto tuple_get( types<Ret0, Ret1, Ret...>, std::index_sequence<I...>, Keys&& keys ) const
     -> decltype(stack::pop<std::tuple<Ret0, Ret1, Ret...>>(nullptr)){
@@ -99,6 +139,45 @@ class table_core : public reference {
         return traverse_get_deep<false, T>(std::forward<Keys>(keys)...);
     }
 
+    // Walks the keys once, stopping as soon as a level is not indexable:
+    // levels counts how many values were left on the stack
+    template <bool global, typename T, typename Key>
+    decltype(auto) traverse_try_get_deep( int& levels, Key&& key ) const {
+        stack::get_field<global>( lua_state( ), std::forward<Key>( key ) );
+        ++levels;
+        return stack::check_get<T>( lua_state( ) );
+    }
+
+    template <bool global, typename T, typename Key, typename... Keys>
+    auto traverse_try_get_deep( int& levels, Key&& key, Keys&&... keys ) const
+    -> decltype(stack::check_get<T>(nullptr)) {
+        stack::get_field<global>( lua_state( ), std::forward<Key>( key ) );
+        ++levels;
+        if ( !stack::maybe_indexable( lua_state( ) ) )
+            return nullopt;
+        return traverse_try_get_deep<false, T>(levels, std::forward<Keys>(keys)...);
+    }
+
+    template <typename T, std::size_t... I, typename Args>
+    T tuple_get_or( std::index_sequence<I...>, Args&& args ) const {
+        auto option = try_get<T>( detail::forward_get<I>(args)... );
+        if ( option )
+            return static_cast<T>( option.value( ) );
+        return static_cast<T>( detail::forward_get<sizeof...(I)>(args) );
+    }
+
+    template <typename T, typename... Keys>
+    decltype(auto) traverse_get_tagged( std::false_type, Keys&&... keys ) const {
+        auto pp = stack::push_pop<is_global<Keys...>::value>(*this);
+        struct clean { lua_State* L; clean(lua_State* L) : L(L) {} ~clean() { lua_pop(L, static_cast<int>(sizeof...(Keys))); } } c(lua_state());
+        return traverse_get_deep<top_level, T>(std::forward<Keys>(keys)...);
+    }
+
+    template <typename T, typename... Keys>
+    T traverse_get_tagged( std::true_type, Keys&&... keys ) const {
+        return try_get<typename T::value_type>(std::forward<Keys>(keys)...);
+    }
+
     template <bool global, typename Key, typename Value>
     void traverse_set_deep( Key&& key, Value&& value ) const {
         stack::set_field<global>( lua_state( ), std::forward<Key>( key ), std::forward<Value>(value) );
@@ -110,12 +189,63 @@ class table_core : public reference {
         traverse_set_deep<false>(std::forward<Keys>(keys)...);
     }
 
-    table_core(lua_State* L, detail::global_tag t) noexcept : reference(L, t) { }
+    // The raw_ versions always push the table itself: lua_getglobal and friends are not raw
+    template<typename Ret0, typename Ret1, typename... Ret, std::size_t... I, typename Keys>
+    auto tuple_raw_get( types<Ret0, Ret1, Ret...>, std::index_sequence<I...>, Keys&& keys ) const
+    -> decltype(stack::pop<std::tuple<Ret0, Ret1, Ret...>>(nullptr)){
+        auto pp = stack::push_pop(*this);
+        int tableindex = lua_gettop(lua_state());
+        void(detail::swallow{ ( stack::raw_get_field(lua_state(), detail::forward_get<I>(keys), tableindex), 0)... });
+        return stack::pop<std::tuple<Ret0, Ret1, Ret...>>( lua_state() );
+    }
+
+    template<typename Ret, std::size_t I, typename Keys>
+    decltype(auto) tuple_raw_get( types<Ret>, std::index_sequence<I>, Keys&& keys ) const {
+        auto pp = stack::push_pop(*this);
+        stack::raw_get_field( lua_state( ), detail::forward_get<I>(keys));
+        return stack::pop<Ret>( lua_state( ) );
+    }
+
+    template<typename Pairs, std::size_t... I>
+    void tuple_raw_set( std::index_sequence<I...>, Pairs&& pairs ) {
+        auto pp = stack::push_pop(*this);
+        void(detail::swallow{ (stack::raw_set_field(lua_state(),
+            detail::forward_get<I * 2>(pairs),
+            detail::forward_get<I * 2 + 1>(pairs)
+        ), 0)... });
+    }
+
+    template <typename T, typename Key>
+    decltype(auto) raw_traverse_get_deep( Key&& key ) const {
+        stack::raw_get_field( lua_state( ), std::forward<Key>( key ) );
+        return stack::get<T>( lua_state( ) );
+    }
+
+    template <typename T, typename Key, typename... Keys>
+    decltype(auto) raw_traverse_get_deep( Key&& key, Keys&&... keys ) const {
+        stack::raw_get_field( lua_state( ), std::forward<Key>( key ) );
+        return raw_traverse_get_deep<T>(std::forward<Keys>(keys)...);
+    }
+
+    template <typename Key, typename Value>
+    void raw_traverse_set_deep( Key&& key, Value&& value ) const {
+        stack::raw_set_field( lua_state( ), std::forward<Key>( key ), std::forward<Value>(value) );
+    }
+
+    template <typename Key, typename... Keys>
+    void raw_traverse_set_deep( Key&& key, Keys&&... keys ) const {
+        stack::raw_get_field( lua_state( ), std::forward<Key>( key ) );
+        raw_traverse_set_deep(std::forward<Keys>(keys)...);
+    }
+
+    basic_table_core(lua_State* L, detail::global_tag t) noexcept : base_t(L, t) { }
 
 public:
-    table_core( ) noexcept : reference( ) { }
-    table_core( const table_core<true>& global ) noexcept : reference( global ) { }
-    table_core( lua_State* L, int index = -1 ) : reference( L, index ) {
+    using base_t::lua_state;
+
+    basic_table_core( ) noexcept : base_t( ) { }
+    basic_table_core( const table_core<true>& global ) noexcept : base_t( global ) { }
+    basic_table_core( lua_State* L, int index = -1 ) : base_t( L, index ) {
         type_assert( L, index, type::table );
     }
 
@@ -142,25 +272,32 @@ public:
 
     template<typename Ret, typename Key>
     Ret get_with_default(Key key, Ret _default) const {
+        return get_or<Ret>(key, std::move(_default));
+    }
 
-      sol::optional<Ret> option = operator[](key);
-      if( option ){
-        return option.value();
-      }
-      else {
-        return _default;
-      }
+    // Looks up a chain of keys in a single pass: nullopt if any level is missing,
+    // not indexable, or if the final value is not a T
+    template <typename T, typename... Keys>
+    decltype(auto) try_get( Keys&&... keys ) const {
+        auto pp = stack::push_pop<is_global<Keys...>::value>(*this);
+        struct clean { lua_State* L; int levels; clean(lua_State* L) : L(L), levels(0) {} ~clean() { lua_pop(L, levels); } } c(lua_state());
+        return traverse_try_get_deep<top_level, T>(c.levels, std::forward<Keys>(keys)...);
+    }
+
+    // get_or<T>(keys..., default): the last argument is returned when the lookup fails
+    template <typename T, typename... Args>
+    T get_or( Args&&... args ) const {
+        static_assert(sizeof...(Args) > 1, "get_or needs at least one key and a default value");
+        return tuple_get_or<T>(std::make_index_sequence<sizeof...(Args) - 1>(), std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
     template <typename T, typename... Keys>
     decltype(auto) traverse_get( Keys&&... keys ) const {
-        auto pp = stack::push_pop<is_global<Keys...>::value>(*this);
-        struct clean { lua_State* L; clean(lua_State* L) : L(L) {} ~clean() { lua_pop(L, static_cast<int>(sizeof...(Keys))); } } c(lua_state());
-        return traverse_get_deep<top_level, T>(std::forward<Keys>(keys)...);
+        return traverse_get_tagged<T>(meta::Bool<meta::is_specialization_of<T, optional>::value>(), std::forward<Keys>(keys)...);
     }
 
     template <typename... Keys>
-    table_core& traverse_set( Keys&&... keys ) {
+    basic_table_core& traverse_set( Keys&&... keys ) {
         auto pp = stack::push_pop<is_global<Keys...>::value>(*this);
         traverse_set_deep<top_level>(std::forward<Keys>(keys)...);
         lua_pop(lua_state(), static_cast<int>(sizeof...(Keys)-2));
@@ -168,105 +305,240 @@ public:
     }
 
     template<typename... Args>
-    table_core& set( Args&&... args ) {
+    basic_table_core& set( Args&&... args ) {
         tuple_set(std::make_index_sequence<sizeof...(Args) / 2>(), std::forward_as_tuple(std::forward<Args>(args)...));
         return *this;
     }
 
+    // get, set, traverse_get and traverse_set with raw accesses: no __index or __newindex is
+    // ever consulted, and integer keys use lua_rawgeti/lua_rawseti on every Lua version
+    template<typename... Ret, typename... Keys>
+    decltype(auto) raw_get( Keys&&... keys ) const {
+        return tuple_raw_get( types<Ret...>( ), std::index_sequence_for<Ret...>( ), std::forward_as_tuple(std::forward<Keys>(keys)...));
+    }
+
+    template<typename... Args>
+    basic_table_core& raw_set( Args&&... args ) {
+        tuple_raw_set(std::make_index_sequence<sizeof...(Args) / 2>(), std::forward_as_tuple(std::forward<Args>(args)...));
+        return *this;
+    }
+
+    template <typename T, typename... Keys>
+    decltype(auto) raw_traverse_get( Keys&&... keys ) const {
+        auto pp = stack::push_pop(*this);
+        struct clean { lua_State* L; clean(lua_State* L) : L(L) {} ~clean() { lua_pop(L, static_cast<int>(sizeof...(Keys))); } } c(lua_state());
+        return raw_traverse_get_deep<T>(std::forward<Keys>(keys)...);
+    }
+
+    template <typename... Keys>
+    basic_table_core& raw_traverse_set( Keys&&... keys ) {
+        auto pp = stack::push_pop(*this);
+        raw_traverse_set_deep(std::forward<Keys>(keys)...);
+        lua_pop(lua_state(), static_cast<int>(sizeof...(Keys)-2));
+        return *this;
+    }
+
+    // Sets every key/value pair in [first, last) with raw sets: no metamethods are invoked
+    template<typename It>
+    basic_table_core& bulk_set( It first, It last ) {
+        auto pp = stack::push_pop( *this );
+        stack::stack_detail::raw_set_pairs( lua_state( ), lua_gettop( lua_state( ) ), first, last );
+        return *this;
+    }
+
+    // Appends [first, last) after the last element of the array part with raw sets
+    template<typename It>
+    basic_table_core& append_range( It first, It last ) {
+        auto pp = stack::push_pop( *this );
+        int tableindex = lua_gettop( lua_state( ) );
+        int index = static_cast<int>( lua_rawlen( lua_state( ), tableindex ) ) + 1;
+        stack::stack_detail::raw_set_sequence( lua_state( ), tableindex, index, first, last );
+        return *this;
+    }
+
+    template<typename Range>
+    basic_table_core& append_range( const Range& range ) {
+        using std::begin;
+        using std::end;
+        return append_range( begin( range ), end( range ) );
+    }
+
+    // Bulk numeric transfer with the array part: see stack::read_numbers and stack::write_numbers
     template<typename T>
-    table_core& set_usertype( usertype<T>& user ) {
-        return set_usertype(usertype_traits<T>::name, user);
+    std::size_t read_numbers( array_view<T> out ) const {
+        auto pp = stack::push_pop( *this );
+        return stack::read_numbers( lua_state( ), -1, out );
+    }
+
+    template<typename T>
+    basic_table_core& write_numbers( array_view<T> in ) {
+        auto pp = stack::push_pop( *this );
+        stack::write_numbers( lua_state( ), -1, in );
+        return *this;
+    }
+
+    template<typename T>
+    basic_table_core& set_usertype( usertype<T>& user ) {
+        return set_usertype(usertype_traits<T>::name(), user);
     }
 
     template<typename Key, typename T>
-    table_core& set_usertype( Key&& key, usertype<T>& user ) {
+    basic_table_core& set_usertype( Key&& key, usertype<T>& user ) {
         return set(std::forward<Key>(key), user);
     }
 
     template<typename Class, typename... Args>
-    table_core& new_usertype(const std::string& name, Args&&... args) {
+    basic_table_core& new_usertype(const std::string& name, Args&&... args) {
         usertype<Class> utype(std::forward<Args>(args)...);
         set_usertype(name, utype);
         return *this;
     }
 
     template<typename Class, typename CTor0, typename... CTor, typename... Args>
-    table_core& new_usertype(const std::string& name, Args&&... args) {
+    basic_table_core& new_usertype(const std::string& name, Args&&... args) {
         constructors<types<CTor0, CTor...>> ctor{};
         return new_usertype<Class>(name, ctor, std::forward<Args>(args)...);
     }
 
     template<typename Class, typename... CArgs, typename... Args>
-    table_core& new_usertype(const std::string& name, constructors<CArgs...> ctor, Args&&... args) {
+    basic_table_core& new_usertype(const std::string& name, constructors<CArgs...> ctor, Args&&... args) {
         usertype<Class> utype(ctor, std::forward<Args>(args)...);
         set_usertype(name, utype);
         return *this;
     }
 
+    // Sets name to a table of the given names and values, and teaches the stack to read E from either a
+    // number or one of those names. A read-only table refuses writes and hides its metatable
+    template<typename E>
+    basic_table_core& new_enum(const std::string& name, std::initializer_list<std::pair<const char*, E>> items, bool read_only = false) {
+        static_assert(std::is_enum<E>::value, "new_enum is for enumerations");
+        lua_State* L = lua_state();
+        int count = static_cast<int>(items.size());
+        lua_createtable(L, 0, count);
+        lua_createtable(L, 0, count);
+        for (const auto& item : items) {
+            stack::push(L, item.second);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -3, item.first);
+            lua_setfield(L, -3, item.first);
+        }
+        lua_rawsetp(L, LUA_REGISTRYINDEX, stack::stack_detail::enum_names<E>::key());
+        if (read_only) {
+            lua_createtable(L, 0, 0);
+            lua_createtable(L, 0, 4);
+            lua_pushvalue(L, -3);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, &detail::enum_newindex);
+            lua_setfield(L, -2, "__newindex");
+            lua_pushvalue(L, -3);
+            lua_pushcclosure(L, &detail::enum_pairs, 1);
+            lua_setfield(L, -2, "__pairs");
+            lua_pushboolean(L, 0);
+            lua_setfield(L, -2, "__metatable");
+            lua_setmetatable(L, -2);
+            lua_remove(L, -2);
+        }
+        table values(L, -1);
+        lua_pop(L, 1);
+        set(name, values);
+        return *this;
+    }
+
     template<typename Fx>
     void for_each( Fx&& fx ) const {
         typedef meta::is_callable<Fx( std::pair<sol::object, sol::object> )> is_paired;
         for_each(is_paired(), std::forward<Fx>(fx));
     }
 
+    // Converts every key and value straight off the stack: nothing goes through the registry,
+    // unless Key or Value are registry-backed types themselves
+    template<typename Key, typename Value, typename Fx>
+    void for_each( Fx&& fx ) const {
+        auto pp = stack::push_pop( *this );
+        lua_State* L = lua_state( );
+        int tableindex = lua_gettop( L );
+        stack::push( L, nil );
+        while ( lua_next( L, tableindex ) ) {
+            call_with_pair<Key, Value>( meta::Bool<lua_type_of<meta::Unqualified<Key>>::value == type::string>( ), L, fx );
+            lua_pop( L, 1 );
+        }
+    }
+
+    // Walks the array part with raw gets, from 1 up to the first nil, like ipairs
+    template<typename Value, typename Fx>
+    void ipairs( Fx&& fx ) const {
+        auto pp = stack::push_pop( *this );
+        lua_State* L = lua_state( );
+        int tableindex = lua_gettop( L );
+        for ( int i = 1; ; ++i ) {
+            lua_rawgeti( L, tableindex, i );
+            if ( lua_type( L, -1 ) == LUA_TNIL ) {
+                lua_pop( L, 1 );
+                break;
+            }
+            fx( static_cast<std::size_t>( i ), stack::get<Value>( L, -1 ) );
+            lua_pop( L, 1 );
+        }
+    }
+
     size_t size( ) const {
         auto pp = stack::push_pop( *this );
         return lua_rawlen(lua_state(), -1);
     }
 
     template<typename T>
-    proxy<table_core&, T> operator[]( T&& key ) & {
-        return proxy<table_core&, T>( *this, std::forward<T>( key ) );
+    proxy<basic_table_core&, T> operator[]( T&& key ) & {
+        return proxy<basic_table_core&, T>( *this, std::forward<T>( key ) );
     }
 
     template<typename T>
-    proxy<const table_core&, T> operator[]( T&& key ) const & {
-        return proxy<const table_core&, T>( *this, std::forward<T>( key ) );
+    proxy<const basic_table_core&, T> operator[]( T&& key ) const & {
+        return proxy<const basic_table_core&, T>( *this, std::forward<T>( key ) );
     }
 
     template<typename T>
-    proxy<table_core, T> operator[]( T&& key ) && {
-        return proxy<table_core, T>( *this, std::forward<T>( key ) );
+    proxy<basic_table_core, T> operator[]( T&& key ) && {
+        return proxy<basic_table_core, T>( *this, std::forward<T>( key ) );
     }
 
     template<typename... Args, typename R, typename Key>
-    table_core& set_function( Key&& key, R fun_ptr( Args... ) ) {
+    basic_table_core& set_function( Key&& key, R fun_ptr( Args... ) ) {
         set_resolved_function( std::forward<Key>( key ), fun_ptr );
         return *this;
     }
 
     template<typename Sig, typename Key>
-    table_core& set_function( Key&& key, Sig* fun_ptr ) {
+    basic_table_core& set_function( Key&& key, Sig* fun_ptr ) {
         set_resolved_function( std::forward<Key>( key ), fun_ptr );
         return *this;
     }
 
     template<typename... Args, typename R, typename C, typename T, typename Key>
-    table_core& set_function( Key&& key, R( C::*mem_ptr )( Args... ), T&& obj ) {
+    basic_table_core& set_function( Key&& key, R( C::*mem_ptr )( Args... ), T&& obj ) {
         set_resolved_function( std::forward<Key>( key ), mem_ptr, std::forward<T>( obj ) );
         return *this;
     }
 
     template<typename Sig, typename C, typename T, typename Key>
-    table_core& set_function( Key&& key, Sig C::* mem_ptr, T&& obj ) {
+    basic_table_core& set_function( Key&& key, Sig C::* mem_ptr, T&& obj ) {
         set_resolved_function( std::forward<Key>( key ), mem_ptr, std::forward<T>( obj ) );
         return *this;
     }
 
     template<typename... Args, typename R, typename C, typename Key>
-    table_core& set_function( Key&& key, R( C::*mem_ptr )( Args... ) ) {
+    basic_table_core& set_function( Key&& key, R( C::*mem_ptr )( Args... ) ) {
         set_resolved_function( std::forward<Key>( key ), mem_ptr );
         return *this;
     }
 
     template<typename Sig, typename C, typename Key>
-    table_core& set_function( Key&& key, Sig C::* mem_ptr ) {
+    basic_table_core& set_function( Key&& key, Sig C::* mem_ptr ) {
         set_resolved_function( std::forward<Key>( key ), mem_ptr );
         return *this;
     }
 
     template<typename... Sig, typename Fx, typename Key>
-    table_core& set_function( Key&& key, Fx&& fx ) {
+    basic_table_core& set_function( Key&& key, Fx&& fx ) {
         set_fx( types<Sig...>( ), std::forward<Key>( key ), std::forward<Fx>( fx ) );
         return *this;
     }
@@ -317,6 +589,29 @@ public:
         return create(L, narr, static_cast<int>((sizeof...(Args) / 2) - narr), std::forward<Args>(args)...);
     }
 
+    // A pooled table is only sized by narr/nrec when the pool has none to hand out
+    static inline table create(pooled_t, lua_State* L, int narr = 0, int nrec = 0) {
+        table_pool_detail::acquire(L, narr, nrec);
+        table result(L);
+        lua_pop(L, 1);
+        return result;
+    }
+
+    template <typename Key, typename Value, typename... Args>
+    static inline table create(pooled_t, lua_State* L, int narr, int nrec, Key&& key, Value&& value, Args&&... args) {
+        table_pool_detail::acquire(L, narr, nrec);
+        table result(L);
+        result.set(std::forward<Key>(key), std::forward<Value>(value), std::forward<Args>(args)...);
+        lua_pop(L, 1);
+        return result;
+    }
+
+    template <typename... Args>
+    static inline table create_with(pooled_t, lua_State* L, Args&&... args) {
+        static const int narr = static_cast<int>(meta::count_if_2_pack<std::is_integral, Args...>::value);
+        return create(pooled, L, narr, static_cast<int>((sizeof...(Args) / 2) - narr), std::forward<Args>(args)...);
+    }
+
     table create(int narr = 0, int nrec = 0) {
         return create(lua_state(), narr, nrec);
     }
@@ -344,7 +639,29 @@ public:
     table create_with(Args&&... args) {
         return create_with(lua_state(), std::forward<Args>(args)...);
     }  
+
+    table create(pooled_t, int narr = 0, int nrec = 0) {
+        return create(pooled, lua_state(), narr, nrec);
+    }
+
+    template <typename Key, typename Value, typename... Args>
+    table create(pooled_t, int narr, int nrec, Key&& key, Value&& value, Args&&... args) {
+        return create(pooled, lua_state(), narr, nrec, std::forward<Key>(key), std::forward<Value>(value), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    table create_with(pooled_t, Args&&... args) {
+        return create_with(pooled, lua_state(), std::forward<Args>(args)...);
+    }
 };
+
+template<typename... Args>
+inline cached_proxy& cached_proxy::set_function(Args&&... args) {
+    auto pp = stack::push_pop(tbl);
+    table t(tbl.lua_state(), -1);
+    t.set_function(key, std::forward<Args>(args)...);
+    return *this;
+}
 } // sol
 
 #endif // SOL_TABLE_CORE_HPP
@@ -0,0 +1,125 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_TABLE_POOL_HPP
+#define SOL_TABLE_POOL_HPP
+
+#include "table.hpp"
+#include "table_pool_core.hpp"
+
+namespace sol {
+// Hands out empty tables that were released before, instead of making new ones for the collector
+// to sweep. There is one pool per state: this only refers to it, and is cheap to copy
+class table_pool {
+private:
+    lua_State* L;
+
+public:
+    table_pool(lua_State* L) : L(L) {}
+
+    lua_State* lua_state() const {
+        return L;
+    }
+
+    // narr/nrec only size the table when a new one has to be made
+    table acquire(int narr = 0, int nrec = 0) {
+        return table::create(pooled, L, narr, nrec);
+    }
+
+    // Empties t and keeps it for a later acquire. Anything else still holding t sees it emptied
+    void release(const table& t) {
+        t.push();
+        table_pool_detail::release(L, -1);
+        lua_pop(L, 1);
+    }
+
+    void release(lua_State* Ls, int index) {
+        table_pool_detail::release(Ls, index);
+    }
+
+    // How many tables are waiting to be handed out
+    std::size_t size() const {
+        int pool = table_pool_detail::push_pool(L);
+        std::size_t n = table_pool_detail::count(L, pool);
+        lua_pop(L, 1);
+        return n;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    std::size_t capacity() const {
+        int pool = table_pool_detail::push_pool(L);
+        std::size_t n = table_pool_detail::get_settings(L, pool).capacity;
+        lua_pop(L, 1);
+        return n;
+    }
+
+    // Releases past the capacity are dropped, and left to the collector
+    void set_capacity(std::size_t capacity) {
+        table_pool_detail::shrink(L, capacity);
+    }
+
+    // Lets go of every pooled table, keeping the capacity
+    void clear() {
+        std::size_t keep = capacity();
+        table_pool_detail::shrink(L, 0);
+        table_pool_detail::shrink(L, keep);
+    }
+
+    // Bind this to give scripts a way to hand tables back: it releases all of its arguments
+    static int lua_release(lua_State* L) {
+        return table_pool_detail::lua_release(L);
+    }
+};
+
+// A table from the pool that goes back to it when this goes out of scope, for tables that
+// only live through a call, like the arguments to a Lua callback
+class pooled_table : public table {
+public:
+    pooled_table(lua_State* L, int narr = 0, int nrec = 0) : table(table::create(pooled, L, narr, nrec)) {}
+    pooled_table(const pooled_table&) = delete;
+    pooled_table(pooled_table&& o) = default;
+    pooled_table& operator=(const pooled_table&) = delete;
+    pooled_table& operator=(pooled_table&& o) {
+        if (this != &o) {
+            give_back();
+            table::operator=(std::move(o));
+        }
+        return *this;
+    }
+
+    ~pooled_table() {
+        give_back();
+    }
+
+    void give_back() {
+        if (valid()) {
+            table_pool(lua_state()).release(*this);
+            table::operator=(table());
+        }
+    }
+};
+} // sol
+
+#endif // SOL_TABLE_POOL_HPP
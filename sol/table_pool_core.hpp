@@ -0,0 +1,153 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_TABLE_POOL_CORE_HPP
+#define SOL_TABLE_POOL_CORE_HPP
+
+#include "compatibility.hpp"
+#include <cstddef>
+
+namespace sol {
+namespace table_pool_detail {
+// The free tables sit in the array part of the pool, and are also keys of its hash part,
+// so that a table released twice is only pooled once
+struct settings {
+    std::size_t capacity;
+};
+
+const std::size_t default_capacity = 256;
+
+inline const void* pool_key() {
+    static char key = 0;
+    return &key;
+}
+
+// Pushes the state's pool, making it the first time
+inline int push_pool(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, pool_key());
+    if (lua_type(L, -1) == LUA_TTABLE) {
+        return lua_gettop(L);
+    }
+    lua_pop(L, 1);
+    lua_createtable(L, 16, 17);
+    settings* s = static_cast<settings*>(lua_newuserdata(L, sizeof(settings)));
+    s->capacity = default_capacity;
+    lua_rawseti(L, -2, 0);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, pool_key());
+    return lua_gettop(L);
+}
+
+inline settings& get_settings(lua_State* L, int pool) {
+    lua_rawgeti(L, pool, 0);
+    settings* s = static_cast<settings*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return *s;
+}
+
+inline std::size_t count(lua_State* L, int pool) {
+    return static_cast<std::size_t>(lua_rawlen(L, pool));
+}
+
+// Removes every key, and the metatable. Lua does not shrink a table when its fields are set to nil,
+// only when it next has to grow, so the table keeps the space it had
+inline void clear(lua_State* L, int index) {
+    index = lua_absindex(L, index);
+    lua_pushnil(L);
+    lua_setmetatable(L, index);
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_pushnil(L);
+        lua_rawset(L, index);
+    }
+}
+
+// Pushes an empty table: a pooled one if there are any, a new one sized narr/nrec otherwise
+inline void acquire(lua_State* L, int narr, int nrec) {
+    int pool = push_pool(L);
+    int n = static_cast<int>(count(L, pool));
+    if (n < 1) {
+        lua_pop(L, 1);
+        lua_createtable(L, narr, nrec);
+        return;
+    }
+    lua_rawgeti(L, pool, n);
+    lua_pushnil(L);
+    lua_rawseti(L, pool, n);
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    lua_rawset(L, pool);
+    lua_remove(L, pool);
+}
+
+// Empties the table at index and keeps it for the next acquire, unless the pool is full.
+// Whatever else still refers to the table sees it empty, and sees it refilled once it is handed out again
+inline void release(lua_State* L, int index) {
+    index = lua_absindex(L, index);
+    if (lua_type(L, index) != LUA_TTABLE) {
+        return;
+    }
+    int pool = push_pool(L);
+    lua_pushvalue(L, index);
+    lua_rawget(L, pool);
+    bool pooled = lua_toboolean(L, -1) != 0;
+    lua_pop(L, 1);
+    clear(L, index);
+    std::size_t n = count(L, pool);
+    if (!pooled && n < get_settings(L, pool).capacity) {
+        lua_pushvalue(L, index);
+        lua_rawseti(L, pool, static_cast<int>(n + 1));
+        lua_pushvalue(L, index);
+        lua_pushboolean(L, 1);
+        lua_rawset(L, pool);
+    }
+    lua_pop(L, 1);
+}
+
+// Pools at most capacity tables from now on, letting go of any beyond that
+inline void shrink(lua_State* L, std::size_t capacity) {
+    int pool = push_pool(L);
+    get_settings(L, pool).capacity = capacity;
+    for (std::size_t n = count(L, pool); n > capacity; --n) {
+        lua_rawgeti(L, pool, static_cast<int>(n));
+        lua_pushnil(L);
+        lua_rawset(L, pool);
+        lua_pushnil(L);
+        lua_rawseti(L, pool, static_cast<int>(n));
+    }
+    lua_pop(L, 1);
+}
+
+// Callable from Lua: releases every table it is given
+inline int lua_release(lua_State* L) {
+    int top = lua_gettop(L);
+    for (int i = 1; i <= top; ++i) {
+        release(L, i);
+    }
+    return 0;
+}
+} // table_pool_detail
+} // sol
+
+#endif // SOL_TABLE_POOL_CORE_HPP
@@ -0,0 +1,207 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_THREAD_POOL_HPP
+#define SOL_THREAD_POOL_HPP
+
+#include "reference.hpp"
+#include "stack.hpp"
+#include "coroutine.hpp"
+#include <vector>
+
+namespace sol {
+// Recycles Lua threads instead of making a new one (and a new Lua stack) for each coroutine.
+// Threads are anchored in a registry table so idle ones are never collected;
+// a thread that comes back suspended or after an error cannot be reused and is let go
+class thread_pool {
+private:
+    lua_State* L;
+    int anchor;
+    std::vector<lua_State*> idle;
+    std::size_t created = 0;
+
+    void anchor_thread(lua_State* thread, bool keep) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, anchor);
+        lua_pushthread(thread);
+        lua_xmove(thread, L, 1);
+        if (keep) {
+            lua_pushboolean(L, 1);
+        }
+        else {
+            lua_pushnil(L);
+        }
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+    }
+
+    lua_State* make_thread() {
+        lua_State* thread = lua_newthread(L);
+        lua_pop(L, 1);
+        anchor_thread(thread, true);
+        ++created;
+        return thread;
+    }
+
+public:
+    thread_pool(lua_State* L, std::size_t reserve = 0) : L(L) {
+        lua_newtable(L);
+        anchor = luaL_ref(L, LUA_REGISTRYINDEX);
+        idle.reserve(reserve);
+        for (std::size_t i = 0; i < reserve; ++i) {
+            idle.push_back(make_thread());
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() {
+        // idle threads become garbage with the anchor table
+        luaL_unref(L, LUA_REGISTRYINDEX, anchor);
+    }
+
+    // An idle thread with an empty stack, made if none is left
+    lua_State* acquire() {
+        if (!idle.empty()) {
+            lua_State* thread = idle.back();
+            idle.pop_back();
+            return thread;
+        }
+        return make_thread();
+    }
+
+    void release(lua_State* thread) {
+        if (lua_status(thread) != LUA_OK) {
+            anchor_thread(thread, false);
+            return;
+        }
+#if SOL_LUA_VERSION >= 504
+        lua_resetthread(thread);
+#else
+        lua_settop(thread, 0);
+#endif // Lua 5.4 can reset a thread fully
+        idle.push_back(thread);
+    }
+
+    std::size_t idle_count() const {
+        return idle.size();
+    }
+
+    // threads made over the pool's lifetime
+    std::size_t created_count() const {
+        return created;
+    }
+
+    lua_State* lua_state() const {
+        return L;
+    }
+};
+
+// A coroutine running on a pooled thread, which goes back to the pool when the coroutine is destroyed
+class pooled_coroutine {
+private:
+    thread_pool* pool = nullptr;
+    lua_State* thread = nullptr;
+    coroutine co;
+
+    void release() {
+        if (pool == nullptr) {
+            return;
+        }
+        co = coroutine();
+        pool->release(thread);
+        pool = nullptr;
+        thread = nullptr;
+    }
+
+public:
+    pooled_coroutine() = default;
+
+    template <typename Fx>
+    pooled_coroutine(thread_pool& p, const Fx& fx) : pool(&p), thread(p.acquire()) {
+        fx.push();
+        lua_xmove(p.lua_state(), thread, 1);
+        co = coroutine(thread, -1);
+        lua_pop(thread, 1);
+    }
+
+    pooled_coroutine(const pooled_coroutine&) = delete;
+    pooled_coroutine& operator=(const pooled_coroutine&) = delete;
+
+    pooled_coroutine(pooled_coroutine&& o) : pool(o.pool), thread(o.thread), co(std::move(o.co)) {
+        o.pool = nullptr;
+        o.thread = nullptr;
+    }
+
+    pooled_coroutine& operator=(pooled_coroutine&& o) {
+        if (this != &o) {
+            release();
+            pool = o.pool;
+            thread = o.thread;
+            co = std::move(o.co);
+            o.pool = nullptr;
+            o.thread = nullptr;
+        }
+        return *this;
+    }
+
+    ~pooled_coroutine() {
+        release();
+    }
+
+    call_status status() const noexcept {
+        return co.status();
+    }
+
+    bool error() const noexcept {
+        return co.error();
+    }
+
+    bool runnable() const noexcept {
+        return co.runnable();
+    }
+
+    explicit operator bool() const noexcept {
+        return runnable();
+    }
+
+    lua_State* thread_state() const noexcept {
+        return thread;
+    }
+
+    template<typename... Args>
+    protected_function_result operator()( Args&&... args ) {
+        return co.call<>( std::forward<Args>( args )... );
+    }
+
+    template<typename... Ret, typename... Args>
+    decltype(auto) operator()( types<Ret...>, Args&&... args ) {
+        return co.call<Ret...>( std::forward<Args>( args )... );
+    }
+
+    template<typename... Ret, typename... Args>
+    decltype(auto) call( Args&&... args ) {
+        return co.call<Ret...>( std::forward<Args>( args )... );
+    }
+};
+} // sol
+
+#endif // SOL_THREAD_POOL_HPP
@@ -0,0 +1,593 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_TRANSFER_HPP
+#define SOL_TRANSFER_HPP
+
+#include "stack.hpp"
+#include "object.hpp"
+#include "state_view.hpp"
+#include "error.hpp"
+#include "string_view.hpp"
+#include "inheritance.hpp"
+#include "usertype_traits.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sol {
+// How to carry usertypes between states (and through serialize/deserialize);
+// plain values and tables need no hooks
+class transfer_hooks {
+public:
+    typedef std::function<void(lua_State* from, int index, lua_State* to)> copy_function;
+    typedef std::function<void(lua_State* L, int index, std::string& out)> write_function;
+    typedef std::function<void(lua_State* L, const char* data, std::size_t size)> read_function;
+
+    struct hook {
+        const void* id;
+        std::string name;
+        copy_function copy;
+        write_function write;
+        read_function read;
+    };
+
+private:
+    std::vector<hook> hooks;
+
+    hook& slot(const void* id, std::string name) {
+        for (auto& h : hooks) {
+            if (h.id == id) {
+                h.name = std::move(name);
+                return h;
+            }
+        }
+        hooks.push_back({ id, std::move(name), nullptr, nullptr, nullptr });
+        return hooks.back();
+    }
+
+public:
+    // T is copy constructed into the other state
+    template <typename T>
+    transfer_hooks& add(std::string name = usertype_traits<T>::name()) {
+        hook& h = slot(detail::id_for<T>::value, std::move(name));
+        h.copy = [](lua_State* from, int index, lua_State* to) {
+            stack::push<T>(to, stack::get<T&>(from, index));
+        };
+        return *this;
+    }
+
+    // T is also written as write(const T&, std::string& out) and read back as read(const char* data, std::size_t size)
+    template <typename T, typename Write, typename Read>
+    transfer_hooks& add(std::string name, Write write, Read read) {
+        add<T>(name);
+        hook& h = slot(detail::id_for<T>::value, std::move(name));
+        h.write = [write](lua_State* L, int index, std::string& out) {
+            write(static_cast<const T&>(stack::get<T&>(L, index)), out);
+        };
+        h.read = [read](lua_State* L, const char* data, std::size_t size) {
+            T value = read(data, size);
+            stack::push(L, std::move(value));
+        };
+        return *this;
+    }
+
+    const hook* find(const void* id) const {
+        for (auto& h : hooks) {
+            if (h.id == id) {
+                return &h;
+            }
+        }
+        return nullptr;
+    }
+
+    const hook* find(string_view name) const {
+        for (auto& h : hooks) {
+            if (name.size() == h.name.size() && std::equal(name.begin(), name.end(), h.name.begin())) {
+                return &h;
+            }
+        }
+        return nullptr;
+    }
+};
+
+namespace transfer_detail {
+enum class tag : char {
+    nil,
+    boolean_false,
+    boolean_true,
+    number,
+    integer,
+    string,
+    table,
+    end,
+    reference,
+    usertype
+};
+
+inline const transfer_hooks::hook* find_hook(lua_State* L, int index, const transfer_hooks* hooks) {
+    if (hooks == nullptr || lua_getmetatable(L, index) == 0) {
+        return nullptr;
+    }
+    const detail::usertype_identity* identity = detail::get_identity(L, -1);
+    lua_pop(L, 1);
+    return identity == nullptr ? nullptr : hooks->find(identity->id);
+}
+
+inline int count_pairs(lua_State* L, int index) {
+    int count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        lua_pop(L, 1);
+        ++count;
+    }
+    return count;
+}
+
+[[noreturn]] inline void cannot_transfer(lua_State* L, int index) {
+    throw error(std::string("sol: cannot transfer or serialize a value of type ") + lua_typename(L, lua_type(L, index)));
+}
+
+// Tables are walked recursively: nesting deeper than this is refused before it can run out of C stack
+const int max_depth = 200;
+
+// Counts one level of nesting for as long as it lives
+struct nesting {
+    int& depth;
+    nesting(int& depth) : depth(depth) {
+        if (++depth > max_depth) {
+            --depth;
+            throw error("sol: tables nested too deeply to transfer, serialize or deserialize");
+        }
+    }
+    ~nesting() {
+        --depth;
+    }
+};
+
+// Copies straight from one stack to the other.
+// Tables already copied are remembered in a table on the destination, keyed by their source address,
+// so shared and cyclic tables come out shared and cyclic
+class copier {
+private:
+    lua_State* from;
+    lua_State* to;
+    const transfer_hooks* hooks;
+    int seen = 0;
+    int depth = 0;
+
+    void copy_table(int index) {
+        const void* source = lua_topointer(from, index);
+        if (seen == 0) {
+            lua_newtable(to);
+            seen = lua_gettop(to);
+        }
+        else {
+            lua_rawgetp(to, seen, source);
+            if (!lua_isnil(to, -1)) {
+                return;
+            }
+            lua_pop(to, 1);
+        }
+        nesting level(depth);
+        luaL_checkstack(from, 3, "sol: not enough space to transfer a table");
+        luaL_checkstack(to, 4, "sol: not enough space to transfer a table");
+        int arraysize = static_cast<int>(lua_rawlen(from, index));
+        int total = count_pairs(from, index);
+        lua_createtable(to, arraysize, total > arraysize ? total - arraysize : 0);
+        int table = lua_gettop(to);
+        lua_pushvalue(to, table);
+        lua_rawsetp(to, seen, source);
+        lua_pushnil(from);
+        while (lua_next(from, index) != 0) {
+            copy(-2);
+            copy(-1);
+            lua_rawset(to, table);
+            lua_pop(from, 1);
+        }
+    }
+
+public:
+    copier(lua_State* from, lua_State* to, const transfer_hooks* hooks) : from(from), to(to), hooks(hooks) {}
+
+    int seen_index() const {
+        return seen;
+    }
+
+    void copy(int index) {
+        index = lua_absindex(from, index);
+        switch (lua_type(from, index)) {
+        case LUA_TNIL:
+            lua_pushnil(to);
+            break;
+        case LUA_TBOOLEAN:
+            lua_pushboolean(to, lua_toboolean(from, index));
+            break;
+        case LUA_TNUMBER:
+#if SOL_LUA_VERSION >= 503
+            if (lua_isinteger(from, index)) {
+                lua_pushinteger(to, lua_tointeger(from, index));
+                break;
+            }
+#endif // Lua 5.3 integers
+            lua_pushnumber(to, lua_tonumber(from, index));
+            break;
+        case LUA_TSTRING: {
+            std::size_t len;
+            const char* str = lua_tolstring(from, index, &len);
+            lua_pushlstring(to, str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            copy_table(index);
+            break;
+        case LUA_TUSERDATA: {
+            const transfer_hooks::hook* h = find_hook(from, index, hooks);
+            if (h == nullptr || !h->copy) {
+                cannot_transfer(from, index);
+            }
+            h->copy(from, index, to);
+            break;
+        }
+        default:
+            cannot_transfer(from, index);
+        }
+    }
+};
+
+// Compact native-layout encoding: a tag byte, then sizes as base-128 varints
+// and numbers as their raw bytes, so it is only meant to be read back by the same build
+class writer {
+private:
+    lua_State* L;
+    const transfer_hooks* hooks;
+    std::string& out;
+    int seen = 0;
+    int depth = 0;
+    std::size_t tables = 0;
+
+    void put(tag t) {
+        out.push_back(static_cast<char>(t));
+    }
+
+    void put_size(std::size_t n) {
+        while (n >= 0x80) {
+            out.push_back(static_cast<char>((n & 0x7F) | 0x80));
+            n >>= 7;
+        }
+        out.push_back(static_cast<char>(n));
+    }
+
+    void put_bytes(const char* data, std::size_t size) {
+        put_size(size);
+        out.append(data, size);
+    }
+
+    template <typename T>
+    void put_raw(T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write_table(int index) {
+        const void* source = lua_topointer(L, index);
+        if (seen == 0) {
+            lua_newtable(L);
+            seen = lua_gettop(L);
+        }
+        else {
+            lua_rawgetp(L, seen, source);
+            if (!lua_isnil(L, -1)) {
+                std::size_t ordinal = static_cast<std::size_t>(lua_tointeger(L, -1));
+                lua_pop(L, 1);
+                put(tag::reference);
+                put_size(ordinal);
+                return;
+            }
+            lua_pop(L, 1);
+        }
+        nesting level(depth);
+        luaL_checkstack(L, 4, "sol: not enough space to serialize a table");
+        lua_pushinteger(L, static_cast<lua_Integer>(tables++));
+        lua_rawsetp(L, seen, source);
+        std::size_t arraysize = static_cast<std::size_t>(lua_rawlen(L, index));
+        std::size_t total = static_cast<std::size_t>(count_pairs(L, index));
+        put(tag::table);
+        put_size(arraysize);
+        put_size(total > arraysize ? total - arraysize : 0);
+        lua_pushnil(L);
+        while (lua_next(L, index) != 0) {
+            write(-2);
+            write(-1);
+            lua_pop(L, 1);
+        }
+        put(tag::end);
+    }
+
+public:
+    writer(lua_State* L, const transfer_hooks* hooks, std::string& out) : L(L), hooks(hooks), out(out) {}
+
+    void write(int index) {
+        index = lua_absindex(L, index);
+        switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            put(tag::nil);
+            break;
+        case LUA_TBOOLEAN:
+            put(lua_toboolean(L, index) ? tag::boolean_true : tag::boolean_false);
+            break;
+        case LUA_TNUMBER:
+#if SOL_LUA_VERSION >= 503
+            if (lua_isinteger(L, index)) {
+                put(tag::integer);
+                put_raw(lua_tointeger(L, index));
+                break;
+            }
+#endif // Lua 5.3 integers
+            put(tag::number);
+            put_raw(lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING: {
+            std::size_t len;
+            const char* str = lua_tolstring(L, index, &len);
+            put(tag::string);
+            put_bytes(str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            write_table(index);
+            break;
+        case LUA_TUSERDATA: {
+            const transfer_hooks::hook* h = find_hook(L, index, hooks);
+            if (h == nullptr || !h->write) {
+                cannot_transfer(L, index);
+            }
+            std::string payload;
+            h->write(L, index, payload);
+            put(tag::usertype);
+            put_bytes(h->name.data(), h->name.size());
+            put_bytes(payload.data(), payload.size());
+            break;
+        }
+        default:
+            cannot_transfer(L, index);
+        }
+    }
+};
+
+class reader {
+private:
+    lua_State* L;
+    const transfer_hooks* hooks;
+    const char* first;
+    const char* last;
+    int seen = 0;
+    int depth = 0;
+    lua_Integer tables = 0;
+
+    [[noreturn]] void malformed() {
+        throw error("sol: cannot deserialize malformed data");
+    }
+
+    tag get() {
+        if (first == last) {
+            malformed();
+        }
+        return static_cast<tag>(*first++);
+    }
+
+    std::size_t get_size() {
+        std::size_t n = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (first == last || shift >= static_cast<int>(sizeof(std::size_t) * 8)) {
+                malformed();
+            }
+            unsigned char byte = static_cast<unsigned char>(*first++);
+            n |= static_cast<std::size_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return n;
+            }
+        }
+    }
+
+    const char* get_bytes(std::size_t size) {
+        if (static_cast<std::size_t>(last - first) < size) {
+            malformed();
+        }
+        const char* data = first;
+        first += size;
+        return data;
+    }
+
+    template <typename T>
+    T get_raw() {
+        T value;
+        std::memcpy(&value, get_bytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    void read_table() {
+        nesting level(depth);
+        luaL_checkstack(L, 4, "sol: not enough space to deserialize a table");
+        std::size_t arraysize = get_size();
+        std::size_t hashsize = get_size();
+        if (seen == 0) {
+            lua_newtable(L);
+            seen = lua_gettop(L);
+        }
+        // sizes are only hints, but keep a bad one from asking for the moon
+        std::size_t remaining = static_cast<std::size_t>(last - first);
+        lua_createtable(L, static_cast<int>((std::min)(arraysize, remaining)), static_cast<int>((std::min)(hashsize, remaining)));
+        int table = lua_gettop(L);
+        lua_pushvalue(L, table);
+        lua_rawseti(L, seen, static_cast<int>(tables++));
+        for (;;) {
+            if (first == last) {
+                malformed();
+            }
+            if (static_cast<tag>(*first) == tag::end) {
+                ++first;
+                break;
+            }
+            read();
+            read();
+            if (lua_isnil(L, -2)) {
+                malformed();
+            }
+            lua_rawset(L, table);
+        }
+    }
+
+public:
+    reader(lua_State* L, const transfer_hooks* hooks, const char* first, const char* last) : L(L), hooks(hooks), first(first), last(last) {}
+
+    int seen_index() const {
+        return seen;
+    }
+
+    bool done() const {
+        return first == last;
+    }
+
+    void read() {
+        switch (get()) {
+        case tag::nil:
+            lua_pushnil(L);
+            break;
+        case tag::boolean_false:
+            lua_pushboolean(L, 0);
+            break;
+        case tag::boolean_true:
+            lua_pushboolean(L, 1);
+            break;
+        case tag::number:
+            lua_pushnumber(L, get_raw<lua_Number>());
+            break;
+        case tag::integer:
+            lua_pushinteger(L, get_raw<lua_Integer>());
+            break;
+        case tag::string: {
+            std::size_t len = get_size();
+            lua_pushlstring(L, get_bytes(len), len);
+            break;
+        }
+        case tag::table:
+            read_table();
+            break;
+        case tag::reference: {
+            std::size_t ordinal = get_size();
+            if (seen == 0 || ordinal >= static_cast<std::size_t>(tables)) {
+                malformed();
+            }
+            lua_rawgeti(L, seen, static_cast<int>(ordinal));
+            break;
+        }
+        case tag::usertype: {
+            std::size_t namesize = get_size();
+            const char* name = get_bytes(namesize);
+            std::size_t size = get_size();
+            const char* data = get_bytes(size);
+            const transfer_hooks::hook* h = hooks == nullptr ? nullptr : hooks->find(string_view(name, namesize));
+            if (h == nullptr || !h->read) {
+                throw error("sol: no hook to deserialize the usertype " + std::string(name, namesize));
+            }
+            h->read(L, data, size);
+            break;
+        }
+        default:
+            malformed();
+        }
+    }
+};
+} // transfer_detail
+
+namespace stack {
+// Deep copies the value at index in from onto the top of to; both stacks are left as they were on error
+inline int transfer(lua_State* from, int index, lua_State* to, const transfer_hooks* hooks = nullptr) {
+    stack_detail::stack_reset fromreset(from);
+    stack_detail::stack_reset toreset(to);
+    transfer_detail::copier c(from, to, hooks);
+    c.copy(index);
+    if (c.seen_index() != 0) {
+        lua_remove(to, c.seen_index());
+    }
+    toreset.release();
+    return 1;
+}
+
+inline void serialize(lua_State* L, int index, std::string& out, const transfer_hooks* hooks = nullptr) {
+    stack_detail::stack_reset reset(L);
+    transfer_detail::writer w(L, hooks, out);
+    w.write(index);
+}
+
+inline int deserialize(lua_State* L, const char* data, std::size_t size, const transfer_hooks* hooks = nullptr) {
+    stack_detail::stack_reset reset(L);
+    transfer_detail::reader r(L, hooks, data, data + size);
+    r.read();
+    if (!r.done()) {
+        throw error("sol: cannot deserialize malformed data");
+    }
+    if (r.seen_index() != 0) {
+        lua_remove(L, r.seen_index());
+    }
+    reset.release();
+    return 1;
+}
+} // stack
+
+template <typename T>
+inline object transfer(const T& value, lua_State* to, const transfer_hooks* hooks = nullptr) {
+    lua_State* from = value.lua_state();
+    stack::stack_detail::stack_reset reset(from);
+    value.push();
+    stack::transfer(from, -1, to, hooks);
+    return stack::pop<object>(to);
+}
+
+template <typename T>
+inline object transfer(const T& value, const state_view& to, const transfer_hooks* hooks = nullptr) {
+    return transfer(value, to.lua_state(), hooks);
+}
+
+template <typename T>
+inline std::string serialize(const T& value, const transfer_hooks* hooks = nullptr) {
+    std::string out;
+    lua_State* L = value.lua_state();
+    stack::stack_detail::stack_reset reset(L);
+    value.push();
+    stack::serialize(L, -1, out, hooks);
+    return out;
+}
+
+inline object deserialize(lua_State* L, string_view data, const transfer_hooks* hooks = nullptr) {
+    stack::deserialize(L, data.data(), data.size(), hooks);
+    return stack::pop<object>(L);
+}
+
+inline object deserialize(const state_view& L, string_view data, const transfer_hooks* hooks = nullptr) {
+    return deserialize(L.lua_state(), data, hooks);
+}
+} // sol
+
+#endif // SOL_TRANSFER_HPP
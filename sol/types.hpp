@@ -25,7 +25,12 @@
 #include "compatibility.hpp"
 #include "traits.hpp"
 #include "optional.hpp"
+#include "string_view.hpp"
 #include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <unordered_map>
 
 namespace sol {
 namespace detail {
@@ -121,6 +126,33 @@ struct c_closure {
     c_closure(lua_CFunction f, int upvalues = 0) : c_function(f), upvalues(upvalues) {}
 };
 
+// A usertype value still to be built: pushing it constructs T from args directly inside the new userdata,
+// so a factory returning one skips the temporary T and the move into Lua
+template <typename T, typename... Args>
+struct emplaced {
+    std::tuple<Args...> args;
+};
+
+template <typename T, typename... Args>
+emplaced<T, std::decay_t<Args>...> emplace_return(Args&&... args) {
+    return emplaced<T, std::decay_t<Args>...>{ std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...) };
+}
+
+// Tag for table::create and create_with: the table comes from the state's table_pool
+struct pooled_t {};
+const pooled_t pooled {};
+
+// A container to be pushed into a table taken from the state's table_pool instead of a new one
+template <typename T>
+struct pooled_container {
+    T container;
+};
+
+template <typename T>
+pooled_container<std::decay_t<T>> pooled_return(T&& container) {
+    return pooled_container<std::decay_t<T>>{ std::forward<T>(container) };
+}
+
 enum class call_syntax {
     dot = 0,
     colon = 1
@@ -195,19 +227,40 @@ inline std::string type_name(lua_State*L, type t) {
 }
 
 class reference;
+class stack_reference;
+class value_reference;
 template<typename T>
 class usertype;
-template <bool>
-class table_core;
+template <bool, typename>
+class basic_table_core;
+template <bool b>
+using table_core = basic_table_core<b, reference>;
 typedef table_core<false> table;
 typedef table_core<true> global_table;
-class function;
+typedef basic_table_core<false, stack_reference> stack_table;
+template <typename>
+class basic_function;
+typedef basic_function<reference> function;
+typedef basic_function<stack_reference> stack_function;
 class protected_function;
 class coroutine;
+template <typename Sig>
+class function_ref;
 class thread;
-class object;
+template <typename>
+class basic_object;
+typedef basic_object<reference> object;
+typedef basic_object<stack_reference> stack_object;
+typedef basic_object<value_reference> value;
 class userdata;
 class light_userdata;
+class key;
+
+template <typename T>
+struct is_lua_reference : std::integral_constant<bool,
+    std::is_base_of<reference, meta::Unqualified<T>>::value
+    || std::is_base_of<stack_reference, meta::Unqualified<T>>::value
+    || std::is_base_of<value_reference, meta::Unqualified<T>>::value> {};
 
 template <typename T, typename = void>
 struct lua_type_of : std::integral_constant<type, type::userdata> {};
@@ -215,6 +268,24 @@ struct lua_type_of : std::integral_constant<type, type::userdata> {};
 template <>
 struct lua_type_of<std::string> : std::integral_constant<type, type::string> {};
 
+template <>
+struct lua_type_of<string_view> : std::integral_constant<type, type::string> {};
+
+template <>
+struct lua_type_of<key> : std::integral_constant<type, type::string> {};
+
+template <typename T, typename Al>
+struct lua_type_of<std::vector<T, Al>> : std::integral_constant<type, type::table> {};
+
+template <typename T, std::size_t N>
+struct lua_type_of<std::array<T, N>> : std::integral_constant<type, type::table> {};
+
+template <typename K, typename V, typename C, typename Al>
+struct lua_type_of<std::map<K, V, C, Al>> : std::integral_constant<type, type::table> {};
+
+template <typename K, typename V, typename H, typename E, typename Al>
+struct lua_type_of<std::unordered_map<K, V, H, E, Al>> : std::integral_constant<type, type::table> {};
+
 template <std::size_t N>
 struct lua_type_of<char[N]> : std::integral_constant<type, type::string> {};
 
@@ -227,17 +298,20 @@ struct lua_type_of<bool> : std::integral_constant<type, type::boolean> {};
 template <>
 struct lua_type_of<nil_t> : std::integral_constant<type, type::nil> { };
 
-template <>
-struct lua_type_of<table> : std::integral_constant<type, type::table> { };
+template <bool b, typename base_t>
+struct lua_type_of<basic_table_core<b, base_t>> : std::integral_constant<type, type::table> { };
 
 template <>
-struct lua_type_of<global_table> : std::integral_constant<type, type::table> { };
+struct lua_type_of<reference> : std::integral_constant<type, type::poly> {};
 
 template <>
-struct lua_type_of<reference> : std::integral_constant<type, type::poly> {};
+struct lua_type_of<stack_reference> : std::integral_constant<type, type::poly> {};
 
 template <>
-struct lua_type_of<object> : std::integral_constant<type, type::poly> {};
+struct lua_type_of<value_reference> : std::integral_constant<type, type::poly> {};
+
+template <typename base_t>
+struct lua_type_of<basic_object<base_t>> : std::integral_constant<type, type::poly> {};
 
 template <typename... Args>
 struct lua_type_of<std::tuple<Args...>> : std::integral_constant<type, type::poly> {};
@@ -260,8 +334,8 @@ struct lua_type_of<userdata> : std::integral_constant<type, type::userdata> {};
 template <>
 struct lua_type_of<lua_CFunction> : std::integral_constant<type, type::function> {};
 
-template <>
-struct lua_type_of<function> : std::integral_constant<type, type::function> {};
+template <typename base_t>
+struct lua_type_of<basic_function<base_t>> : std::integral_constant<type, type::function> {};
 
 template <>
 struct lua_type_of<coroutine> : std::integral_constant<type, type::function> {};
@@ -275,12 +349,56 @@ struct lua_type_of<protected_function> : std::integral_constant<type, type::func
 template <typename Signature>
 struct lua_type_of<std::function<Signature>> : std::integral_constant<type, type::function>{};
 
+template <typename T, typename... Args>
+struct lua_type_of<emplaced<T, Args...>> : std::integral_constant<type, type::userdata>{};
+
+template <typename T>
+struct lua_type_of<pooled_container<T>> : std::integral_constant<type, type::table>{};
+
+template <typename Signature>
+struct lua_type_of<function_ref<Signature>> : std::integral_constant<type, type::function>{};
+
 template <typename T>
 struct lua_type_of<optional<T>> : std::integral_constant<type, type::poly>{};
 
 template <typename T>
 struct lua_type_of<T*> : std::integral_constant<type, type::userdata> {};
 
+// Specialize with a static fields() returning sol::fields("name", &T::member, ...) to convert T
+// to and from plain tables, field by field (see schema.hpp)
+template <typename T>
+struct schema_for {};
+
+struct has_schema_impl {
+    template<typename T, typename F = decltype(schema_for<T>::fields())>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct has_schema : decltype(has_schema_impl::test<T>(0)) {};
+
+template <typename T>
+struct lua_type_of<T, std::enable_if_t<has_schema<T>::value>> : std::integral_constant<type, type::table> {};
+
+// Specialize with a static fields() returning sol::fields("name", &T::member, ...) to describe a
+// standard-layout T to LuaJIT's FFI: once ffi_declare<T> ran for a state, T* is pushed as cdata (see ffi.hpp)
+template <typename T>
+struct ffi_layout {};
+
+struct is_ffi_usertype_impl {
+    template<typename T, typename F = decltype(ffi_layout<T>::fields())>
+    static std::true_type test(int);
+
+    template<typename...>
+    static std::false_type test(...);
+};
+
+template <typename T>
+struct is_ffi_usertype : decltype(is_ffi_usertype_impl::test<T>(0)) {};
+
 template <typename T>
 struct lua_type_of<T, std::enable_if_t<std::is_arithmetic<T>::value>> : std::integral_constant<type, type::number> {};
 
@@ -290,7 +408,7 @@ struct lua_type_of<T, std::enable_if_t<std::is_enum<T>::value>> : std::integral_
 template <typename T>
 struct is_lua_primitive : std::integral_constant<bool, 
     type::userdata != lua_type_of<meta::Unqualified<T>>::value
-    || std::is_base_of<reference, meta::Unqualified<T>>::value> { };
+    || is_lua_reference<T>::value> { };
 
 template <typename T>
 struct is_lua_primitive<T*> : std::true_type {};
@@ -319,6 +437,21 @@ struct is_proxy_primitive<std::pair<A, B>> : std::true_type { };
 template <typename T>
 struct is_unique_usertype : std::false_type {};
 
+// Specialize as std::true_type to keep values of T in their userdata without a pointer in front of them.
+// T has to be registered as a usertype before any value of it is pushed
+template <typename T>
+struct is_value_only_usertype : std::false_type {};
+
+// Specialize as std::true_type to push every T* (and std::ref(T)) as one userdata per address and state,
+// kept in a weak table: the same pointer is the same Lua value. See stack::invalidate_identity
+template <typename T>
+struct is_identity_cached : std::false_type {};
+
+// Specialize as std::true_type to have __gc move T (or the unique holder of a T) into the state's
+// finalizer_queue instead of destroying it; it is destroyed when the queue is drained. T must be movable
+template <typename T>
+struct is_destruction_deferred : std::false_type {};
+
 template<typename T>
 inline type type_of() {
     return lua_type_of<meta::Unqualified<T>>::value;
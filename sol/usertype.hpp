@@ -31,7 +31,7 @@
 #include <vector>
 #include <array>
 #include <algorithm>
-#include <map>
+#include <memory>
 
 namespace sol {
 const std::array<std::string, 2> meta_variable_names = { {
@@ -114,76 +114,54 @@ struct is_destructor<destructor_wrapper<Fx>> : std::true_type {};
 template <typename... Args>
 using has_destructor = meta::Or<is_destructor<meta::Unqualified<Args>>...>;
 
-enum class stage {
-    normalmeta,
-    refmeta,
-    uniquemeta,
-};
+// Lua marks every userdata whose metatable has a __gc for finalization, which costs the collector
+// and holds the memory back for a cycle: types with nothing to destroy are better off without one
+template <typename T, typename... Args>
+using needs_destructor = meta::And<std::is_destructible<T>, meta::Not<std::is_trivially_destructible<T>>, meta::Not<has_destructor<Args...>>>;
+
+typedef std::vector<std::unique_ptr<function_detail::base_function>> function_list;
+// Every state the usertype is pushed into holds one of these,
+// so the functions live until the last of those states is closed
+typedef std::shared_ptr<function_list> shared_function_list;
 
-template<bool releasemem = false, typename TCont>
+template<typename TCont>
 inline int push_upvalues(lua_State* L, TCont&& cont) {
     int n = 0;
     for(auto& c : cont) {
-        if(releasemem) {
-            stack::push<light_userdata_value>(L, c.release());
-        }
-        else {
-            stack::push<light_userdata_value>(L, c.get());
-        }
+        stack::push<light_userdata_value>(L, c.get());
         ++n;
     }
     return n;
 }
 
-template<typename T, stage metastage>
-inline void push_metatable(lua_State* L, bool needsindexfunction, std::vector<std::unique_ptr<function_detail::base_function>>& funcs, std::vector<luaL_Reg>& functable, std::vector<luaL_Reg>& metafunctable, void* baseclasscheck, void* baseclasscast) {
-    static const auto& gcname = meta_function_names[static_cast<int>(meta_function::garbage_collect)];
-    luaL_newmetatable(L, &usertype_traits<T>::metatable[0]);
-    int metatableindex = lua_gettop(L);
-    if (baseclasscheck != nullptr) {
-        stack::push(L, light_userdata_value(baseclasscheck));
-        lua_setfield(L, metatableindex, &detail::base_class_check_key()[0]);
-    }
-    if (baseclasscast != nullptr) {
-        stack::push(L, light_userdata_value(baseclasscast));
-        lua_setfield(L, metatableindex, &detail::base_class_cast_key()[0]);
+inline int release_functions(lua_State* L) {
+    void* memory = lua_touserdata(L, 1);
+    shared_function_list* functions = static_cast<shared_function_list*>(memory);
+    for (auto& f : **functions) {
+        if (f) {
+            f->release(L);
+        }
     }
-    if (funcs.size() < 1 && metafunctable.size() < 2) {
+    functions->~shared_function_list();
+    return 0;
+}
+
+// functable and metafunctable end in a { nullptr, nullptr } entry already: nothing here writes to
+// the usertype, so one usertype can be pushed into states on several threads at once
+template<typename T>
+inline void push_metatable(lua_State* L, bool needsindexfunction, const function_list& funcs, const std::vector<luaL_Reg>& functable, const std::vector<luaL_Reg>& metafunctable, const detail::usertype_identity* identity) {
+    luaL_newmetatable(L, &usertype_traits<T>::metatable()[0]);
+    int metatableindex = lua_gettop(L);
+    stack::stack_detail::register_metatable<T>(L, metatableindex);
+    // The casts are kept on the C++ side, in an identity that is never written to
+    stack::push(L, light_userdata_value(const_cast<detail::usertype_identity*>(identity)));
+    lua_rawsetp(L, metatableindex, detail::usertype_identity_key());
+    if (funcs.size() < 1 && metafunctable.size() < 3) {
         return;
     }
     // Metamethods directly on the metatable itself
     int metaup = push_upvalues(L, funcs);
-    switch (metastage) {
-        case stage::uniquemeta: {
-            if (gcname != metafunctable.back().name) {
-                metafunctable.push_back({ "__gc", nullptr });
-            }
-            luaL_Reg& target = metafunctable.back();
-            luaL_Reg old = target;
-            target.func = detail::unique_destruct<T>;
-            metafunctable.push_back({nullptr, nullptr});
-            luaL_setfuncs(L, metafunctable.data(), metaup);
-            metafunctable.pop_back();
-            target = old;
-            break; }
-        case stage::refmeta:
-            if (gcname == metafunctable.back().name) {
-                // We can just "clip" out the __gc function,
-                // which we always put as the last entry in the meta function table.
-                luaL_Reg& target = metafunctable.back();
-                luaL_Reg old = target;
-                target = { nullptr, nullptr };
-                luaL_setfuncs(L, metafunctable.data(), metaup);
-                target = old;
-            }
-            break;
-        case stage::normalmeta:
-        default:
-            metafunctable.push_back({nullptr, nullptr});
-            luaL_setfuncs(L, metafunctable.data(), metaup);
-            metafunctable.pop_back();
-            break;
-    }
+    luaL_setfuncs(L, metafunctable.data(), metaup);
     if (needsindexfunction) {
         // We don't need to do anything more
         // since we've already bound the __index field using
@@ -192,47 +170,96 @@ inline void push_metatable(lua_State* L, bool needsindexfunction, std::vector<st
     }
     // Otherwise, we use quick, fast table indexing for methods
     // gives us performance boost in calling them
-    lua_createtable(L, 0, static_cast<int>(functable.size()));
+    lua_createtable(L, 0, static_cast<int>(functable.size() - 1));
     int up = push_upvalues(L, funcs);
-    functable.push_back({nullptr, nullptr});
     luaL_setfuncs(L, functable.data(), up);
-    functable.pop_back();
     lua_setfield(L, metatableindex, "__index");
     return;
 }
 
-template <typename T, typename Functions>
-inline void set_global_deleter(lua_State* L, lua_CFunction cleanup, Functions&& functions) {
-    // Automatic deleter table -- stays alive until lua VM dies
+inline void push_base_fields(bases<>, lua_State*, const char*) {}
+
+// Pushes the field of every declared base's metatable, in declaration order.
+// Bases that were never registered are skipped over to their own bases
+template <typename Base, typename... Rest>
+inline void push_base_fields(bases<Base, Rest...>, lua_State* L, const char* field) {
+    luaL_getmetatable(L, &usertype_traits<Base>::metatable()[0]);
+    if (lua_type(L, -1) == LUA_TTABLE) {
+        lua_getfield(L, -1, field);
+        if (lua_type(L, -1) == LUA_TNIL) {
+            lua_pop(L, 2);
+        }
+        else {
+            lua_remove(L, -2);
+        }
+    }
+    else {
+        lua_pop(L, 1);
+        push_base_fields(typename base<Base>::type(), L, field);
+    }
+    push_base_fields(bases<Rest...>(), L, field);
+}
+
+template <typename Bases>
+inline void push_base_fields_for(lua_State* L, const char* field) {
+    push_base_fields(Bases(), L, field);
+}
+
+typedef void(*base_fields_function)(lua_State*, const char*);
+
+// Collects the bases' __index or __newindex into an array, and returns its index, or 0 if there are none
+inline int make_fallbacks(lua_State* L, base_fields_function basefields, const char* field) {
+    if (basefields == nullptr) {
+        return 0;
+    }
+    int first = lua_gettop(L) + 1;
+    basefields(L, field);
+    int count = lua_gettop(L) - first + 1;
+    if (count < 1) {
+        return 0;
+    }
+    lua_createtable(L, count, 0);
+    lua_insert(L, first);
+    for (int i = count; i > 0; --i) {
+        lua_rawseti(L, first, i);
+    }
+    return first;
+}
+
+template <typename T>
+inline void set_global_deleter(lua_State* L, const shared_function_list& functions) {
+    // Automatic deleter -- stays alive until lua VM dies
     // even if the user calls collectgarbage(), weirdly enough
-    lua_createtable(L, 0, 0); // global table that sits at toplevel
-    lua_createtable(L, 0, 1); // metatable for the global table
-    int up = push_upvalues<true>(L, functions);
-    stack::set_field(L, "__gc", c_closure(cleanup, up));
+    void* memory = lua_newuserdata(L, sizeof(shared_function_list)); // global that sits at toplevel
+    new (memory) shared_function_list(functions);
+    lua_createtable(L, 0, 1); // metatable for the global
+    stack::set_field(L, "__gc", release_functions);
     lua_setmetatable(L, -2);
     // gctable name by default has ♻ part of it
-    lua_setglobal(L, &usertype_traits<T>::gc_table[0]);
+    lua_setglobal(L, &usertype_traits<T>::gc_table()[0]);
 }
 } // usertype_detail
 
 template<typename T>
 class usertype {
 private:
-    typedef std::map<std::string, std::pair<bool, function_detail::base_function*>> function_map_t;
+    typedef function_detail::usertype_indexing_function::member_list_t function_map_t;
     std::vector<std::string> functionnames;
-    std::vector<std::unique_ptr<function_detail::base_function>> functions;
+    usertype_detail::function_list functions;
+    usertype_detail::shared_function_list sharedfunctions;
     std::vector<luaL_Reg> functiontable;
     std::vector<luaL_Reg> metafunctiontable;
     function_detail::base_function* indexfunc;
     function_detail::base_function* newindexfunc;
     function_map_t indexwrapper, newindexwrapper;
+    function_detail::usertype_indexing_function* indexwrapperfunc;
+    function_detail::usertype_indexing_function* newindexwrapperfunc;
     lua_CFunction constructfunc;
     const char* destructfuncname;
     lua_CFunction destructfunc;
-    lua_CFunction functiongcfunc;
     bool needsindexfunction;
-    void* baseclasscheck;
-    void* baseclasscast;
+    const detail::usertype_identity* identity;
+    usertype_detail::base_fields_function basefields;
 
     template<typename... Functions>
     std::unique_ptr<function_detail::base_function> make_function(const std::string&, overload_set<Functions...> func) {
@@ -272,6 +299,10 @@ private:
         return make_variable_function(std::is_member_object_pointer<function_type>(), name, func);
     }
 
+    std::unique_ptr<function_detail::base_function> make_function(const std::string&, lua_CFunction func) {
+        return std::make_unique<function_detail::usertype_cfunction>(func);
+    }
+
     template<typename Fx>
     std::unique_ptr<function_detail::base_function> make_function(const std::string&, Fx&& func) {
         typedef meta::Unqualified<Fx> Fxu;
@@ -326,21 +357,33 @@ private:
         destructfuncname = name.c_str();
     }
 
+    // What goes into the metatable for the N-th function: raw lua_CFunctions are registered as themselves
+    template<std::size_t N, typename Fx>
+    static lua_CFunction table_function(Fx&&) {
+        return function_detail::usertype_call<N>;
+    }
+
+    template<std::size_t N>
+    static lua_CFunction table_function(lua_CFunction func) {
+        return func;
+    }
+
     template<std::size_t N, typename Fx>
     void build_function(std::string funcname, Fx&& func) {
         typedef std::is_member_object_pointer<meta::Unqualified<Fx>> is_variable;
+        lua_CFunction tablefunc = table_function<N>(func);
         functionnames.push_back(std::move(funcname));
         std::string& name = functionnames.back();
         auto baseptr = make_function(name, std::forward<Fx>(func));
         functions.emplace_back(std::move(baseptr));
         auto metamethodfind = std::find(meta_function_names.begin(), meta_function_names.end(), name);
         if (metamethodfind != meta_function_names.end()) {
-            metafunctiontable.push_back({ name.c_str(), function_detail::usertype_call<N> });
+            metafunctiontable.push_back({ name.c_str(), tablefunc });
             meta_function metafunction = static_cast<meta_function>(metamethodfind - meta_function_names.begin());
             switch (metafunction) {
             case meta_function::garbage_collect:
                 destructfuncname = name.c_str();
-                destructfunc = function_detail::usertype_call<N>;
+                destructfunc = tablefunc;
                 return;
             case meta_function::index:
                 indexfunc = functions.back().get();
@@ -350,7 +393,7 @@ private:
                 newindexfunc = functions.back().get();
                 break;
             case meta_function::construct:
-                constructfunc = function_detail::usertype_call<N>;
+                constructfunc = tablefunc;
                 break;
             default:
                 break;
@@ -359,12 +402,12 @@ private:
         }
         if (is_variable::value) {
             needsindexfunction = true;
-            indexwrapper.insert({ name, { false, functions.back().get() } });
-            newindexwrapper.insert({ name, { false, functions.back().get() } });
+            indexwrapper.push_back({ name, { false, functions.back().get() } });
+            newindexwrapper.push_back({ name, { false, functions.back().get() } });
             return;
         }
-        indexwrapper.insert({ name, { true, functions.back().get() } });
-        functiontable.push_back({ name.c_str(), function_detail::usertype_call<N> });
+        indexwrapper.push_back({ name, { true, functions.back().get() } });
+        functiontable.push_back({ name.c_str(), tablefunc });
     }
 
     template<std::size_t N, typename Fx, typename... Args>
@@ -385,66 +428,80 @@ private:
         build_function_tables<N>(std::forward<Args>(args)...);
         if (sizeof...(Bases) < 1)
             return;
-#ifndef SOL_NO_EXCEPTIONS
-        static_assert(sizeof(void*) <= sizeof(detail::throw_cast), "The size of this data pointer is too small to fit the inheritance checking function: file a bug report.");
-        baseclasscast = (void*)&detail::throw_as<T>;
-#elif !defined(SOL_NO_RTTI)
-        static_assert(sizeof(void*) <= sizeof(detail::inheritance_check_function), "The size of this data pointer is too small to fit the inheritance checking function: file a bug report.");
-        static_assert(sizeof(void*) <= sizeof(detail::inheritance_cast_function), "The size of this data pointer is too small to fit the inheritance checking function: file a bug report.");
-        baseclasscheck = (void*)&detail::inheritance<T, Bases...>::check;
-        baseclasscast = (void*)&detail::inheritance<T, Bases...>::cast;
-#else
-        static_assert(sizeof(void*) <= sizeof(detail::inheritance_check_function), "The size of this data pointer is too small to fit the inheritance checking function: file a bug report.");
-        static_assert(sizeof(void*) <= sizeof(detail::inheritance_cast_function), "The size of this data pointer is too small to fit the inheritance checking function: file a bug report.");
-        baseclasscheck = (void*)&detail::inheritance<T, Bases...>::check;
-        baseclasscast = (void*)&detail::inheritance<T, Bases...>::cast;
-#endif // No Runtime Type Information vs. Throw-Style Inheritance
+        // Build the cast table now rather than on the first argument that needs it
+        detail::inheritance<T, Bases...>::casts();
+        identity = &detail::identity_for<T, Bases...>::value;
+        basefields = &usertype_detail::push_base_fields_for<bases<Bases...>>;
     }
 
     template<std::size_t N>
     void build_function_tables() {
         int variableend = 0;
         if (!indexwrapper.empty()) {
-            functions.push_back(std::make_unique<function_detail::usertype_indexing_function>("__index", indexfunc, std::move(indexwrapper)));
+            auto idxfunc = std::make_unique<function_detail::usertype_indexing_function>("__index", indexfunc, std::move(indexwrapper));
+            indexwrapperfunc = idxfunc.get();
+            functions.push_back(std::move(idxfunc));
             metafunctiontable.push_back({ "__index", function_detail::usertype_call<N> });
             ++variableend;
         }
         if (!newindexwrapper.empty()) {
-            functions.push_back(std::make_unique<function_detail::usertype_indexing_function>("__newindex", newindexfunc, std::move(newindexwrapper)));
-            metafunctiontable.push_back({ "__newindex", indexwrapper.empty() ? function_detail::usertype_call<N> : function_detail::usertype_call<N + 1> });
+            auto newidxfunc = std::make_unique<function_detail::usertype_indexing_function>("__newindex", newindexfunc, std::move(newindexwrapper));
+            newindexwrapperfunc = newidxfunc.get();
+            functions.push_back(std::move(newidxfunc));
+            metafunctiontable.push_back({ "__newindex", variableend == 0 ? function_detail::usertype_call<N> : function_detail::usertype_call<N + 1> });
             ++variableend;
         }
         if (destructfunc != nullptr) {
             metafunctiontable.push_back({ destructfuncname, destructfunc });
         }
-        switch (variableend) {
-        case 2:
-            functiongcfunc = function_detail::usertype_gc<N + 2>;
-            break;
-        case 1:
-            functiongcfunc = function_detail::usertype_gc<N + 1>;
-            break;
-        case 0:
-            functiongcfunc = function_detail::usertype_gc<N + 0>;
-            break;
+    }
+
+    void set_declared_bases(std::false_type) {}
+
+    void set_declared_bases(std::true_type) {
+        // bases declared through sol::base<T> work without sol::base_classes:
+        // identity_for<T> has them already
+        if (basefields != nullptr) {
+            return;
         }
+        detail::inheritance<T>::casts();
+        basefields = &usertype_detail::push_base_fields_for<typename base<T>::type>;
     }
 
     template<typename... Args>
-    usertype(usertype_detail::verified_tag, Args&&... args) : indexfunc(nullptr), newindexfunc(nullptr), constructfunc(nullptr), 
-    destructfunc(nullptr), functiongcfunc(nullptr), needsindexfunction(false), baseclasscheck(nullptr), baseclasscast(nullptr) {
+    usertype(usertype_detail::verified_tag, Args&&... args) : indexfunc(nullptr), newindexfunc(nullptr), indexwrapperfunc(nullptr), newindexwrapperfunc(nullptr), constructfunc(nullptr), 
+    destructfunc(nullptr), needsindexfunction(false), identity(&detail::identity_for<T>::value), basefields(nullptr) {
         functionnames.reserve(sizeof...(args)+3);
         functiontable.reserve(sizeof...(args)+3);
         metafunctiontable.reserve(sizeof...(args)+3);
 
         build_function_tables<0>(std::forward<Args>(args)...);
+        set_declared_bases(meta::Not<std::is_same<typename base<T>::type, bases<>>>());
+        // Everything push needs is finished here, so pushing only ever reads this object
+        functiontable.push_back({ nullptr, nullptr });
+        metafunctiontable.push_back({ nullptr, nullptr });
+        sharedfunctions = std::make_shared<usertype_detail::function_list>(std::move(functions));
     }
 
     template<typename... Args>
     usertype(usertype_detail::add_destructor_tag, Args&&... args) : usertype(usertype_detail::verified, "__gc", default_destructor, std::forward<Args>(args)...) {}
 
     template<typename... Args>
-    usertype(usertype_detail::check_destructor_tag, Args&&... args) : usertype(meta::If<meta::And<std::is_destructible<T>, meta::Not<usertype_detail::has_destructor<Args...>>>, usertype_detail::add_destructor_tag, usertype_detail::verified_tag>(), std::forward<Args>(args)...) {}
+    usertype(usertype_detail::check_destructor_tag, Args&&... args) : usertype(meta::If<usertype_detail::needs_destructor<T, Args...>, usertype_detail::add_destructor_tag, usertype_detail::verified_tag>(), std::forward<Args>(args)...) {}
+
+    void push_indexing(lua_State* L, int metatableindex, function_detail::usertype_indexing_function* wrapper, const char* field) {
+        int fallbacks = usertype_detail::make_fallbacks(L, basefields, field);
+        if (wrapper != nullptr) {
+            wrapper->push(L, fallbacks);
+        }
+        else if (fallbacks != 0) {
+            lua_pushcclosure(L, &function_detail::usertype_indexing_function::chain, 1);
+        }
+        else {
+            return;
+        }
+        lua_setfield(L, metatableindex, field);
+    }
 
 public:
 
@@ -452,22 +509,39 @@ public:
     usertype(Args&&... args) : usertype(meta::If<meta::And<std::is_default_constructible<T>, meta::Not<usertype_detail::has_constructor<Args...>>>, decltype(default_constructor), usertype_detail::check_destructor_tag>(), std::forward<Args>(args)...) {}
 
     template<typename... Args, typename... CArgs>
-    usertype(constructors<CArgs...> constructorlist, Args&&... args) : usertype(usertype_detail::verified, "new", constructorlist, "__gc", default_destructor, std::forward<Args>(args)...) {
+    usertype(constructors<CArgs...> constructorlist, Args&&... args) : usertype(usertype_detail::check_destructor_tag(), "new", constructorlist, std::forward<Args>(args)...) {
             
     }
 
     int push(lua_State* L) {
-        // push pointer tables first,
-        usertype_detail::push_metatable<T*, usertype_detail::stage::refmeta>(L, needsindexfunction, functions, functiontable, metafunctiontable, baseclasscheck, baseclasscast);
-        lua_pop(L, 1);
-        usertype_detail::push_metatable<unique_usertype<T>, usertype_detail::stage::uniquemeta>(L, needsindexfunction, functions, functiontable, metafunctiontable, baseclasscheck, baseclasscast);
-        lua_pop(L, 1);
-        // but leave the regular T table on last
-        // so it can be linked to a type for usage with `.new(...)` or `:new(...)`
-        usertype_detail::push_metatable<T, usertype_detail::stage::normalmeta>(L, needsindexfunction, functions, functiontable, metafunctiontable, baseclasscheck, baseclasscast);
-        // Make sure to drop a table in the global namespace to properly destroy the pushed functions
+        // The functions are shared, not handed over, so the same usertype can be pushed into many states,
+        // from as many threads: they keep no state between calls
+        // Only the table for T itself is made here: the ones for T* and unique_usertype<T>
+        // are copied from it the first time something of that kind is pushed
+        if (is_destruction_deferred<T>::value) {
+            finalizer_detail::ensure(L);
+        }
+        usertype_detail::push_metatable<T>(L, needsindexfunction, *sharedfunctions, functiontable, metafunctiontable, identity);
+        int metatableindex = lua_gettop(L);
+        // Members are found through a plain lookup table held by the __index/__newindex closures,
+        // so methods stay a raw table get even when the usertype has variables.
+        // Whatever is not found there is looked up in the bases registered before T,
+        // so their members never have to be bound again for T
+        push_indexing(L, metatableindex, indexwrapperfunc, "__index");
+        push_indexing(L, metatableindex, newindexwrapperfunc, "__newindex");
+        lua_settop(L, metatableindex);
+        // Make sure to drop a global in the namespace to properly destroy the pushed functions
         // at some later point in life
-        usertype_detail::set_global_deleter<T>(L, functiongcfunc, functions);
+        usertype_detail::set_global_deleter<T>(L, sharedfunctions);
+#ifdef SOL_BINDING_STATS
+        // the bubbles left for constructors and destructors keep the names lined up with the functions
+        for (std::size_t i = 0; i < functionnames.size(); ++i) {
+            const auto& f = (*sharedfunctions)[i];
+            if (f) {
+                binding_stats_detail::name_binding(L, f.get(), usertype_traits<T>::name() + "." + functionnames[i]);
+            }
+        }
+#endif // SOL_BINDING_STATS
         return 1;
     }
 };
@@ -0,0 +1,82 @@
+// The MIT License (MIT) 
+
+// Copyright (c) 2013-2016 Rapptz, ThePhD and contributors
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#ifndef SOL_USERTYPE_STORAGE_HPP
+#define SOL_USERTYPE_STORAGE_HPP
+
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace sol {
+namespace detail {
+// What lua_newuserdata promises to align its blocks to
+union lua_userdata_alignment {
+    double d;
+    void* p;
+    long l;
+    lua_Integer i;
+};
+
+// Where a value pushed as T lives inside its userdata block.
+// By default the block starts with a T* to the object, so T, T* and unique_usertype<T> blocks
+// are all read the same way. Value-only types drop that pointer: their metatable's identity
+// says where the object is, which saves a word per object.
+// Either way the object sits at an address that respects alignof(T)
+template <typename T>
+struct usertype_storage {
+    static const bool value_only = is_value_only_usertype<T>::value;
+    static const std::size_t header = value_only ? 0 : sizeof(T*);
+    // right after the pointer, a block is only as aligned as the pointer is
+    static const std::size_t given_alignment = value_only || alignof(lua_userdata_alignment) < alignof(T*) ? alignof(lua_userdata_alignment) : alignof(T*);
+    static const bool overaligned = alignof(T) > given_alignment;
+    static const std::size_t size = header + sizeof(T) + (overaligned ? alignof(T) - 1 : 0);
+
+    static T* target(void* memory) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(memory) + header;
+        if (overaligned) {
+            std::uintptr_t misalignment = address % alignof(T);
+            if (misalignment != 0) {
+                address += alignof(T) - misalignment;
+            }
+        }
+        return reinterpret_cast<T*>(address);
+    }
+
+    static void* locate(void* memory) {
+        return target(memory);
+    }
+
+    // Makes the block and fills in its pointer, if it has one; the object still has to be constructed
+    static T* allocate(lua_State* L) {
+        void* memory = lua_newuserdata(L, size);
+        T* obj = target(memory);
+        if (!value_only) {
+            *static_cast<T**>(memory) = obj;
+        }
+        return obj;
+    }
+};
+} // detail
+} // sol
+
+#endif // SOL_USERTYPE_STORAGE_HPP
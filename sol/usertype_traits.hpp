@@ -26,25 +26,36 @@
 
 namespace sol {
 
+// The names are built the first time they are asked for, not during static initialization:
+// types that are never pushed are never demangled, and nothing depends on initialization order
 template<typename T>
 struct usertype_traits {
-    static const std::string name;
-    static const std::string metatable;
-    static const std::string variable_metatable;
-    static const std::string gc_table;
+    static const std::string& name() {
+        static const std::string n = detail::demangle_once<T>();
+        return n;
+    }
+
+    static const std::string& metatable() {
+        static const std::string m = std::string("sol.").append(name());
+        return m;
+    }
+
+    static const std::string& variable_metatable() {
+        static const std::string m = std::string("sol.").append(name()).append(".variables");
+        return m;
+    }
+
+    static const std::string& gc_table() {
+        static const std::string g = std::string("sol.").append(name()).append(".\xE2\x99\xBB");
+        return g;
+    }
+
+    // only the address matters: it keys the metatable in the registry
+    static char metatable_key;
 };
 
 template<typename T>
-const std::string usertype_traits<T>::name = detail::demangle<T>();
-
-template<typename T>
-const std::string usertype_traits<T>::metatable = std::string("sol.").append(detail::demangle<T>());
-
-template<typename T>
-const std::string usertype_traits<T>::variable_metatable = std::string("sol.").append(detail::demangle<T>()).append(".variables");
-
-template<typename T>
-const std::string usertype_traits<T>::gc_table = std::string("sol.").append(detail::demangle<T>().append(".\xE2\x99\xBB"));
+char usertype_traits<T>::metatable_key = 0;
 
 }
 
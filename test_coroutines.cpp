@@ -61,4 +61,387 @@ end
     }
     counter -= 1;
     REQUIRE(counter == 30);
-}
\ No newline at end of file
+}
+TEST_CASE("threading/generator", "a generator resumes its coroutine once per step, and ends on return or error") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine);
+    lua.script(R"(function squares(n)
+    for i = 1, n do
+        coroutine.yield(i * i, 'n' .. i)
+    end
+    return 'done'
+end
+function failing()
+    coroutine.yield(1)
+    error('out of items')
+end
+function forever()
+    local i = 0
+    while true do
+        i = i + 1
+        coroutine.yield(i)
+    end
+end
+)");
+
+    std::vector<int> values;
+    sol::generator<int> gen(lua.lua_state(), lua["squares"], 4);
+    for (int v : gen) {
+        values.push_back(v);
+    }
+    REQUIRE((values == std::vector<int>{ 1, 4, 9, 16 }));
+    REQUIRE(gen.status() == sol::call_status::ok);
+    REQUIRE(gen.begin() == gen.end());
+
+    std::vector<std::string> names;
+    for (const auto& pair : sol::generator<std::tuple<int, std::string>>(lua.lua_state(), lua["squares"], 2)) {
+        names.push_back(std::get<1>(pair));
+    }
+    REQUIRE((names == std::vector<std::string>{ "n1", "n2" }));
+
+    int seen = 0;
+    sol::generator<int> broken(lua.lua_state(), lua["failing"]);
+    REQUIRE_THROWS([&]() {
+        for (int v : broken) {
+            seen += v;
+        }
+    }());
+    REQUIRE(seen == 1);
+    REQUIRE(broken.error());
+    REQUIRE(broken.error_message().find("out of items") != std::string::npos);
+
+    sol::thread runner = sol::thread::create(lua.lua_state());
+    sol::coroutine cr = runner.state()["forever"];
+    sol::generator<int> endless(cr);
+    int last = 0;
+    for (int v : endless) {
+        last = v;
+        if (v == 5) {
+            break;
+        }
+    }
+    REQUIRE(last == 5);
+    REQUIRE(endless.status() == sol::call_status::yielded);
+    REQUIRE(endless.next());
+    REQUIRE(*endless.begin() == 6);
+}
+
+TEST_CASE("threading/scheduler", "a scheduler runs many coroutines, honoring sleeps and events") {
+    const auto& script = R"(log = {}
+function agent(name, steps)
+    for i = 1, steps do
+        log[#log + 1] = name
+        coroutine.yield()
+    end
+end
+function sleeper()
+    coroutine.yield("sleep", 10)
+    log[#log + 1] = "woke"
+end
+function listener()
+    coroutine.yield("wait", "door")
+    log[#log + 1] = "heard"
+end
+function broken()
+    error("broken agent", 0)
+end
+)";
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine);
+    lua.script(script);
+    sol::scheduler tasks(lua.lua_state());
+    sol::function agent = lua["agent"];
+    sol::scheduler::task_id a = tasks.spawn(agent, "a", 2);
+    sol::scheduler::task_id b = tasks.spawn(agent, "b", 1);
+    sol::scheduler::task_id s = tasks.spawn(lua.get<sol::function>("sleeper"));
+    sol::scheduler::task_id l = tasks.spawn(lua.get<sol::function>("listener"));
+    sol::scheduler::task_id e = tasks.spawn(lua.get<sol::function>("broken"));
+    REQUIRE(tasks.size() == 5);
+
+    sol::scheduler::clock::time_point now = sol::scheduler::clock::now();
+    REQUIRE(tasks.step(now) == 5);
+    REQUIRE(tasks.sleeping_count() == 1);
+    REQUIRE(tasks.waiting_count() == 1);
+    REQUIRE(tasks.finished(e));
+    REQUIRE(tasks.info(e).status == sol::call_status::runtime);
+    REQUIRE(tasks.info(e).error == "broken agent");
+
+    REQUIRE(tasks.step(now) == 2);
+    REQUIRE(tasks.finished(b));
+    REQUIRE(tasks.step(now) == 1);
+    REQUIRE(tasks.finished(a));
+    REQUIRE(tasks.info(a).status == sol::call_status::ok);
+    REQUIRE(tasks.info(a).resumes == 3);
+
+    REQUIRE(tasks.notify("door") == 1);
+    REQUIRE(tasks.step(now) == 1);
+    REQUIRE(tasks.finished(l));
+    REQUIRE_FALSE(tasks.finished(s));
+    REQUIRE(tasks.step(now + std::chrono::seconds(11)) == 1);
+    REQUIRE(tasks.finished(s));
+    REQUIRE(tasks.size() == 0);
+
+    sol::table log = lua["log"];
+    REQUIRE(log.get<std::string>(1) == "a");
+    REQUIRE(log.get<std::string>(2) == "b");
+    REQUIRE(log.get<std::string>(3) == "a");
+    REQUIRE(log.get<std::string>(4) == "heard");
+    REQUIRE(log.get<std::string>(5) == "woke");
+
+    REQUIRE(tasks.reap() == 5);
+    REQUIRE(tasks.spawn(agent, "c", 1) < 5);
+
+    // spawning from inside a task grows the task list while that task is being resumed
+    lua.set_function("fork", [&tasks, &agent](int n) {
+        for (int i = 0; i < n; ++i) {
+            tasks.spawn(agent, "f", 1);
+        }
+    });
+    lua.script("function forker() fork(64) coroutine.yield() end");
+    sol::scheduler::task_id f = tasks.spawn(lua.get<sol::function>("forker"));
+    tasks.run();
+    REQUIRE(tasks.size() == 0);
+    REQUIRE(tasks.info(f).status == sol::call_status::ok);
+    REQUIRE(tasks.info(f).resumes == 2);
+}
+
+TEST_CASE("threading/thread-pool", "finished coroutines give their threads back to the pool") {
+    const auto& script = R"(function count(n)
+    for i = 1, n do
+        coroutine.yield(i)
+    end
+    return n * 10
+end
+)";
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine);
+    lua.script(script);
+    sol::function count = lua["count"];
+    sol::thread_pool pool(lua.lua_state(), 2);
+    REQUIRE(pool.idle_count() == 2);
+    REQUIRE(pool.created_count() == 2);
+
+    for (int round = 0; round < 3; ++round) {
+        sol::pooled_coroutine co(pool, count);
+        REQUIRE(pool.idle_count() == 1);
+        int first = co(2);
+        int second = co();
+        int last = co();
+        REQUIRE(first == 1);
+        REQUIRE(second == 2);
+        REQUIRE(last == 20);
+        REQUIRE_FALSE(co.runnable());
+    }
+    REQUIRE(pool.idle_count() == 2);
+    REQUIRE(pool.created_count() == 2);
+
+    {
+        // still suspended when destroyed: the thread cannot be reused
+        sol::pooled_coroutine co(pool, count);
+        int first = co(5);
+        REQUIRE(first == 1);
+    }
+    REQUIRE(pool.idle_count() == 1);
+
+    {
+        sol::scheduler tasks(lua.lua_state(), &pool);
+        tasks.spawn(count, 1);
+        tasks.spawn(count, 1);
+        tasks.step();
+        tasks.step();
+        REQUIRE(tasks.size() == 0);
+    }
+    REQUIRE(pool.idle_count() == 2);
+    REQUIRE(pool.created_count() == 3);
+}
+
+TEST_CASE("threading/state-pool", "every state in the pool gets the same registrations and runs work on its own thread") {
+    struct counter {
+        int value = 0;
+        int bump(int by) {
+            value += by;
+            return value;
+        }
+    };
+
+    sol::usertype<counter> countertype("bump", &counter::bump, "value", &counter::value);
+    sol::state_pool pool(3, [&countertype](sol::state& lua) {
+        lua.open_libraries(sol::lib::base);
+        lua.set_usertype("counter", countertype);
+        lua.script("function twice(x) local c = counter.new() c:bump(x) return c:bump(x) end");
+    });
+    REQUIRE(pool.size() == 3);
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 9; ++i) {
+        results.push_back(pool.call<int>("twice", i));
+    }
+    for (int i = 0; i < 9; ++i) {
+        REQUIRE(results[i].get() == i * 2);
+    }
+
+    auto byhand = pool.submit_to(1, [](sol::state& lua) {
+        lua.script("c = counter.new() c.value = 41 c:bump(1)");
+        return lua.traverse_get<int>("c", "value");
+    });
+    REQUIRE(byhand.get() == 42);
+
+    auto bad = pool.script("error('boom')");
+    REQUIRE_THROWS(bad.get());
+
+    REQUIRE_THROWS(sol::state_pool(2, [](sol::state& lua) { lua.script("error('setup failed')"); }));
+}
+
+TEST_CASE("threading/yielding-futures", "yielding functions returning futures park their task until the result is in") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::coroutine);
+    std::promise<int> answer;
+    lua["fetch"] = sol::yielding([&answer](int) {
+        return answer.get_future();
+    });
+    int paused = 0;
+    lua["pause"] = sol::yielding([&paused]() {
+        ++paused;
+    });
+    lua.script(R"(
+function worker()
+    pause()
+    got = fetch(1)
+end
+)");
+    sol::function worker = lua["worker"];
+    sol::scheduler tasks(lua.lua_state());
+    tasks.spawn(worker);
+    tasks.step();
+    REQUIRE(paused == 1);
+    REQUIRE(tasks.ready_count() == 1);
+    tasks.step();
+    REQUIRE(tasks.inflight_count() == 1);
+    tasks.step();
+    REQUIRE(tasks.inflight_count() == 1);
+    REQUIRE_FALSE(lua["got"].valid());
+
+    answer.set_value(42);
+    tasks.run();
+    REQUIRE(tasks.size() == 0);
+    REQUIRE(lua.get<int>("got") == 42);
+
+    std::promise<int> broken;
+    lua["fail"] = sol::yielding([&broken]() {
+        return broken.get_future();
+    });
+    lua.script("function failing() got, message = fail() end");
+    sol::function failing = lua["failing"];
+    tasks.spawn(failing);
+    tasks.step();
+    broken.set_exception(std::make_exception_ptr(std::runtime_error("no route to host")));
+    tasks.run();
+    REQUIRE_FALSE(lua["got"].valid());
+    REQUIRE(lua.get<std::string>("message") == "no route to host");
+}
+
+TEST_CASE("threading/mailbox", "payloads posted from other threads are handed to a Lua handler in batches") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.script(R"(
+total = 0
+count = 0
+function on_event(kind, value)
+    if kind == "add" then
+        total = total + value
+    end
+    count = count + 1
+end
+)");
+    sol::function handler = lua["on_event"];
+    sol::mailbox<std::tuple<std::string, int>> events(lua.lua_state(), 100);
+    REQUIRE(events.capacity() == 128);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p) {
+        producers.emplace_back([&events]() {
+            for (int i = 1; i <= 25; ++i) {
+                while (!events.post(std::string("add"), i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    REQUIRE(events.drain(handler, 10) == 10);
+    REQUIRE(lua.get<int>("count") == 10);
+    REQUIRE(events.drain(handler) == 90);
+    REQUIRE(lua.get<int>("total") == 4 * (25 * 26 / 2));
+    REQUIRE(events.drain(handler) == 0);
+
+    lua.script("function picky(kind) if kind == 'bad' then error('bad payload', 0) end end");
+    sol::function picky = lua["picky"];
+    REQUIRE(events.post(std::string("ok"), 0));
+    REQUIRE(events.post(std::string("bad"), 0));
+    REQUIRE(events.post(std::string("ok"), 0));
+#ifndef SOL_NO_EXCEPTIONS
+    REQUIRE_THROWS_AS(events.drain(picky), sol::error);
+#else
+    REQUIRE(events.drain(picky) == 2);
+#endif // No Exceptions
+    REQUIRE(events.error_message() == "bad payload");
+    REQUIRE(events.drain(picky) == 1);
+    REQUIRE(events.error_message().empty());
+
+    for (std::size_t i = 0; i < events.capacity(); ++i) {
+        REQUIRE(events.post(std::string("skip"), 0));
+    }
+    REQUIRE_FALSE(events.post(std::string("skip"), 0));
+    REQUIRE(lua_gettop(lua.lua_state()) == 0);
+}
+
+TEST_CASE("threading/profiler", "the sampling profiler folds the stacks it samples, C++ functions included") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::os);
+    lua.set_function("spin", [](int n) {
+        volatile int x = 0;
+        for (int i = 0; i < n; ++i) {
+            x = x + i;
+        }
+        return static_cast<int>(x);
+    });
+    lua.script(R"(
+function inner()
+    return spin(100000)
+end
+function outer(seconds)
+    local stop = os.clock() + seconds
+    while os.clock() < stop do
+        inner()
+    end
+end
+)");
+    sol::profiler prof(lua, std::chrono::microseconds(500));
+    prof.start();
+    REQUIRE(prof.running());
+    lua["outer"](0.2);
+    prof.stop();
+    REQUIRE_FALSE(prof.running());
+
+    REQUIRE(prof.samples() > 0);
+    std::string folded = prof.folded();
+    REQUIRE(folded.find("outer") != std::string::npos);
+    REQUIRE(folded.find("inner") != std::string::npos);
+    REQUIRE(folded.find("spin [C]") != std::string::npos);
+    // stacks run from the outermost call to the innermost, each line ending in its count
+    std::size_t leaf = folded.find(";spin [C] ");
+    REQUIRE(leaf != std::string::npos);
+    std::size_t start = folded.rfind('\n', leaf);
+    std::string stack = folded.substr(start == std::string::npos ? 0 : start + 1, leaf - (start == std::string::npos ? 0 : start + 1));
+    REQUIRE(stack.find("outer") < stack.find("inner"));
+    REQUIRE(lua_gethook(lua.lua_state()) == nullptr);
+
+    prof.clear();
+    REQUIRE(prof.samples() == 0);
+    REQUIRE(prof.folded().empty());
+}
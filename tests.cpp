@@ -5,6 +5,9 @@
 #include <sol.hpp>
 #include <vector>
 #include <map>
+#include <list>
+#include <fstream>
+#include <cstdio>
 
 struct stack_guard {
     lua_State* L;
@@ -219,6 +222,36 @@ int factory_test::num_saved = 0;
 int factory_test::num_killed = 0;
 const int factory_test::true_a = 156;
 
+struct inheritance_root {
+    int r = 5;
+    virtual ~inheritance_root() {}
+};
+
+struct inheritance_pad {
+    double pad = 0.5;
+    virtual ~inheritance_pad() {}
+};
+
+struct inheritance_mid : inheritance_pad, inheritance_root {
+    int m = 6;
+};
+
+struct inheritance_leaf : inheritance_mid {
+    int l = 7;
+};
+
+namespace sol {
+template <>
+struct base<inheritance_mid> {
+    typedef bases<inheritance_pad, inheritance_root> type;
+};
+
+template <>
+struct base<inheritance_leaf> {
+    typedef bases<inheritance_mid> type;
+};
+}
+
 TEST_CASE("table/traversal", "ensure that we can chain requests and tunnel down into a value if we desire") {
 
     sol::state lua;
@@ -381,6 +414,27 @@ TEST_CASE("simple/call-lambda", "A C++ lambda is exposed to lua and called") {
     REQUIRE(a == 1);
 }
 
+TEST_CASE("simple/string_view", "string_view reads strings straight out of Lua and pushes them without an intermediate std::string") {
+    sol::state lua;
+
+    std::size_t seen = 0;
+    bool prefixed = false;
+    lua.set_function("route", [&](sol::string_view payload) {
+        seen = payload.size();
+        prefixed = payload.substr(0, 3) == "log";
+        return payload.substr(4);
+    });
+    lua.script("r = route('log:an embedded\\0 nul')");
+    REQUIRE(seen == 20);
+    REQUIRE(prefixed);
+    REQUIRE(lua.get<std::string>("r") == std::string("an embedded\0 nul", 16));
+
+    lua.set("v", sol::string_view("abcdef", 3));
+    REQUIRE(lua.get<std::string>("v") == "abc");
+    lua.script("s = 'some string'");
+    REQUIRE(lua.get<sol::string_view>("s") == "some string");
+}
+
 TEST_CASE("advanced/get-and-call", "Checks for lambdas returning values after a get operation") {
     const static std::string lol = "lol", str = "str";
     const static std::tuple<int, float, double, std::string> heh_tuple = std::make_tuple(1, 6.28f, 3.14, std::string("heh"));
@@ -487,6 +541,235 @@ TEST_CASE("advanced/call-referenced_obj", "A C++ object is passed by pointer/ref
     REQUIRE(y == 9);
 }
 
+TEST_CASE("advanced/call-site", "A function bound to a call site is called repeatedly with a fixed signature") {
+    sol::state lua;
+    lua.script("function update(dt, n) return n + dt end");
+    lua.script("function split(x) return x * 2, 'twice' end");
+    lua.script("calls = 0 function tick() calls = calls + 1 end");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+    {
+        sol::function f = lua["update"];
+        auto update = f.bind<double(double, int)>();
+        double total = 0;
+        for (int i = 0; i < 10; ++i) {
+            total += update(0.5, i);
+        }
+        REQUIRE(total == 50.0);
+        REQUIRE(lua_gettop(L) == top + 1);
+
+        sol::function g = lua["split"];
+        sol::call_site<std::tuple<int, std::string>(int)> split(g);
+        std::tuple<int, std::string> results;
+        split.call_into(results, 21);
+        REQUIRE(std::get<0>(results) == 42);
+        REQUIRE(std::get<1>(results) == "twice");
+        REQUIRE(split(4) == std::make_tuple(8, std::string("twice")));
+
+        sol::function h = lua["tick"];
+        sol::call_site<void()> tick(h);
+        tick();
+        tick();
+        REQUIRE(lua.get<int>("calls") == 2);
+    }
+    REQUIRE(lua_gettop(L) == top);
+}
+
+TEST_CASE("advanced/batched-calls", "A function is called over a whole range, collecting protected failures") {
+    sol::state lua;
+    lua.script("function score(x) return x * 10 end");
+    lua.script("seen = 0 function visit(x) seen = seen + x end");
+    lua.script("function picky(x) if x == 2 then error('no twos') end return x end");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+
+    std::vector<int> inputs{ 1, 2, 3 };
+    std::vector<int> scores;
+    sol::function score = lua["score"];
+    score.map<int>(inputs.begin(), inputs.end(), std::back_inserter(scores));
+    REQUIRE((scores == std::vector<int>{ 10, 20, 30 }));
+
+    sol::function visit = lua["visit"];
+    visit.for_each_call(inputs);
+    REQUIRE(lua.get<int>("seen") == 6);
+
+    sol::protected_function picky = lua["picky"];
+    std::vector<int> kept;
+    sol::protected_function::batch_errors errors = picky.map<int>(inputs.begin(), inputs.end(), std::back_inserter(kept));
+    REQUIRE((kept == std::vector<int>{ 1, 3 }));
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors[0].first == 1);
+    REQUIRE(errors[0].second.find("no twos") != std::string::npos);
+    REQUIRE(lua_gettop(L) == top);
+}
+
+TEST_CASE("advanced/dispatcher", "Many listeners are called with the same arguments, pushed once") {
+    struct event {
+        int id;
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<event>("event", "id", &event::id);
+    lua.script("seen = {}\n"
+        "function first(e, n) seen[1] = e; return nil end\n"
+        "function second(e, n) seen[2] = e; return e.id + n end\n"
+        "function third(e, n) seen[3] = e; return 0 end\n"
+        "function broken(e, n) error('listener failed') end");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+
+    event e{ 4 };
+    sol::dispatcher bus(L);
+    bus.add(lua["first"]);
+    bus.add(lua.get<sol::function>("second"));
+    bus.add(lua["third"]);
+    REQUIRE(bus.size() == 3);
+    REQUIRE(bus.call(&e, 1) == 3);
+    // every listener got the same userdata
+    REQUIRE_NOTHROW(lua.script("assert(seen[1] == seen[2] and seen[2] == seen[3])"));
+    REQUIRE(lua_gettop(L) == top);
+
+    sol::optional<int> answer = bus.call_until<int>(&e, 2);
+    REQUIRE(answer);
+    REQUIRE(answer.value() == 6);
+    REQUIRE(lua_gettop(L) == top);
+
+    bus.add(lua["broken"]);
+    REQUIRE_THROWS(bus.call(&e, 1));
+    lua_settop(L, top);
+    bus.set_protected(true);
+    REQUIRE(bus.call(&e, 1) == 3);
+    REQUIRE(bus.errors().size() == 1);
+    REQUIRE(bus.errors()[0].first == 3);
+    REQUIRE(bus.errors()[0].second.find("listener failed") != std::string::npos);
+    REQUIRE(lua_gettop(L) == top);
+
+    REQUIRE(bus.remove(lua.get<sol::function>("broken")));
+    REQUIRE_FALSE(bus.remove(lua.get<sol::function>("broken")));
+    REQUIRE(bus.size() == 3);
+
+    std::vector<sol::function> adhoc{ lua["third"], lua["first"] };
+    lua.script("seen = {}");
+    sol::multi_call(adhoc, &e, 0);
+    REQUIRE_NOTHROW(lua.script("assert(seen[1] == seen[3] and seen[2] == nil)"));
+    REQUIRE(lua_gettop(L) == top);
+
+    // listeners changing the list while it is being dispatched
+    sol::dispatcher changing(L);
+    lua.set_function("subscribe", [&changing](sol::function f) { changing.add(f); });
+    lua.set_function("unsubscribe", [&changing](sol::function f) { return changing.remove(f); });
+    lua.set_function("unsubscribe_all", [&changing]() { changing.clear(); });
+    lua.script("calls = {}\n"
+        "function once() calls[#calls + 1] = 'once'; assert(unsubscribe(once)); subscribe(late) end\n"
+        "function late() calls[#calls + 1] = 'late' end\n"
+        "function skipped() calls[#calls + 1] = 'skipped' end\n"
+        "function clearing() calls[#calls + 1] = 'clearing'; unsubscribe(skipped) end");
+    changing.add(lua["once"]);
+    changing.add(lua["clearing"]);
+    changing.add(lua["skipped"]);
+    REQUIRE(changing.call() == 2);
+    REQUIRE(changing.size() == 2);
+    REQUIRE_NOTHROW(lua.script("assert(#calls == 2 and calls[1] == 'once' and calls[2] == 'clearing')"));
+    REQUIRE(changing.call() == 2);
+    REQUIRE_NOTHROW(lua.script("assert(#calls == 4 and calls[3] == 'clearing' and calls[4] == 'late')"));
+    lua.script("function clearing() unsubscribe_all() end");
+    changing.clear();
+    changing.add(lua["clearing"]);
+    changing.add(lua["late"]);
+    REQUIRE(changing.call() == 1);
+    REQUIRE(changing.empty());
+    REQUIRE(lua_gettop(L) == top);
+}
+
+TEST_CASE("advanced/pinned-error-handler", "A protected function keeps its error handler in one stack slot across calls") {
+    sol::state lua;
+    lua.script("function handle(m) return 'handled: ' .. m end");
+    lua.script("function fail() error('bad', 0) end");
+    lua.script("function twice(x) return x * 2 end");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+
+    sol::reference handle = lua["handle"];
+    sol::protected_function::set_default_handler(handle);
+    {
+        sol::protected_function fail = lua["fail"];
+        sol::protected_function twice = lua["twice"];
+        twice.pin_handler();
+        REQUIRE(twice.handler_pinned());
+        REQUIRE(lua_gettop(L) == top + 1);
+        for (int i = 0; i < 3; ++i) {
+            int doubled = twice(i);
+            REQUIRE(doubled == i * 2);
+            REQUIRE(lua_gettop(L) == top + 1);
+        }
+        sol::protected_function copy = twice;
+        REQUIRE_FALSE(copy.handler_pinned());
+        twice.unpin_handler();
+        REQUIRE(lua_gettop(L) == top);
+
+        fail.pin_handler();
+        {
+            sol::protected_function_result result = fail();
+            REQUIRE_FALSE(result.valid());
+            std::string message = result;
+            REQUIRE(message == "handled: bad");
+        }
+        REQUIRE(lua_gettop(L) == top + 1);
+    }
+    REQUIRE(lua_gettop(L) == top);
+    sol::reference none;
+    sol::protected_function::set_default_handler(none);
+}
+
+TEST_CASE("advanced/function_ref", "Lua callbacks are stored as function_refs and called with a fixed signature") {
+    sol::state lua;
+    std::vector<sol::function_ref<int(int)>> handlers;
+    lua.set_function("on_event", [&handlers](sol::function_ref<int(int)> handler) {
+        handlers.push_back(std::move(handler));
+    });
+    lua.script("on_event(function(x) return x + 1 end)");
+    lua.script("on_event(function(x) return x * 3 end)");
+    REQUIRE(handlers.size() == 2);
+    REQUIRE(handlers[0](4) == 5);
+    REQUIRE(handlers[1](4) == 12);
+
+    lua.script("last = 0 function record(a, b) last = a + b end");
+    sol::function record_fx = lua["record"];
+    sol::function_ref<void(int, int)> record(record_fx);
+    record(2, 3);
+    REQUIRE(lua.get<int>("last") == 5);
+
+    sol::function_ref<void(int, int)> moved = std::move(record);
+    REQUIRE(moved);
+    REQUIRE_FALSE(record);
+}
+
+int c_call_add(int a, int b) {
+    return a + b;
+}
+
+struct c_call_counter {
+    int value = 0;
+    int add(int x) {
+        value += x;
+        return value;
+    }
+};
+
+TEST_CASE("advanced/c_call", "Functions baked into a lua_CFunction at compile time are called without upvalues") {
+    sol::state lua;
+    lua.set_function("add", sol::c_call<decltype(&c_call_add), &c_call_add>);
+    lua.set("add2", &sol::c_call<decltype(&c_call_add), &c_call_add>);
+    lua.new_usertype<c_call_counter>("c_call_counter",
+        "add", &sol::c_call<decltype(&c_call_counter::add), &c_call_counter::add>
+    );
+    lua.script("x = add(2, 3) y = add2(4, 5)");
+    lua.script("c = c_call_counter.new() c:add(4) z = c:add(6)");
+    REQUIRE(lua.get<int>("x") == 5);
+    REQUIRE(lua.get<int>("y") == 9);
+    REQUIRE(lua.get<int>("z") == 10);
+}
+
 TEST_CASE("negative/basic_errors", "Check if error handling works correctly") {
     sol::state lua;
 
@@ -520,6 +803,35 @@ TEST_CASE("simple/get_default", "Test that table::get_default work corretly") {
   REQUIRE(is_not_set == 22);
 }
 
+TEST_CASE("tables/get_or", "single pass lookups stop at the first missing level and fall back to the default") {
+    sol::state lua;
+    lua.script("config = { window = { width = 800, title = 'main' }, depth = 3 }");
+    sol::table config = lua["config"];
+
+    REQUIRE(config.get_or<int>("window", "width", 640) == 800);
+    REQUIRE(config.get_or<int>("window", "height", 480) == 480);
+    REQUIRE(config.get_or<int>("depth", "width", 640) == 640);
+    REQUIRE(config.get_or<int>("missing", "width", 640) == 640);
+    REQUIRE(config.get_or<std::string>("window", "title", "untitled") == "main");
+    REQUIRE(config.get_or<int>("window", "title", 5) == 5);
+    REQUIRE(lua.get_or<int>("config", "depth", 0) == 3);
+
+    sol::optional<int> width = config.try_get<int>("window", "width");
+    sol::optional<int> height = config.traverse_get<sol::optional<int>>("window", "height");
+    REQUIRE(width);
+    REQUIRE(width.value() == 800);
+    REQUIRE_FALSE(height);
+
+    REQUIRE(lua["config"]["window"]["width"].get_or(1) == 800);
+    REQUIRE(lua["config"]["nope"]["width"].get_or(1) == 1);
+    sol::optional<int> through_proxy = lua["config"]["depth"]["width"];
+    REQUIRE_FALSE(through_proxy);
+
+    int top = lua_gettop(lua.lua_state());
+    config.get_or<int>("missing", "a", "b", 0);
+    REQUIRE(lua_gettop(lua.lua_state()) == top);
+}
+
 
 
 TEST_CASE("tables/create", "Check if creating a table is kosher") {
@@ -668,6 +980,301 @@ TEST_CASE("tables/operator[]", "Check if operator[] retrieval and setting works
     REQUIRE_NOTHROW(assert1(lua.globals()));
 }
 
+TEST_CASE("tables/container-get", "Lua tables convert straight into standard containers") {
+    sol::state lua;
+    lua.script("arr = { 1, 2, 3, 4, 5 }\n"
+        "dict = { a = 1, b = 2, c = 3 }\n"
+        "bad = { 1, 2, 'three' }\n"
+        "nested = { { 1, 2 }, { 3 } }");
+
+    std::vector<int> arr = lua["arr"];
+    REQUIRE((arr == std::vector<int>{ 1, 2, 3, 4, 5 }));
+    std::array<double, 3> firstthree = lua.get<std::array<double, 3>>("arr");
+    REQUIRE((firstthree == std::array<double, 3>{ { 1, 2, 3 } }));
+    std::vector<std::vector<int>> nested = lua["nested"];
+    REQUIRE(nested.size() == 2);
+    REQUIRE(nested[1].front() == 3);
+
+    std::map<std::string, int> dict = lua["dict"];
+    REQUIRE(dict.size() == 3);
+    REQUIRE(dict["a"] == 1);
+    REQUIRE(dict["c"] == 3);
+    std::unordered_map<std::string, int> udict = lua["dict"];
+    REQUIRE(udict["b"] == 2);
+
+    sol::optional<std::vector<int>> good = lua["arr"];
+    REQUIRE(good);
+    REQUIRE(good->size() == 5);
+    sol::optional<std::vector<int>> bad = lua["bad"];
+    REQUIRE_FALSE(bad);
+    sol::optional<std::map<std::string, int>> notatable = lua["arr"][1];
+    REQUIRE_FALSE(notatable);
+}
+
+TEST_CASE("tables/bulk-set", "Whole ranges go into tables with raw sets") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.script("t = setmetatable({}, { __newindex = function() error('metamethod should not be called') end })");
+    sol::table t = lua["t"];
+
+    std::vector<int> values{ 1, 2, 3 };
+    REQUIRE_NOTHROW(t.append_range(values));
+    REQUIRE_NOTHROW(t.append_range(values.begin(), values.begin() + 2));
+    REQUIRE(t.size() == 5);
+    REQUIRE(t.get<int>(4) == 1);
+
+    std::map<std::string, int> named{ { "a", 24 }, { "b", 25 } };
+    REQUIRE_NOTHROW(t.bulk_set(named.begin(), named.end()));
+    REQUIRE(t.get<int>("b") == 25);
+
+    lua.set("m", named);
+    lua.set("v", values);
+    REQUIRE_NOTHROW(lua.script("assert(m.a == 24 and m.b == 25)\n"
+        "assert(#v == 3 and v[3] == 3)"));
+}
+
+TEST_CASE("tables/array_view", "array_view lets Lua read and write C++ buffers in place") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    std::vector<float> samples{ 0.5f, 1.5f, 2.5f };
+    const std::vector<int> fixed{ 1, 2 };
+    lua.set("samples", sol::as_container(samples));
+    lua.set("fixed", sol::as_container(fixed));
+
+    REQUIRE_NOTHROW(lua.script("assert(#samples == 3)\n"
+        "local sum = 0\n"
+        "for i = 1, #samples do sum = sum + samples[i] end\n"
+        "assert(sum == 4.5)\n"
+        "assert(samples[0] == nil and samples[4] == nil)\n"
+        "samples[2] = 8\n"
+        "assert(fixed[2] == 2)"));
+    REQUIRE(samples[1] == 8.0f);
+    REQUIRE_THROWS(lua.script("fixed[1] = 3"));
+#ifndef SOL_NO_BOUNDS_CHECKS
+    REQUIRE_THROWS(lua.script("samples[4] = 1"));
+#endif // Bounds checks
+
+    sol::array_view<float> back = lua["samples"];
+    REQUIRE(back.data() == samples.data());
+    REQUIRE(back.size() == 3);
+    sol::object samples_object = lua["samples"];
+    sol::object fixed_object = lua["fixed"];
+    REQUIRE(samples_object.is<sol::array_view<float>>());
+    REQUIRE_FALSE(samples_object.is<sol::array_view<int>>());
+    REQUIRE_FALSE(fixed_object.is<sol::array_view<float>>());
+    lua.set_function("first", [](sol::array_view<float> v) { return v[0]; });
+    REQUIRE_NOTHROW(lua.script("assert(first(samples) == 0.5)"));
+    REQUIRE_THROWS(lua.script("first(fixed)"));
+    REQUIRE_THROWS(lua.script("first({})"));
+}
+
+TEST_CASE("tables/soa_view", "struct-of-arrays columns are viewed in place and handed to Lua a chunk at a time") {
+    std::vector<float> x = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    std::vector<float> vx(10, 0.5f);
+    const std::vector<int> id = { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+    sol::soa_view particles;
+    particles.add("x", x).add("vx", vx).add("id", id);
+    REQUIRE(particles.size() == 10);
+    REQUIRE(particles.column_count() == 3);
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.set("particles", particles);
+    REQUIRE_NOTHROW(lua.script("assert(#particles == 10)\n"
+        "assert(#particles.id == 10)\n"
+        "assert(particles.id[3] == 12)\n"
+        "assert(particles.missing == nil)\n"
+        "calls, rows = 0, 0\n"
+        "local n = particles:for_each_batch(function(s, count, first)\n"
+        "    calls = calls + 1\n"
+        "    assert(#s.x == count and s.id[1] == 9 + first)\n"
+        "    local px, pvx = s.x, s.vx\n"
+        "    for i = 1, count do px[i] = px[i] + pvx[i] end\n"
+        "    rows = rows + count\n"
+        "end, 4)\n"
+        "assert(n == 3 and calls == 3 and rows == 10)\n"
+    ));
+    REQUIRE(x[0] == 0.5f);
+    REQUIRE(x[9] == 9.5f);
+    REQUIRE_THROWS(lua.script("particles.id[1] = 0"));
+    REQUIRE_THROWS(lua.script("particles.x = 1"));
+    REQUIRE_THROWS(lua.script("particles:for_each_batch(function() end, 0)"));
+
+    lua.set_function("rows", [](sol::soa_view& v) { return v.size(); });
+    REQUIRE_NOTHROW(lua.script("assert(rows(particles) == 10)"));
+    REQUIRE_THROWS(lua.script("rows(particles.x)"));
+    REQUIRE_THROWS(lua.script("rows({})"));
+}
+
+TEST_CASE("containers/by-reference", "containers pushed by pointer or std::ref are live views of the C++ object") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    std::vector<int> v{ 1, 2, 3 };
+    std::map<std::string, int> m{ { "a", 1 } };
+    std::list<int> l{ 5, 6 };
+    const std::vector<int> fixed{ 4 };
+    static_assert(sol::is_container<std::vector<int>>::value && sol::is_container<std::map<std::string, int>>::value, "standard containers are viewed by reference");
+    static_assert(!sol::is_container<std::string>::value, "strings stay strings");
+    lua.set("v", std::ref(v));
+    lua.set("m", &m);
+    lua.set("l", &l);
+    lua.set("fixed", &fixed);
+    lua.set_function("total", [](const std::vector<int>& c) {
+        int sum = 0;
+        for (int x : c) sum += x;
+        return sum;
+    });
+
+    REQUIRE_NOTHROW(lua.script("assert(#v == 3 and v[2] == 2 and v[4] == nil)\n"
+        "v[1] = 10\n"
+        "v[#v + 1] = 4\n"
+        "v:insert(1, 0)\n"
+        "v:erase(#v)\n"
+        "assert(total(v) == 15)\n"
+        "assert(m.a == 1 and m.b == nil)\n"
+        "m.b = 2\n"
+        "assert(m:insert('c', 3) and not m:insert('c', 4))\n"
+        "m.a = nil\n"
+        "l:insert(7)\n"
+        "assert(l[3] == 7)"));
+    REQUIRE(v == (std::vector<int>{ 0, 10, 2, 3 }));
+    REQUIRE(m == (std::map<std::string, int>{ { "b", 2 }, { "c", 3 } }));
+    REQUIRE(l.size() == 3);
+
+    REQUIRE_THROWS(lua.script("fixed[1] = 3"));
+    REQUIRE_THROWS(lua.script("fixed:clear()"));
+#ifndef SOL_NO_BOUNDS_CHECKS
+    REQUIRE_THROWS(lua.script("v[10] = 1"));
+#endif // Bounds checks
+
+#if SOL_LUA_VERSION > 501
+    REQUIRE_NOTHROW(lua.script("local keys, sum = 0, 0\n"
+        "for k, x in pairs(m) do keys = keys + 1; sum = sum + x end\n"
+        "assert(keys == 2 and sum == 5)\n"
+        "local n = 0\n"
+        "for i, x in ipairs(l) do n = n + i end\n"
+        "assert(n == 6)"));
+#endif
+
+    // by value, a view is copied out of the container it refers to
+    std::vector<int> copy = lua["v"];
+    REQUIRE(copy == v);
+    sol::optional<std::map<std::string, int>> maybe = lua["m"];
+    REQUIRE(static_cast<bool>(maybe));
+    REQUIRE(*maybe == m);
+    sol::optional<std::vector<int>> notvector = lua["m"];
+    REQUIRE_FALSE(static_cast<bool>(notvector));
+
+    REQUIRE_NOTHROW(lua.script("v:clear()"));
+    REQUIRE(v.empty());
+    std::vector<int>* back = lua["v"];
+    REQUIRE(back == &v);
+}
+
+TEST_CASE("tables/stack-references", "stack_object, stack_table and stack_function refer to arguments in place") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    sol::object kept;
+    lua.set_function("inspect", [&](sol::stack_table t, sol::stack_function f, sol::stack_object o) {
+        int x = t["x"];
+        t.set("seen", true);
+        kept = o;
+        return f.call<int>(x) + o.as<int>();
+    });
+    REQUIRE_NOTHROW(lua.script("t = { x = 2 }\n"
+        "r = inspect(t, function(v) return v * 10 end, 3)"));
+    REQUIRE(lua.get<int>("r") == 23);
+    REQUIRE(lua["t"]["seen"].get<bool>());
+    REQUIRE(kept.as<int>() == 3);
+
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+    lua_pushinteger(L, 5);
+    {
+        sol::stack_object o(L, -1);
+        REQUIRE(o.is<int>());
+        REQUIRE(o.stack_index() == top + 1);
+        sol::stack_object copy = o;
+        REQUIRE(copy.as<int>() == 5);
+    }
+    lua_pop(L, 1);
+    REQUIRE(lua_gettop(L) == top);
+}
+
+TEST_CASE("tables/values", "sol::value keeps scalars inline and everything else in the registry") {
+    static_assert(!std::is_polymorphic<sol::value>::value, "sol::value has no vtable");
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::math);
+    std::vector<sol::value> kept;
+    lua.set_function("keep", [&](sol::value v) { kept.push_back(v); });
+    lua.set_function("give", [&](std::size_t i) { return kept[i - 1]; });
+    REQUIRE_NOTHROW(lua.script("keep(nil) keep(true) keep(42) keep(0.5) keep('text') keep({ x = 1 })"));
+    REQUIRE(kept.size() == 6);
+
+    REQUIRE_FALSE(kept[0].valid());
+    REQUIRE(kept[0] == sol::nil);
+    REQUIRE(kept[1].get_type() == sol::type::boolean);
+    REQUIRE(kept[1].as<bool>());
+    REQUIRE(kept[2].as<int>() == 42);
+    REQUIRE(kept[3].as<double>() == 0.5);
+    REQUIRE(kept[4].as<std::string>() == "text");
+    REQUIRE(kept[5].as<sol::table>()["x"].get<int>() == 1);
+    for (std::size_t i = 0; i < 4; ++i) {
+        REQUIRE(kept[i].registry_index() == LUA_NOREF);
+    }
+    REQUIRE(kept[4].registry_index() != LUA_NOREF);
+    REQUIRE(kept[5].registry_index() != LUA_NOREF);
+
+    REQUIRE_NOTHROW(lua.script("assert(give(1) == nil and give(2) == true and give(3) == 42)\n"
+        "assert(give(4) == 0.5 and give(5) == 'text' and give(6).x == 1)"));
+#if SOL_LUA_VERSION >= 503
+    REQUIRE_NOTHROW(lua.script("keep(math.maxinteger) keep(2.0)"));
+    REQUIRE_NOTHROW(lua.script("assert(math.type(give(7)) == 'integer' and give(7) == math.maxinteger)\n"
+        "assert(math.type(give(8)) == 'float')"));
+#endif // Lua 5.3+ integers
+
+    sol::object o = lua["give"](5);
+    sol::value fromobject = o;
+    sol::value copy = fromobject;
+    sol::value moved = std::move(copy);
+    REQUIRE(moved.as<std::string>() == "text");
+    REQUIRE_FALSE(copy.valid());
+    lua["back"] = moved;
+    REQUIRE(lua.get<std::string>("back") == "text");
+    sol::value global = lua["back"];
+    REQUIRE(global.is<std::string>());
+}
+
+TEST_CASE("tables/for_each-typed", "typed iteration converts keys and values straight off the stack") {
+    sol::state lua;
+    lua.script("arr = { 10, 20, 30, nil, 50 }\n"
+        "kv = { a = 1, b = 2, c = 3 }");
+    sol::table arr = lua["arr"];
+    sol::table kv = lua["kv"];
+
+    std::vector<int> seen;
+    arr.ipairs<int>([&](std::size_t i, int v) {
+        REQUIRE(v == static_cast<int>(i) * 10);
+        seen.push_back(v);
+    });
+    REQUIRE(seen.size() == 3);
+
+    std::map<std::string, int> entries;
+    kv.for_each<std::string, int>([&](std::string k, int v) {
+        entries[k] = v;
+    });
+    REQUIRE(entries.size() == 3);
+    REQUIRE(entries["c"] == 3);
+
+    int count = 0;
+    kv.for_each<sol::stack_object, sol::stack_object>([&](sol::stack_object k, sol::stack_object v) {
+        REQUIRE(k.valid());
+        REQUIRE(v.is<int>());
+        ++count;
+    });
+    REQUIRE(count == 3);
+}
+
 TEST_CASE("tables/operator[]-valid", "Test if proxies on tables can lazily evaluate validity") {
     sol::state lua;
     bool isFullScreen = false;
@@ -690,6 +1297,48 @@ TEST_CASE("tables/operator[]-valid", "Test if proxies on tables can lazily evalu
     REQUIRE_FALSE(isFullScreen);
 }
 
+TEST_CASE("tables/operator[]-cached", "Proxies can resolve their key chain once and be reused") {
+    sol::state lua;
+    lua.script("config = { ai = { pathing = { weights = 2 } } }");
+
+    sol::cached_proxy weights = lua["config"]["ai"]["pathing"]["weights"].cache();
+    REQUIRE(weights.valid());
+    int w = weights;
+    REQUIRE(w == 2);
+    weights = 5;
+    REQUIRE(lua["config"]["ai"]["pathing"]["weights"].get<int>() == 5);
+    lua.script("config.ai.pathing.weights = 7");
+    REQUIRE(weights.get<int>() == 7);
+
+    sol::cached_proxy top = lua["toplevel"].cache();
+    REQUIRE_FALSE(top.valid());
+    REQUIRE(top == sol::nil);
+    top = "hello";
+    REQUIRE(lua.get<std::string>("toplevel") == "hello");
+    top.set_function([]() { return 24; });
+    REQUIRE(top.call<int>() == 24);
+
+    // the cached table stays the one it resolved
+    lua.script("config.ai.pathing = { weights = 9 }");
+    REQUIRE(weights.get<int>() == 7);
+}
+
+TEST_CASE("tables/keys", "sol::key holds a ready-made Lua string for table lookups") {
+    sol::state lua;
+    lua.script("t = { position = 1, velocity = 2 }");
+    sol::table t = lua["t"];
+    auto keys = sol::make_keys(lua.lua_state(), "position", "velocity", "mass");
+
+    REQUIRE(t.get<int>(keys[0]) == 1);
+    int v = t[keys[1]];
+    REQUIRE(v == 2);
+    t.set(keys[2], 24);
+    REQUIRE(t.get<int>("mass") == 24);
+    t[keys[0]] = 10;
+    REQUIRE(t.get<int>("position") == 10);
+    REQUIRE(keys[1].get_type() == sol::type::string);
+}
+
 TEST_CASE("tables/operator[]-optional", "Test if proxies on tables can lazily evaluate validity") {
     sol::state lua;
     
@@ -872,6 +1521,247 @@ TEST_CASE("tables/arbitrary-creation", "tables should be created from standard c
     REQUIRE(c.get<std::string>("project") == "sol");
 }
 
+TEST_CASE("tables/numbers", "numbers move between the array part of a table and C++ buffers in bulk") {
+    sol::state lua;
+    std::vector<float> source(1000);
+    for (std::size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<float>(i) * 0.5f;
+    }
+    sol::table t = lua.create_table(static_cast<int>(source.size()), 0);
+    t.write_numbers(sol::as_container(source));
+    REQUIRE(t.size() == source.size());
+    REQUIRE(t.get<float>(3) == 1.0f);
+
+    std::vector<float> back(source.size());
+    REQUIRE(t.read_numbers(sol::as_container(back)) == source.size());
+    REQUIRE(back == source);
+
+    std::vector<std::int32_t> ints(600);
+    REQUIRE(t.read_numbers(sol::as_container(ints)) == ints.size());
+    REQUIRE(ints[4] == 2);
+
+    // reading stops at the first element that is not a number, or at the end of either side
+    lua.script("u = { 1, 2, 3, 'x', 5 }");
+    sol::table u = lua["u"];
+    std::vector<double> partial(10, -1.0);
+    REQUIRE(u.read_numbers(sol::as_container(partial)) == 3);
+    REQUIRE(partial[2] == 3.0);
+    REQUIRE(partial[3] == -1.0);
+
+    const std::int32_t values[] = { 7, 8, 9 };
+    sol::stack::push_numbers(lua.lua_state(), sol::array_view<const std::int32_t>(values, 3));
+    sol::table pushed(lua.lua_state(), -1);
+    lua_pop(lua.lua_state(), 1);
+    REQUIRE(pushed.size() == 3);
+    REQUIRE(pushed.get<int>(3) == 9);
+    REQUIRE(lua_gettop(lua.lua_state()) == 0);
+}
+
+struct schema_point {
+    double x = 0, y = 0;
+};
+
+struct schema_spawn {
+    std::string name;
+    schema_point at;
+    int count = 1;
+};
+
+namespace sol {
+template <>
+struct schema_for<schema_point> {
+    static auto fields() {
+        return sol::fields("x", &schema_point::x, "y", &schema_point::y);
+    }
+};
+
+template <>
+struct schema_for<schema_spawn> {
+    static auto fields() {
+        return sol::fields("name", &schema_spawn::name, "at", &schema_spawn::at, "count", &schema_spawn::count);
+    }
+};
+}
+
+TEST_CASE("tables/schema", "structs with a schema convert to and from plain tables") {
+    static_assert(sol::schema<schema_spawn>::size == 3, "one entry per field");
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.set_function("moved", [](const schema_spawn& s, double dx) {
+        schema_spawn r = s;
+        r.at.x += dx;
+        return r;
+    });
+
+    schema_spawn s;
+    s.name = "orc";
+    s.at.x = 1.5;
+    s.at.y = -2;
+    s.count = 3;
+    lua["s"] = s;
+    REQUIRE_NOTHROW(lua.script("assert(type(s) == 'table' and type(s.at) == 'table')\n"
+        "assert(s.name == 'orc' and s.at.x == 1.5 and s.at.y == -2 and s.count == 3)\n"
+        "t = moved({ name = 'elf', at = { x = 1, y = 2 } }, 2)"));
+
+    schema_spawn t = lua["t"];
+    REQUIRE(t.name == "elf");
+    REQUIRE(t.at.x == 3.0);
+    REQUIRE(t.at.y == 2.0);
+    // missing fields keep their defaults
+    REQUIRE(t.count == 1);
+
+    // reads and writes are raw: metamethods on the table are not consulted
+    lua.script("u = setmetatable({ at = {} }, { __index = function() return 'trap' end })");
+    schema_spawn u = lua["u"];
+    REQUIRE(u.name.empty());
+    REQUIRE(u.at.x == 0.0);
+}
+
+enum class command : int {
+    jump = 1,
+    crouch = 2,
+    fire = 4
+};
+
+TEST_CASE("tables/enum", "enums registered with new_enum are read from numbers or their names") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_enum<command>("command", { { "jump", command::jump }, { "crouch", command::crouch }, { "fire", command::fire } });
+    lua.new_enum<sol::type>("luatype", { { "number", sol::type::number }, { "string", sol::type::string } }, true);
+    std::vector<command> seen;
+    lua.set_function("issue", [&seen](command c) { seen.push_back(c); });
+    lua.set_function("wants", [](command c) { return c; });
+    lua.set_function("only_a_command", sol::overload([](command) { return "command"; }, [](std::string) { return "string"; }));
+
+    REQUIRE_NOTHROW(lua.script("issue(command.jump) issue('fire') issue(2)\n"
+        "assert(wants('crouch') == command.crouch and command.fire == 4)\n"
+        "assert(only_a_command('fire') == 'command' and only_a_command('duck') == 'string')"));
+    REQUIRE((seen == std::vector<command>{ command::jump, command::fire, command::crouch }));
+    REQUIRE(lua["command"]["fire"].get<command>() == command::fire);
+    lua_State* L = lua.lua_state();
+    lua_pushliteral(L, "crouch");
+    lua_pushliteral(L, "duck");
+    lua_pushnumber(L, 1.5);
+    REQUIRE(sol::stack::check<command>(L, -3));
+    REQUIRE_FALSE(sol::stack::check<command>(L, -2));
+    REQUIRE_FALSE(sol::stack::check<command>(L, -1));
+    lua_pop(L, 3);
+    REQUIRE_THROWS(lua.script("wants('duck')"));
+    REQUIRE_THROWS(lua.script("wants(1.5)"));
+    // the same argument types, picked apart by the string's value each time
+    REQUIRE_NOTHROW(lua.script("for i = 1, 4 do\n"
+        "    assert(only_a_command('jump') == 'command' and only_a_command('run') == 'string')\n"
+        "end"));
+
+    REQUIRE_NOTHROW(lua.script("assert(luatype.number == 3)"));
+    REQUIRE_THROWS(lua.script("luatype.number = 4"));
+    REQUIRE_THROWS(lua.script("setmetatable(luatype, nil)"));
+    REQUIRE_NOTHROW(lua.script("command.fire = 8"));
+}
+
+TEST_CASE("tables/pool", "released tables are emptied and handed out again instead of new ones") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    sol::table_pool pool = lua.pooled_tables();
+    REQUIRE(pool.empty());
+
+    sol::table first = pool.acquire(4);
+    first[1] = 10;
+    first["name"] = "first";
+    lua["first"] = first;
+    pool.release(first);
+    REQUIRE(pool.size() == 1);
+    pool.release(first);
+    REQUIRE(pool.size() == 1);
+    REQUIRE_NOTHROW(lua.script("assert(next(first) == nil)"));
+
+    sol::table again = lua.create_table(sol::pooled, 0, 2, "x", 1, "y", 2);
+    REQUIRE(pool.empty());
+    lua["again"] = again;
+    REQUIRE_NOTHROW(lua.script("assert(again == first)"));
+    REQUIRE(again.get<int>("x") == 1);
+    REQUIRE_FALSE(again[1].valid());
+
+    lua.set("recycle", sol::c_closure(&sol::table_pool::lua_release));
+    lua.set_function("squares", [](int n) {
+        std::vector<int> v;
+        for (int i = 1; i <= n; ++i) {
+            v.push_back(i * i);
+        }
+        return sol::pooled_return(std::move(v));
+    });
+    REQUIRE_NOTHROW(lua.script("local seen = nil\n"
+        "for i = 1, 10 do\n"
+        "    local t = squares(3)\n"
+        "    assert(#t == 3 and t[3] == 9)\n"
+        "    if seen ~= nil then assert(t == seen) end\n"
+        "    seen = t\n"
+        "    recycle(t)\n"
+        "end\n"
+    ));
+    REQUIRE(pool.size() == 1);
+
+    {
+        sol::pooled_table args(lua.lua_state(), 0, 1);
+        args["value"] = 3;
+        REQUIRE(args.get<int>("value") == 3);
+        REQUIRE(pool.empty());
+    }
+    REQUIRE(pool.size() == 1);
+
+    pool.set_capacity(0);
+    REQUIRE(pool.empty());
+    pool.release(pool.acquire());
+    REQUIRE(pool.empty());
+}
+
+TEST_CASE("tables/raw", "raw_get and raw_set skip __index and __newindex") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.script("writes = 0\n"
+        "t = setmetatable({ 10, x = 1, inner = { 20 } }, {\n"
+        "    __index = function() return 'fallback' end,\n"
+        "    __newindex = function(t, k, v) writes = writes + 1 end\n"
+        "})");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+    sol::table t = lua["t"];
+
+    REQUIRE(t.get<std::string>("missing") == "fallback");
+    REQUIRE(t.raw_get<sol::object>("missing").get_type() == sol::type::nil);
+    REQUIRE(t.raw_get<sol::object>(2).get_type() == sol::type::nil);
+    int one, ten;
+    std::tie(one, ten) = t.raw_get<int, int>("x", 1);
+    REQUIRE(one == 1);
+    REQUIRE(ten == 10);
+
+    t.raw_set("y", 2, 2, 11);
+    REQUIRE(lua.get<int>("writes") == 0);
+    REQUIRE(t.raw_get<int>("y") == 2);
+    REQUIRE(t.raw_get<int>(2) == 11);
+    t.set("z", 3);
+    REQUIRE(lua.get<int>("writes") == 1);
+
+    REQUIRE(t.raw_traverse_get<int>("inner", 1) == 20);
+    t.raw_traverse_set("inner", 2, 21);
+    REQUIRE(lua["t"]["inner"][2].raw_get<int>() == 21);
+    lua["t"]["w"].raw_set(5);
+    REQUIRE(lua.get<int>("writes") == 1);
+    REQUIRE(t.raw_get<int>("w") == 5);
+
+    sol::cached_proxy slot = t["v"].cache();
+    slot.raw_set(6);
+    REQUIRE(slot.raw_get<int>() == 6);
+    REQUIRE(lua.get<int>("writes") == 1);
+
+    // bool keys are their own keys, not 1 and 0
+    t.raw_set(true, 7);
+    REQUIRE(t.raw_get<int>(true) == 7);
+    REQUIRE(t.raw_get<int>(1) == 10);
+    REQUIRE(lua.globals().raw_get<int>("writes") == 1);
+    REQUIRE(lua_gettop(L) == top);
+}
+
 TEST_CASE("tables/for-each", "Testing the use of for_each to get values from a lua table") {
     sol::state lua;
     lua.open_libraries(sol::lib::base);
@@ -1095,6 +1985,61 @@ TEST_CASE("usertype/member-variables", "allow table-like accessors to behave as
                ));
 }
 
+TEST_CASE("usertype/member-variables-lookup", "member lookup on usertypes with variables works for long names, unknown names and non-string keys") {
+    struct long_names {
+        int a_member_variable_with_a_very_long_name_that_is_not_interned = 24;
+        int x = 1;
+        int get() const { return x; }
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<long_names>("long_names",
+        "a_member_variable_with_a_very_long_name_that_is_not_interned", &long_names::a_member_variable_with_a_very_long_name_that_is_not_interned,
+        "x", &long_names::x,
+        "get", &long_names::get
+    );
+
+    REQUIRE_NOTHROW(lua.script("v = long_names.new()\n"
+        "local name = 'a_member_variable_with_a_very_long_name' .. '_that_is_not_interned'\n"
+        "assert(v[name] == 24)\n"
+        "v[name] = 25\n"
+        "assert(v.a_member_variable_with_a_very_long_name_that_is_not_interned == 25)\n"
+        "v.x = 3\n"
+        "assert(v:get() == 3)\n"
+        "assert(v.get == v.get)\n"
+        "assert(v.get == long_names.new().get)\n"
+        "assert(v.nope == nil)\n"
+        "assert(v[1] == nil)\n"
+    ));
+    REQUIRE_THROWS(lua.script("v.nope = 2"));
+}
+
+TEST_CASE("usertype/member-variables-through-pointers", "pointers and unique usertypes share the member lookup of their usertype") {
+    struct var_holder {
+        int x = 1;
+        int get() const { return x; }
+    };
+    var_holder held;
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<var_holder>("var_holder",
+        "x", &var_holder::x,
+        "get", &var_holder::get
+    );
+    lua.set("p", &held);
+    lua.set("u", std::make_unique<var_holder>());
+
+    REQUIRE_NOTHROW(lua.script("v = var_holder.new()\n"
+        "p.x = 5\n"
+        "u.x = 7\n"
+        "assert(p:get() == 5)\n"
+        "assert(u:get() == 7)\n"
+        "assert(p.get == v.get)\n"
+        "assert(u.get == v.get)\n"
+    ));
+    REQUIRE(held.x == 5);
+}
+
 TEST_CASE("usertype/nonmember-functions", "let users set non-member functions that take unqualified T as first parameter to usertype") {
     sol::state lua;
     lua.open_libraries( sol::lib::base );
@@ -1249,6 +2194,560 @@ TEST_CASE("functions/overloading", "Check if overloading works properly for regu
     REQUIRE_THROWS(lua.script("func(1,2,'meow')"));
 }
 
+namespace {
+struct ov_vec2 {
+    double x = 1, y = 2;
+};
+
+struct ov_vec3 {
+    double x = 1, y = 2, z = 3;
+};
+
+double ov_sum(const ov_vec2& v, double k) {
+    return (v.x + v.y) * k;
+}
+
+double ov_sum3(const ov_vec3& v, double k) {
+    return (v.x + v.y + v.z) * k;
+}
+
+double ov_sum_numbers(double a, double b) {
+    return a + b;
+}
+
+std::string ov_sum_strings(std::string a, double) {
+    return a;
+}
+}
+
+TEST_CASE("functions/overload-cache", "Overloads picked for one argument signature are not reused for another") {
+    // with SOL_OVERLOAD_CACHE, the last signature is remembered: every change of types below has to miss
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<ov_vec2>("vec2");
+    lua.new_usertype<ov_vec3>("vec3");
+    lua.set_function("sum", sol::overload(ov_sum, ov_sum3, ov_sum_numbers, ov_sum_strings));
+    ov_vec2 a;
+    ov_vec3 b;
+    lua["a"] = &a;
+    lua["b"] = &b;
+
+    REQUIRE_NOTHROW(lua.script("local total = 0\n"
+        "for i = 1, 10 do\n"
+        "    total = total + sum(a, 1) + sum(b, 1) + sum(1, 2)\n"
+        "    assert(sum('s', 1) == 's')\n"
+        "end\n"
+        "assert(total == 120)\n"
+        "assert(sum(a, 2) == 6 and sum(a, 2) == 6 and sum(b, 2) == 12)"));
+    REQUIRE_THROWS(lua.script("sum(a, 'x')"));
+    REQUIRE_THROWS(lua.script("sum({}, 1)"));
+    REQUIRE_NOTHROW(lua.script("assert(sum(b, 1) == 6)"));
+}
+
+struct emplaced_matrix {
+    static int moves;
+    static int copies;
+    std::array<double, 16> cells;
+    emplaced_matrix(double fill) {
+        cells.fill(fill);
+    }
+    emplaced_matrix(const emplaced_matrix& o) : cells(o.cells) {
+        ++copies;
+    }
+    emplaced_matrix(emplaced_matrix&& o) : cells(o.cells) {
+        ++moves;
+    }
+    double at(int i) const {
+        return cells[i];
+    }
+};
+int emplaced_matrix::moves = 0;
+int emplaced_matrix::copies = 0;
+
+TEST_CASE("usertype/emplace-return", "Usertypes returned through emplace_return are constructed inside the userdata") {
+    sol::state lua;
+    lua.new_usertype<emplaced_matrix>("matrix", "at", &emplaced_matrix::at);
+    lua.set_function("filled", [](double fill) {
+        return sol::emplace_return<emplaced_matrix>(fill);
+    });
+    lua.script("m = filled(2.5) x = m:at(3)");
+    REQUIRE(lua.get<double>("x") == 2.5);
+    REQUIRE(emplaced_matrix::moves == 0);
+    REQUIRE(emplaced_matrix::copies == 0);
+}
+
+TEST_CASE("usertype/multiple-states", "One usertype can be pushed into several states, which share its functions") {
+    sol::usertype<vars> varstype("boop", &vars::boop);
+    {
+        sol::state first;
+        first.set_usertype("vars", varstype);
+        {
+            sol::state second;
+            second.set_usertype("vars", varstype);
+            second.script("v = vars.new() v.boop = 2 x = v.boop");
+            REQUIRE(second.get<int>("x") == 2);
+        }
+        // closing the second state leaves the functions alone for the first
+        first.script("v = vars.new() v.boop = 5 x = v.boop");
+        REQUIRE(first.get<int>("x") == 5);
+    }
+    sol::state third;
+    third.set_usertype("vars", varstype);
+    third.script("v = vars.new() v.boop = 7 x = v.boop");
+    REQUIRE(third.get<int>("x") == 7);
+}
+
+struct alignas(32) overaligned_vec {
+    float v[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    float sum() const {
+        float total = 0;
+        for (float f : v) {
+            total += f;
+        }
+        return total;
+    }
+};
+
+struct packed_vec3 {
+    float x = 0, y = 0, z = 0;
+
+    float length2() const {
+        return x * x + y * y + z * z;
+    }
+};
+
+namespace sol {
+template <>
+struct is_value_only_usertype<packed_vec3> : std::true_type {};
+}
+
+TEST_CASE("usertype/layouts", "over-aligned usertypes are placed on their alignment and value-only usertypes carry no pointer") {
+    static_assert(sol::detail::usertype_storage<packed_vec3>::size == sizeof(packed_vec3), "value-only blocks are just the object");
+    static_assert(sol::detail::usertype_storage<vars>::size == sizeof(vars*) + sizeof(vars), "the default layout is unchanged");
+
+    sol::state lua;
+    lua.new_usertype<overaligned_vec>("overaligned_vec", "sum", &overaligned_vec::sum);
+    lua.new_usertype<packed_vec3>("vec3", "x", &packed_vec3::x, "y", &packed_vec3::y, "z", &packed_vec3::z, "length2", &packed_vec3::length2);
+    lua.script("a = overaligned_vec.new() s = a:sum() v = vec3.new() v.x = 1 v.y = 2 v.z = 2 l = v:length2()");
+    overaligned_vec* a = lua.get<overaligned_vec*>("a");
+    REQUIRE(reinterpret_cast<std::uintptr_t>(a) % alignof(overaligned_vec) == 0);
+    REQUIRE(lua.get<float>("s") == 36.0f);
+    REQUIRE(lua.get<float>("l") == 9.0f);
+
+    overaligned_vec pushedaligned;
+    lua["b"] = pushedaligned;
+    REQUIRE(reinterpret_cast<std::uintptr_t>(lua.get<overaligned_vec*>("b")) % alignof(overaligned_vec) == 0);
+
+    packed_vec3 original;
+    original.x = 3;
+    original.y = 4;
+    lua["p"] = original;
+    lua["r"] = &original;
+    lua.script("pl = p:length2() rl = r:length2() p.x = 0");
+    REQUIRE(lua.get<float>("pl") == 25.0f);
+    REQUIRE(lua.get<float>("rl") == 25.0f);
+    REQUIRE(lua.get<packed_vec3*>("r") == &original);
+    packed_vec3& copy = lua.get<packed_vec3&>("p");
+    REQUIRE(&copy != &original);
+    REQUIRE(copy.x == 0.0f);
+    REQUIRE(copy.y == 4.0f);
+    REQUIRE(original.x == 3.0f);
+
+    lua.script("q = p");
+    sol::object q = lua["q"];
+    q.push();
+    REQUIRE(lua_rawlen(lua.lua_state(), -1) == sizeof(packed_vec3));
+    lua_pop(lua.lua_state(), 1);
+}
+
+TEST_CASE("usertype/trivial-no-gc", "trivially destructible usertypes get no __gc unless one is asked for") {
+    struct named {
+        std::string name;
+    };
+    struct forced {
+        int value = 0;
+    };
+    struct built {
+        int value = 0;
+    };
+    sol::state lua;
+    lua.new_usertype<packed_vec3>("vec3", "x", &packed_vec3::x);
+    lua.new_usertype<named>("named", "name", &named::name);
+    lua.new_usertype<forced>("forced", "__gc", sol::default_destructor, "value", &forced::value);
+    lua.new_usertype<built>("built", sol::constructors<sol::types<>>(), "value", &built::value);
+    lua.new_usertype<vars>("vars", sol::constructors<sol::types<>>(), "boop", &vars::boop);
+    auto has_gc = [&lua](const char* name) {
+        lua.script(std::string("local v = ") + name + ".new() sol_test_mt = debug.getmetatable(v)");
+        sol::table mt = lua["sol_test_mt"];
+        return mt.get<sol::object>("__gc").get_type() != sol::type::nil;
+    };
+    lua.open_libraries(sol::lib::debug);
+    REQUIRE_FALSE(has_gc("vec3"));
+    REQUIRE_FALSE(has_gc("built"));
+    REQUIRE(has_gc("vars"));
+    REQUIRE(has_gc("named"));
+    REQUIRE(has_gc("forced"));
+}
+
+struct cached_entity {
+    int hp = 10;
+};
+
+struct cached_world {
+    cached_entity player;
+
+    cached_entity* get_player() {
+        return &player;
+    }
+};
+
+namespace sol {
+template <>
+struct is_identity_cached<cached_entity> : std::true_type {};
+}
+
+TEST_CASE("usertype/identity-cache", "pointers of identity-cached types are pushed as one userdata per address") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<cached_entity>("entity", "hp", &cached_entity::hp);
+    lua.new_usertype<cached_world>("world", "player", &cached_world::get_player);
+    cached_world w;
+    lua["w"] = &w;
+    lua.set("ref", std::ref(w.player));
+
+    REQUIRE_NOTHROW(lua.script("local a, b = w:player(), w:player()\n"
+        "assert(rawequal(a, b) and rawequal(a, ref))\n"
+        "assert(a.hp == 10)\n"
+        "seen = { [a] = true }"));
+    lua["again"] = &w.player;
+    REQUIRE_NOTHROW(lua.script("assert(seen[again])"));
+
+    sol::stack::invalidate_identity(lua.lua_state(), &w.player);
+    lua["fresh"] = &w.player;
+    REQUIRE_NOTHROW(lua.script("assert(not rawequal(fresh, ref) and fresh.hp == ref.hp)"));
+
+    // types that are not cached still get a new userdata every time
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+    sol::stack::push(L, &w);
+    sol::stack::push(L, &w);
+    REQUIRE(lua_rawequal(L, -1, -2) == 0);
+    lua_settop(L, top);
+}
+
+struct deferred_resource {
+    static int destroyed;
+    bool owner = true;
+
+    deferred_resource() = default;
+    deferred_resource(deferred_resource&& o) : owner(o.owner) {
+        o.owner = false;
+    }
+    ~deferred_resource() {
+        if (owner) {
+            ++destroyed;
+        }
+    }
+};
+
+int deferred_resource::destroyed = 0;
+
+namespace sol {
+template <>
+struct is_destruction_deferred<deferred_resource> : std::true_type {};
+}
+
+struct ffi_particle {
+    float x;
+    std::int32_t id;
+    double y;
+    std::uint8_t alive;
+};
+
+double ffi_particle_sum(ffi_particle* p) {
+    return p->x + p->y;
+}
+
+namespace sol {
+template <>
+struct ffi_layout<ffi_particle> {
+    static auto fields() {
+        return sol::fields("y", &ffi_particle::y, "x", &ffi_particle::x, "alive", &ffi_particle::alive);
+    }
+};
+}
+
+TEST_CASE("usertype/ffi", "standard-layout types are described to the FFI field by field, with explicit padding") {
+    std::string decl = sol::ffi_declaration<ffi_particle>();
+    REQUIRE(decl.find("typedef struct { float x; ") == 0);
+    REQUIRE(decl.find("uint8_t sol_pad0[4]; double y; uint8_t alive; ") != std::string::npos);
+    REQUIRE(decl.find("id") == std::string::npos);
+    REQUIRE(decl.find("} sol_") != std::string::npos);
+    REQUIRE(sol::ffi_detail::signature(&ffi_particle_sum) == "double(*)(" + sol::ffi_detail::c_type<ffi_particle>::name() + "*)");
+
+#ifdef SOL_LUAJIT
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package);
+    lua.new_usertype<ffi_particle>("particle");
+    ffi_particle p{ 1.5f, 7, 2.5, 1 };
+    lua["before"] = &p;
+    sol::ffi_declare<ffi_particle>(lua.lua_state(), "sum", &ffi_particle_sum);
+    sol::ffi_declare<ffi_particle>(lua.lua_state());
+    lua["p"] = &p;
+    REQUIRE_NOTHROW(lua.script("assert(type(before) == 'userdata' and type(p) == 'cdata')\n"
+        "for i = 1, 100 do p.y = p.y + 1 end\n"
+        "assert(p.x == 1.5 and p:sum() == 104)"));
+    REQUIRE(p.y == 102.5);
+#endif // SOL_LUAJIT
+}
+
+TEST_CASE("usertype/deferred-destruction", "finalizers of deferred types queue the object until the queue is drained") {
+    deferred_resource::destroyed = 0;
+    {
+        sol::state lua;
+        lua.open_libraries(sol::lib::base);
+        lua.new_usertype<deferred_resource>("resource");
+        lua.script("for i = 1, 10 do local r = resource.new() end");
+        lua["held"] = std::make_shared<deferred_resource>();
+        lua["held"] = sol::nil;
+        lua.collect_garbage();
+        REQUIRE(deferred_resource::destroyed == 0);
+        REQUIRE(lua.pending_finalizers() == 11);
+
+        REQUIRE(lua.drain_finalizers(std::chrono::nanoseconds(0)) == 1);
+        REQUIRE(deferred_resource::destroyed == 1);
+        REQUIRE(lua.drain_finalizers() == 10);
+        REQUIRE(deferred_resource::destroyed == 11);
+        REQUIRE(lua.drain_finalizers() == 0);
+
+        lua.script("left = resource.new() left = nil");
+        lua.collect_garbage();
+        REQUIRE(lua.finalizers().size() == 1);
+    }
+    // whatever is still queued goes when the state is closed
+    REQUIRE(deferred_resource::destroyed == 12);
+}
+
+TEST_CASE("usertype/traits-names", "usertype names are built on first use and stay put") {
+    const std::string& name = sol::usertype_traits<vars>::name();
+    REQUIRE(&name == &sol::usertype_traits<vars>::name());
+    REQUIRE(name.find("vars") != std::string::npos);
+    REQUIRE(sol::usertype_traits<vars>::metatable() == "sol." + name);
+    REQUIRE(sol::usertype_traits<vars>::metatable() != sol::usertype_traits<fuser>::metatable());
+}
+
+TEST_CASE("usertype/binding-stats", "calls to usertype bindings are counted per member when SOL_BINDING_STATS is defined") {
+    struct counted {
+        int value = 0;
+        int bump() {
+            return ++value;
+        }
+        void fail() {
+            throw sol::error("counted failure");
+        }
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<counted>("counted", "bump", &counted::bump, "fail", &counted::fail, "value", &counted::value);
+    lua.enable_binding_stats();
+    lua.script("c = counted.new() for i = 1, 10 do c:bump() end v = c.value ok = pcall(function() c:fail() end)");
+    REQUIRE(lua.get<int>("v") == 10);
+    REQUIRE_FALSE(lua.get<bool>("ok"));
+    std::vector<sol::binding_stat> stats = lua.binding_stats();
+#ifdef SOL_BINDING_STATS
+    auto find = [&stats](const std::string& member) {
+        return std::find_if(stats.begin(), stats.end(), [&member](const sol::binding_stat& s) {
+            return s.name.size() > member.size() && s.name.compare(s.name.size() - member.size(), member.size(), member) == 0;
+        });
+    };
+    auto bump = find(".bump");
+    REQUIRE(bump != stats.end());
+    REQUIRE(bump->calls == 10);
+    REQUIRE(bump->errors == 0);
+    REQUIRE(bump->p50 <= bump->p99);
+    REQUIRE(bump->p99 <= bump->max);
+    REQUIRE(bump->max <= bump->total);
+    auto value = find(".value");
+    REQUIRE(value != stats.end());
+    REQUIRE(value->calls == 1);
+    auto fail = find(".fail");
+    REQUIRE(fail != stats.end());
+    REQUIRE(fail->calls == 1);
+    REQUIRE(fail->errors == 1);
+
+    lua.reset_binding_stats();
+    REQUIRE(lua.binding_stats().empty());
+    lua.enable_binding_stats(false);
+    lua.script("c:bump()");
+    REQUIRE(lua.binding_stats().empty());
+#else
+    REQUIRE(stats.empty());
+#endif // SOL_BINDING_STATS
+}
+
+namespace {
+sol::reference reference_site_one(lua_State* L) {
+    return sol::reference(L, -1);
+}
+
+sol::reference reference_site_two(lua_State* L) {
+    return sol::reference(L, -1);
+}
+}
+
+TEST_CASE("state/reference-sites", "references made in different places are recorded as different sites") {
+    sol::state lua;
+    lua.script("t = {}");
+    lua_State* L = lua.lua_state();
+    std::size_t existing = lua.reference_sites().size();
+    lua_getglobal(L, "t");
+    std::vector<sol::reference> held;
+    for (int i = 0; i < 3; ++i) {
+        held.push_back(reference_site_one(L));
+    }
+    held.push_back(reference_site_two(L));
+    lua_pop(L, 1);
+#if defined(SOL_REFERENCE_STATS) && !defined(NDEBUG)
+    std::vector<sol::reference_site> sites = lua.reference_sites();
+    REQUIRE(sites.size() == existing + 2);
+    REQUIRE(sites.front().live == 3);
+#else
+    REQUIRE(existing == 0);
+    REQUIRE(lua.reference_sites().empty());
+#endif // SOL_REFERENCE_STATS in debug
+}
+
+TEST_CASE("state/reference-stats", "registry references are counted per state when SOL_REFERENCE_STATS is defined") {
+    sol::state lua;
+    lua.script("t = {} f = function() end");
+    sol::reference_stats before = lua.reference_statistics();
+    {
+        std::vector<sol::object> held;
+        for (int i = 0; i < 10; ++i) {
+            held.push_back(lua["t"]);
+        }
+        sol::function f = lua["f"];
+        sol::reference_stats during = lua.reference_statistics();
+#ifdef SOL_REFERENCE_STATS
+        REQUIRE(during.live == before.live + 11);
+        REQUIRE(during.created >= before.created + 11);
+        REQUIRE(during.created_per_second > 0);
+#ifndef NDEBUG
+        std::vector<sol::reference_site> sites = lua.reference_sites();
+        REQUIRE_FALSE(sites.empty());
+        REQUIRE(sites.front().live >= 10);
+#endif // Debug
+#else
+        REQUIRE(during.live == 0);
+        REQUIRE(during.created == 0);
+        REQUIRE(lua.reference_sites().empty());
+#endif // SOL_REFERENCE_STATS
+    }
+    sol::reference_stats after = lua.reference_statistics();
+    REQUIRE(after.live == before.live);
+    REQUIRE(after.destroyed - before.destroyed == after.created - before.created);
+}
+
+TEST_CASE("state/transfer", "values are deep copied between states and through the binary serializer, keeping shared and cyclic tables") {
+    sol::state from;
+    from.open_libraries(sol::lib::base);
+    from.script(R"(
+shared = { 1, 2, 3 }
+data = { name = "thing", ratio = 0.5, flag = true, list = shared, again = shared, [10] = "ten" }
+data.self = data
+)");
+    sol::table data = from["data"];
+
+    sol::state to;
+    to.open_libraries(sol::lib::base);
+    to["data"] = sol::transfer(data, to);
+    REQUIRE_NOTHROW(to.script(R"(
+assert(data.name == "thing")
+assert(data.ratio == 0.5)
+assert(data.flag == true)
+assert(data[10] == "ten")
+assert(#data.list == 3 and data.list[3] == 3)
+assert(data.list == data.again)
+assert(data.self == data)
+)"));
+
+    std::string bytes = sol::serialize(data);
+    to["copy"] = sol::deserialize(to, bytes);
+    REQUIRE_NOTHROW(to.script("assert(copy.self == copy) assert(copy.list == copy.again) assert(copy.name == 'thing')"));
+    REQUIRE_THROWS(sol::deserialize(to, bytes.substr(0, bytes.size() / 2)));
+
+    from.set_function("f", []() {});
+    sol::object f = from["f"];
+    REQUIRE_THROWS(sol::transfer(f, to));
+    REQUIRE(lua_gettop(from.lua_state()) == 0);
+    REQUIRE(lua_gettop(to.lua_state()) == 0);
+
+    // nesting is bounded, so neither deep tables nor crafted data can run out of C stack
+    from.script("deep = {} for i = 1, 100000 do deep = { deep } end");
+    sol::object deep = from["deep"];
+    REQUIRE_THROWS(sol::transfer(deep, to));
+    REQUIRE_THROWS(sol::serialize(deep));
+    std::string nested;
+    for (int i = 0; i < 100000; ++i) {
+        nested.push_back(static_cast<char>(6));
+        nested.push_back('\0');
+        nested.push_back('\0');
+    }
+    REQUIRE_THROWS(sol::deserialize(to, nested));
+    REQUIRE(lua_gettop(from.lua_state()) == 0);
+    REQUIRE(lua_gettop(to.lua_state()) == 0);
+
+    from.new_usertype<vars>("vars", "boop", &vars::boop);
+    to.new_usertype<vars>("vars", "boop", &vars::boop);
+    from.script("v = vars.new() v.boop = 11");
+    sol::transfer_hooks hooks;
+    hooks.add<vars>("vars", [](const vars& v, std::string& out) {
+        out = std::to_string(v.boop);
+    }, [](const char* data, std::size_t size) {
+        vars v;
+        v.boop = std::stoi(std::string(data, size));
+        return v;
+    });
+    sol::object v = from["v"];
+    to["v"] = sol::transfer(v, to, &hooks);
+    to["w"] = sol::deserialize(to, sol::serialize(v, &hooks), &hooks);
+    REQUIRE_NOTHROW(to.script("assert(v.boop == 11) assert(w.boop == 11)"));
+}
+
+TEST_CASE("usertype/constructor-call-syntax", "constructors take their arguments the same way whether called with . or :") {
+    struct ctor_point {
+        int x = 0;
+        int y = 0;
+        ctor_point() {}
+        ctor_point(int x, int y) : x(x), y(y) {}
+    };
+    struct init_point {
+        int sum = 0;
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<ctor_point>("ctor_point",
+        sol::constructors<sol::types<>, sol::types<int, int>>(),
+        "x", &ctor_point::x,
+        "y", &ctor_point::y
+    );
+    lua.new_usertype<init_point>("init_point",
+        "new", sol::initializers([](init_point& p, int a, int b) { new (&p) init_point(); p.sum = a + b; }),
+        "sum", &init_point::sum
+    );
+    REQUIRE_NOTHROW(lua.script("local a = ctor_point.new(1, 2)\n"
+        "local b = ctor_point:new(3, 4)\n"
+        "local c = ctor_point:new()\n"
+        "assert(a.x == 1 and a.y == 2)\n"
+        "assert(b.x == 3 and b.y == 4)\n"
+        "assert(c.x == 0 and c.y == 0)\n"
+        "assert(init_point.new(1, 2).sum == 3)\n"
+        "assert(init_point:new(3, 4).sum == 7)\n"
+    ));
+    REQUIRE_THROWS(lua.script("ctor_point.new(1)"));
+}
+
 TEST_CASE("usertype/private-constructible", "Check to make sure special snowflake types from Enterprise thingamahjongs work properly.") {
     int numsaved = factory_test::num_saved;
     int numkilled = factory_test::num_killed;
@@ -1314,3 +2813,457 @@ TEST_CASE("usertype/overloading", "Check if overloading works properly for usert
 
     REQUIRE_THROWS(lua.script("r:func(1,2,'meow')"));
 }
+
+TEST_CASE("usertype/inheritance", "derived usertypes are usable where their listed bases are expected, with pointers adjusted properly") {
+    struct base_a {
+        int a = 10;
+        virtual ~base_a() {}
+        int get_a() const { return a; }
+    };
+    struct base_b {
+        int b = 20;
+        virtual ~base_b() {}
+    };
+    struct derived : base_b, base_a {
+        int d = 30;
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    lua.new_usertype<derived>("derived",
+        "d", &derived::d,
+        sol::base_classes, sol::bases<base_b, base_a>()
+    );
+    lua.set_function("take_a", [](base_a& x) { return x.a; });
+    lua.set_function("take_b", [](base_b* x) { return x->b; });
+    lua.set_function("take_d", [](derived& x) { return x.d; });
+
+    REQUIRE_NOTHROW(lua.script("x = derived.new()\n"
+        "assert(take_a(x) == 10)\n"
+        "assert(take_b(x) == 20)\n"
+        "assert(take_d(x) == 30)\n"
+        "assert(take_a(x) == 10)\n"
+    ));
+    derived& x = lua["x"];
+    base_a& xa = lua["x"];
+    REQUIRE(&xa == static_cast<base_a*>(&x));
+    REQUIRE(xa.get_a() == 10);
+    REQUIRE_THROWS(lua.script("take_a(24)"));
+
+    // registering derived again elsewhere without its bases leaves this state's casts alone
+    sol::state other;
+    other.new_usertype<derived>("derived", "d", &derived::d);
+    other.set_function("take_a", [](base_a& x) { return x.a; });
+#ifdef SOL_CHECK_ARGUMENTS
+    REQUIRE_THROWS(other.script("take_a(derived.new())"));
+#endif // Checked arguments
+    REQUIRE_NOTHROW(lua.script("assert(take_a(derived.new()) == 10)"));
+}
+
+TEST_CASE("usertype/base-chaining", "members of registered bases are found through the derived usertype without being bound again") {
+    struct chain_root {
+        int r = 1;
+        virtual ~chain_root() {}
+        int root_value() const { return r * 100; }
+    };
+    struct chain_mid : chain_root {
+        int m = 2;
+        int mid_value() const { return m * 10; }
+    };
+    struct chain_leaf : chain_mid {
+        int l = 3;
+    };
+    struct chain_bare : chain_mid {};
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    lua.new_usertype<chain_root>("chain_root",
+        "r", &chain_root::r,
+        "root_value", &chain_root::root_value
+    );
+    lua.new_usertype<chain_mid>("chain_mid",
+        "m", &chain_mid::m,
+        "mid_value", &chain_mid::mid_value,
+        sol::base_classes, sol::bases<chain_root>()
+    );
+    lua.new_usertype<chain_leaf>("chain_leaf",
+        "l", &chain_leaf::l,
+        sol::base_classes, sol::bases<chain_mid, chain_root>()
+    );
+    lua.new_usertype<chain_bare>("chain_bare",
+        sol::base_classes, sol::bases<chain_mid, chain_root>()
+    );
+
+    REQUIRE_NOTHROW(lua.script("x = chain_leaf.new()\n"
+        "assert(x.l == 3)\n"
+        "assert(x.m == 2)\n"
+        "assert(x.r == 1)\n"
+        "assert(x:mid_value() == 20)\n"
+        "assert(x:root_value() == 100)\n"
+        "x.m = 5\n"
+        "x.r = 7\n"
+        "assert(x:mid_value() == 50)\n"
+        "assert(x:root_value() == 700)\n"
+        "assert(x.nothing == nil)\n"
+    ));
+    chain_leaf& x = lua["x"];
+    REQUIRE(x.m == 5);
+    REQUIRE(x.r == 7);
+
+    REQUIRE_NOTHROW(lua.script("y = chain_bare.new()\n"
+        "y.m = 4\n"
+        "assert(y:mid_value() == 40)\n"
+        "assert(y:root_value() == 100)\n"
+        "assert(y.nothing == nil)\n"
+    ));
+    REQUIRE_THROWS(lua.script("x.nothing = 1"));
+    REQUIRE_THROWS(lua.script("y.nothing = 1"));
+}
+
+TEST_CASE("usertype/base-chaining-fallbacks", "a usertype's own __index is asked before the __index of its bases") {
+    struct fallback_base {
+        int b = 1;
+        virtual ~fallback_base() {}
+    };
+    struct fallback_derived : fallback_base {
+        int d = 2;
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_usertype<fallback_base>("fallback_base",
+        "b", &fallback_base::b,
+        "__index", [](fallback_base&, std::string) { return "base"; }
+    );
+    lua.new_usertype<fallback_derived>("fallback_derived",
+        "d", &fallback_derived::d,
+        "__index", [](fallback_derived&, std::string key) { return key; },
+        sol::base_classes, sol::bases<fallback_base>()
+    );
+
+    REQUIRE_NOTHROW(lua.script("local x = fallback_base.new()\n"
+        "assert(x.b == 1 and x.anything == 'base')\n"
+        "local y = fallback_derived.new()\n"
+        "assert(y.d == 2 and y.anything == 'anything')"));
+}
+
+TEST_CASE("usertype/identity-checks", "checking usertypes works for values, pointers, unique holders and bases, and rejects other userdata") {
+    struct checked_base {
+        virtual ~checked_base() {}
+    };
+    struct checked : checked_base {
+        int x = 1;
+    };
+    struct unrelated {
+        int y = 2;
+    };
+    sol::state lua;
+    lua.new_usertype<checked>("checked", "x", &checked::x, sol::base_classes, sol::bases<checked_base>());
+    lua.new_usertype<unrelated>("unrelated", "y", &unrelated::y);
+    checked c;
+    lua.set("value", checked());
+    lua.set("pointer", &c);
+    lua.set("unique", std::make_unique<checked>());
+    lua.set("other", unrelated());
+    lua_State* L = lua.lua_state();
+
+    for (const char* name : { "value", "pointer", "unique" }) {
+        lua_getglobal(L, name);
+        REQUIRE(sol::stack::check<checked>(L, -1));
+        REQUIRE(sol::stack::check<checked_base>(L, -1));
+        REQUIRE_FALSE(sol::stack::check<unrelated>(L, -1));
+        lua_pop(L, 1);
+    }
+    lua_getglobal(L, "other");
+    REQUIRE(sol::stack::check<unrelated>(L, -1));
+    REQUIRE_FALSE(sol::stack::check<checked>(L, -1));
+    lua_pop(L, 1);
+}
+
+TEST_CASE("usertype/re-registered-pointers", "pointers and unique holders follow a usertype registered again") {
+    struct again {
+        int value = 1;
+        int get() const { return value; }
+        int twice() const { return value * 2; }
+    };
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    again a;
+    lua.new_usertype<again>("again", "get", &again::get);
+    lua.set("p", &a);
+    lua.set("u", std::make_unique<again>());
+    REQUIRE_NOTHROW(lua.script("assert(p:get() == 1 and u:get() == 1)"));
+
+    lua.new_usertype<again>("again", "twice", &again::twice);
+    lua.set("q", &a);
+    lua.set("w", std::make_unique<again>());
+    REQUIRE_NOTHROW(lua.script("assert(q:twice() == 2 and w:twice() == 2)"));
+#if SOL_LUA_VERSION > 502
+    lua_State* L = lua.lua_state();
+    lua_getglobal(L, "q");
+    lua_getmetatable(L, -1);
+    lua_getfield(L, -1, "__name");
+    REQUIRE(sol::stack::get<std::string>(L, -1) == sol::usertype_traits<again*>::metatable());
+    lua_pop(L, 3);
+#endif // __name is 5.3
+}
+
+TEST_CASE("usertype/inheritance-transitive", "bases declared through sol::base<T> are flattened, so ancestors-of-ancestors are reachable") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    lua.new_usertype<inheritance_leaf>("leaf",
+        "l", &inheritance_leaf::l
+    );
+    lua.set_function("take_root", [](inheritance_root& x) { return x.r; });
+    lua.set_function("take_mid", [](inheritance_mid& x) { return x.m; });
+
+    REQUIRE_NOTHROW(lua.script("x = leaf.new()\n"
+        "assert(take_root(x) == 5)\n"
+        "assert(take_mid(x) == 6)\n"
+        "assert(x.l == 7)\n"
+    ));
+    inheritance_leaf& x = lua["x"];
+    inheritance_root& xr = lua["x"];
+    REQUIRE(&xr == static_cast<inheritance_root*>(&x));
+}
+
+TEST_CASE("state/chunk-cache", "scripts run through a chunk_cache are compiled once and loaded from bytecode afterwards") {
+    sol::chunk_cache cache;
+    const std::string code = "x = (x or 0) + 1";
+    for (int i = 0; i < 3; ++i) {
+        sol::state lua;
+        lua.script(code, cache);
+        lua.script(code, cache);
+        REQUIRE(lua.get<int>("x") == 2);
+    }
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(cache.hits() == 5);
+
+    sol::state lua;
+    REQUIRE_THROWS(lua.script("this is not lua", cache));
+    REQUIRE(cache.size() == 1);
+    REQUIRE_THROWS(lua.script_file("no_such_file_for_the_chunk_cache.lua", cache));
+}
+
+TEST_CASE("state/compile-parallel", "sources are compiled to bytecode on worker threads and loaded into states afterwards") {
+    std::vector<std::pair<std::string, std::string>> sources = {
+        { "=first", "return 1" },
+        { "=broken", "return +" },
+        { "=third", "local x = ... return x * 3" },
+    };
+    std::vector<sol::compiled_chunk> chunks = sol::compile_parallel(sources, 2);
+    REQUIRE(chunks.size() == 3);
+    REQUIRE(chunks[0].valid());
+    REQUIRE_FALSE(chunks[1].valid());
+    REQUIRE(chunks[1].name == "=broken");
+    REQUIRE(chunks[2].valid());
+
+    sol::state lua;
+    sol::function first = lua.load(chunks[0]);
+    sol::function third = lua.load(chunks[2]);
+    int one = first();
+    int nine = third(3);
+    REQUIRE(one == 1);
+    REQUIRE(nine == 9);
+    REQUIRE_THROWS(lua.load(chunks[1]));
+}
+
+TEST_CASE("state/load-file", "files are mapped and compiled without running, with a shebang line skipped") {
+    const char* filename = "sol_load_file_test.lua";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << "#!/usr/bin/env lua\nloaded = (loaded or 0) + 1\nreturn ...\n";
+    }
+    sol::state lua;
+    sol::function chunk = lua.load_file(filename);
+    REQUIRE_FALSE(lua["loaded"].valid());
+    int passed = chunk(24);
+    REQUIRE(passed == 24);
+    REQUIRE(lua.get<int>("loaded") == 1);
+
+    sol::protected_function safe = lua.load_file<sol::protected_function>(filename);
+    sol::protected_function_result result = safe(1);
+    REQUIRE(result.valid());
+    lua.script_file(filename);
+    REQUIRE(lua.get<int>("loaded") == 3);
+    std::remove(filename);
+
+    REQUIRE_THROWS(lua.load_file(filename));
+    REQUIRE_THROWS(lua.script_file(filename));
+}
+
+TEST_CASE("state/modules", "changed modules are run again in place, keeping their tables and the data in them") {
+    auto write = [](const char* filename, const char* code) {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        file << code;
+    };
+    write("sol_module_util.lua", "return { count = 0, scale = function(x) return x * 2 end }\n");
+    write("sol_module_value.lua", "return function() return 1 end\n");
+    write("sol_module_main.lua", "local util = require 'sol_module_util'\n"
+        "local value = require 'sol_module_value'\n"
+        "return { run = function(x) util.count = util.count + 1 return util.scale(x) end, value = function() return value() end }\n");
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package);
+    sol::module_manager& modules = lua.modules();
+    REQUIRE_NOTHROW(lua.script("package.path = './?.lua'\n"
+        "main = require 'sol_module_main'\n"
+        "util = require 'sol_module_util'\n"
+        "assert(main.run(2) == 4)\n"
+        "assert(main.value() == 1)\n"
+    ));
+    REQUIRE(modules.tracks("sol_module_main"));
+    REQUIRE(modules.dependencies("sol_module_main") == std::vector<std::string>{ "sol_module_util", "sol_module_value" });
+    REQUIRE(modules.changed().empty());
+
+    write("sol_module_util.lua", "return { count = 0, scale = function(x) return x * 3 end }\n");
+    REQUIRE(modules.changed() == std::vector<std::string>{ "sol_module_util" });
+    sol::module_reload first = modules.reload();
+    REQUIRE(first.ok());
+    REQUIRE(first.reloaded == std::vector<std::string>{ "sol_module_util" });
+    REQUIRE_NOTHROW(lua.script("assert(util == require 'sol_module_util')\n"
+        "assert(util.count == 1)\n"
+        "assert(main.run(2) == 6)\n"
+    ));
+
+    // a new function cannot be patched into the old one, so what required it runs again as well
+    write("sol_module_value.lua", "return function() return 2 end\n");
+    sol::module_reload second = modules.reload();
+    REQUIRE(second.reloaded == std::vector<std::string>{ "sol_module_value", "sol_module_main" });
+    REQUIRE_NOTHROW(lua.script("assert(main.value() == 2)\n"
+        "assert(util.count == 2)\n"
+    ));
+
+    write("sol_module_util.lua", "return { scale = function(x) return x * 4 end\n");
+    sol::module_reload broken = modules.reload();
+    REQUIRE_FALSE(broken.ok());
+    REQUIRE(broken.reloaded.empty());
+    REQUIRE_NOTHROW(lua.script("assert(main.run(2) == 6)"));
+
+    std::remove("sol_module_util.lua");
+    std::remove("sol_module_value.lua");
+    std::remove("sol_module_main.lua");
+}
+
+TEST_CASE("state/gc", "garbage collection can be stepped within a time budget and its cycles are counted") {
+    sol::state lua;
+    sol::gc_stats before = lua.gc_statistics();
+    REQUIRE(before.cycles == 0);
+    REQUIRE(before.bytes == lua.memory_used());
+
+    lua.script("garbage = {} for i = 1, 1000 do garbage[i] = { i } end garbage = nil");
+    REQUIRE(lua.gc_statistics().bytes_since_cycle > 0);
+    lua.collect_garbage();
+    sol::gc_stats after = lua.gc_statistics();
+    REQUIRE(after.cycles >= 1);
+
+    lua.stop_gc();
+#if SOL_LUA_VERSION > 501
+    REQUIRE_FALSE(lua.is_gc_running());
+#endif // Lua 5.2+ only
+    lua.restart_gc();
+    int pause = lua.set_gc_pause(150);
+    REQUIRE(lua.set_gc_pause(pause) == 150);
+    lua.set_gc_mode(sol::gc_mode::incremental);
+
+    bool finished = false;
+    for (int i = 0; i < 10000 && !finished; ++i) {
+        finished = lua.collect_garbage_step(std::chrono::microseconds(100));
+    }
+    REQUIRE(finished);
+    REQUIRE(lua.gc_statistics().cycles > after.cycles);
+}
+
+TEST_CASE("state/prototype", "states made from a prototype get its libraries, registrations and precompiled scripts, and nothing else") {
+    sol::usertype<vars> varstype("boop", &vars::boop);
+    sol::state_prototype prototype;
+    prototype.open_libraries(sol::lib::base, sol::lib::string)
+        .setup([&varstype](sol::state_view& lua) { lua.set_usertype("vars", varstype); })
+        .script("counter = 0 function bump() counter = counter + 1 return counter end");
+    REQUIRE(prototype.size() == 3);
+    REQUIRE_THROWS(prototype.script("this is not lua"));
+    REQUIRE(prototype.size() == 3);
+
+    sol::state first = prototype.make();
+    sol::state second = prototype.make();
+    first.script("bump() bump() v = vars.new() v.boop = #string.rep('a', 3)");
+    second.script("bump()");
+    REQUIRE(first.get<int>("counter") == 2);
+    REQUIRE(second.get<int>("counter") == 1);
+    REQUIRE(first.traverse_get<int>("v", "boop") == 3);
+    REQUIRE_FALSE(second["v"].valid());
+}
+
+TEST_CASE("state/lazy-libraries", "libraries opened lazily are only built when first looked up") {
+    sol::state lua;
+    lua.open_libraries_lazy(sol::lib::base, sol::lib::math, sol::lib::string, sol::lib::table);
+    REQUIRE_NOTHROW(lua.script("assert(rawget(_G, 'math') == nil and rawget(_G, 'string') == nil)"));
+    REQUIRE_NOTHROW(lua.script("assert(math.floor(2.5) == 2) assert(rawget(_G, 'math') ~= nil)"));
+    REQUIRE_NOTHROW(lua.script("assert(rawget(_G, 'string') == nil) assert(('ab'):rep(2) == 'abab') assert(rawget(_G, 'string') ~= nil)"));
+    REQUIRE_NOTHROW(lua.script("assert(table.concat({ 'a', 'b' }) == 'ab')"));
+    REQUIRE_NOTHROW(lua.script("assert(os == nil) assert(undefined_global == nil)"));
+
+    sol::state everything;
+    everything.open_libraries_lazy();
+    REQUIRE_NOTHROW(everything.script("assert(rawget(_G, 'os') == nil) assert(type(os.time()) == 'number')"));
+}
+
+TEST_CASE("state/allocators", "states can be created with custom allocators, which outlive the lua_State") {
+    sol::pool_allocator pool;
+    {
+        sol::state lua(std::ref(pool));
+        lua.open_libraries(sol::lib::base);
+        REQUIRE_NOTHROW(lua.script("t = {}\n"
+            "for i = 1, 1000 do t[i] = tostring(i) .. 'x' end\n"
+            "t = nil\n"
+            "collectgarbage()\n"
+            "u = { 'a', 'b', 'c' }\n"));
+        REQUIRE(pool.chunk_count() > 0);
+        std::string b = lua["u"][2];
+        REQUIRE(b == "b");
+    }
+
+    sol::state arena(sol::arena_allocator(4096));
+    arena.open_libraries(sol::lib::base, sol::lib::string);
+    REQUIRE_NOTHROW(arena.script("x = string.rep('a', 100000)\n"));
+    std::size_t len = arena["x"].get<std::string>().size();
+    REQUIRE(len == 100000);
+
+    std::size_t allocations = 0;
+    {
+        sol::state counted([&allocations](void* ptr, std::size_t osize, std::size_t nsize) {
+            if (nsize != 0 && ptr == nullptr) {
+                ++allocations;
+            }
+            return sol::default_allocator()(ptr, osize, nsize);
+        });
+        counted["value"] = 24;
+        int value = counted["value"];
+        REQUIRE(value == 24);
+    }
+    REQUIRE(allocations > 0);
+}
+
+TEST_CASE("state/tracking-allocator", "a tracking allocator counts a state's memory and refuses to grow past its limit") {
+    sol::pool_allocator pool;
+    sol::tracking_allocator<std::reference_wrapper<sol::pool_allocator>> tracker(0, std::ref(pool));
+    {
+        sol::state lua(std::ref(tracker));
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        const sol::allocation_stats& stats = tracker.stats();
+        REQUIRE(stats.current > 0);
+        REQUIRE(stats.allocations > 0);
+        REQUIRE(stats.peak >= stats.current);
+        REQUIRE(pool.chunk_count() > 0);
+
+        tracker.set_limit(stats.current + 64 * 1024);
+        REQUIRE_THROWS(lua.script("x = string.rep('a', 1024 * 1024)"));
+        REQUIRE(stats.failures > 0);
+        REQUIRE(stats.current <= tracker.limit());
+        tracker.set_limit(0);
+        REQUIRE_NOTHROW(lua.script("x = string.rep('a', 1024 * 1024)"));
+        REQUIRE(stats.histogram[sol::allocation_stats::size_classes - 1] > 0);
+    }
+    REQUIRE(tracker.stats().current == 0);
+    REQUIRE(tracker.stats().frees > 0);
+}